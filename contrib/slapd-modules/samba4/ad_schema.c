@@ -29,6 +29,7 @@
 #include "ldb.h"
 #include "samba_security.h"
 #include "ndr.h"
+#include "samba_utils.h"
 
 static ObjectClass *oc_attributeSchema;
 static ObjectClass *oc_classSchema;
@@ -109,6 +110,7 @@ static char	*caseignoreMRs[] = {
 
 static char	*intMRs[] = {
 	"integerMatch",
+	"integerOrderingMatch",
 	NULL
 };
 
@@ -551,7 +553,7 @@ static struct {
 	/*2.5.5.11 String(UTC-Time) */
 	{23, "SYNTAX 1.3.6.1.4.1.1466.115.121.1.53", "EQUALITY generalizedTimeMatch"},
 	/*2.5.5.11 String(Generalized-Time) */
-	{24, "SYNTAX 1.3.6.1.4.1.1466.115.121.1.24", "EQUALITY generalizedTimeMatch"},
+	{24, "SYNTAX 1.3.6.1.4.1.1466.115.121.1.24", "EQUALITY generalizedTimeMatch ORDERING generalizedTimeOrderingMatch"},
 	/*2.5.5.3 String(Case) */
 	{27, "SYNTAX 1.2.840.113556.1.4.1362", "EQUALITY caseExactMatch SUBSTR caseExactSubstringsMatch"},
 	/* 2.5.5.12 String(Unicode) */
@@ -973,6 +975,11 @@ static void ad_schema_load_extended_attribute(AttributeType *at,
 	}
 #endif
 	at->at_private = ads_at;
+
+	/* searches consult the confidential map rather than at_private */
+	if (ads_at->searchFlags & AD_FLAGS_CONFIDENTIAL) {
+		samba_confidential_set(at);
+	}
 }
 
 static void ad_schema_load_extended_class(ObjectClass *oc, Entry *e)
@@ -1920,6 +1927,7 @@ ad_schema_init( void )
 	ad_schema.on_bi.bi_op_add = ad_schema_add;
 	ad_schema.on_bi.bi_db_open = ad_schema_db_open;
 	ad_schema.on_bi.bi_op_search = ad_schema_op_search;
+	samba_confidential_init();
 	for ( i=0; ad_syntaxes[i].oid; i++ ) {	
 		code = register_syntax( &ad_syntaxes[ i ].syn );
 		if ( code != 0 ) {
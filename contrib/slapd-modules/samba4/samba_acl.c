@@ -27,6 +27,7 @@
 #include "config.h"
 
 #include "lutil.h"
+#include "lutil_hash.h"
 #include "ldap_rq.h"
 #include "flags.h"
 #include "ldb.h"
@@ -382,11 +383,203 @@ samba_acl_op_modrdn( Operation *op, SlapReply *rs )
 	
 }
 
-/* TODO this only checks access on base, we need to implement a callback
-to check return entry access */
+/* Confidential attributes are only returned to those holding control
+ * access on them.  The token is fixed for the whole search and entries
+ * mostly share an inherited security descriptor, so each distinct
+ * descriptor is unmarshalled once and each (class, attribute) pair is
+ * checked once against it; the results live until the search ends. */
+typedef struct acl_check_node {
+	struct ad_schema_class *cn_class;
+	AttributeDescription *cn_ad;
+	int cn_rc;
+} acl_check_node;
+
+typedef struct acl_sd_node {
+	uint32_t sn_hash;
+	struct berval sn_blob;
+	struct security_descriptor *sn_sd;
+	Avlnode *sn_checks;
+} acl_sd_node;
+
+typedef struct acl_search_info {
+	slap_overinst *si_on;
+	struct security_token *si_token;
+	struct dom_sid *si_sid;
+	TALLOC_CTX *si_ctx;
+	Avlnode *si_sds;
+} acl_search_info;
+
+static int
+acl_sd_node_cmp( const void *v1, const void *v2 )
+{
+	const acl_sd_node *s1 = v1, *s2 = v2;
+
+	if ( s1->sn_hash != s2->sn_hash )
+		return s1->sn_hash < s2->sn_hash ? -1 : 1;
+	if ( s1->sn_blob.bv_len != s2->sn_blob.bv_len )
+		return s1->sn_blob.bv_len < s2->sn_blob.bv_len ? -1 : 1;
+	return memcmp( s1->sn_blob.bv_val, s2->sn_blob.bv_val, s1->sn_blob.bv_len );
+}
+
+static int
+acl_check_node_cmp( const void *v1, const void *v2 )
+{
+	const acl_check_node *c1 = v1, *c2 = v2;
+
+	if ( c1->cn_class != c2->cn_class )
+		return c1->cn_class < c2->cn_class ? -1 : 1;
+	if ( c1->cn_ad != c2->cn_ad )
+		return c1->cn_ad < c2->cn_ad ? -1 : 1;
+	return 0;
+}
+
+static void
+acl_sd_node_free( void *v )
+{
+	acl_sd_node *sn = v;
+
+	avl_free( sn->sn_checks, NULL );
+}
+
+static acl_sd_node *
+acl_sd_node_get( acl_search_info *si, struct berval *blob )
+{
+	acl_sd_node key, *sn;
+	lutil_HASH_CTX ctx;
+	unsigned char digest[LUTIL_HASH_BYTES];
+
+	lutil_HASHInit( &ctx );
+	lutil_HASHUpdate( &ctx, (unsigned char *)blob->bv_val, blob->bv_len );
+	lutil_HASHFinal( digest, &ctx );
+
+	key.sn_hash = digest[0] | digest[1] << 8 | digest[2] << 16 |
+		(uint32_t)digest[3] << 24;
+	key.sn_blob = *blob;
+	sn = avl_find( si->si_sds, &key, acl_sd_node_cmp );
+	if ( sn != NULL ) {
+		return sn;
+	}
+
+	sn = talloc_zero( si->si_ctx, acl_sd_node );
+	sn->sn_hash = key.sn_hash;
+	sn->sn_blob.bv_len = blob->bv_len;
+	sn->sn_blob.bv_val = talloc_memdup( si->si_ctx, blob->bv_val, blob->bv_len );
+	unmarshall_sec_desc( si->si_ctx, blob->bv_val, blob->bv_len, &sn->sn_sd );
+	avl_insert( &si->si_sds, sn, acl_sd_node_cmp, avl_dup_error );
+	return sn;
+}
+
+static int
+acl_check_confidential( acl_search_info *si,
+			acl_sd_node *sn,
+			struct ad_schema_class *objectclass,
+			AttributeDescription *ad )
+{
+	acl_check_node key, *cn;
+	struct ad_schema_attribute *attr = ad->ad_type->at_private;
+
+	key.cn_class = objectclass;
+	key.cn_ad = ad;
+	cn = avl_find( sn->sn_checks, &key, acl_check_node_cmp );
+	if ( cn != NULL ) {
+		return cn->cn_rc;
+	}
+
+	cn = talloc_zero( si->si_ctx, acl_check_node );
+	cn->cn_class = objectclass;
+	cn->cn_ad = ad;
+	if ( sn->sn_sd == NULL || objectclass == NULL || attr == NULL ) {
+		cn->cn_rc = LDAP_INSUFFICIENT_ACCESS;
+	} else {
+		cn->cn_rc = acl_check_attribute_access( sn->sn_sd, si->si_sid,
+			SEC_ADS_READ_PROP | SEC_ADS_CONTROL_ACCESS,
+			attr, objectclass, si->si_token );
+	}
+	avl_insert( &sn->sn_checks, cn, acl_check_node_cmp, avl_dup_error );
+	return cn->cn_rc;
+}
+
+static int
+samba_acl_search_response( Operation *op, SlapReply *rs )
+{
+	acl_search_info *si = op->o_callback->sc_private;
+	Entry *e = rs->sr_entry;
+	Attribute *a, **ap, *sd_att;
+	struct ad_schema_class *objectclass;
+	acl_sd_node *sn, nosd = { 0 };
+	int denied = 0;
+
+	if ( rs->sr_type != REP_SEARCH || e == NULL || !samba_confidential_any() ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	for ( a = e->e_attrs; a != NULL; a = a->a_next ) {
+		if ( samba_is_confidential( a->a_desc ) )
+			break;
+	}
+	if ( a == NULL ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	objectclass = samba_entry_structural_class( e );
+
+	sd_att = attr_find( e->e_attrs, slap_schema.si_ad_nTSecurityDescriptor );
+	if ( sd_att != NULL && sd_att->a_vals != NULL ) {
+		sn = acl_sd_node_get( si, &sd_att->a_vals[0] );
+	} else {
+		/* no descriptor, nothing confidential is readable */
+		sn = &nosd;
+	}
+
+	for ( ; a != NULL; a = a->a_next ) {
+		if ( samba_is_confidential( a->a_desc ) &&
+		     acl_check_confidential( si, sn, objectclass, a->a_desc ) != LDAP_SUCCESS ) {
+			denied++;
+		}
+	}
+
+	if ( denied ) {
+		rs_entry2modifiable( op, rs, si->si_on );
+		for ( ap = &rs->sr_entry->e_attrs; *ap != NULL; ) {
+			a = *ap;
+			if ( samba_is_confidential( a->a_desc ) &&
+			     acl_check_confidential( si, sn, objectclass, a->a_desc ) != LDAP_SUCCESS ) {
+				*ap = a->a_next;
+				attr_free( a );
+			} else {
+				ap = &a->a_next;
+			}
+		}
+	}
+	avl_free( nosd.sn_checks, NULL );
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+samba_acl_search_cleanup( Operation *op, SlapReply *rs )
+{
+	slap_callback *sc = op->o_callback;
+	acl_search_info *si = sc->sc_private;
+
+	if ( rs->sr_type != REP_RESULT && rs->sr_err != SLAPD_ABANDON ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	avl_free( si->si_sds, acl_sd_node_free );
+	talloc_free( si->si_ctx );
+	op->o_tmpfree( sc, op->o_tmpmemctx );
+	op->o_callback = NULL;
+	return SLAP_CB_CONTINUE;
+}
+
+/* TODO this only checks list access on base, entries returned are
+only filtered for confidential attributes */
 static int
 samba_acl_op_search( Operation *op, SlapReply *rs )
 {
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	slap_callback *sc;
+	acl_search_info *si;
 	struct ad_schema_class *objectclass;
 	struct berval psd_bv;
 	struct security_descriptor *parent_sd = NULL;
@@ -426,7 +619,25 @@ samba_acl_op_search( Operation *op, SlapReply *rs )
 		talloc_free(mem_ctx);
 		return rc;
 	}
-	talloc_free(mem_ctx);
+
+	if (!samba_confidential_any()) {
+		talloc_free(mem_ctx);
+		return SLAP_CB_CONTINUE;
+	}
+
+	/* the search keeps mem_ctx, it holds the domain sid and the cache */
+	sc = op->o_tmpcalloc( 1, sizeof(slap_callback) + sizeof(acl_search_info),
+			      op->o_tmpmemctx );
+	si = (acl_search_info *)(sc + 1);
+	si->si_on = on;
+	si->si_token = token;
+	si->si_sid = sid;
+	si->si_ctx = mem_ctx;
+	sc->sc_response = samba_acl_search_response;
+	sc->sc_cleanup = samba_acl_search_cleanup;
+	sc->sc_private = si;
+	sc->sc_next = op->o_callback;
+	op->o_callback = sc;
 	return SLAP_CB_CONTINUE;
 }
 
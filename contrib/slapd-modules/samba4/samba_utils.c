@@ -468,18 +468,27 @@ samba_get_token_from_connection( Operation *op )
 /* TODO this is overly simplified, we must implement
  * object class sorting, and check objectClassCategory */
 struct ad_schema_class *
-samba_get_structural_class( Operation *op )
+samba_entry_structural_class( Entry *e )
 {
-	Attribute *at_objectClass = samba_find_attribute( op->ora_e->e_attrs, "objectClass" );
+	Attribute *at_objectClass = attr_find( e->e_attrs, slap_schema.si_ad_objectClass );
 	ObjectClass *oc;
-	struct ad_schema_class *objectclass = NULL;
 
-	assert( at_objectClass != 0 );
-	
-	oc = oc_find( at_objectClass->a_vals[at_objectClass->a_numvals-1].bv_val );
-	assert ( oc != NULL );
+	if ( at_objectClass == NULL ) {
+		return NULL;
+	}
+	oc = oc_bvfind( &at_objectClass->a_vals[at_objectClass->a_numvals-1] );
+	if ( oc == NULL ) {
+		return NULL;
+	}
+	return (struct ad_schema_class *)oc->oc_private;
+}
+
+struct ad_schema_class *
+samba_get_structural_class( Operation *op )
+{
+	struct ad_schema_class *objectclass = samba_entry_structural_class( op->ora_e );
 
-	objectclass = (struct ad_schema_class *)oc->oc_private;
+	assert( objectclass != NULL );
 	return objectclass;
 }
 
@@ -542,3 +551,90 @@ samba_get_new_parent_sd( Operation *op, SlapReply *rs, TALLOC_CTX *mem_ctx )
 }
 
 
+
+/* Confidential attributes (searchFlags & AD_FLAGS_CONFIDENTIAL), as a
+ * bitmap indexed by the ad_index of the attribute's bare description.
+ * ad_schema marks attributes as their attributeSchema entries are loaded,
+ * samba_acl consults the map for every search result. */
+static unsigned long *confidential_map = NULL;
+static unsigned confidential_words = 0;
+static int confidential_count = 0;
+static ldap_pvt_thread_rdwr_t confidential_rwlock;
+
+#define CONFIDENTIAL_BITS	( sizeof(unsigned long) * 8 )
+
+void
+samba_confidential_init( void )
+{
+	static int initialized = 0;
+
+	if ( !initialized ) {
+		ldap_pvt_thread_rdwr_init( &confidential_rwlock );
+		initialized = 1;
+	}
+}
+
+int
+samba_confidential_set( AttributeType *at )
+{
+	AttributeDescription *ad = NULL;
+	const char *text = NULL;
+	unsigned word;
+	int rc;
+
+	rc = slap_bv2ad( &at->sat_cname, &ad, &text );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY,
+		       "samba_confidential_set: no description for %s: %s\n",
+		       at->sat_cname.bv_val, text, 0 );
+		return rc;
+	}
+
+	word = ad->ad_index / CONFIDENTIAL_BITS;
+	ldap_pvt_thread_rdwr_wlock( &confidential_rwlock );
+	if ( word >= confidential_words ) {
+		unsigned n = word + 1 + confidential_words;
+
+		confidential_map = ch_realloc( confidential_map,
+					       n * sizeof(unsigned long) );
+		memset( confidential_map + confidential_words, 0,
+			( n - confidential_words ) * sizeof(unsigned long) );
+		confidential_words = n;
+	}
+	if ( !( confidential_map[word] & ( 1UL << ( ad->ad_index % CONFIDENTIAL_BITS ) ) ) ) {
+		confidential_map[word] |= 1UL << ( ad->ad_index % CONFIDENTIAL_BITS );
+		confidential_count++;
+	}
+	ldap_pvt_thread_rdwr_wunlock( &confidential_rwlock );
+	return LDAP_SUCCESS;
+}
+
+/* Returns the number of attributes in the map, so callers can skip
+ * the per-entry work entirely while nothing is confidential */
+int
+samba_confidential_any( void )
+{
+	return confidential_count;
+}
+
+bool
+samba_is_confidential( AttributeDescription *ad )
+{
+	unsigned idx;
+	bool rc = false;
+
+	/* options share the bare description's flags, and the bare
+	 * description is always kept at the head of the type's list */
+	if ( ad->ad_type->sat_ad != NULL ) {
+		ad = ad->ad_type->sat_ad;
+	}
+	idx = ad->ad_index;
+
+	ldap_pvt_thread_rdwr_rlock( &confidential_rwlock );
+	if ( idx / CONFIDENTIAL_BITS < confidential_words ) {
+		rc = ( confidential_map[idx / CONFIDENTIAL_BITS] &
+		       ( 1UL << ( idx % CONFIDENTIAL_BITS ) ) ) != 0;
+	}
+	ldap_pvt_thread_rdwr_runlock( &confidential_rwlock );
+	return rc;
+}
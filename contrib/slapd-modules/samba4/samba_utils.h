@@ -101,6 +101,9 @@ samba_get_domain_sid( Operation *op, SlapReply *rs, TALLOC_CTX *talloc_mem_ctx )
 struct security_token *
 samba_get_token_from_connection( Operation *op );
 
+struct ad_schema_class *
+samba_entry_structural_class( Entry *e );
+
 struct ad_schema_class *
 samba_get_structural_class( Operation *op );
 
@@ -109,6 +112,18 @@ samba_get_object_sd( Operation *op, SlapReply *rs, TALLOC_CTX *mem_ctx );
 struct security_descriptor *
 samba_get_new_parent_sd( Operation *op, SlapReply *rs, TALLOC_CTX *mem_ctx );
 
+void
+samba_confidential_init( void );
+
+int
+samba_confidential_set( AttributeType *at );
+
+int
+samba_confidential_any( void );
+
+bool
+samba_is_confidential( AttributeDescription *ad );
+
 /* opprep o_extra - will likely be unnecessary */
 typedef struct opprep_info_add {
 	struct berval parent_sd;
@@ -0,0 +1,688 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2018 The OpenLDAP Foundation.
+ * Portions Copyright 2018 Symas Corporation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the
+ * GNU General Public License version 3, as published by the
+ * the Free Software Foundation;
+ *
+ * A copy of this license is available at
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/* Constructed tokenGroups attribute: the objectSid of every group an
+ * entry is a transitive member of, including its primary group.
+ *
+ * The membership graph is cached in memory. Each cached node holds the
+ * objectSid of an entry and the DNs of the groups that list it in
+ * member (plus its primary group), so walking the graph after the first
+ * lookup needs no searches. Closures are memoized per node and stamped
+ * with a generation that is bumped on every membership change; the
+ * nodes whose direct groups changed are dropped and reloaded on demand.
+ *
+ * Nodes are read with the searching operation's read txn, which may
+ * predate a change that has already been invalidated. So each search
+ * notes the generation when it starts, and what it reads is only
+ * cached if no change was seen since. The mutex only guards the cache;
+ * it is not held across the internal searches. */
+
+#include "portable.h"
+
+#ifdef SLAPD_OVER_TOKENGROUPS
+
+#include <stdio.h>
+
+#include "ac/string.h"
+#include "ac/socket.h"
+
+#include "slap.h"
+#include "config.h"
+
+#include "lutil.h"
+#include "avl.h"
+
+#define	TOKENGROUPS_CACHESIZE	10000
+
+typedef struct tg_node {
+	struct berval	tn_ndn;
+	struct berval	tn_sid;		/* objectSid, empty if none */
+	BerVarray	tn_parents;	/* ndn of each direct group */
+	BerVarray	tn_closure;	/* objectSid of each transitive group */
+	unsigned long	tn_gen;		/* tn_closure is valid if == ti_gen */
+} tg_node;
+
+typedef struct tg_info {
+	ldap_pvt_thread_mutex_t	ti_mutex;
+	Avlnode		*ti_nodes;
+	int		ti_numnodes;
+	int		ti_max;
+	unsigned long	ti_gen;
+} tg_info;
+
+static slap_overinst	tokengroups;
+
+static AttributeDescription	*ad_tokenGroups, *ad_member,
+	*ad_objectSid, *ad_primaryGroupID;
+
+static ConfigTable tgcfg[] = {
+	{ "tokengroups-cachesize", "entries", 2, 2, 0,
+	  ARG_INT|ARG_OFFSET,
+	  (void *)offsetof(tg_info, ti_max),
+	  "( OLcfgCtAt:8.1 "
+	  "NAME 'olcTokenGroupsCacheSize' "
+	  "DESC 'Maximum number of entries in the group membership cache' "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
+};
+
+static ConfigOCs tgocs[] = {
+	{ "( OLcfgCtOc:8.1 "
+	  "NAME 'olcTokenGroupsConfig' "
+	  "DESC 'tokenGroups overlay configuration' "
+	  "SUP olcOverlayConfig "
+	  "MAY olcTokenGroupsCacheSize )",
+	  Cft_Overlay, tgcfg, NULL, NULL },
+	{ NULL, 0, NULL }
+};
+
+/* the AD schema is loaded from the database, possibly after we start */
+static int
+tg_schema( void )
+{
+	const char *text;
+
+	if ( ad_tokenGroups )
+		return 0;
+
+	if ( slap_str2ad( "member", &ad_member, &text ) ||
+		slap_str2ad( "objectSid", &ad_objectSid, &text ) ||
+		slap_str2ad( "primaryGroupID", &ad_primaryGroupID, &text ) ||
+		slap_str2ad( "tokenGroups", &ad_tokenGroups, &text ))
+	{
+		ad_tokenGroups = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static int
+tg_node_cmp( const void *v1, const void *v2 )
+{
+	const tg_node *n1 = v1, *n2 = v2;
+	int rc;
+
+	rc = n1->tn_ndn.bv_len - n2->tn_ndn.bv_len;
+	if ( rc == 0 )
+		rc = memcmp( n1->tn_ndn.bv_val, n2->tn_ndn.bv_val, n1->tn_ndn.bv_len );
+	return rc;
+}
+
+static void
+tg_node_free( void *v )
+{
+	tg_node *tn = v;
+
+	ber_bvarray_free( tn->tn_closure );
+	ber_bvarray_free( tn->tn_parents );
+	ch_free( tn->tn_sid.bv_val );
+	ch_free( tn );
+}
+
+static void
+tg_flush( tg_info *ti )
+{
+	avl_free( ti->ti_nodes, tg_node_free );
+	ti->ti_nodes = NULL;
+	ti->ti_numnodes = 0;
+}
+
+static void
+tg_drop( tg_info *ti, struct berval *ndn )
+{
+	tg_node key, *tn;
+
+	key.tn_ndn = *ndn;
+	tn = avl_delete( &ti->ti_nodes, &key, tg_node_cmp );
+	if ( tn ) {
+		tg_node_free( tn );
+		ti->ti_numnodes--;
+	}
+}
+
+typedef struct tg_drop_s {
+	struct berval *group;
+	BerVarray stale;
+} tg_drop_s;
+
+static int
+tg_find_members( void *v, void *arg )
+{
+	tg_node *tn = v;
+	tg_drop_s *td = arg;
+	int i;
+
+	if ( tn->tn_parents ) {
+		for ( i = 0; !BER_BVISNULL( &tn->tn_parents[i] ); i++ ) {
+			if ( dn_match( &tn->tn_parents[i], td->group )) {
+				ber_bvarray_add( &td->stale, &tn->tn_ndn );
+				break;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Drop every cached node that lists group as a direct parent */
+static void
+tg_drop_members( tg_info *ti, struct berval *group )
+{
+	tg_drop_s td;
+	int i;
+
+	td.group = group;
+	td.stale = NULL;
+	avl_apply( ti->ti_nodes, tg_find_members, &td, -1, AVL_INORDER );
+	if ( td.stale ) {
+		/* the array only borrows each node's own ndn */
+		for ( i = 0; !BER_BVISNULL( &td.stale[i] ); i++ )
+			tg_drop( ti, &td.stale[i] );
+		ch_free( td.stale );
+	}
+}
+
+typedef struct tg_search_s {
+	int		attrs;		/* also pick up objectSid and primaryGroupID */
+	struct berval	sid;
+	struct berval	pgid;
+	BerVarray	dns;
+} tg_search_s;
+
+static int
+tg_search_cb( Operation *op, SlapReply *rs )
+{
+	tg_search_s *ts = op->o_callback->sc_private;
+	Attribute *a;
+	struct berval bv;
+
+	if ( rs->sr_type != REP_SEARCH ) return 0;
+
+	ber_dupbv( &bv, &rs->sr_entry->e_nname );
+	ber_bvarray_add( &ts->dns, &bv );
+	if ( !ts->attrs ) return 0;
+
+	a = attr_find( rs->sr_entry->e_attrs, ad_objectSid );
+	if ( a && BER_BVISNULL( &ts->sid ))
+		ber_dupbv( &ts->sid, &a->a_nvals[0] );
+	a = attr_find( rs->sr_entry->e_attrs, ad_primaryGroupID );
+	if ( a && BER_BVISNULL( &ts->pgid ))
+		ber_dupbv( &ts->pgid, &a->a_nvals[0] );
+	return 0;
+}
+
+/* Internal search of the underlying database. The caller's operation
+ * is copied so that the backend reuses its read transaction. */
+static void
+tg_search( Operation *op, BackendDB *db, struct berval *base, int scope,
+	Filter *f, AttributeName *attrs, tg_search_s *ts )
+{
+	Operation fop = *op;
+	SlapReply frs = { REP_RESULT };
+	slap_callback cb = { NULL, tg_search_cb, NULL, NULL, NULL };
+
+	cb.sc_private = ts;
+	fop.o_tag = LDAP_REQ_SEARCH;
+	fop.o_bd = db;
+	fop.o_callback = &cb;
+	fop.o_dn = db->be_rootdn;
+	fop.o_ndn = db->be_rootndn;
+	fop.o_req_dn = *base;
+	fop.o_req_ndn = *base;
+	fop.o_sync = SLAP_CONTROL_NONE;
+	fop.o_pagedresults = SLAP_CONTROL_NONE;
+	fop.o_managedsait = SLAP_CONTROL_NONCRITICAL;
+	fop.ors_scope = scope;
+	fop.ors_deref = LDAP_DEREF_NEVER;
+	fop.ors_slimit = SLAP_NO_LIMIT;
+	fop.ors_tlimit = SLAP_NO_LIMIT;
+	fop.ors_limit = NULL;
+	fop.ors_attrs = attrs;
+	fop.ors_attrsonly = 0;
+	fop.ors_filter = f;
+	filter2bv_x( &fop, f, &fop.ors_filterstr );
+
+	db->bd_info->bi_op_search( &fop, &frs );
+	op->o_tmpfree( fop.ors_filterstr.bv_val, op->o_tmpmemctx );
+}
+
+/* The primary group's SID is the entry's SID with the last
+ * subauthority replaced by primaryGroupID. */
+static int
+tg_primary_sid( struct berval *sid, struct berval *pgid, struct berval *out )
+{
+	unsigned long rid;
+	unsigned char *p;
+
+	if ( sid->bv_len < 12 || sid->bv_len != 8 + 4 * (unsigned char)sid->bv_val[1] )
+		return -1;
+	if ( lutil_atoul( &rid, pgid->bv_val ))
+		return -1;
+
+	ber_dupbv( out, sid );
+	p = (unsigned char *)out->bv_val + out->bv_len - 4;
+	p[0] = rid & 0xff;
+	p[1] = ( rid >> 8 ) & 0xff;
+	p[2] = ( rid >> 16 ) & 0xff;
+	p[3] = ( rid >> 24 ) & 0xff;
+	return 0;
+}
+
+/* Read an entry's SID and the groups it is a direct member of */
+static tg_node *
+tg_node_load( Operation *op, BackendDB *db, struct berval *ndn )
+{
+	tg_node *tn;
+	tg_search_s ts = { 1, BER_BVNULL, BER_BVNULL, NULL };
+	AttributeName an[3];
+	Filter f;
+	AttributeAssertion ava = ATTRIBUTEASSERTION_INIT;
+
+	tn = ch_calloc( 1, sizeof( tg_node ));
+	ber_dupbv( &tn->tn_ndn, ndn );
+
+	memset( an, 0, sizeof( an ));
+	an[0].an_desc = ad_objectSid;
+	an[0].an_name = ad_objectSid->ad_cname;
+	an[1].an_desc = ad_primaryGroupID;
+	an[1].an_name = ad_primaryGroupID->ad_cname;
+
+	f.f_choice = LDAP_FILTER_PRESENT;
+	f.f_desc = slap_schema.si_ad_objectClass;
+	f.f_next = NULL;
+	tg_search( op, db, ndn, LDAP_SCOPE_BASE, &f, an, &ts );
+	ber_bvarray_free( ts.dns );
+	ts.dns = NULL;
+	ts.attrs = 0;
+	tn->tn_sid = ts.sid;
+
+	f.f_choice = LDAP_FILTER_EQUALITY;
+	f.f_ava = &ava;
+	ava.aa_desc = ad_member;
+	ava.aa_value = *ndn;
+	tg_search( op, db, &db->be_nsuffix[0], LDAP_SCOPE_SUBTREE, &f,
+		slap_anlist_no_attrs, &ts );
+	tn->tn_parents = ts.dns;
+
+	if ( !BER_BVISNULL( &ts.pgid )) {
+		struct berval pgsid;
+
+		if ( !BER_BVISNULL( &tn->tn_sid ) &&
+			tg_primary_sid( &tn->tn_sid, &ts.pgid, &pgsid ) == 0 )
+		{
+			ts.dns = NULL;
+			ava.aa_desc = ad_objectSid;
+			ava.aa_value = pgsid;
+			tg_search( op, db, &db->be_nsuffix[0], LDAP_SCOPE_SUBTREE, &f,
+				slap_anlist_no_attrs, &ts );
+			if ( ts.dns ) {
+				ber_bvarray_add( &tn->tn_parents, &ts.dns[0] );
+				ch_free( ts.dns );
+			}
+			ch_free( pgsid.bv_val );
+		}
+		ch_free( ts.pgid.bv_val );
+	}
+
+	return tn;
+}
+
+/* Copy out an entry's SID and direct groups, from the cache if it's
+ * there, else read with the operation's txn and cached if no change
+ * was seen since the operation started (stamp). */
+static void
+tg_node_get( Operation *op, BackendDB *db, tg_info *ti, unsigned long stamp,
+	struct berval *ndn, struct berval *sid, BerVarray *parents )
+{
+	tg_node key, *tn;
+
+	key.tn_ndn = *ndn;
+	ldap_pvt_thread_mutex_lock( &ti->ti_mutex );
+	tn = avl_find( ti->ti_nodes, &key, tg_node_cmp );
+	if ( tn ) {
+		ber_dupbv( sid, &tn->tn_sid );
+		ber_bvarray_dup_x( parents, tn->tn_parents, NULL );
+		ldap_pvt_thread_mutex_unlock( &ti->ti_mutex );
+		return;
+	}
+	ldap_pvt_thread_mutex_unlock( &ti->ti_mutex );
+
+	tn = tg_node_load( op, db, ndn );
+	ber_dupbv( sid, &tn->tn_sid );
+	ber_bvarray_dup_x( parents, tn->tn_parents, NULL );
+
+	ldap_pvt_thread_mutex_lock( &ti->ti_mutex );
+	if ( ti->ti_gen == stamp ) {
+		if ( ti->ti_numnodes >= ti->ti_max )
+			tg_flush( ti );
+		if ( avl_insert( &ti->ti_nodes, tn, tg_node_cmp, avl_dup_error ) == 0 ) {
+			ti->ti_numnodes++;
+			tn = NULL;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &ti->ti_mutex );
+	if ( tn )
+		tg_node_free( tn );
+}
+
+static int
+tg_str_cmp( const void *v1, const void *v2 )
+{
+	return strcmp( v1, v2 );
+}
+
+/* Breadth-first walk up the membership graph from ndn */
+static BerVarray
+tg_closure( Operation *op, BackendDB *db, tg_info *ti, unsigned long stamp,
+	struct berval *ndn )
+{
+	tg_node key, *tn;
+	Avlnode *seen = NULL;
+	BerVarray closure = NULL, parents;
+	struct berval sid, bv;
+	char **queue, *dn;
+	int i, head = 0, tail = 0, size = 16;
+
+	key.tn_ndn = *ndn;
+	ldap_pvt_thread_mutex_lock( &ti->ti_mutex );
+	tn = avl_find( ti->ti_nodes, &key, tg_node_cmp );
+	if ( tn && tn->tn_gen == ti->ti_gen ) {
+		ber_bvarray_dup_x( &closure, tn->tn_closure, NULL );
+		ldap_pvt_thread_mutex_unlock( &ti->ti_mutex );
+		return closure;
+	}
+	ldap_pvt_thread_mutex_unlock( &ti->ti_mutex );
+
+	queue = ch_malloc( size * sizeof( char * ));
+	dn = ch_strdup( ndn->bv_val );
+	avl_insert( &seen, dn, tg_str_cmp, avl_dup_error );
+	queue[tail++] = dn;
+
+	while ( head < tail ) {
+		ber_str2bv( queue[head++], 0, 0, &bv );
+		tg_node_get( op, db, ti, stamp, &bv, &sid, &parents );
+		/* the start entry's own SID isn't one of its groups */
+		if ( head > 1 && !BER_BVISEMPTY( &sid ))
+			value_add_one( &closure, &sid );
+		ch_free( sid.bv_val );
+
+		for ( i = 0; parents && !BER_BVISNULL( &parents[i] ); i++ ) {
+			dn = ch_strdup( parents[i].bv_val );
+			if ( avl_insert( &seen, dn, tg_str_cmp, avl_dup_error )) {
+				ch_free( dn );
+				continue;
+			}
+			if ( tail == size ) {
+				size *= 2;
+				queue = ch_realloc( queue, size * sizeof( char * ));
+			}
+			queue[tail++] = dn;
+		}
+		ber_bvarray_free( parents );
+	}
+
+	avl_free( seen, ch_free );
+	ch_free( queue );
+
+	/* memoize only if nothing changed since the operation started */
+	ldap_pvt_thread_mutex_lock( &ti->ti_mutex );
+	if ( ti->ti_gen == stamp ) {
+		tn = avl_find( ti->ti_nodes, &key, tg_node_cmp );
+		if ( tn ) {
+			ber_bvarray_free( tn->tn_closure );
+			ber_bvarray_dup_x( &tn->tn_closure, closure, NULL );
+			tn->tn_gen = stamp;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &ti->ti_mutex );
+	return closure;
+}
+
+static int
+tg_stamp_cleanup( Operation *op, SlapReply *rs )
+{
+	if ( rs->sr_type == REP_RESULT || rs->sr_err == SLAPD_ABANDON ) {
+		op->o_tmpfree( op->o_callback, op->o_tmpmemctx );
+		op->o_callback = NULL;
+	}
+	return SLAP_CB_CONTINUE;
+}
+
+/* Note the generation before the backend starts its read txn */
+static int
+tg_op_search( Operation *op, SlapReply *rs )
+{
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	tg_info *ti = on->on_bi.bi_private;
+	slap_callback *sc;
+
+	if ( op->ors_scope != LDAP_SCOPE_BASE || tg_schema() ||
+		!ad_inlist( ad_tokenGroups, op->ors_attrs ))
+		return SLAP_CB_CONTINUE;
+
+	sc = op->o_tmpcalloc( 1, sizeof( slap_callback ) + sizeof( unsigned long ),
+		op->o_tmpmemctx );
+	sc->sc_cleanup = tg_stamp_cleanup;
+	sc->sc_private = sc + 1;
+	ldap_pvt_thread_mutex_lock( &ti->ti_mutex );
+	*(unsigned long *)sc->sc_private = ti->ti_gen;
+	ldap_pvt_thread_mutex_unlock( &ti->ti_mutex );
+	sc->sc_next = op->o_callback;
+	op->o_callback = sc;
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+tg_operational( Operation *op, SlapReply *rs )
+{
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	tg_info *ti = on->on_bi.bi_private;
+	BackendDB db;
+	Attribute *a, **ap;
+	BerVarray closure;
+	slap_callback *sc;
+	unsigned long stamp = 0;
+
+	/* like AD, only computed on explicit request of a base object */
+	if ( !rs->sr_entry || op->ors_scope != LDAP_SCOPE_BASE ||
+		tg_schema() || !ad_inlist( ad_tokenGroups, rs->sr_attrs ))
+		return SLAP_CB_CONTINUE;
+
+	if ( attr_find( rs->sr_entry->e_attrs, ad_tokenGroups ))
+		return SLAP_CB_CONTINUE;
+
+	/* without a stamp nothing read here is cached */
+	for ( sc = op->o_callback; sc; sc = sc->sc_next ) {
+		if ( sc->sc_cleanup == tg_stamp_cleanup ) {
+			stamp = *(unsigned long *)sc->sc_private;
+			break;
+		}
+	}
+
+	db = *op->o_bd;
+	db.bd_info = on->on_info->oi_orig;
+
+	closure = tg_closure( op, &db, ti, stamp, &rs->sr_entry->e_nname );
+	if ( closure ) {
+		a = attr_alloc( ad_tokenGroups );
+		for ( a->a_numvals = 0; !BER_BVISNULL( &closure[a->a_numvals] );
+			a->a_numvals++ )
+			;
+		a->a_vals = closure;
+		a->a_nvals = a->a_vals;
+
+		for ( ap = &rs->sr_operational_attrs; *ap; ap = &(*ap)->a_next )
+			;
+		*ap = a;
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+/* Invalidate the nodes whose direct groups may have changed */
+static int
+tg_response( Operation *op, SlapReply *rs )
+{
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	tg_info *ti = on->on_bi.bi_private;
+	Modifications *ml;
+	Attribute *a;
+	BerVarray vals;
+	int i;
+
+	/* the generation is bumped even if nothing is cached, a search
+	 * may be reading a node with a txn older than this change.
+	 */
+	if ( rs->sr_type != REP_RESULT || rs->sr_err != LDAP_SUCCESS ||
+		tg_schema() )
+		return SLAP_CB_CONTINUE;
+
+	ldap_pvt_thread_mutex_lock( &ti->ti_mutex );
+	switch ( op->o_tag ) {
+	case LDAP_REQ_ADD:
+		/* it may have been looked up while it didn't exist */
+		tg_drop( ti, &op->o_req_ndn );
+		a = attr_find( op->ora_e->e_attrs, ad_member );
+		if ( a ) {
+			for ( i = 0; i < a->a_numvals; i++ )
+				tg_drop( ti, &a->a_nvals[i] );
+		}
+		break;
+
+	case LDAP_REQ_DELETE:
+		tg_drop( ti, &op->o_req_ndn );
+		tg_drop_members( ti, &op->o_req_ndn );
+		break;
+
+	case LDAP_REQ_MODIFY:
+		for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+			if ( ml->sml_desc == ad_member ) {
+				int mop = ml->sml_op & LDAP_MOD_OP;
+
+				/* removed members are among the current ones */
+				if ( mop == LDAP_MOD_DELETE || mop == LDAP_MOD_REPLACE ||
+					mop == SLAP_MOD_SOFTDEL )
+					tg_drop_members( ti, &op->o_req_ndn );
+				if ( mop == LDAP_MOD_ADD || mop == LDAP_MOD_REPLACE ||
+					mop == SLAP_MOD_SOFTADD || mop == SLAP_MOD_ADD_IF_NOT_PRESENT )
+				{
+					vals = ml->sml_nvalues ? ml->sml_nvalues : ml->sml_values;
+					for ( i = 0; vals && !BER_BVISNULL( &vals[i] ); i++ )
+						tg_drop( ti, &vals[i] );
+				}
+			} else if ( ml->sml_desc == ad_objectSid ||
+				ml->sml_desc == ad_primaryGroupID )
+			{
+				tg_drop( ti, &op->o_req_ndn );
+			}
+		}
+		break;
+
+	case LDAP_REQ_MODRDN:
+		/* member values of the whole subtree change */
+		tg_flush( ti );
+		break;
+
+	default:
+		ldap_pvt_thread_mutex_unlock( &ti->ti_mutex );
+		return SLAP_CB_CONTINUE;
+	}
+	ti->ti_gen++;
+	ldap_pvt_thread_mutex_unlock( &ti->ti_mutex );
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+tg_db_init(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	tg_info *ti;
+
+	ti = ch_calloc( 1, sizeof(tg_info) );
+	ti->ti_max = TOKENGROUPS_CACHESIZE;
+	ti->ti_gen = 1;
+	ldap_pvt_thread_mutex_init( &ti->ti_mutex );
+	on->on_bi.bi_private = ti;
+
+	return 0;
+}
+
+static int
+tg_db_close(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	tg_info *ti = on->on_bi.bi_private;
+
+	ldap_pvt_thread_mutex_lock( &ti->ti_mutex );
+	tg_flush( ti );
+	ldap_pvt_thread_mutex_unlock( &ti->ti_mutex );
+
+	return 0;
+}
+
+static int
+tg_db_destroy(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	tg_info *ti = on->on_bi.bi_private;
+
+	avl_free( ti->ti_nodes, tg_node_free );
+	ldap_pvt_thread_mutex_destroy( &ti->ti_mutex );
+	ch_free( ti );
+	on->on_bi.bi_private = NULL;
+
+	return 0;
+}
+
+int
+tokengroups_initialize( void )
+{
+	int code;
+
+	tokengroups.on_bi.bi_type = "tokengroups";
+	tokengroups.on_bi.bi_db_init = tg_db_init;
+	tokengroups.on_bi.bi_db_close = tg_db_close;
+	tokengroups.on_bi.bi_db_destroy = tg_db_destroy;
+	tokengroups.on_bi.bi_op_search = tg_op_search;
+	tokengroups.on_bi.bi_operational = tg_operational;
+	tokengroups.on_response = tg_response;
+
+	tokengroups.on_bi.bi_cf_ocs = tgocs;
+	code = config_register_schema( tgcfg, tgocs );
+	if ( code ) return code;
+
+	Debug(LDAP_DEBUG_TRACE, "tokengroups_initialize\n",0,0,0);
+	return overlay_register(&tokengroups);
+}
+
+#if SLAPD_OVER_TOKENGROUPS == SLAPD_MOD_DYNAMIC
+int init_module( int argc, char *argv[] )
+{
+	return tokengroups_initialize();
+}
+#endif /* SLAPD_OVER_TOKENGROUPS == SLAPD_MOD_DYNAMIC */
+
+#endif /*SLAPD_OVER_TOKENGROUPS*/
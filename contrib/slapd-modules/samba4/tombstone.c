@@ -0,0 +1,817 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2018 The OpenLDAP Foundation.
+ * Portions Copyright 2018 Symas Corporation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the
+ * GNU General Public License version 3, as published by the
+ * the Free Software Foundation;
+ *
+ * A copy of this license is available at
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/* Background garbage collection of deleted objects. Entries with
+ * isDeleted=TRUE whose whenChanged is older than the tombstone lifetime
+ * are physically removed, a batch at a time, each batch in a single
+ * write transaction of the underlying database. */
+
+#include "portable.h"
+
+#ifdef SLAPD_OVER_TOMBSTONE
+
+#include <stdio.h>
+
+#include "ac/string.h"
+#include "ac/socket.h"
+
+#include "slap.h"
+#include "config.h"
+
+#include "lutil.h"
+#include "ldap_rq.h"
+
+#include "back-monitor/back-monitor.h"
+
+#define	TOMBSTONE_LIFETIME	180		/* days */
+#define	TOMBSTONE_INTERVAL	(12*60*60)	/* seconds between passes */
+#define	TOMBSTONE_BATCH		100		/* entries per transaction */
+#define	TOMBSTONE_PAUSE		1		/* seconds between batches */
+
+typedef struct tombstone_info {
+	BackendDB	*ti_db;
+	struct re_s	*ti_task;
+	int		ti_lifetime;
+	int		ti_interval;
+	int		ti_batch;
+	int		ti_pause;
+
+	/* statistics, published in cn=monitor */
+	unsigned long	ti_reaped;
+	unsigned long	ti_errors;
+	unsigned long	ti_lastbatch;
+	time_t		ti_lastrun;
+	int		ti_backlog;
+
+	void		*ti_monitor_cb;
+	struct berval	ti_monitor_ndn;
+} tombstone_info;
+
+static slap_overinst	tombstone;
+
+static AttributeDescription	*ad_isDeleted, *ad_whenChanged;
+
+static AttributeDescription	*ad_tombstoneReaped, *ad_tombstoneErrors,
+	*ad_tombstoneLastBatch, *ad_tombstoneLastRun, *ad_tombstoneBacklog;
+static ObjectClass		*oc_olmTombstone;
+
+static struct {
+	char			*name;
+	char			*oid;
+}		s_oid[] = {
+	{ "TombstoneOID",		"1.3.6.1.4.1.4203.666.11.12" },
+	{ "TombstoneAttributes",	"TombstoneOID:1" },
+	{ "TombstoneObjectClasses",	"TombstoneOID:2" },
+
+	{ NULL }
+};
+
+static struct {
+	char	*desc;
+	AttributeDescription **adp;
+} s_ad[] = {
+	{ "( TombstoneAttributes:1 "
+		"NAME 'tombstoneReaped' "
+		"DESC 'Number of expired tombstones removed' "
+		"EQUALITY integerMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_tombstoneReaped },
+	{ "( TombstoneAttributes:2 "
+		"NAME 'tombstoneErrors' "
+		"DESC 'Number of expired tombstones that could not be removed' "
+		"EQUALITY integerMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_tombstoneErrors },
+	{ "( TombstoneAttributes:3 "
+		"NAME 'tombstoneLastBatch' "
+		"DESC 'Number of tombstones removed by the last batch' "
+		"EQUALITY integerMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_tombstoneLastBatch },
+	{ "( TombstoneAttributes:4 "
+		"NAME 'tombstoneLastRun' "
+		"DESC 'Time the last batch was run' "
+		"EQUALITY generalizedTimeMatch "
+		"ORDERING generalizedTimeOrderingMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.24 "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_tombstoneLastRun },
+	{ "( TombstoneAttributes:5 "
+		"NAME 'tombstoneBacklog' "
+		"DESC 'TRUE while expired tombstones remain to be removed' "
+		"EQUALITY booleanMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.7 "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_tombstoneBacklog },
+
+	{ NULL }
+};
+
+static struct {
+	char		*desc;
+	ObjectClass	**ocp;
+}		s_oc[] = {
+	/* augments an existing object, so it must be AUXILIARY */
+	{ "( TombstoneObjectClasses:1 "
+		"NAME ( 'olmTombstone' ) "
+		"SUP top AUXILIARY "
+		"MAY ( "
+			"tombstoneReaped "
+			"$ tombstoneErrors "
+			"$ tombstoneLastBatch "
+			"$ tombstoneLastRun "
+			"$ tombstoneBacklog "
+			") )",
+		&oc_olmTombstone },
+
+	{ NULL }
+};
+
+enum {
+	TS_INTERVAL = 1
+};
+
+static ConfigDriver tombstone_cf_gen;
+
+static ConfigTable tombstonecfg[] = {
+	{ "tombstone-lifetime", "days", 2, 2, 0,
+	  ARG_INT|ARG_OFFSET,
+	  (void *)offsetof(tombstone_info, ti_lifetime),
+	  "( OLcfgCtAt:7.1 "
+	  "NAME 'olcTombstoneLifetime' "
+	  "DESC 'Days a deleted object is kept before it is removed' "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "tombstone-interval", "seconds", 2, 2, 0,
+	  ARG_INT|ARG_MAGIC|TS_INTERVAL, tombstone_cf_gen,
+	  "( OLcfgCtAt:7.2 "
+	  "NAME 'olcTombstoneInterval' "
+	  "DESC 'Seconds between garbage collection passes' "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "tombstone-batch", "entries", 2, 2, 0,
+	  ARG_INT|ARG_OFFSET,
+	  (void *)offsetof(tombstone_info, ti_batch),
+	  "( OLcfgCtAt:7.3 "
+	  "NAME 'olcTombstoneBatch' "
+	  "DESC 'Number of tombstones removed per write transaction' "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "tombstone-pause", "seconds", 2, 2, 0,
+	  ARG_INT|ARG_OFFSET,
+	  (void *)offsetof(tombstone_info, ti_pause),
+	  "( OLcfgCtAt:7.4 "
+	  "NAME 'olcTombstonePause' "
+	  "DESC 'Seconds to wait between consecutive batches' "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
+};
+
+static ConfigOCs tombstoneocs[] = {
+	{ "( OLcfgCtOc:7.1 "
+	  "NAME 'olcTombstoneConfig' "
+	  "DESC 'Tombstone garbage collector configuration' "
+	  "SUP olcOverlayConfig "
+	  "MAY ( olcTombstoneLifetime $ olcTombstoneInterval $ "
+	  "olcTombstoneBatch $ olcTombstonePause ) )",
+	  Cft_Overlay, tombstonecfg, NULL, NULL },
+	{ NULL, 0, NULL }
+};
+
+static int
+tombstone_cf_gen( ConfigArgs *c )
+{
+	slap_overinst *on = (slap_overinst *)c->bi;
+	tombstone_info *ti = on->on_bi.bi_private;
+	int rc = 0;
+
+	switch ( c->op ) {
+	case SLAP_CONFIG_EMIT:
+		c->value_int = ti->ti_interval;
+		break;
+
+	case LDAP_MOD_DELETE:
+		ti->ti_interval = TOMBSTONE_INTERVAL;
+		break;
+
+	case SLAP_CONFIG_ADD:
+	case LDAP_MOD_ADD:
+		if ( c->value_int < 1 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> invalid interval", c->argv[0] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		ti->ti_interval = c->value_int;
+		break;
+	}
+
+	/* a running task picks the new interval up when it reschedules */
+	if ( ti->ti_task && !ti->ti_backlog ) {
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		ti->ti_task->interval.tv_sec = ti->ti_interval;
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	}
+
+	return rc;
+}
+
+typedef struct tombstone_batch {
+	int slots;
+	int used;
+	int max;
+	int more;
+	BerVarray dn;
+	BerVarray ndn;
+} tombstone_batch;
+
+static slap_callback nullsc;
+
+static int
+tombstone_collect( Operation *op, SlapReply *rs )
+{
+	tombstone_batch *tb = op->o_callback->sc_private;
+
+	if ( rs->sr_type != REP_SEARCH ) return 0;
+
+	if ( slapd_shutdown ) return 0;
+
+	/* internal searches don't count entries against ors_slimit */
+	if ( tb->used >= tb->max ) {
+		tb->more = 1;
+		return LDAP_SIZELIMIT_EXCEEDED;
+	}
+
+	if ( tb->used >= tb->slots ) {
+		tb->slots += TOMBSTONE_BATCH;
+		tb->dn = ch_realloc( tb->dn, tb->slots * sizeof( struct berval ));
+		tb->ndn = ch_realloc( tb->ndn, tb->slots * sizeof( struct berval ));
+	}
+	ber_dupbv( &tb->dn[tb->used], &rs->sr_entry->e_name );
+	ber_dupbv( &tb->ndn[tb->used], &rs->sr_entry->e_nname );
+	tb->used++;
+	return 0;
+}
+
+/* Delete one batch inside a single transaction. Entries are removed
+ * in reverse search order so that children go before their parents.
+ * Returns the number of entries removed, or -1 if the transaction
+ * could not be used and the caller must fall back to single deletes. */
+static int
+tombstone_expunge_txn( Operation *op, tombstone_batch *tb )
+{
+	BackendInfo *bi = op->o_bd->bd_info;
+	OpExtra *txn = NULL;
+	SlapReply rs = {REP_RESULT};
+	int i, rc;
+
+	if ( !bi->bi_op_txn || tb->used < 2 )
+		return -1;
+
+	if ( bi->bi_op_txn( op, SLAP_TXN_BEGIN, &txn ))
+		return -1;
+
+	for ( i = tb->used - 1; i >= 0 && !slapd_shutdown; i-- ) {
+		op->o_req_dn = tb->dn[i];
+		op->o_req_ndn = tb->ndn[i];
+		rs_reinit( &rs, REP_RESULT );
+		rc = bi->bi_op_delete( op, &rs );
+		if ( rc != LDAP_SUCCESS )
+			break;
+	}
+
+	/* the transaction was parked in o_extra by BEGIN */
+	LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+	if ( i >= 0 ) {
+		bi->bi_op_txn( op, SLAP_TXN_ABORT, &txn );
+		return -1;
+	}
+	if ( bi->bi_op_txn( op, SLAP_TXN_COMMIT, &txn ))
+		return -1;
+
+	return tb->used;
+}
+
+/* Periodically search for expired tombstones and delete them */
+static void *
+tombstone_reap( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	slap_overinst *on = rtask->arg;
+	tombstone_info *ti = on->on_bi.bi_private;
+
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	BackendDB db;
+	SlapReply rs = {REP_RESULT};
+	slap_callback cb = { NULL, tombstone_collect, NULL, NULL, NULL };
+	Filter f[3];
+	AttributeAssertion ava[2] = { ATTRIBUTEASSERTION_INIT, ATTRIBUTEASSERTION_INIT };
+	tombstone_batch tb = {0};
+	char timebuf[LDAP_LUTIL_GENTIME_BUFSIZE];
+	time_t old = slap_get_time();
+	int i, more = 0, reaped = 0;
+
+	if ( !ad_isDeleted || !ad_whenChanged ) {
+		const char *text = NULL;
+
+		/* the AD schema may be loaded after we were opened */
+		if ( slap_str2ad( "isDeleted", &ad_isDeleted, &text ) ||
+			slap_str2ad( "whenChanged", &ad_whenChanged, &text ))
+		{
+			Debug( LDAP_DEBUG_ANY, "tombstone_reap: "
+				"isDeleted/whenChanged not defined: %s\n",
+				text, 0, 0 );
+			ad_isDeleted = NULL;
+			goto done;
+		}
+	}
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+
+	/* bypass the overlays: show_deleted would hide the very
+	 * entries we are looking for */
+	db = *ti->ti_db;
+	db.bd_info = on->on_info->oi_orig;
+	op->o_bd = &db;
+
+	f[0].f_choice = LDAP_FILTER_AND;
+	f[0].f_and = &f[1];
+	f[0].f_next = NULL;
+	f[1].f_choice = LDAP_FILTER_EQUALITY;
+	f[1].f_ava = &ava[0];
+	f[1].f_next = &f[2];
+	f[2].f_choice = LDAP_FILTER_LE;
+	f[2].f_ava = &ava[1];
+	f[2].f_next = NULL;
+
+	ava[0].aa_desc = ad_isDeleted;
+	ava[0].aa_value = slap_true_bv;
+	ava[1].aa_desc = ad_whenChanged;
+	ava[1].aa_value.bv_val = timebuf;
+	ava[1].aa_value.bv_len = sizeof(timebuf);
+
+	old -= (time_t)ti->ti_lifetime * 24 * 60 * 60;
+	slap_timestamp( &old, &ava[1].aa_value );
+
+	op->o_tag = LDAP_REQ_SEARCH;
+	op->o_dn = db.be_rootdn;
+	op->o_ndn = db.be_rootndn;
+	op->o_req_dn = db.be_suffix[0];
+	op->o_req_ndn = db.be_nsuffix[0];
+	op->o_callback = &cb;
+	op->ors_scope = LDAP_SCOPE_SUBTREE;
+	op->ors_deref = LDAP_DEREF_NEVER;
+	op->ors_tlimit = SLAP_NO_LIMIT;
+	op->ors_slimit = SLAP_NO_LIMIT;
+	op->ors_filter = f;
+	filter2bv_x( op, f, &op->ors_filterstr );
+	op->ors_attrs = slap_anlist_no_attrs;
+	op->ors_attrsonly = 1;
+	op->o_managedsait = SLAP_CONTROL_CRITICAL;
+	tb.max = ti->ti_batch;
+	cb.sc_private = &tb;
+
+	db.bd_info->bi_op_search( op, &rs );
+	op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
+	more = tb.more;
+
+	if ( tb.used ) {
+		op->o_tag = LDAP_REQ_DELETE;
+		op->o_callback = &nullsc;
+		op->o_dont_replicate = 1;
+
+		reaped = tombstone_expunge_txn( op, &tb );
+		if ( reaped < 0 ) {
+			/* one of them failed; find out which on its own */
+			reaped = 0;
+			for ( i = tb.used - 1; i >= 0 && !slapd_shutdown; i-- ) {
+				op->o_req_dn = tb.dn[i];
+				op->o_req_ndn = tb.ndn[i];
+				rs_reinit( &rs, REP_RESULT );
+				if ( db.bd_info->bi_op_delete( op, &rs ) == LDAP_SUCCESS ) {
+					reaped++;
+				} else {
+					Debug( LDAP_DEBUG_ANY, "tombstone_reap: "
+						"unable to delete \"%s\" (%d)\n",
+						tb.dn[i].bv_val, rs.sr_err, 0 );
+					ti->ti_errors++;
+				}
+				ldap_pvt_thread_pool_pausecheck( &connection_pool );
+			}
+		}
+
+		for ( i = 0; i < tb.used; i++ ) {
+			ch_free( tb.ndn[i].bv_val );
+			ch_free( tb.dn[i].bv_val );
+		}
+		ch_free( tb.ndn );
+		ch_free( tb.dn );
+	}
+
+	Debug( LDAP_DEBUG_STATS, "tombstone_reap: %s removed %d of %d\n",
+		db.be_suffix[0].bv_val, reaped, tb.used );
+
+	ti->ti_reaped += reaped;
+	ti->ti_lastbatch = reaped;
+	ti->ti_lastrun = slap_get_time();
+
+	/* entries that keep failing would be found again first;
+	 * don't spin on them until the next regular pass */
+	if ( !reaped )
+		more = 0;
+
+done:
+	ti->ti_backlog = more && !slapd_shutdown;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( ldap_pvt_runqueue_isrunning( &slapd_rq, rtask ))
+		ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	if ( ti->ti_task == rtask ) {
+		/* throttle: come back soon while there is a backlog */
+		rtask->interval.tv_sec = ti->ti_backlog ? ti->ti_pause : ti->ti_interval;
+		ldap_pvt_runqueue_resched( &slapd_rq, rtask, 0 );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	if ( ti->ti_backlog )
+		slap_wake_listener();
+
+	return NULL;
+}
+
+static int
+tombstone_monitor_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e,
+	void		*priv )
+{
+	tombstone_info	*ti = (tombstone_info *) priv;
+	Attribute	*a;
+	char		buf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+	struct berval	bv;
+	struct {
+		AttributeDescription *ad;
+		unsigned long val;
+	} counters[] = {
+		{ ad_tombstoneReaped, ti->ti_reaped },
+		{ ad_tombstoneErrors, ti->ti_errors },
+		{ ad_tombstoneLastBatch, ti->ti_lastbatch },
+		{ NULL }
+	};
+	int i;
+
+	for ( i = 0; counters[i].ad; i++ ) {
+		a = attr_find( e->e_attrs, counters[i].ad );
+		assert( a != NULL );
+
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", counters[i].val );
+		if ( a->a_nvals != a->a_vals ) {
+			ber_bvreplace( &a->a_nvals[ 0 ], &bv );
+		}
+		ber_bvreplace( &a->a_vals[ 0 ], &bv );
+	}
+
+	a = attr_find( e->e_attrs, ad_tombstoneBacklog );
+	assert( a != NULL );
+	bv = ti->ti_backlog ? slap_true_bv : slap_false_bv;
+	if ( a->a_nvals != a->a_vals ) {
+		ber_bvreplace( &a->a_nvals[ 0 ], &bv );
+	}
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	attr_delete( &e->e_attrs, ad_tombstoneLastRun );
+	if ( ti->ti_lastrun ) {
+		bv.bv_val = buf;
+		bv.bv_len = sizeof( buf );
+		slap_timestamp( &ti->ti_lastrun, &bv );
+		attr_merge_one( e, ad_tombstoneLastRun, &bv, NULL );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+tombstone_monitor_free(
+	Entry		*e,
+	void		**priv )
+{
+	struct berval	values[ 2 ];
+	Modification	mod = { 0 };
+	AttributeDescription *ads[] = {
+		ad_tombstoneReaped, ad_tombstoneErrors, ad_tombstoneLastBatch,
+		ad_tombstoneLastRun, ad_tombstoneBacklog, NULL };
+
+	const char	*text;
+	char		textbuf[ SLAP_TEXT_BUFLEN ];
+
+	int		i;
+
+	/* NOTE: if slap_shutdown != 0, priv might have already been freed */
+	*priv = NULL;
+
+	/* Remove objectClass */
+	mod.sm_op = LDAP_MOD_DELETE;
+	mod.sm_desc = slap_schema.si_ad_objectClass;
+	mod.sm_values = values;
+	mod.sm_numvals = 1;
+	values[ 0 ] = oc_olmTombstone->soc_cname;
+	BER_BVZERO( &values[ 1 ] );
+
+	modify_delete_values( e, &mod, 1, &text,
+		textbuf, sizeof( textbuf ) );
+	/* don't care too much about return code... */
+
+	/* remove attrs */
+	mod.sm_values = NULL;
+	mod.sm_numvals = 0;
+	for ( i = 0; ads[i]; i++ ) {
+		mod.sm_desc = ads[i];
+		modify_delete_values( e, &mod, 1, &text,
+			textbuf, sizeof( textbuf ) );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+tombstone_monitor_db_open( BackendDB *be )
+{
+	slap_overinst		*on = (slap_overinst *)be->bd_info;
+	tombstone_info		*ti = on->on_bi.bi_private;
+	Attribute		*a, *next;
+	monitor_callback_t	*cb = NULL;
+	int			rc = 0;
+	BackendInfo		*mi;
+	monitor_extra_t		*mbe;
+	struct berval		zero = BER_BVC( "0" );
+
+	if ( !SLAP_DBMONITORING( be ) ) {
+		return 0;
+	}
+
+	mi = backend_info( "monitor" );
+	if ( !mi || !mi->bi_extra ) {
+		SLAP_DBFLAGS( be ) ^= SLAP_DBFLAG_MONITORING;
+		return 0;
+	}
+	mbe = mi->bi_extra;
+
+	/* don't bother if monitor is not configured */
+	if ( !mbe->is_configured() ) {
+		return 0;
+	}
+
+	/* alloc as many as required (plus 1 for objectClass) */
+	a = attrs_alloc( 1 + 4 );
+	if ( a == NULL ) {
+		rc = 1;
+		goto cleanup;
+	}
+
+	a->a_desc = slap_schema.si_ad_objectClass;
+	attr_valadd( a, &oc_olmTombstone->soc_cname, NULL, 1 );
+	next = a->a_next;
+
+	next->a_desc = ad_tombstoneReaped;
+	attr_valadd( next, &zero, NULL, 1 );
+	next = next->a_next;
+
+	next->a_desc = ad_tombstoneErrors;
+	attr_valadd( next, &zero, NULL, 1 );
+	next = next->a_next;
+
+	next->a_desc = ad_tombstoneLastBatch;
+	attr_valadd( next, &zero, NULL, 1 );
+	next = next->a_next;
+
+	next->a_desc = ad_tombstoneBacklog;
+	attr_valadd( next, (struct berval *)&slap_false_bv, NULL, 1 );
+
+	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
+	cb->mc_update = tombstone_monitor_update;
+	cb->mc_free = tombstone_monitor_free;
+	cb->mc_private = (void *)ti;
+
+	/* make sure the database is registered; then add monitor attributes */
+	BER_BVZERO( &ti->ti_monitor_ndn );
+	rc = mbe->register_overlay( be, on, &ti->ti_monitor_ndn );
+	if ( rc == 0 ) {
+		rc = mbe->register_entry_attrs( &ti->ti_monitor_ndn, a, cb,
+			NULL, -1, NULL );
+	}
+
+cleanup:;
+	if ( rc != 0 && cb != NULL ) {
+		ch_free( cb );
+		cb = NULL;
+	}
+
+	/* store for cleanup */
+	ti->ti_monitor_cb = (void *)cb;
+
+	/* register_entry_attrs() keeps its own copy */
+	if ( a != NULL ) {
+		attrs_free( a );
+	}
+
+	return rc;
+}
+
+static int
+tombstone_db_init(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	tombstone_info *ti;
+
+	ti = ch_calloc( 1, sizeof(tombstone_info) );
+	ti->ti_lifetime = TOMBSTONE_LIFETIME;
+	ti->ti_interval = TOMBSTONE_INTERVAL;
+	ti->ti_batch = TOMBSTONE_BATCH;
+	ti->ti_pause = TOMBSTONE_PAUSE;
+	on->on_bi.bi_private = ti;
+
+	if ( backend_info( "monitor" ) != NULL ) {
+		SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_MONITORING;
+	}
+
+	return 0;
+}
+
+static int
+tombstone_db_open(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	tombstone_info *ti = on->on_bi.bi_private;
+
+	if ( ti->ti_lifetime < 1 || ti->ti_batch < 1 || ti->ti_pause < 0 ) {
+		Debug( LDAP_DEBUG_ANY, "tombstone_db_open: "
+			"invalid lifetime, batch or pause\n", 0, 0, 0 );
+		return 1;
+	}
+
+	if ( !( slapMode & SLAP_SERVER_MODE ))
+		return 0;
+
+	if ( BER_BVISEMPTY( &be->be_rootndn )) {
+		Debug( LDAP_DEBUG_ANY, "tombstone_db_open: "
+			"rootdn is required to remove tombstones\n", 0, 0, 0 );
+		return 1;
+	}
+
+	/* be is a scratch copy; remember the real database */
+	ti->ti_db = select_backend( &be->be_nsuffix[0], 0 );
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ti->ti_task = ldap_pvt_runqueue_insert( &slapd_rq,
+		ti->ti_interval, tombstone_reap, on,
+		"tombstone_reap", be->be_suffix[0].bv_val );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return tombstone_monitor_db_open( be );
+}
+
+static int
+tombstone_db_close(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	tombstone_info *ti = on->on_bi.bi_private;
+
+	if ( ti->ti_task ) {
+		struct re_s *re = ti->ti_task;
+		ti->ti_task = NULL;
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, re ))
+			ldap_pvt_runqueue_stoptask( &slapd_rq, re );
+		ldap_pvt_runqueue_remove( &slapd_rq, re );
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	}
+
+	if ( ti->ti_monitor_cb != NULL ) {
+		BackendInfo		*mi = backend_info( "monitor" );
+		monitor_extra_t		*mbe;
+
+		if ( mi && mi->bi_extra ) {
+			mbe = mi->bi_extra;
+			mbe->unregister_entry_callback( &ti->ti_monitor_ndn,
+				(monitor_callback_t *)ti->ti_monitor_cb,
+				NULL, 0, NULL );
+		}
+		ti->ti_monitor_cb = NULL;
+	}
+
+	return 0;
+}
+
+static int
+tombstone_db_destroy(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	tombstone_info *ti = on->on_bi.bi_private;
+
+	ch_free( ti );
+	on->on_bi.bi_private = NULL;
+
+	return 0;
+}
+
+int
+tombstone_initialize( void )
+{
+	ConfigArgs c;
+	char *argv[ 4 ];
+	int i, code;
+
+	argv[ 0 ] = "tombstone";
+	c.argv = argv;
+	c.argc = 3;
+	c.fname = argv[0];
+
+	for ( i = 0; s_oid[ i ].name; i++ ) {
+		c.lineno = i;
+		argv[ 1 ] = s_oid[ i ].name;
+		argv[ 2 ] = s_oid[ i ].oid;
+
+		if ( parse_oidm( &c, 0, NULL ) != 0 ) {
+			Debug( LDAP_DEBUG_ANY, "tombstone_initialize: "
+				"unable to add objectIdentifier \"%s=%s\"\n",
+				s_oid[ i ].name, s_oid[ i ].oid, 0 );
+			return 1;
+		}
+	}
+
+	for ( i = 0; s_ad[i].desc != NULL; i++ ) {
+		code = register_at( s_ad[i].desc, s_ad[i].adp, 0 );
+		if ( code ) {
+			Debug( LDAP_DEBUG_ANY,
+				"tombstone_initialize: register_at #%d failed\n", i, 0, 0 );
+			return code;
+		}
+		(*s_ad[i].adp)->ad_type->sat_flags |= SLAP_AT_HIDE;
+	}
+
+	for ( i = 0; s_oc[i].desc != NULL; i++ ) {
+		code = register_oc( s_oc[i].desc, s_oc[i].ocp, 0 );
+		if ( code ) {
+			Debug( LDAP_DEBUG_ANY,
+				"tombstone_initialize: register_oc #%d failed\n", i, 0, 0 );
+			return code;
+		}
+		(*s_oc[i].ocp)->soc_flags |= SLAP_OC_HIDE;
+	}
+
+	tombstone.on_bi.bi_type = "tombstone";
+	tombstone.on_bi.bi_db_init = tombstone_db_init;
+	tombstone.on_bi.bi_db_open = tombstone_db_open;
+	tombstone.on_bi.bi_db_close = tombstone_db_close;
+	tombstone.on_bi.bi_db_destroy = tombstone_db_destroy;
+
+	tombstone.on_bi.bi_cf_ocs = tombstoneocs;
+	code = config_register_schema( tombstonecfg, tombstoneocs );
+	if ( code ) return code;
+
+	Debug(LDAP_DEBUG_TRACE, "tombstone_initialize\n",0,0,0);
+	return overlay_register(&tombstone);
+}
+
+#if SLAPD_OVER_TOMBSTONE == SLAPD_MOD_DYNAMIC
+int init_module( int argc, char *argv[] )
+{
+	return tombstone_initialize();
+}
+#endif /* SLAPD_OVER_TOMBSTONE == SLAPD_MOD_DYNAMIC */
+
+#endif /*SLAPD_OVER_TOMBSTONE*/
@@ -29,54 +29,213 @@
 
 #include "slap.h"
 #include "config.h"
+#include "lutil.h"
 
 /* This overlay intercepts write operations and adds a Microsoft-style
  * USN to the target entry.
+ *
+ * USNs are 64 bit. Each write takes the next one and queues it on a
+ * list of uncommitted USNs under a short mutex; the list stays in USN
+ * order, and the committed watermark sits just below its head, so one
+ * slow write only holds back the USNs after its own. The counter is
+ * saved in the suffix entry at close, and on open it is pushed past
+ * the highest uSNChanged actually present in the database, so a crash
+ * never causes USNs to be reused.
+ *
+ * It also implements a subset of the Active Directory DirSync control:
+ * a search carrying the control only returns entries whose uSNChanged
+ * is greater than the USN in the client's cookie, in ascending USN
+ * order, along with a new cookie to resume from. With an equality
+ * index on uSNChanged the backend answers this from the ordered
+ * integer index instead of scanning the whole database.
  */
 
+typedef unsigned long long usn_t;
+
+/* 20 digits for 2^64-1, plus NUL */
+#define USN_BUFSIZE	24
+
+/* A USN whose write has not finished yet */
+typedef struct usn_pending {
+	struct usn_pending *up_prev, *up_next;
+	usn_t up_usn;
+} usn_pending;
+
 typedef struct usn_info {
-	int ui_current;
-	ldap_pvt_thread_mutex_t ui_mutex;
+	usn_t ui_current;	/* last USN handed out */
+	usn_t ui_stable;	/* all USNs <= this are committed */
+	usn_pending *ui_head;	/* uncommitted USNs, oldest first */
+	usn_pending *ui_tail;
+	ldap_pvt_thread_mutex_t ui_mutex;	/* protects the pending list */
 } usn_info_t;
 
+#define usn_next(ui)	__sync_add_and_fetch( &(ui)->ui_current, 1 )
+#define usn_get(ui)	__sync_add_and_fetch( &(ui)->ui_current, 0 )
+
+#ifndef LDAP_CONTROL_X_DIRSYNC
+#define LDAP_CONTROL_X_DIRSYNC	"1.2.840.113556.1.4.841"
+#endif
+
+/* DirSync response flag: more changes are pending */
+#define DIRSYNC_MORE_RESULTS	1
+
+typedef struct dirsync_ctrl {
+	ber_int_t dc_flags;
+	ber_int_t dc_maxbytes;
+	usn_t dc_cookie;
+} dirsync_ctrl;
+
+typedef struct dirsync_node {
+	usn_t dn_usn;
+	ber_len_t dn_size;
+	struct berval dn_ndn;
+} dirsync_node;
+
+/* While collecting, ds_nodes is a max-heap on dn_usn holding no more
+ * entries than the sizelimit and MaxBytes let us send, so that the
+ * one to drop when a limit is hit is always on top.
+ */
+typedef struct dirsync_state {
+	usn_t ds_stable;
+	dirsync_node *ds_nodes;
+	int ds_num;
+	int ds_max;
+	int ds_limit;		/* sizelimit, negative if none */
+	int ds_more;		/* some matches were left out */
+	ber_len_t ds_bytes;	/* entry data held */
+} dirsync_state;
+
+static int usn_dirsync_cid;
+#define o_dirsync		o_ctrlflag[usn_dirsync_cid]
+#define o_ctrl_dirsync	o_controls[usn_dirsync_cid]
+
 static AttributeDescription *ad_usnCreated, *ad_usnChanged;
 
+/* AD LargeInteger, from the samba4 ad_schema module */
+#define USN_SYNTAX	"1.2.840.113556.1.4.906"
+#define USN_SYNTAX_INTEGER	"1.3.6.1.4.1.1466.115.121.1.27"
+
 static struct {
 	char *desc;
 	AttributeDescription **adp;
 } as[] = {
 	{ "( 1.2.840.113556.1.2.19 "
 	    "NAME 'uSNCreated' "
-	    "SYNTAX '1.2.840.113556.1.4.906' "
+	    "SYNTAX '%s' "
+		"EQUALITY integerMatch "
+		"ORDERING integerOrderingMatch "
 		"SINGLE-VALUE "
-		"NO-USER-MODIFICATION )",
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
 		&ad_usnCreated },
 	{ "( 1.2.840.113556.1.2.120 "
 		"NAME 'uSNChanged' "
-		"SYNTAX '1.2.840.113556.1.4.906' "
+		"SYNTAX '%s' "
+		"EQUALITY integerMatch "
+		"ORDERING integerOrderingMatch "
 		"SINGLE-VALUE "
-		"NO-USER-MODIFICATION )",
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
 		&ad_usnChanged },
 	{ NULL }
 };
 
+static ber_len_t
+usn_format( char *buf, usn_t usn )
+{
+	char tmp[USN_BUFSIZE], *ptr = tmp + sizeof(tmp);
+	ber_len_t len;
+
+	do {
+		*--ptr = '0' + (int)(usn % 10);
+		usn /= 10;
+	} while ( usn );
+
+	len = tmp + sizeof(tmp) - ptr;
+	AC_MEMCPY( buf, ptr, len );
+	buf[len] = '\0';
+	return len;
+}
+
+/* Move the committed watermark forward to cur. Only called with
+ * ui_mutex held; readers load it without the lock.
+ */
+static void
+usn_stable_advance( usn_info_t *ui, usn_t cur )
+{
+	usn_t old;
+
+	do {
+		old = ui->ui_stable;
+		if ( old >= cur )
+			break;
+	} while ( !__sync_bool_compare_and_swap( &ui->ui_stable, old, cur ));
+}
+
+static int
+usn_op_cleanup( Operation *op, SlapReply *rs )
+{
+	slap_callback *sc = op->o_callback;
+	usn_info_t *ui = sc->sc_private;
+	usn_pending *up = (usn_pending *)(sc+1);
+
+	/* USNs are queued in the order they are handed out, so when the
+	 * oldest one finishes everything below the next is committed.
+	 */
+	ldap_pvt_thread_mutex_lock( &ui->ui_mutex );
+	if ( up->up_next )
+		up->up_next->up_prev = up->up_prev;
+	else
+		ui->ui_tail = up->up_prev;
+	if ( up->up_prev ) {
+		up->up_prev->up_next = up->up_next;
+	} else {
+		ui->ui_head = up->up_next;
+		usn_stable_advance( ui, ui->ui_head ?
+			ui->ui_head->up_usn - 1 : usn_get( ui ));
+	}
+	ldap_pvt_thread_mutex_unlock( &ui->ui_mutex );
+
+	op->o_callback = sc->sc_next;
+	op->o_tmpfree( sc, op->o_tmpmemctx );
+	return 0;
+}
+
 static int
 usn_func( Operation *op, SlapReply *rs )
 {
 	slap_overinst		*on = (slap_overinst *) op->o_bd->bd_info;
 	usn_info_t		*ui = on->on_bi.bi_private;
-	int my_usn;
-	char intbuf[64];
+	slap_callback	*sc;
+	usn_pending *up;
+	usn_t my_usn;
+	char intbuf[USN_BUFSIZE];
 	struct berval bv[2];
 
+	sc = op->o_tmpcalloc( 1, sizeof(slap_callback) + sizeof(usn_pending),
+		op->o_tmpmemctx );
+	up = (usn_pending *)(sc+1);
+
+	/* Allocate and queue together, so the list stays in USN order */
 	ldap_pvt_thread_mutex_lock( &ui->ui_mutex );
-	ui->ui_current++;
-	my_usn = ui->ui_current;
+	my_usn = usn_next( ui );
+	up->up_usn = my_usn;
+	up->up_prev = ui->ui_tail;
+	if ( ui->ui_tail )
+		ui->ui_tail->up_next = up;
+	else
+		ui->ui_head = up;
+	ui->ui_tail = up;
 	ldap_pvt_thread_mutex_unlock( &ui->ui_mutex );
 
+	sc->sc_cleanup = usn_op_cleanup;
+	sc->sc_private = ui;
+	sc->sc_next = op->o_callback;
+	op->o_callback = sc;
+
 	BER_BVZERO(&bv[1]);
 	bv[0].bv_val = intbuf;
-	bv[0].bv_len = snprintf( intbuf, sizeof(intbuf), "%d", my_usn );
+	bv[0].bv_len = usn_format( intbuf, my_usn );
 	switch(op->o_tag) {
 	case LDAP_REQ_ADD:
 		attr_merge( op->ora_e, ad_usnCreated, bv, NULL );
@@ -117,9 +276,8 @@ usn_operational(
 		if ( SLAP_OPATTRS( rs->sr_attr_flags ) ||
 			ad_inlist( ad_usnChanged, rs->sr_attrs )) {
 			Attribute *a, **ap = NULL;
-			char intbuf[64];
+			char intbuf[USN_BUFSIZE];
 			struct berval bv;
-			int my_usn;
 
 			for ( a=rs->sr_entry->e_attrs; a; a=a->a_next ) {
 				if ( a->a_desc == ad_usnChanged )
@@ -143,10 +301,7 @@ usn_operational(
 				a->a_vals = NULL;
 				a->a_numvals = 0;
 			}
-			ldap_pvt_thread_mutex_lock( &ui->ui_mutex );
-			my_usn = ui->ui_current;
-			ldap_pvt_thread_mutex_unlock( &ui->ui_mutex );
-			bv.bv_len = snprintf( intbuf, sizeof(intbuf), "%d", my_usn );
+			bv.bv_len = usn_format( intbuf, usn_get( ui ));
 			bv.bv_val = intbuf;
 			attr_valadd( a, &bv, NULL, 1 );
 		}
@@ -154,6 +309,469 @@ usn_operational(
 	return SLAP_CB_CONTINUE;
 }
 
+static int
+usn_dirsync_parseCtrl(
+	Operation *op,
+	SlapReply *rs,
+	LDAPControl *ctrl )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	struct berval cookie = BER_BVNULL;
+	ber_int_t flags, maxbytes;
+	dirsync_ctrl *dc;
+	usn_t usn = 0;
+
+	if ( op->o_dirsync != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "DirSync control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( BER_BVISNULL( &ctrl->ldctl_value ) ||
+		BER_BVISEMPTY( &ctrl->ldctl_value )) {
+		rs->sr_text = "DirSync control value is absent";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	/* DirSyncRequestValue ::= SEQUENCE {
+	 *	Flags		INTEGER,
+	 *	MaxBytes	INTEGER,
+	 *	Cookie		OCTET STRING }
+	 */
+	ber_init2( ber, &ctrl->ldctl_value, 0 );
+	if ( ber_scanf( ber, "{iim}", &flags, &maxbytes, &cookie ) == LBER_ERROR ) {
+		rs->sr_text = "DirSync control value is invalid";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	/* Our cookies are just the decimal USN to resume after */
+	if ( !BER_BVISEMPTY( &cookie )) {
+		char buf[USN_BUFSIZE];
+
+		if ( cookie.bv_len >= sizeof( buf )) {
+			rs->sr_text = "DirSync cookie is invalid";
+			return LDAP_PROTOCOL_ERROR;
+		}
+		AC_MEMCPY( buf, cookie.bv_val, cookie.bv_len );
+		buf[cookie.bv_len] = '\0';
+		if ( lutil_atoull( &usn, buf ) != 0 ) {
+			rs->sr_text = "DirSync cookie is invalid";
+			return LDAP_PROTOCOL_ERROR;
+		}
+	}
+
+	dc = op->o_tmpalloc( sizeof( dirsync_ctrl ), op->o_tmpmemctx );
+	dc->dc_flags = flags;
+	dc->dc_maxbytes = maxbytes;
+	dc->dc_cookie = usn;
+
+	op->o_ctrl_dirsync = dc;
+	op->o_dirsync = ctrl->ldctl_iscritical ?
+		SLAP_CONTROL_CRITICAL : SLAP_CONTROL_NONCRITICAL;
+
+	return LDAP_SUCCESS;
+}
+
+static int
+usn_dirsync_cmp( const void *v1, const void *v2 )
+{
+	const dirsync_node *n1 = v1, *n2 = v2;
+
+	if ( n1->dn_usn < n2->dn_usn )
+		return -1;
+	return n1->dn_usn > n2->dn_usn;
+}
+
+static int
+usn_dirsync_pack(
+	Operation *op,
+	SlapReply *rs,
+	int more,
+	usn_t cookie,
+	LDAPControl **ctrlp )
+{
+	LDAPControl *ctrl;
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	char intbuf[USN_BUFSIZE];
+	struct berval bv, cbv;
+	int rc;
+
+	cbv.bv_val = intbuf;
+	cbv.bv_len = usn_format( intbuf, cookie );
+
+	ber_init2( ber, NULL, LBER_USE_DER );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+
+	/* DirSyncResponseValue ::= SEQUENCE {
+	 *	MoreResults	INTEGER,
+	 *	unused		INTEGER,
+	 *	CookieServer	OCTET STRING }
+	 */
+	rc = ber_printf( ber, "{iiO}", more, 0, &cbv );
+	if ( rc != -1 )
+		rc = ber_flatten2( ber, &bv, 0 );
+
+	if ( rc != -1 ) {
+		ctrl = op->o_tmpalloc( sizeof( LDAPControl ) + bv.bv_len,
+			op->o_tmpmemctx );
+		ctrl->ldctl_oid = LDAP_CONTROL_X_DIRSYNC;
+		ctrl->ldctl_iscritical = 0;
+		ctrl->ldctl_value.bv_val = (char *)(ctrl+1);
+		ctrl->ldctl_value.bv_len = bv.bv_len;
+		AC_MEMCPY( ctrl->ldctl_value.bv_val, bv.bv_val, bv.bv_len );
+		*ctrlp = ctrl;
+		rc = LDAP_SUCCESS;
+	} else {
+		*ctrlp = NULL;
+		rc = LDAP_OTHER;
+	}
+
+	ber_free_buf( ber );
+	return rc;
+}
+
+/* Send the collected entries in USN order, up to MaxBytes worth,
+ * and return the USN the client should resume after.
+ */
+static usn_t
+usn_dirsync_send(
+	Operation *op,
+	SlapReply *rs,
+	dirsync_state *ds,
+	int *more )
+{
+	dirsync_ctrl *dc = op->o_ctrl_dirsync;
+	BackendDB *be = op->o_bd;
+	usn_t cookie = dc->dc_cookie;
+	ber_len_t total = 0;
+	int i;
+
+	*more = ds->ds_more;
+	if ( !ds->ds_num )
+		return cookie;
+
+	qsort( ds->ds_nodes, ds->ds_num, sizeof( dirsync_node ),
+		usn_dirsync_cmp );
+
+	rs->sr_attrs = op->ors_attrs;
+	for ( i = 0; i < ds->ds_num; i++ ) {
+		dirsync_node *dn = &ds->ds_nodes[i];
+		Entry *e = NULL;
+		int rc;
+
+		if ( dc->dc_maxbytes > 0 && total >= (ber_len_t)dc->dc_maxbytes ) {
+			*more = 1;
+			break;
+		}
+		if ( slapd_shutdown ) {
+			*more = 1;
+			break;
+		}
+
+		op->o_bd = select_backend( &dn->dn_ndn, 0 );
+		rc = be_entry_get_rw( op, &dn->dn_ndn, NULL, NULL, 0, &e );
+		if ( e && rc == LDAP_SUCCESS ) {
+			ber_len_t len;
+			int nattrs, nvals;
+
+			entry_partsize( e, &len, &nattrs, &nvals, 0 );
+			total += len;
+
+			rs->sr_entry = e;
+			rs->sr_flags = REP_ENTRY_MUSTRELEASE;
+			rs->sr_err = send_search_entry( op, rs );
+			/* An entry the client may not read is skipped for good,
+			 * anything else not sent (sizelimit, pause) must come
+			 * again with the next poll.
+			 */
+			if ( rs->sr_err != LDAP_SUCCESS &&
+				rs->sr_err != LDAP_INSUFFICIENT_ACCESS ) {
+				op->o_bd = be;
+				*more = 1;
+				break;
+			}
+		}
+		op->o_bd = be;
+		cookie = dn->dn_usn;
+	}
+	rs->sr_entry = NULL;
+
+	return cookie;
+}
+
+static void
+usn_dirsync_free( dirsync_state *ds )
+{
+	int i;
+
+	for ( i = 0; i < ds->ds_num; i++ )
+		ch_free( ds->ds_nodes[i].dn_ndn.bv_val );
+	ch_free( ds->ds_nodes );
+	ds->ds_nodes = NULL;
+	ds->ds_num = ds->ds_max = 0;
+	ds->ds_bytes = 0;
+}
+
+static void
+usn_dirsync_siftup( dirsync_node *h, int i )
+{
+	dirsync_node tmp = h[i];
+
+	while ( i > 0 ) {
+		int p = ( i - 1 ) / 2;
+		if ( h[p].dn_usn >= tmp.dn_usn )
+			break;
+		h[i] = h[p];
+		i = p;
+	}
+	h[i] = tmp;
+}
+
+static void
+usn_dirsync_siftdown( dirsync_node *h, int n, int i )
+{
+	dirsync_node tmp = h[i];
+
+	for (;;) {
+		int c = 2 * i + 1;
+		if ( c >= n )
+			break;
+		if ( c + 1 < n && h[c+1].dn_usn > h[c].dn_usn )
+			c++;
+		if ( tmp.dn_usn >= h[c].dn_usn )
+			break;
+		h[i] = h[c];
+		i = c;
+	}
+	h[i] = tmp;
+}
+
+/* Drop the highest USN collected, it will not fit in this reply */
+static void
+usn_dirsync_drop( dirsync_state *ds )
+{
+	ds->ds_bytes -= ds->ds_nodes[0].dn_size;
+	ch_free( ds->ds_nodes[0].dn_ndn.bv_val );
+	if ( --ds->ds_num ) {
+		ds->ds_nodes[0] = ds->ds_nodes[ds->ds_num];
+		usn_dirsync_siftdown( ds->ds_nodes, ds->ds_num, 0 );
+	}
+	ds->ds_more = 1;
+}
+
+static int
+usn_dirsync_response( Operation *op, SlapReply *rs )
+{
+	dirsync_state *ds = op->o_callback->sc_private;
+
+	if ( rs->sr_type == REP_SEARCH ) {
+		dirsync_ctrl *dc = op->o_ctrl_dirsync;
+		Attribute *a;
+		dirsync_node *dn;
+		usn_t usn = 0;
+		ber_len_t len;
+		int nattrs, nvals;
+
+		a = attr_find( rs->sr_entry->e_attrs, ad_usnChanged );
+		if ( a )
+			lutil_atoull( &usn, a->a_nvals[0].bv_val );
+
+		/* Never hand out a cookie past a USN whose write may not
+		 * be visible yet, or the client would skip it forever.
+		 */
+		if ( usn > ds->ds_stable ) {
+			ds->ds_more = 1;
+			return LDAP_SUCCESS;
+		}
+		if ( ds->ds_limit >= 0 && ds->ds_num >= ds->ds_limit &&
+			( !ds->ds_num || usn >= ds->ds_nodes[0].dn_usn )) {
+			ds->ds_more = 1;
+			return LDAP_SUCCESS;
+		}
+
+		if ( ds->ds_num == ds->ds_max ) {
+			ds->ds_max = ds->ds_max ? ds->ds_max * 2 : 64;
+			ds->ds_nodes = ch_realloc( ds->ds_nodes,
+				ds->ds_max * sizeof( dirsync_node ));
+		}
+		entry_partsize( rs->sr_entry, &len, &nattrs, &nvals, 0 );
+		dn = &ds->ds_nodes[ds->ds_num];
+		dn->dn_usn = usn;
+		dn->dn_size = len;
+		ber_dupbv( &dn->dn_ndn, &rs->sr_entry->e_nname );
+		usn_dirsync_siftup( ds->ds_nodes, ds->ds_num++ );
+		ds->ds_bytes += len;
+
+		/* The send stops once MaxBytes is reached, so the top entry
+		 * is never sent if the others already make up that much.
+		 */
+		while (( ds->ds_limit >= 0 && ds->ds_num > ds->ds_limit ) ||
+			( dc->dc_maxbytes > 0 && ds->ds_bytes - ds->ds_nodes[0].dn_size >=
+				(ber_len_t)dc->dc_maxbytes ))
+			usn_dirsync_drop( ds );
+
+		/* Held back until they can be sent in USN order */
+		return LDAP_SUCCESS;
+
+	} else if ( rs->sr_type == REP_RESULT ) {
+		LDAPControl *ctrls[2];
+		usn_t cookie;
+		int more;
+
+		/* Don't see the entries we are about to send again */
+		if ( op->o_callback->sc_response == usn_dirsync_response )
+			op->o_callback = op->o_callback->sc_next;
+
+		if ( rs->sr_err != LDAP_SUCCESS ) {
+			usn_dirsync_free( ds );
+			return SLAP_CB_CONTINUE;
+		}
+
+		cookie = usn_dirsync_send( op, rs, ds, &more );
+		usn_dirsync_free( ds );
+		if ( rs->sr_err == LDAP_UNAVAILABLE )
+			return rs->sr_err;
+
+		rs->sr_err = LDAP_SUCCESS;
+		if ( usn_dirsync_pack( op, rs, more, cookie, ctrls ) == LDAP_SUCCESS ) {
+			ctrls[1] = NULL;
+			slap_add_ctrls( op, rs, ctrls );
+		}
+		send_ldap_result( op, rs );
+		return rs->sr_err;
+	}
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+usn_op_search( Operation *op, SlapReply *rs )
+{
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	usn_info_t *ui = on->on_bi.bi_private;
+	dirsync_ctrl *dc;
+	dirsync_state *ds;
+	slap_callback *cb;
+
+	if ( op->o_dirsync <= SLAP_CONTROL_IGNORED )
+		return SLAP_CB_CONTINUE;
+
+	dc = op->o_ctrl_dirsync;
+
+	/* Resuming: (&(uSNChanged>=<cookie+1>)<filter>) */
+	if ( dc->dc_cookie ) {
+		AttributeAssertion *ava;
+		Filter *fand, *fge;
+		char intbuf[USN_BUFSIZE];
+		struct berval bv;
+
+		ava = op->o_tmpcalloc( 1, sizeof( AttributeAssertion ),
+			op->o_tmpmemctx );
+		ava->aa_desc = ad_usnChanged;
+		bv.bv_val = intbuf;
+		bv.bv_len = usn_format( intbuf, dc->dc_cookie + 1 );
+		ber_dupbv_x( &ava->aa_value, &bv, op->o_tmpmemctx );
+
+		fge = op->o_tmpalloc( sizeof( Filter ), op->o_tmpmemctx );
+		fge->f_choice = LDAP_FILTER_GE;
+		fge->f_ava = ava;
+		fge->f_next = op->ors_filter;
+
+		fand = op->o_tmpalloc( sizeof( Filter ), op->o_tmpmemctx );
+		fand->f_choice = LDAP_FILTER_AND;
+		fand->f_and = fge;
+		fand->f_next = NULL;
+
+		/* The frontend frees the whole tree when the op is done */
+		op->ors_filter = fand;
+		op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
+		filter2bv_x( op, op->ors_filter, &op->ors_filterstr );
+	}
+
+	cb = op->o_tmpcalloc( 1, sizeof( slap_callback ) + sizeof( dirsync_state ),
+		op->o_tmpmemctx );
+	ds = (dirsync_state *)(cb+1);
+
+	/* Taken before the backend opens its read txn: every USN up to
+	 * here that the search can't see never will be.
+	 */
+	ds->ds_stable = __sync_add_and_fetch( &ui->ui_stable, 0 );
+	ds->ds_limit = op->ors_slimit;
+
+	cb->sc_response = usn_dirsync_response;
+	cb->sc_private = ds;
+	cb->sc_next = op->o_callback;
+	op->o_callback = cb;
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+usn_findmax_cb( Operation *op, SlapReply *rs )
+{
+	if ( rs->sr_type == REP_SEARCH ) {
+		usn_t *max = op->o_callback->sc_private, usn;
+		Attribute *a = attr_find( rs->sr_entry->e_attrs, ad_usnChanged );
+
+		if ( a && !lutil_atoull( &usn, a->a_nvals[0].bv_val ) &&
+			usn > *max )
+			*max = usn;
+	}
+	return LDAP_SUCCESS;
+}
+
+/* Find the highest uSNChanged above the saved counter, in case we
+ * weren't shut down cleanly. With an index on uSNChanged this only
+ * touches the entries written since the last checkpoint.
+ */
+static void
+usn_findmax( Operation *op, slap_overinst *on, usn_t *max )
+{
+	slap_callback cb = {0};
+	Operation fop;
+	SlapReply frs = { REP_RESULT };
+	AttributeAssertion ava = ATTRIBUTEASSERTION_INIT;
+	AttributeName an[2];
+	Filter f;
+	char intbuf[USN_BUFSIZE];
+	char fbuf[USN_BUFSIZE + STRLENOF("(uSNChanged>=)")];
+
+	fop = *op;
+	fop.o_tag = LDAP_REQ_SEARCH;
+	fop.o_managedsait = SLAP_CONTROL_CRITICAL;
+	fop.o_req_dn = op->o_bd->be_suffix[0];
+	fop.o_req_ndn = op->o_bd->be_nsuffix[0];
+	fop.ors_scope = LDAP_SCOPE_SUBTREE;
+	fop.ors_deref = LDAP_DEREF_NEVER;
+	fop.ors_limit = NULL;
+	fop.ors_slimit = SLAP_NO_LIMIT;
+	fop.ors_tlimit = SLAP_NO_LIMIT;
+	fop.ors_attrsonly = 0;
+
+	memset( an, 0, sizeof( an ));
+	an[0].an_desc = ad_usnChanged;
+	an[0].an_name = ad_usnChanged->ad_cname;
+	fop.ors_attrs = an;
+
+	ava.aa_desc = ad_usnChanged;
+	ava.aa_value.bv_val = intbuf;
+	ava.aa_value.bv_len = usn_format( intbuf, *max + 1 );
+	f.f_choice = LDAP_FILTER_GE;
+	f.f_ava = &ava;
+	f.f_next = NULL;
+	fop.ors_filter = &f;
+	fop.ors_filterstr.bv_val = fbuf;
+	fop.ors_filterstr.bv_len = sprintf( fbuf, "(uSNChanged>=%s)", intbuf );
+
+	cb.sc_response = usn_findmax_cb;
+	cb.sc_private = max;
+	fop.o_callback = &cb;
+
+	fop.o_bd->bd_info = (BackendInfo *)on->on_info;
+	fop.o_bd->be_search( &fop, &frs );
+	fop.o_bd->bd_info = (BackendInfo *)on;
+}
+
 /* Read the old USN from the underlying DB. This code is
  * stolen from the syncprov overlay.
  */
@@ -186,10 +804,13 @@ usn_db_open(
 	if ( e ) {
 		a = attr_find( e->e_attrs, ad_usnChanged );
 		if ( a ) {
-			ui->ui_current = atoi( a->a_vals[0].bv_val );
+			lutil_atoull( &ui->ui_current, a->a_nvals[0].bv_val );
 		}
 		overlay_entry_release_ov( op, e, 0, on );
 	}
+
+	usn_findmax( op, on, &ui->ui_current );
+	ui->ui_stable = ui->ui_current;
 	return 0;
 }
 
@@ -231,7 +852,7 @@ usn_db_close(
 
 	Modifications mod;
 	slap_callback cb = {0};
-	char intbuf[64];
+	char intbuf[USN_BUFSIZE];
 	struct berval bv[2];
 
 	thrctx = ldap_pvt_thread_pool_context();
@@ -239,7 +860,7 @@ usn_db_close(
 	op = &opbuf.ob_op;
 	op->o_bd = be;
 	BER_BVZERO( &bv[1] );
-	bv[0].bv_len = snprintf( intbuf, sizeof(intbuf), "%d", ui->ui_current );
+	bv[0].bv_len = usn_format( intbuf, usn_get( ui ));
 	bv[0].bv_val = intbuf;
 	mod.sml_numvals = 1;
 	mod.sml_values = bv;
@@ -293,6 +914,7 @@ static slap_overinst usn;
 int
 usn_init( void )
 {
+	char *syntax = USN_SYNTAX, buf[ 512 ];
 	int i, code;
 
 	memset( &usn, 0, sizeof( slap_overinst ) );
@@ -306,10 +928,28 @@ usn_init( void )
 	usn.on_bi.bi_op_modrdn = usn_func;
 	usn.on_bi.bi_op_add = usn_func;
 	usn.on_bi.bi_op_delete = usn_func;
+	usn.on_bi.bi_op_search = usn_op_search;
 	usn.on_bi.bi_operational = usn_operational;
 
+	code = register_supported_control( LDAP_CONTROL_X_DIRSYNC,
+		SLAP_CTRL_SEARCH, NULL,
+		usn_dirsync_parseCtrl, &usn_dirsync_cid );
+	if ( code != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY,
+			"usn_init: Failed to register DirSync control (%d)\n",
+			code, 0, 0 );
+		return code;
+	}
+
+	/* without ad_schema, plain Integer orders the same */
+	if ( !syn_find( syntax )) {
+		Debug( LDAP_DEBUG_CONFIG, "usn_init: syntax %s not defined, "
+			"using Integer\n", syntax, 0, 0 );
+		syntax = USN_SYNTAX_INTEGER;
+	}
 	for ( i = 0; as[i].desc; i++ ) {
-		code = register_at( as[i].desc, as[i].adp, 0 );
+		snprintf( buf, sizeof( buf ), as[i].desc, syntax );
+		code = register_at( buf, as[i].adp, 0 );
 		if ( code ) {
 			Debug( LDAP_DEBUG_ANY,
 				"usn_init: register_at #%d failed\n", i, 0, 0 );
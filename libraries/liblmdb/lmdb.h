@@ -721,6 +721,41 @@ int  mdb_env_stat(MDB_env *env, MDB_stat *stat);
 	 */
 int  mdb_env_info(MDB_env *env, MDB_envinfo *stat);
 
+	/** @brief Advise the OS that pages of the map will be read soon.
+	 *
+	 * The OS may then start reading them in the background, so that a
+	 * reader that knows where it is going doesn't wait for each page in
+	 * turn. This does nothing on systems without madvise().
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[in] pgno The first page, e.g. from #mdb_key_page()
+	 * @param[in] npages The number of pages
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - the pages are not in the map.
+	 * </ul>
+	 */
+int  mdb_env_prefetch(MDB_env *env, size_t pgno, size_t npages);
+
+	/** @brief Tell which pages of the map are in memory.
+	 *
+	 * Together with #mdb_env_prefetch() this lets an application note
+	 * which pages it was using before it stops, and read them back in
+	 * when it starts again. On systems without mincore() no page is
+	 * reported as resident.
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[in] pgno The first page
+	 * @param[in] npages The number of pages
+	 * @param[out] vec An array of \b npages bytes, set to 1 for each
+	 * page that is resident and 0 for the others
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - the pages are not in the map.
+	 * </ul>
+	 */
+int  mdb_env_incore(MDB_env *env, size_t pgno, size_t npages, unsigned char *vec);
+
 	/** @brief Flush the data buffers to disk.
 	 *
 	 * Data is always written to disk when #mdb_txn_commit() is called,
@@ -1287,6 +1322,30 @@ int  mdb_set_relctx(MDB_txn *txn, MDB_dbi dbi, void *ctx);
 	 */
 int  mdb_get(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data);
 
+	/** @brief Find the pages that hold a key and its data.
+	 *
+	 * If \b npages is NULL, this returns the leaf page the key is or
+	 * would be on, reading only the branch pages above it, and not the
+	 * leaf itself. Otherwise the leaf is read too, and if the key's data
+	 * is on overflow pages their first page and count are returned. For
+	 * data on the leaf, the leaf and a count of 0 are returned.
+	 * The pages can be passed to #mdb_env_prefetch().
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[in] key The key to look up
+	 * @param[out] pgno The page number
+	 * @param[out] npages The number of overflow pages, or NULL
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>#MDB_NOTFOUND - the database is empty, or \b npages was
+	 *		given and the key is not in it.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_key_page(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, size_t *pgno,
+	size_t *npages);
+
 	/** @brief Store items into a database.
 	 *
 	 * This function stores key/data pairs in the database. The default behavior
@@ -5762,6 +5762,74 @@ mdb_get(MDB_txn *txn, MDB_dbi dbi,
 	return mdb_cursor_set(&mc, key, data, MDB_SET, &exact);
 }
 
+int
+mdb_key_page(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, size_t *pgno,
+    size_t *npages)
+{
+	MDB_cursor	mc;
+	MDB_xcursor	mx;
+	MDB_page	*mp;
+	MDB_node	*node;
+	unsigned int	 i, depth;
+	int rc, exact = 0;
+
+	if (!key || !pgno || !TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+
+	if (txn->mt_flags & MDB_TXN_BLOCKED)
+		return MDB_BAD_TXN;
+
+	mdb_cursor_init(&mc, txn, dbi, &mx);
+	if (npages) {
+		MDB_val data;
+		rc = mdb_cursor_set(&mc, key, &data, MDB_SET, &exact);
+		if (rc)
+			return rc;
+		mp = mc.mc_pg[mc.mc_top];
+		node = NODEPTR(mp, mc.mc_ki[mc.mc_top]);
+		if (F_ISSET(node->mn_flags, F_BIGDATA)) {
+			pgno_t pg;
+			memcpy(&pg, NODEDATA(node), sizeof(pg));
+			*pgno = pg;
+			*npages = OVPAGES(NODEDSZ(node), txn->mt_env->me_psize);
+		} else {
+			*pgno = mp->mp_pgno;
+			*npages = 0;
+		}
+		return MDB_SUCCESS;
+	}
+
+	/* Walk down the branch pages like mdb_page_search_root(), but
+	 * stop at the leaf's page number instead of getting the leaf.
+	 */
+	rc = mdb_page_search(&mc, key, MDB_PS_ROOTONLY);
+	if (rc)
+		return rc;
+	mp = mc.mc_pg[0];
+	for (depth = mc.mc_db->md_depth; depth > 1; depth--) {
+		node = mdb_node_search(&mc, key, &exact);
+		if (node == NULL)
+			i = NUMKEYS(mp) - 1;
+		else {
+			i = mc.mc_ki[mc.mc_top];
+			if (!exact)
+				i--;
+		}
+		node = NODEPTR(mp, i);
+		if (depth == 2) {
+			*pgno = NODEPGNO(node);
+			return MDB_SUCCESS;
+		}
+		if ((rc = mdb_page_get(&mc, NODEPGNO(node), &mp, NULL)) != 0)
+			return rc;
+		mc.mc_ki[mc.mc_top] = i;
+		if ((rc = mdb_cursor_push(&mc, mp)))
+			return rc;
+	}
+	*pgno = mp->mp_pgno;
+	return MDB_SUCCESS;
+}
+
 /** Find a sibling for a page.
  * Replaces the page at the top of the cursor's stack with the
  * specified sibling, if one exists.
@@ -5892,6 +5960,9 @@ skip:
 
 	if (F_ISSET(leaf->mn_flags, F_DUPDATA)) {
 		mdb_xcursor_init1(mc, leaf);
+	} else if (mc->mc_xcursor) {
+		/* don't leave the sub-cursor on the previous node's dups */
+		mc->mc_xcursor->mx_cursor.mc_flags &= ~(C_INITIALIZED|C_EOF);
 	}
 	if (data) {
 		if ((rc = mdb_node_read(mc, leaf, data)) != MDB_SUCCESS)
@@ -5975,6 +6046,9 @@ mdb_cursor_prev(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
 
 	if (F_ISSET(leaf->mn_flags, F_DUPDATA)) {
 		mdb_xcursor_init1(mc, leaf);
+	} else if (mc->mc_xcursor) {
+		/* don't leave the sub-cursor on the previous node's dups */
+		mc->mc_xcursor->mx_cursor.mc_flags &= ~(C_INITIALIZED|C_EOF);
 	}
 	if (data) {
 		if ((rc = mdb_node_read(mc, leaf, data)) != MDB_SUCCESS)
@@ -9667,6 +9741,86 @@ mdb_env_info(MDB_env *env, MDB_envinfo *arg)
 	return MDB_SUCCESS;
 }
 
+/** Most bytes to advise at once. Linux reads ahead at most the
+ *	device's readahead window per call and drops the rest of the range.
+ */
+#define MDB_PREFETCH_MAX	(128*1024)
+
+int
+mdb_env_prefetch(MDB_env *env, size_t pgno, size_t npages)
+{
+	char *ptr, *end;
+	size_t len;
+
+	if (env == NULL || env->me_map == NULL ||
+		pgno + npages > env->me_mapsize / env->me_psize)
+		return EINVAL;
+
+	ptr = env->me_map + pgno * env->me_psize;
+	end = ptr + npages * env->me_psize;
+	for (; ptr < end; ptr += len) {
+		len = end - ptr;
+		if (len > MDB_PREFETCH_MAX)
+			len = MDB_PREFETCH_MAX;
+#ifdef MADV_WILLNEED
+		if (madvise(ptr, len, MADV_WILLNEED))
+			return ErrCode();
+#else
+#ifdef POSIX_MADV_WILLNEED
+		{
+			int rc = posix_madvise(ptr, len, POSIX_MADV_WILLNEED);
+			if (rc)
+				return rc;
+		}
+#else
+		break;
+#endif /* POSIX_MADV_WILLNEED */
+#endif /* MADV_WILLNEED */
+	}
+	return MDB_SUCCESS;
+}
+
+int
+mdb_env_incore(MDB_env *env, size_t pgno, size_t npages, unsigned char *vec)
+{
+#ifdef _WIN32
+	if (env == NULL || env->me_map == NULL || vec == NULL ||
+		pgno + npages > env->me_mapsize / env->me_psize)
+		return EINVAL;
+	memset(vec, 0, npages);
+#else
+	unsigned char buf[4096];
+	char *p, *q, *end;
+	size_t i, len, ospsize;
+
+	if (env == NULL || env->me_map == NULL || vec == NULL ||
+		pgno + npages > env->me_mapsize / env->me_psize)
+		return EINVAL;
+
+	/* mincore() works in OS pages, which needn't be our page size.
+	 * A page counts as resident if its first OS page is.
+	 */
+	ospsize = env->me_os_psize;
+	end = env->me_map + (pgno + npages) * env->me_psize;
+	for (i = 0; i < npages; ) {
+		q = env->me_map + (pgno + i) * env->me_psize;
+		p = env->me_map + ((q - env->me_map) & ~(ospsize - 1));
+		len = sizeof(buf) * ospsize;
+		if (len > (size_t)(end - p))
+			len = end - p;
+		if (mincore((void *)p, len, (void *)buf))
+			return ErrCode();
+		for (; i < npages; i++) {
+			q = env->me_map + (pgno + i) * env->me_psize;
+			if (q >= p + len)
+				break;
+			vec[i] = buf[(q - p) / ospsize] & 1;
+		}
+	}
+#endif
+	return MDB_SUCCESS;
+}
+
 /** Set the default comparison functions for a database.
  * Called immediately after a database is opened to set the defaults.
  * The user can then override them with #mdb_set_compare() or
@@ -0,0 +1,332 @@
+/* mdb_warm.c - memory-mapped database cache warm-up tool */
+/*
+ * Copyright 2018 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "lmdb.h"
+
+#ifdef	_WIN32
+#define	Z	"I"
+#else
+#define	Z	"z"
+#endif
+
+#define	CHUNK	65536
+
+static char *prog;
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: %s [-V] [-n] [-v] [-o file] [-i file] [-a|-s subdb ...] dbpath\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+/* Write the runs of pages that are in memory, one "pgno count" per line */
+static int save_pages(MDB_env *env, FILE *fp, size_t *count)
+{
+	MDB_envinfo mei;
+	unsigned char *vec;
+	size_t pgno, npages, i, start = 0, run = 0;
+	int rc = 0;
+
+	*count = 0;
+	vec = malloc(CHUNK);
+	if (!vec)
+		return ENOMEM;
+	mdb_env_info(env, &mei);
+	for (pgno = 0; pgno <= mei.me_last_pgno; pgno += npages) {
+		npages = mei.me_last_pgno + 1 - pgno;
+		if (npages > CHUNK)
+			npages = CHUNK;
+		rc = mdb_env_incore(env, pgno, npages, vec);
+		if (rc)
+			break;
+		for (i = 0; i < npages; i++) {
+			if (vec[i]) {
+				if (!run++)
+					start = pgno + i;
+			} else if (run) {
+				fprintf(fp, "%"Z"u %"Z"u\n", start, run);
+				*count += run;
+				run = 0;
+			}
+		}
+	}
+	if (run) {
+		fprintf(fp, "%"Z"u %"Z"u\n", start, run);
+		*count += run;
+	}
+	free(vec);
+	return rc;
+}
+
+/* Ask for the pages listed by save_pages(). The OS reads them in
+ * the background, many at a time; pages no longer in the map are
+ * skipped.
+ */
+static void load_pages(MDB_env *env, FILE *fp, size_t *count)
+{
+	char buf[64];
+	size_t pgno, npages;
+
+	*count = 0;
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (sscanf(buf, "%"Z"u %"Z"u", &pgno, &npages) != 2)
+			continue;
+		if (!mdb_env_prefetch(env, pgno, npages))
+			*count += npages;
+	}
+}
+
+/* Read through a DB in key order. The cursor brings in the branch
+ * and leaf pages, values on overflow pages are touched page by page.
+ */
+static int read_db(MDB_txn *txn, MDB_dbi dbi, unsigned int psize, size_t *count)
+{
+	MDB_cursor *mc;
+	MDB_val key, data;
+	char *ptr, *end;
+	int rc;
+
+	*count = 0;
+	rc = mdb_cursor_open(txn, dbi, &mc);
+	if (rc)
+		return rc;
+	while ((rc = mdb_cursor_get(mc, &key, &data, MDB_NEXT)) == 0) {
+		(*count)++;
+		if (data.mv_size <= psize)
+			continue;
+		end = (char *)data.mv_data + data.mv_size;
+		for (ptr = data.mv_data; ptr < end; ptr += psize)
+			(void)*(volatile char *)ptr;
+	}
+	mdb_cursor_close(mc);
+	return rc == MDB_NOTFOUND ? MDB_SUCCESS : rc;
+}
+
+static int warm_db(MDB_txn *txn, MDB_dbi dbi, char *name, unsigned int psize,
+	int verbose)
+{
+	size_t count;
+	int rc;
+
+	rc = read_db(txn, dbi, psize, &count);
+	if (rc)
+		fprintf(stderr, "%s: reading %s failed, error %d %s\n",
+			prog, name ? name : "main DB", rc, mdb_strerror(rc));
+	else if (verbose)
+		printf("Read %s: %"Z"u entries\n", name ? name : "main DB", count);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, rc;
+	MDB_env *env;
+	MDB_txn *txn;
+	MDB_dbi dbi;
+	MDB_cursor *cursor;
+	MDB_val key;
+	MDB_stat mst;
+	FILE *fp;
+	char *envname, *outfile = NULL, *infile = NULL;
+	char **subnames = NULL;
+	int nsubs = 0, alldbs = 0, envflags = 0, verbose = 0;
+	size_t count;
+
+	prog = argv[0];
+
+	if (argc < 2) {
+		usage();
+	}
+
+	/* -o: save the pages that are in memory to a file
+	 * -i: read in the pages listed in a file
+	 * -a: read all subDBs
+	 * -s: read the named subDB, may be repeated
+	 * -n: use NOSUBDIR flag on env_open
+	 * -v: print what was done
+	 * -V: print version and exit
+	 * (default) read the main DB
+	 */
+	while ((i = getopt(argc, argv, "Vai:no:s:v")) != EOF) {
+		switch(i) {
+		case 'V':
+			printf("%s\n", MDB_VERSION_STRING);
+			exit(0);
+			break;
+		case 'a':
+			if (subnames)
+				usage();
+			alldbs++;
+			break;
+		case 'i':
+			infile = optarg;
+			break;
+		case 'n':
+			envflags |= MDB_NOSUBDIR;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 's':
+			if (alldbs)
+				usage();
+			subnames = realloc(subnames, (nsubs + 1) * sizeof(char *));
+			if (!subnames) {
+				fprintf(stderr, "%s: out of memory\n", prog);
+				return EXIT_FAILURE;
+			}
+			subnames[nsubs++] = optarg;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind != argc - 1)
+		usage();
+
+	envname = argv[optind];
+	rc = mdb_env_create(&env);
+	if (rc) {
+		fprintf(stderr, "mdb_env_create failed, error %d %s\n", rc, mdb_strerror(rc));
+		return EXIT_FAILURE;
+	}
+
+	if (alldbs || subnames) {
+		mdb_env_set_maxdbs(env, 2);
+	}
+
+	rc = mdb_env_open(env, envname, envflags | MDB_RDONLY, 0664);
+	if (rc) {
+		fprintf(stderr, "mdb_env_open failed, error %d %s\n", rc, mdb_strerror(rc));
+		goto env_close;
+	}
+
+	/* Save first, before reading anything in ourselves */
+	if (outfile) {
+		fp = strcmp(outfile, "-") ? fopen(outfile, "w") : stdout;
+		if (!fp) {
+			rc = errno;
+			fprintf(stderr, "%s: cannot open %s, error %d %s\n",
+				prog, outfile, rc, strerror(rc));
+			goto env_close;
+		}
+		rc = save_pages(env, fp, &count);
+		if (fp != stdout && fclose(fp) && !rc)
+			rc = errno;
+		if (rc) {
+			fprintf(stderr, "%s: saving pages failed, error %d %s\n",
+				prog, rc, mdb_strerror(rc));
+			goto env_close;
+		}
+		if (verbose)
+			fprintf(stderr, "Saved %"Z"u pages\n", count);
+		if (!infile && !alldbs && !subnames)
+			goto env_close;
+	}
+
+	if (infile) {
+		fp = strcmp(infile, "-") ? fopen(infile, "r") : stdin;
+		if (!fp) {
+			rc = errno;
+			fprintf(stderr, "%s: cannot open %s, error %d %s\n",
+				prog, infile, rc, strerror(rc));
+			goto env_close;
+		}
+		load_pages(env, fp, &count);
+		if (fp != stdin)
+			fclose(fp);
+		if (verbose)
+			printf("Requested %"Z"u pages\n", count);
+		if (!alldbs && !subnames)
+			goto env_close;
+	}
+
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc) {
+		fprintf(stderr, "mdb_txn_begin failed, error %d %s\n", rc, mdb_strerror(rc));
+		goto env_close;
+	}
+	(void)mdb_env_stat(env, &mst);
+
+	if (subnames) {
+		for (i = 0; i < nsubs; i++) {
+			rc = mdb_open(txn, subnames[i], 0, &dbi);
+			if (rc) {
+				fprintf(stderr, "mdb_open %s failed, error %d %s\n",
+					subnames[i], rc, mdb_strerror(rc));
+				goto txn_abort;
+			}
+			rc = warm_db(txn, dbi, subnames[i], mst.ms_psize, verbose);
+			mdb_close(env, dbi);
+			if (rc)
+				goto txn_abort;
+		}
+	} else if (alldbs) {
+		rc = mdb_open(txn, NULL, 0, &dbi);
+		if (rc) {
+			fprintf(stderr, "mdb_open failed, error %d %s\n", rc, mdb_strerror(rc));
+			goto txn_abort;
+		}
+		rc = mdb_cursor_open(txn, dbi, &cursor);
+		if (rc) {
+			fprintf(stderr, "mdb_cursor_open failed, error %d %s\n", rc, mdb_strerror(rc));
+			goto txn_abort;
+		}
+		while ((rc = mdb_cursor_get(cursor, &key, NULL, MDB_NEXT_NODUP)) == 0) {
+			char *str;
+			MDB_dbi db2;
+			if (memchr(key.mv_data, '\0', key.mv_size))
+				continue;
+			str = malloc(key.mv_size+1);
+			memcpy(str, key.mv_data, key.mv_size);
+			str[key.mv_size] = '\0';
+			/* not every key of the main DB names a subDB */
+			rc = mdb_open(txn, str, 0, &db2);
+			if (rc == MDB_SUCCESS) {
+				rc = warm_db(txn, db2, str, mst.ms_psize, verbose);
+				mdb_close(env, db2);
+				free(str);
+				if (rc)
+					break;
+			} else {
+				free(str);
+			}
+		}
+		mdb_cursor_close(cursor);
+		if (rc == MDB_NOTFOUND)
+			rc = MDB_SUCCESS;
+	} else {
+		rc = mdb_open(txn, NULL, 0, &dbi);
+		if (rc == MDB_SUCCESS)
+			rc = warm_db(txn, dbi, NULL, mst.ms_psize, verbose);
+		else
+			fprintf(stderr, "mdb_open failed, error %d %s\n", rc, mdb_strerror(rc));
+	}
+
+txn_abort:
+	mdb_txn_abort(txn);
+env_close:
+	mdb_env_close(env);
+	free(subnames);
+
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
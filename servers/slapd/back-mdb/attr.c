@@ -110,7 +110,8 @@ mdb_attr_dbs_open(
 				cr->msg, 0, 0 );
 			return rc;
 		}
-		dbis = ch_calloc( 1, mdb->mi_nattrs * sizeof(MDB_dbi) );
+		dbis = ch_calloc( 1, ( mdb->mi_nattrs + mdb->mi_ncomps ) *
+			sizeof(MDB_dbi) );
 	} else {
 		rc = 0;
 	}
@@ -140,6 +141,25 @@ mdb_attr_dbs_open(
 			dbis[i] = mdb->mi_attrs[i]->ai_dbi;
 	}
 
+	for ( i=0; !rc && i<mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		if ( ci->ci_dbi )	/* already open */
+			continue;
+		rc = mdb_dbi_open( txn, ci->ci_name.bv_val, flags, &ci->ci_dbi );
+		if ( rc ) {
+			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+				"mdb_dbi_open(%s) failed: %s (%d).",
+				be->be_suffix[0].bv_val, ci->ci_name.bv_val,
+				mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_attr_dbs) ": %s\n",
+				cr->msg, 0, 0 );
+			break;
+		}
+		if ( dbis )
+			dbis[mdb->mi_nattrs + i] = ci->ci_dbi;
+	}
+
 	/* Only commit if this is our txn */
 	if ( tx0 == NULL ) {
 		if ( !rc ) {
@@ -163,6 +183,12 @@ mdb_attr_dbs_open(
 					mdb->mi_attrs[i]->ai_indexmask |= MDB_INDEX_DELETING;
 				}
 			}
+			for ( i=0; i<mdb->mi_ncomps; i++ ) {
+				if ( dbis[mdb->mi_nattrs + i] ) {
+					mdb->mi_comps[i]->ci_dbi = 0;
+					mdb->mi_comps[i]->ci_indexmask |= MDB_INDEX_DELETING;
+				}
+			}
 			mdb_attr_flush( mdb );
 		}
 		ch_free( dbis );
@@ -181,7 +207,195 @@ mdb_attr_dbs_close(
 		if ( mdb->mi_attrs[i]->ai_dbi ) {
 			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_attrs[i]->ai_dbi );
 			mdb->mi_attrs[i]->ai_dbi = 0;
+			mdb_bloom_free( mdb->mi_attrs[i]->ai_bloom );
+			mdb->mi_attrs[i]->ai_bloom = NULL;
+		}
+	for ( i=0; i<mdb->mi_ncomps; i++ )
+		if ( mdb->mi_comps[i]->ci_dbi ) {
+			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_comps[i]->ci_dbi );
+			mdb->mi_comps[i]->ci_dbi = 0;
+		}
+}
+
+/* Find a composite index by "attr1+attr2...", the attributes in
+ * any order and by any of their names.
+ */
+CompInfo *
+mdb_comp_find( struct mdb_info *mdb, struct berval *name )
+{
+	AttributeDescription *ads[MDB_COMP_MAX];
+	struct berval bv;
+	const char *text;
+	char *ptr, *end;
+	int i, j, k, n;
+
+	end = name->bv_val + name->bv_len;
+	for ( n = 0, ptr = name->bv_val; ptr < end; n++ ) {
+		if ( n == MDB_COMP_MAX )
+			return NULL;
+		bv.bv_val = ptr;
+		ptr = memchr( bv.bv_val, '+', end - bv.bv_val );
+		if ( !ptr )
+			ptr = end;
+		bv.bv_len = ptr - bv.bv_val;
+		ptr++;
+		ads[n] = NULL;
+		if ( slap_bv2ad( &bv, &ads[n], &text ) != LDAP_SUCCESS )
+			return NULL;
+	}
+
+	for ( i=0; i<mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+
+		if ( ci->ci_nads != n )
+			continue;
+		for ( j = 0; j < n; j++ ) {
+			for ( k = 0; k < n; k++ )
+				if ( ci->ci_ads[k] == ads[j] ) break;
+			if ( k == n )
+				break;
+		}
+		if ( j == n )
+			return ci;
+	}
+	return NULL;
+}
+
+/* Configure a composite index "attr1+attr2..." */
+static int
+mdb_comp_index_config(
+	struct mdb_info	*mdb,
+	const char		*fname,
+	int			lineno,
+	char		*name,
+	slap_mask_t	mask,
+	struct		config_reply_s *c_reply)
+{
+	CompInfo	*ci, *old;
+	char **attrs, *ptr;
+	const char *text;
+	int i, j, rc = LDAP_PARAM_ERROR;
+	ber_len_t len;
+
+	if ( mask != SLAP_INDEX_EQUALITY ) {
+		if ( c_reply ) {
+			snprintf( c_reply->msg, sizeof(c_reply->msg),
+				"composite index \"%s\" must be eq only", name );
+			fprintf( stderr, "%s: line %d: %s\n",
+				fname, lineno, c_reply->msg );
+		}
+		return LDAP_PARAM_ERROR;
+	}
+
+	attrs = ldap_str2charray( name, "+" );
+	for ( i = 0; attrs && attrs[i]; i++ ) ;
+	if ( i < 2 || i > MDB_COMP_MAX ) {
+		if ( c_reply ) {
+			snprintf( c_reply->msg, sizeof(c_reply->msg),
+				"composite index \"%s\" must have 2 to %d attributes",
+				name, MDB_COMP_MAX );
+			fprintf( stderr, "%s: line %d: %s\n",
+				fname, lineno, c_reply->msg );
+		}
+		goto done;
+	}
+
+	ci = ch_calloc( 1, sizeof(CompInfo) );
+	len = 0;
+	for ( i = 0; attrs[i]; i++ ) {
+		AttributeDescription *ad = NULL;
+
+		if ( slap_str2ad( attrs[i], &ad, &text ) != LDAP_SUCCESS ) {
+			if ( c_reply ) {
+				snprintf( c_reply->msg, sizeof(c_reply->msg),
+					"index attribute \"%s\" undefined", attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			goto fail;
+		}
+		for ( j = 0; j < i; j++ ) {
+			if ( ci->ci_ads[j] == ad )
+				break;
+		}
+		if ( j < i || ad == slap_schema.si_ad_entryDN ||
+			slap_ad_is_binary( ad ) || !( ad->ad_type->sat_equality
+				&& ad->ad_type->sat_equality->smr_indexer
+				&& ad->ad_type->sat_equality->smr_filter ) )
+		{
+			if ( c_reply ) {
+				snprintf( c_reply->msg, sizeof(c_reply->msg),
+					"composite index of attribute \"%s\" disallowed",
+					attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			goto fail;
+		}
+		/* Keep the components sorted by name, so a+b and b+a
+		 * are the same index with the same keys */
+		for ( j = i; j > 0 && strcasecmp( ci->ci_ads[j-1]->ad_cname.bv_val,
+				ad->ad_cname.bv_val ) > 0; j-- )
+			ci->ci_ads[j] = ci->ci_ads[j-1];
+		ci->ci_ads[j] = ad;
+		len += ad->ad_cname.bv_len + 1;
+	}
+	ci->ci_nads = i;
+
+	/* The canonical name, also used for the DB */
+	ci->ci_name.bv_len = len - 1;
+	ci->ci_name.bv_val = ptr = ch_malloc( len );
+	for ( i = 0; i < ci->ci_nads; i++ ) {
+		if ( i )
+			*ptr++ = '+';
+		ptr = lutil_strcopy( ptr, ci->ci_ads[i]->ad_cname.bv_val );
+	}
+
+	Debug( LDAP_DEBUG_CONFIG, "index %s 0x%04lx\n",
+		ci->ci_name.bv_val, mask, 0 );
+
+	if ( mdb->mi_flags & MDB_IS_OPEN ) {
+		ci->ci_newmask = mask;
+	} else {
+		ci->ci_indexmask = mask;
+	}
+
+	old = mdb_comp_find( mdb, &ci->ci_name );
+	if ( old ) {
+		if (( mdb->mi_flags & MDB_IS_OPEN ) &&
+			( old->ci_indexmask & MDB_INDEX_DELETING )) {
+			/* Deleted and readded in the same modify, keep it */
+			old->ci_indexmask &= ~MDB_INDEX_DELETING;
+			if ( old->ci_newmask )
+				old->ci_indexmask = old->ci_newmask;
+			old->ci_newmask = 0;
+			mdb_comp_info_free( ci );
+			rc = 0;
+			goto done;
+		}
+		if ( c_reply ) {
+			snprintf( c_reply->msg, sizeof(c_reply->msg),
+				"duplicate index definition for attr \"%s\"",
+				name );
+			fprintf( stderr, "%s: line %d: %s\n",
+				fname, lineno, c_reply->msg );
 		}
+		rc = LDAP_PARAM_ERROR;
+		goto fail;
+	}
+
+	mdb->mi_comps = ch_realloc( mdb->mi_comps, ( mdb->mi_ncomps+1 ) *
+		sizeof( CompInfo * ));
+	mdb->mi_comps[mdb->mi_ncomps++] = ci;
+	rc = 0;
+	goto done;
+
+fail:
+	mdb_comp_info_free( ci );
+done:
+	ldap_charray_free( attrs );
+	return rc;
 }
 
 int
@@ -273,6 +487,13 @@ mdb_attr_index_config(
 			continue;
 		}
 
+		if( strchr( attrs[i], '+' ) != NULL ) {
+			rc = mdb_comp_index_config( mdb, fname, lineno,
+				attrs[i], mask, c_reply );
+			if( rc ) goto done;
+			continue;
+		}
+
 #ifdef LDAP_COMP_MATCH
 		if ( is_component_reference( attrs[i] ) ) {
 			rc = extract_component_reference( attrs[i], &cr );
@@ -372,6 +593,24 @@ fail:
 			goto fail;
 		}
 
+		/* The keys are value prefixes, which only order like the
+		 * values themselves for rules that compare them bytewise.
+		 * Rules with SLAP_MR_ORDERED_INDEX get ordered eq keys.
+		 */
+		if( IS_SLAP_INDEX( mask, SLAP_INDEX_ORDERED ) && !(
+			ad->ad_type->sat_ordering
+				&& ad->ad_type->sat_ordering->smr_match == octetStringOrderingMatch ) )
+		{
+			if (c_reply) {
+				snprintf(c_reply->msg, sizeof(c_reply->msg),
+					"ordered index of attribute \"%s\" disallowed", attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			goto fail;
+		}
+
 		Debug( LDAP_DEBUG_CONFIG, "index %s 0x%04lx\n",
 			ad->ad_cname.bv_val, mask, 0 ); 
 
@@ -384,6 +623,10 @@ fail:
 		a->ai_root = NULL;
 		a->ai_desc = ad;
 		a->ai_dbi = 0;
+		a->ai_bloom = NULL;
+#ifdef MDB_MONITOR_IDX
+		memset( a->ai_stat, 0, sizeof( a->ai_stat ));
+#endif
 
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			a->ai_indexmask = 0;
@@ -435,6 +678,9 @@ fail:
 					if ( b->ai_newmask )
 						b->ai_indexmask = b->ai_newmask;
 					b->ai_newmask = a->ai_newmask;
+					/* keys may have been missed meanwhile */
+					mdb_bloom_free( b->ai_bloom );
+					b->ai_bloom = NULL;
 					ch_free( a );
 					rc = 0;
 					continue;
@@ -495,6 +741,22 @@ mdb_attr_index_unparse( struct mdb_info *mdb, BerVarray *bva )
 	}
 	for ( i=0; i<mdb->mi_nattrs; i++ )
 		mdb_attr_index_unparser( mdb->mi_attrs[i], bva );
+	for ( i=0; i<mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		struct berval bv;
+		char *ptr;
+
+		slap_index2bvlen( ci->ci_indexmask | ci->ci_newmask, &bv );
+		if ( !bv.bv_len )
+			continue;
+		bv.bv_len += ci->ci_name.bv_len + 1;
+		ptr = ch_malloc( bv.bv_len+1 );
+		bv.bv_val = lutil_strcopy( ptr, ci->ci_name.bv_val );
+		*bv.bv_val++ = ' ';
+		slap_index2bv( ci->ci_indexmask | ci->ci_newmask, &bv );
+		bv.bv_val = ptr;
+		ber_bvarray_add( bva, &bv );
+	}
 }
 
 void
@@ -503,9 +765,17 @@ mdb_attr_info_free( AttrInfo *ai )
 #ifdef LDAP_COMP_MATCH
 	free( ai->ai_cr );
 #endif
+	mdb_bloom_free( ai->ai_bloom );
 	free( ai );
 }
 
+void
+mdb_comp_info_free( CompInfo *ci )
+{
+	ch_free( ci->ci_name.bv_val );
+	ch_free( ci );
+}
+
 void
 mdb_attr_index_destroy( struct mdb_info *mdb )
 {
@@ -515,6 +785,11 @@ mdb_attr_index_destroy( struct mdb_info *mdb )
 		mdb_attr_info_free( mdb->mi_attrs[i] );
 
 	free( mdb->mi_attrs );
+
+	for ( i=0; i<mdb->mi_ncomps; i++ )
+		mdb_comp_info_free( mdb->mi_comps[i] );
+
+	free( mdb->mi_comps );
 }
 
 void mdb_attr_index_free( struct mdb_info *mdb, AttributeDescription *ad )
@@ -544,6 +819,16 @@ void mdb_attr_flush( struct mdb_info *mdb )
 			i--;
 		}
 	}
+	for ( i=0; i<mdb->mi_ncomps; i++ ) {
+		if ( mdb->mi_comps[i]->ci_indexmask & MDB_INDEX_DELETING ) {
+			int j;
+			mdb_comp_info_free( mdb->mi_comps[i] );
+			mdb->mi_ncomps--;
+			for (j=i; j<mdb->mi_ncomps; j++)
+				mdb->mi_comps[j] = mdb->mi_comps[j+1];
+			i--;
+		}
+	}
 }
 
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn )
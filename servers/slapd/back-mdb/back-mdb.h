@@ -33,7 +33,8 @@ LDAP_BEGIN_DECL
 #define MDB_DN2ID		1
 #define MDB_ID2ENTRY	2
 #define MDB_ID2VAL		3
-#define MDB_NDB			4
+#define MDB_ID2KIDS		4
+#define MDB_NDB			5
 
 /* The default search IDL stack cache depth */
 #define DEFAULT_SEARCH_STACK_DEPTH	16
@@ -51,6 +52,9 @@ LDAP_BEGIN_DECL
 /* Most users will never see this */
 #define DEFAULT_RTXN_SIZE	10000
 
+/* Entries indexed per write txn when an index is added online */
+#define DEFAULT_INDEX_BATCH	100
+
 #ifdef LDAP_DEVEL
 #define MDB_MONITOR_IDX
 #endif
@@ -78,8 +82,18 @@ struct mdb_info {
 	slap_mask_t	mi_defaultmask;
 	int			mi_nattrs;
 	struct mdb_attrinfo		**mi_attrs;
+	int			mi_ncomps;
+	struct mdb_compinfo		**mi_comps;
 	void		*mi_search_stack;
 	int			mi_search_stack_depth;
+	ldap_pvt_thread_mutex_t	mi_search_mutex;
+	size_t		mi_search_peak;	/* largest per-thread search arena */
+	unsigned	mi_search_threads;	/* partitions for the parallel filter pass */
+	unsigned	mi_prefetch;	/* candidates to read ahead in searches */
+	char		*mi_warmfile;	/* hot pages, saved at close and read in at open */
+	BerVarray	mi_warmup;	/* sub-databases to read through at open */
+	BerVarray	mi_bloom;	/* sub-databases to keep Bloom filters for */
+	struct mdb_bloom	*mi_dn2id_bloom;
 	int			mi_readers;
 
 	uint32_t	mi_rtxn_size;
@@ -89,13 +103,38 @@ struct mdb_info {
 
 	struct re_s		*mi_txn_cp_task;
 	struct re_s		*mi_index_task;
+	unsigned	mi_index_batch;	/* entries per online indexing txn */
+	unsigned	mi_index_rate;	/* online indexing entries per second */
+	int			mi_index_restart;	/* an index was added mid-pass */
+	ID			mi_index_id;	/* next entry to index online */
+	ID			mi_index_last;	/* last entry when the pass began */
+	ID			mi_index_first;	/* mi_index_id when this run began */
+	time_t		mi_index_start;
+
+	unsigned	mi_gc_max;	/* most operations in a group commit */
+	int			mi_gc_running;
+	ldap_pvt_thread_mutex_t	mi_gc_mutex;
+	ldap_pvt_thread_cond_t	mi_gc_cond;	/* operations wait here */
+	int			mi_gc_busy;	/* an operation's txn is open */
+	int			mi_gc_waiting;	/* operations waiting to start */
+	unsigned	mi_gc_ops;	/* operations in the open batch */
+	MDB_txn		*mi_gc_txn;
+	struct mdb_gc_batch	*mi_gc_batch;
+
+	unsigned	mi_ecache_size;	/* configured decoded entry cache slots */
+	unsigned	mi_ecache_slots;	/* slots mi_ecache was allocated with */
+	struct mdb_ecache_slot	*mi_ecache;
 
 	mdb_monitor_t	mi_monitor;
 
 #ifdef MDB_MONITOR_IDX
 	ldap_pvt_thread_mutex_t	mi_idx_mutex;
 	Avlnode		*mi_idx;
+	ldap_pvt_thread_rdwr_t	mi_filterstat_rwlock;
+	Avlnode		*mi_filterstat;
+	int			mi_nfilterstat;
 #endif /* MDB_MONITOR_IDX */
+	int		mi_monitor_stats;	/* collect index and filter statistics */
 
 	int		mi_flags;
 #define	MDB_IS_OPEN		0x01
@@ -103,6 +142,8 @@ struct mdb_info {
 #define	MDB_DEL_INDEX	0x08
 #define	MDB_RE_OPEN		0x10
 #define	MDB_NEED_UPGRADE	0x20
+#define	MDB_KIDS_STAMP	0x40	/* stamp the children index at close */
+#define	MDB_MVAL_ONCE	0x80	/* id2val uses MDB_MVAL_SAME */
 
 	int mi_numads;
 
@@ -113,6 +154,12 @@ struct mdb_info {
 		/* less than this many values in an attr goes
 		 * back into main blob */
 
+	int		mi_idl_exact;
+		/* index keys never degrade into ranges */
+
+	int		mi_mval_same;
+		/* a new id2val stores identical values once */
+
 	MDB_dbi	mi_dbis[MDB_NDB];
 	AttributeDescription *mi_ads[MDB_MAXADS];
 	int mi_adxs[MDB_MAXADS];
@@ -122,6 +169,50 @@ struct mdb_info {
 #define mi_dn2id	mi_dbis[MDB_DN2ID]
 #define mi_ad2id	mi_dbis[MDB_AD2ID]
 #define mi_id2val	mi_dbis[MDB_ID2VAL]
+#define mi_id2kids	mi_dbis[MDB_ID2KIDS]
+
+/* A decoded entry shared by the readers of the entry cache. The
+ * attributes and their values are in the same allocation; each
+ * reader gets its own Entry and Attribute structures pointing to
+ * the values.
+ */
+typedef struct mdb_ecache_val {
+	struct mdb_ecache_slot	*ev_slot;
+	ID			ev_id;
+	int			ev_refs;	/* the slot and each reader */
+	int			ev_nattrs;
+	slap_mask_t	ev_ocflags;
+	Attribute	*ev_attrs;
+} mdb_ecache_val;
+
+typedef struct mdb_ecache_slot {
+	ldap_pvt_thread_mutex_t	es_mutex;
+	mdb_ecache_val	*es_val;
+	size_t		es_txnid;	/* last write to an entry of this slot */
+	unsigned	es_hits;	/* misses it takes to replace es_val */
+} mdb_ecache_slot;
+
+/* Most hits a cached entry can save up against replacement */
+#define	MDB_ECACHE_HITS	16
+
+/* A Bloom filter over the keys of an index, or the RDNs of dn2id, so
+ * that looking up a key that isn't there usually needs no DB access.
+ * Keys are only ever added; deletes leave their bits set, which just
+ * costs a few more false positives. The writer sets bits while
+ * readers test them, so a key's bits are set before it's committed.
+ */
+typedef struct mdb_bloom {
+	unsigned long	*mb_bits;
+	unsigned long	mb_mask;	/* number of bits - 1 */
+	unsigned long	mb_count;	/* keys added */
+	unsigned long	mb_max;	/* keys it was sized for */
+} mdb_bloom;
+
+/* Bits per key the filter is sized for, and probes per key; about
+ * a 1% false positive rate when full.
+ */
+#define	MDB_BLOOM_BITS	10
+#define	MDB_BLOOM_PROBES	7
 
 typedef struct mdb_op_info {
 	OpExtra		moi_oe;
@@ -133,9 +224,28 @@ typedef struct mdb_op_info {
 #define MOI_FREEIT	0x02
 #define MOI_KEEPER	0x04
 
+/* Attributes a partial entry decode must materialize, indexed by
+ * the database's own AttributeDescription numbers (mi_ads); numbers
+ * above am_numads were assigned later and are always decoded. */
+typedef struct mdb_attrmask {
+	int am_numads;
+	unsigned char *am_need;
+} mdb_attrmask;
+
 LDAP_END_DECL
 
 /* for the cache of attribute information (which are indexed, etc.) */
+#ifdef MDB_MONITOR_IDX
+/* Lookup counters of one index type, updated atomically */
+#define	MDB_IDXSTAT_TYPES	5	/* pres, eq, approx, sub, ordered */
+
+typedef struct mdb_idxstat {
+	unsigned long is_lookups;
+	unsigned long is_ids;
+	unsigned long is_ranges;
+} mdb_idxstat;
+#endif /* MDB_MONITOR_IDX */
+
 typedef struct mdb_attrinfo {
 	AttributeDescription *ai_desc; /* attribute description cn;lang-en */
 	slap_mask_t ai_indexmask;	/* how the attr is indexed	*/
@@ -147,8 +257,39 @@ typedef struct mdb_attrinfo {
 	MDB_cursor *ai_cursor;	/* for tools */
 	int ai_idx;	/* position in AI array */
 	MDB_dbi ai_dbi;
+	mdb_bloom *ai_bloom;	/* of the equality keys, if configured */
+#ifdef MDB_MONITOR_IDX
+	mdb_idxstat ai_stat[MDB_IDXSTAT_TYPES];	/* lookups, see monitor.c */
+#endif
 } AttrInfo;
 
+/* A composite equality index over several attributes. Each key is
+ * one eq key of every component concatenated in order, so an AND of
+ * equality filters on all of them is a single key lookup.
+ */
+#define	MDB_COMP_MAX	4
+
+/* Composite keys are zero padded to a multiple of 8 bytes, the key
+ * alignment idl.c and key.c expect of keys longer than 8 bytes.
+ */
+#define	MDB_COMP_PAD(len)	(((len) + 7) & ~(ber_len_t)7)
+
+/* An entry with more key combinations than this is listed under the
+ * overflow key, all zeros, instead. Every lookup also reads that key,
+ * and a real key that happens to be all zeros only adds candidates.
+ */
+#define	MDB_COMP_MAXKEYS	1024
+#define	MDB_COMP_OVERFLOW_LEN	8
+
+typedef struct mdb_compinfo {
+	struct berval ci_name;	/* "objectClass+sAMAccountName", the DB name */
+	int ci_nads;
+	AttributeDescription *ci_ads[MDB_COMP_MAX];
+	slap_mask_t ci_indexmask;
+	slap_mask_t ci_newmask;
+	MDB_dbi ci_dbi;
+} CompInfo;
+
 /* tool threaded indexer state */
 typedef struct mdb_attrixinfo {
 	OpExtra ai_oe;
@@ -161,6 +302,11 @@ typedef struct mdb_attrixinfo {
 #define	MDB_INDEX_DELETING	0x8000U	/* index is being modified */
 #define	MDB_INDEX_UPDATE_OP	0x03	/* performing an index update */
 
+/* Ordered index keys hold this many leading bytes of the normalized
+ * value. No other index key has this size.
+ */
+#define	MDB_ORDERED_KEYLEN	16
+
 /* For slapindex to record which attrs in an entry belong to which
  * index database 
  */
@@ -34,12 +34,17 @@ enum {
 	MDB_CHKPT = 1,
 	MDB_DIRECTORY,
 	MDB_DBNOSYNC,
+	MDB_ECACHE,
 	MDB_ENVFLAGS,
+	MDB_GCOMMIT,
 	MDB_INDEX,
 	MDB_MAXREADERS,
 	MDB_MAXSIZE,
 	MDB_MODE,
 	MDB_SSTACK,
+	MDB_WARMFILE,
+	MDB_WARMUP,
+	MDB_BLOOM,
 };
 
 static ConfigTable mdbcfg[] = {
@@ -56,16 +61,41 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:1.4 NAME 'olcDbNoSync' "
 			"DESC 'Disable synchronous database writes' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "entrycache", "entries", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_ECACHE,
+		mdb_cf_gen, "( OLcfgDbAt:12.13 NAME 'olcDbEntryCache' "
+		"DESC 'Number of decoded entries to keep for read operations' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "envflags", "flags", 2, 0, 0, ARG_MAGIC|MDB_ENVFLAGS,
 		mdb_cf_gen, "( OLcfgDbAt:12.3 NAME 'olcDbEnvFlags' "
 			"DESC 'Database environment flags' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "groupcommit", "ops", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_GCOMMIT,
+		mdb_cf_gen, "( OLcfgDbAt:12.10 NAME 'olcDbGroupCommit' "
+		"DESC 'Most write operations to commit together, 0 to commit each one' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "idlexact", NULL, 1, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_idl_exact),
+		"( OLcfgDbAt:12.8 NAME 'olcDbIdlExact' "
+		"DESC 'Keep large index keys as exact ID lists instead of ranges' "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "index", "attr> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
 		mdb_cf_gen, "( OLcfgDbAt:0.2 NAME 'olcDbIndex' "
 		"DESC 'Attribute index parameters' "
 		"EQUALITY caseIgnoreMatch "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "indexbatch", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_index_batch),
+		"( OLcfgDbAt:12.11 NAME 'olcDbIndexBatch' "
+		"DESC 'Number of entries to index in one write transaction "
+			"when an index is added online' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "indexrate", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_index_rate),
+		"( OLcfgDbAt:12.12 NAME 'olcDbIndexRate' "
+		"DESC 'Most entries per second to index when an index is added "
+			"online, 0 for no limit' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "maxentrysize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_maxentrysize),
 		"( OLcfgDbAt:12.4 NAME 'olcDbMaxEntrySize' "
@@ -83,6 +113,11 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:0.3 NAME 'olcDbMode' "
 		"DESC 'Unix permissions of database files' "
 		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "monitorstats", NULL, 1, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_monitor_stats),
+		"( OLcfgDbAt:12.18 NAME 'olcDbMonitorStats' "
+		"DESC 'Collect index and filter statistics for the monitor entry' "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "multival_hi", "num", 2, 2, 0, ARG_UINT|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_multi_hi),
 		"( OLcfgDbAt:12.6 NAME 'olcDbMultivalHi' "
@@ -93,15 +128,46 @@ static ConfigTable mdbcfg[] = {
 		"( OLcfgDbAt:12.7 NAME 'olcDbMultivalLo' "
 		"DESC 'Threshold for consolidating multivalued attr back into main blob' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "mvalsame", NULL, 1, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_mval_same),
+		"( OLcfgDbAt:12.19 NAME 'olcDbMvalSame' "
+		"DESC 'Store split out values identical to their normalized form once, "
+			"in a newly created database' "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "prefetch", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_prefetch),
+		"( OLcfgDbAt:12.14 NAME 'olcDbPrefetch' "
+		"DESC 'Number of search candidates to read ahead' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "rtxnsize", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_rtxn_size),
 		"( OLcfgDbAt:12.5 NAME 'olcDbRtxnSize' "
 		"DESC 'Number of entries to process in one read transaction' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "searchthreads", "num", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_search_threads),
+		"( OLcfgDbAt:12.9 NAME 'olcDbSearchThreads' "
+		"DESC 'Number of threads to test large candidate lists against the filter' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "searchstack", "depth", 2, 2, 0, ARG_INT|ARG_MAGIC|MDB_SSTACK,
 		mdb_cf_gen, "( OLcfgDbAt:1.9 NAME 'olcDbSearchStack' "
 		"DESC 'Depth of search stack in IDLs' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "warmfile", "file", 2, 2, 0, ARG_STRING|ARG_MAGIC|MDB_WARMFILE,
+		mdb_cf_gen, "( OLcfgDbAt:12.15 NAME 'olcDbWarmFile' "
+		"DESC 'File the pages in memory are saved to at shutdown and "
+			"read back from at startup' "
+		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "warmup", "database", 2, 0, 0, ARG_MAGIC|MDB_WARMUP,
+		mdb_cf_gen, "( OLcfgDbAt:12.16 NAME 'olcDbWarmup' "
+		"DESC 'Databases to read through at startup' "
+		"EQUALITY caseIgnoreMatch "
+		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "bloom", "database", 2, 0, 0, ARG_MAGIC|MDB_BLOOM,
+		mdb_cf_gen, "( OLcfgDbAt:12.17 NAME 'olcDbBloom' "
+		"DESC 'Databases to keep Bloom filters of keys for' "
+		"EQUALITY caseIgnoreMatch "
+		"SYNTAX OMsDirectoryString )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -116,7 +182,9 @@ static ConfigOCs mdbocs[] = {
 		"MAY ( olcDbCheckpoint $ olcDbEnvFlags $ "
 		"olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize $ "
 		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize $ "
-		"olcDbMultivalHi $ olcDbMultivalLo ) )",
+		"olcDbMultivalHi $ olcDbMultivalLo $ olcDbIdlExact $ olcDbSearchThreads $ olcDbGroupCommit $ "
+		"olcDbIndexBatch $ olcDbIndexRate $ olcDbEntryCache $ olcDbPrefetch $ "
+		"olcDbWarmFile $ olcDbWarmup $ olcDbBloom $ olcDbMonitorStats $ olcDbMvalSame ) )",
 		 	Cft_Database, mdbcfg },
 	{ NULL, 0, NULL }
 };
@@ -144,7 +212,155 @@ mdb_checkpoint( void *ctx, void *arg )
 	return NULL;
 }
 
-/* reindex entries on the fly */
+/* The online indexer's progress is kept in ad2id under key 0, which
+ * no AttributeDescription uses: the next entry ID, then a line with
+ * the old and new masks of each index being built.
+ */
+#define	MDB_INDEX_PROGRESS	0
+
+#define	MDB_INDEX_PENDING(mask, newmask) \
+	((newmask) && !((mask) & MDB_INDEX_DELETING))
+
+static int
+mdb_index_progress_put( struct mdb_info *mdb, MDB_txn *txn, ID id )
+{
+	MDB_val key, data;
+	char *buf, *ptr;
+	int i, k = MDB_INDEX_PROGRESS, rc, pending = 0;
+	ber_len_t len;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &k;
+
+	len = LDAP_PVT_INTTYPE_CHARS(unsigned long) + 1;
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[i];
+		if ( MDB_INDEX_PENDING( ai->ai_indexmask, ai->ai_newmask )) {
+			len += ai->ai_desc->ad_cname.bv_len +
+				2 * LDAP_PVT_INTTYPE_CHARS(unsigned long) + 3;
+			pending++;
+		}
+	}
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		if ( MDB_INDEX_PENDING( ci->ci_indexmask, ci->ci_newmask )) {
+			len += ci->ci_name.bv_len +
+				2 * LDAP_PVT_INTTYPE_CHARS(unsigned long) + 3;
+			pending++;
+		}
+	}
+
+	if ( id == NOID || !pending ) {
+		rc = mdb_del( txn, mdb->mi_ad2id, &key, NULL );
+		return rc == MDB_NOTFOUND ? 0 : rc;
+	}
+
+	buf = ch_malloc( len );
+	ptr = buf + sprintf( buf, "%lu\n", (unsigned long)id );
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[i];
+		if ( MDB_INDEX_PENDING( ai->ai_indexmask, ai->ai_newmask ))
+			ptr += sprintf( ptr, "%s %lx %lx\n",
+				ai->ai_desc->ad_cname.bv_val,
+				ai->ai_indexmask, ai->ai_newmask );
+	}
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		if ( MDB_INDEX_PENDING( ci->ci_indexmask, ci->ci_newmask ))
+			ptr += sprintf( ptr, "%s %lx %lx\n",
+				ci->ci_name.bv_val,
+				ci->ci_indexmask, ci->ci_newmask );
+	}
+	data.mv_data = buf;
+	data.mv_size = ptr - buf;
+	rc = mdb_put( txn, mdb->mi_ad2id, &key, &data, 0 );
+	ch_free( buf );
+	return rc;
+}
+
+/* Pick up an online indexing pass that was interrupted. The indexes
+ * it was building are only maintained, not used, until the pass
+ * completes; it starts over if their configuration changed since.
+ * Returns nonzero if there is a pass to run.
+ */
+int
+mdb_online_index_resume( BackendDB *be, MDB_txn *txn )
+{
+	struct mdb_info *mdb = be->be_private;
+	MDB_val key, data;
+	char *buf, *ptr, *next;
+	int k = MDB_INDEX_PROGRESS, rc, pending = 0;
+	ID id;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &k;
+	rc = mdb_get( txn, mdb->mi_ad2id, &key, &data );
+	if ( rc )
+		return 0;
+
+	buf = ch_malloc( data.mv_size + 1 );
+	AC_MEMCPY( buf, data.mv_data, data.mv_size );
+	buf[data.mv_size] = '\0';
+
+	id = strtoul( buf, &ptr, 10 );
+	for ( ; *ptr == '\n'; ptr = next ) {
+		struct berval bv;
+		slap_mask_t old, new, *mask = NULL, *newmask = NULL;
+		char *sp;
+
+		bv.bv_val = ptr + 1;
+		next = strchr( bv.bv_val, '\n' );
+		sp = strchr( bv.bv_val, ' ' );
+		if ( !next || !sp || sp > next )
+			break;
+		bv.bv_len = sp - bv.bv_val;
+		old = strtoul( sp + 1, &sp, 16 );
+		new = strtoul( sp, NULL, 16 );
+
+		if ( memchr( bv.bv_val, '+', bv.bv_len )) {
+			CompInfo *ci = mdb_comp_find( mdb, &bv );
+			if ( ci ) {
+				mask = &ci->ci_indexmask;
+				newmask = &ci->ci_newmask;
+			}
+		} else {
+			AttributeDescription *ad = NULL;
+			const char *text;
+			AttrInfo *ai;
+
+			if ( slap_bv2ad( &bv, &ad, &text ) == LDAP_SUCCESS &&
+				( ai = mdb_attr_mask( mdb, ad )) != NULL ) {
+				mask = &ai->ai_indexmask;
+				newmask = &ai->ai_newmask;
+			}
+		}
+		if ( !mask || !*mask || *newmask )
+			continue;
+
+		if ( *mask != new )
+			id = 1;
+		*newmask = *mask;
+		*mask &= old;
+		pending = 1;
+	}
+	ch_free( buf );
+
+	if ( !pending || !id ) {
+		mdb_index_progress_put( mdb, txn, NOID );
+		return 0;
+	}
+
+	Debug( LDAP_DEBUG_ANY,
+		LDAP_XSTRING(mdb_online_index_resume) ": database %s: "
+		"resuming online indexing at entry %lu\n",
+		be->be_suffix[0].bv_val, (unsigned long)id, 0 );
+	mdb->mi_index_id = id;
+	return 1;
+}
+
+/* reindex entries on the fly, mi_index_batch entries per txn and
+ * at most mi_index_rate entries per second
+ */
 static void *
 mdb_online_index( void *ctx, void *arg )
 {
@@ -161,7 +377,8 @@ mdb_online_index( void *ctx, void *arg )
 	MDB_txn *txn;
 	ID id;
 	Entry *e;
-	int rc, getnext = 1;
+	unsigned n, batch, done = 0;
+	int rc = 0, finished = 0, pause = 0;
 	int i;
 
 	connection_fake_init( &conn, &opbuf, ctx );
@@ -169,13 +386,40 @@ mdb_online_index( void *ctx, void *arg )
 
 	op->o_bd = be;
 
-	id = 1;
+	if ( !mdb->mi_index_id )
+		mdb->mi_index_id = 1;
+	if ( !mdb->mi_index_start ) {
+		mdb->mi_index_start = slap_get_time();
+		mdb->mi_index_first = mdb->mi_index_id;
+	}
+	id = mdb->mi_index_id;
 	key.mv_size = sizeof(ID);
 
 	while ( 1 ) {
 		if ( slapd_shutdown )
 			break;
 
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( mdb->mi_index_restart ) {
+			mdb->mi_index_restart = 0;
+			id = 1;
+			mdb->mi_index_id = id;
+			mdb->mi_index_last = 0;
+			mdb->mi_index_first = id;
+			mdb->mi_index_start = slap_get_time();
+		}
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+		batch = mdb->mi_index_batch ? mdb->mi_index_batch : 1;
+		if ( mdb->mi_index_rate ) {
+			if ( done >= mdb->mi_index_rate ) {
+				pause = 1;
+				break;
+			}
+			if ( batch > mdb->mi_index_rate - done )
+				batch = mdb->mi_index_rate - done;
+		}
+
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
 		if ( rc )
 			break;
@@ -184,69 +428,123 @@ mdb_online_index( void *ctx, void *arg )
 			mdb_txn_abort( txn );
 			break;
 		}
-		if ( getnext ) {
-			getnext = 0;
+		if ( !mdb->mi_index_last &&
+			mdb_cursor_get( curs, &key, &data, MDB_LAST ) == 0 )
+			memcpy( &mdb->mi_index_last, key.mv_data, sizeof( ID ));
+
+		for ( n = 0; n < batch; n++, id++ ) {
 			key.mv_data = &id;
 			rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
-			if ( rc ) {
-				mdb_txn_abort( txn );
-				if ( rc == MDB_NOTFOUND )
-					rc = 0;
+			if ( rc )
 				break;
-			}
 			memcpy( &id, key.mv_data, sizeof( id ));
-		}
 
-		rc = mdb_id2entry( op, curs, id, &e );
+			rc = mdb_id2entry( op, curs, id, &e );
+			if ( rc )
+				break;
+			rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+			mdb_entry_return( op, e );
+			if ( rc )
+				break;
+		}
 		mdb_cursor_close( curs );
-		if ( rc ) {
-			mdb_txn_abort( txn );
-			if ( rc == MDB_NOTFOUND ) {
-				id++;
-				getnext = 1;
-				continue;
-			}
-			break;
+		if ( rc == MDB_NOTFOUND ) {
+			finished = 1;
+			rc = 0;
 		}
-		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
-		mdb_entry_return( op, e );
+		/* the record goes with the last batch, so a restart
+		 * after this commit finds the indexes complete
+		 */
+		if ( rc == 0 )
+			rc = mdb_index_progress_put( mdb, txn, finished ? NOID : id );
 		if ( rc == 0 ) {
 			rc = mdb_txn_commit( txn );
-			txn = NULL;
 		} else {
 			mdb_txn_abort( txn );
-			txn = NULL;
 		}
+		txn = NULL;
 		if ( rc ) {
 			Debug( LDAP_DEBUG_ANY,
 				LDAP_XSTRING(mdb_online_index) ": database %s: "
-				"txn_commit failed: %s (%d)\n",
-				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+				"indexing entry %lu failed: %s\n",
+				be->be_suffix[0].bv_val, (unsigned long)id, mdb_strerror(rc) );
 			break;
 		}
-		id++;
-		getnext = 1;
+		mdb->mi_index_id = id;
+		done += n;
+		if ( finished )
+			break;
 	}
 
-	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
-		if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
-			|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
-		{
-			continue;
+	if ( finished ) {
+		for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+			if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
+				|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
+			{
+				continue;
+			}
+			mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
+			mdb->mi_attrs[ i ]->ai_newmask = 0;
+		}
+		for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+			if ( mdb->mi_comps[ i ]->ci_indexmask & MDB_INDEX_DELETING
+				|| mdb->mi_comps[ i ]->ci_newmask == 0 )
+			{
+				continue;
+			}
+			mdb->mi_comps[ i ]->ci_indexmask = mdb->mi_comps[ i ]->ci_newmask;
+			mdb->mi_comps[ i ]->ci_newmask = 0;
 		}
-		mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
-		mdb->mi_attrs[ i ]->ai_newmask = 0;
 	}
 
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
 	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
-	mdb->mi_index_task = NULL;
-	ldap_pvt_runqueue_remove( &slapd_rq, rtask );
+	if ( pause ) {
+		/* pick up again in the next second */
+		rtask->interval.tv_sec = 1;
+		ldap_pvt_runqueue_resched( &slapd_rq, rtask, 0 );
+	} else {
+		/* when interrupted, the indexes stay unused and the
+		 * pass resumes from mi_index_id when slapd restarts
+		 */
+		mdb->mi_index_task = NULL;
+		ldap_pvt_runqueue_remove( &slapd_rq, rtask );
+		if ( finished ) {
+			mdb->mi_index_id = 0;
+			mdb->mi_index_last = 0;
+			mdb->mi_index_start = 0;
+		}
+	}
 	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	/* the listener still sleeps until the old deadline */
+	if ( pause )
+		slap_wake_listener();
 
 	return NULL;
 }
 
+/* Start the online indexer, or have a running one start over so
+ * that it also builds the index just added.
+ */
+void
+mdb_online_index_start( BackendDB *be )
+{
+	struct mdb_info *mdb = be->be_private;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( mdb->mi_index_task ) {
+		mdb->mi_index_restart = 1;
+	} else {
+		/* Start the task as soon as we finish here. Set a long
+		 * interval (10 hours) so that it only gets scheduled once.
+		 */
+		mdb->mi_index_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
+			mdb_online_index, be,
+			LDAP_XSTRING(mdb_online_index), be->be_suffix[0].bv_val );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
 /* Cleanup loose ends after Modify completes */
 static int
 mdb_cf_cleanup( ConfigArgs *c )
@@ -350,6 +648,14 @@ mdb_cf_gen( ConfigArgs *c )
 			c->value_int = mdb->mi_search_stack_depth;
 			break;
 
+		case MDB_GCOMMIT:
+			c->value_uint = mdb->mi_gc_max;
+			break;
+
+		case MDB_ECACHE:
+			c->value_uint = mdb->mi_ecache_size;
+			break;
+
 		case MDB_MAXREADERS:
 			c->value_int = mdb->mi_readers;
 			break;
@@ -357,6 +663,26 @@ mdb_cf_gen( ConfigArgs *c )
 		case MDB_MAXSIZE:
 			c->value_ulong = mdb->mi_mapsize;
 			break;
+
+		case MDB_WARMFILE:
+			if ( mdb->mi_warmfile ) {
+				c->value_string = ch_strdup( mdb->mi_warmfile );
+			} else {
+				rc = 1;
+			}
+			break;
+
+		case MDB_WARMUP:
+		case MDB_BLOOM: {
+			BerVarray bva = c->type == MDB_WARMUP ?
+				mdb->mi_warmup : mdb->mi_bloom;
+			if ( bva ) {
+				ber_bvarray_dup_x( &c->rvalue_vals, bva, NULL );
+			} else {
+				rc = 1;
+			}
+			}
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -395,11 +721,45 @@ mdb_cf_gen( ConfigArgs *c )
 			c->cleanup = mdb_cf_cleanup;
 			ldap_pvt_thread_pool_purgekey( mdb->mi_dbenv );
 			break;
+		case MDB_GCOMMIT:
+			mdb->mi_gc_max = 0;
+			mdb_gc_stop( mdb );
+			break;
+		case MDB_ECACHE:
+			/* the pool is paused, no reader holds a slot */
+			mdb_ecache_close( mdb );
+			mdb->mi_ecache_size = 0;
+			break;
 		case MDB_DBNOSYNC:
 			mdb_env_set_flags( mdb->mi_dbenv, MDB_NOSYNC, 0 );
 			mdb->mi_dbenv_flags &= ~MDB_NOSYNC;
 			break;
 
+		case MDB_WARMFILE:
+			ch_free( mdb->mi_warmfile );
+			mdb->mi_warmfile = NULL;
+			break;
+
+		case MDB_WARMUP:
+		case MDB_BLOOM: {
+			BerVarray *bvp = c->type == MDB_WARMUP ?
+				&mdb->mi_warmup : &mdb->mi_bloom;
+			if ( c->valx == -1 ) {
+				ber_bvarray_free( *bvp );
+				*bvp = NULL;
+			} else {
+				int i;
+				ch_free( (*bvp)[c->valx].bv_val );
+				for ( i = c->valx; !BER_BVISNULL( &(*bvp)[i] ); i++ )
+					(*bvp)[i] = (*bvp)[i+1];
+				if ( BER_BVISNULL( &(*bvp)[0] )) {
+					ch_free( *bvp );
+					*bvp = NULL;
+				}
+			}
+			}
+			break;
+
 		case MDB_ENVFLAGS:
 			if ( c->valx == -1 ) {
 				int i;
@@ -443,6 +803,9 @@ mdb_cf_gen( ConfigArgs *c )
 				for ( i = 0; i < mdb->mi_nattrs; i++ ) {
 					mdb->mi_attrs[i]->ai_indexmask |= MDB_INDEX_DELETING;
 				}
+				for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+					mdb->mi_comps[i]->ci_indexmask |= MDB_INDEX_DELETING;
+				}
 				mdb->mi_flags |= MDB_DEL_INDEX;
 				c->cleanup = mdb_cf_cleanup;
 
@@ -471,6 +834,21 @@ mdb_cf_gen( ConfigArgs *c )
 						const char *text;
 						AttrInfo *ai;
 
+						if ( strchr( attrs[ i ], '+' ) != NULL ) {
+							CompInfo *ci;
+							struct berval name;
+
+							ber_str2bv( attrs[ i ], 0, 0, &name );
+							ci = mdb_comp_find( mdb, &name );
+							/* if we got here... */
+							assert( ci != NULL );
+
+							ci->ci_indexmask |= MDB_INDEX_DELETING;
+							mdb->mi_flags |= MDB_DEL_INDEX;
+							c->cleanup = mdb_cf_cleanup;
+							continue;
+						}
+
 						slap_str2ad( attrs[ i ], &ad, &text );
 						/* if we got here... */
 						assert( ad != NULL );
@@ -641,6 +1019,27 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_GCOMMIT:
+		/* the pool is paused, so no batch is open */
+		mdb->mi_gc_max = c->value_uint;
+		if ( mdb->mi_flags & MDB_IS_OPEN ) {
+			if ( mdb->mi_gc_max )
+				mdb_gc_start( mdb );
+			else
+				mdb_gc_stop( mdb );
+		}
+		break;
+
+	case MDB_ECACHE:
+		/* the table is rebuilt at the new size, the pool is
+		 * paused so no reader holds a slot.
+		 */
+		mdb_ecache_close( mdb );
+		mdb->mi_ecache_size = c->value_uint;
+		if ( mdb->mi_flags & MDB_IS_OPEN )
+			mdb_ecache_open( mdb );
+		break;
+
 	case MDB_INDEX:
 		rc = mdb_attr_index_config( mdb, c->fname, c->lineno,
 			c->argc - 1, &c->argv[1], &c->reply);
@@ -649,22 +1048,13 @@ mdb_cf_gen( ConfigArgs *c )
 		mdb->mi_flags |= MDB_OPEN_INDEX;
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			c->cleanup = mdb_cf_cleanup;
-			if ( !mdb->mi_index_task ) {
-				/* Start the task as soon as we finish here. Set a long
-				 * interval (10 hours) so that it only gets scheduled once.
-				 */
-				if ( c->be->be_suffix == NULL || BER_BVISNULL( &c->be->be_suffix[0] ) ) {
-					fprintf( stderr, "%s: "
-						"\"index\" must occur after \"suffix\".\n",
-						c->log );
-					return 1;
-				}
-				ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
-				mdb->mi_index_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
-					mdb_online_index, c->be,
-					LDAP_XSTRING(mdb_online_index), c->be->be_suffix[0].bv_val );
-				ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+			if ( c->be->be_suffix == NULL || BER_BVISNULL( &c->be->be_suffix[0] ) ) {
+				fprintf( stderr, "%s: "
+					"\"index\" must occur after \"suffix\".\n",
+					c->log );
+				return 1;
 			}
+			mdb_online_index_start( c->be );
 		}
 		break;
 
@@ -694,6 +1084,33 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_WARMFILE:
+		if ( mdb->mi_warmfile )
+			ch_free( mdb->mi_warmfile );
+		mdb->mi_warmfile = c->value_string;
+		break;
+
+	case MDB_WARMUP:
+	case MDB_BLOOM: {
+		BerVarray *bvp = c->type == MDB_WARMUP ?
+			&mdb->mi_warmup : &mdb->mi_bloom;
+		int i;
+		for ( i = 1; i < c->argc; i++ ) {
+			/* index databases are named by the attribute's
+			 * canonical name, accept any of its names.
+			 */
+			AttributeType *at = at_find( c->argv[i] );
+			struct berval bv;
+
+			if ( at )
+				bv = at->sat_cname;
+			else
+				ber_str2bv( c->argv[i], 0, 0, &bv );
+			value_add_one( bvp, &bv );
+		}
+		}
+		break;
+
 	}
 	return 0;
 }
@@ -77,7 +77,8 @@ mdb_dup_compare(
 
 /* We add two elements to the DN2ID database - a data item under the parent's
  * entryID containing the child's RDN and entryID, and an item under the
- * child's entryID containing the parent's entryID.
+ * child's entryID containing the parent's entryID. The child's entryID
+ * also goes into the ID2KIDS database under the parent's entryID.
  */
 int
 mdb_dn2id_add(
@@ -139,6 +140,8 @@ mdb_dn2id_add(
 
 	/* Add our child node under parent's key */
 	rc = mdb_cursor_put( mcp, &key, &data, MDB_NODUPDATA );
+	if ( rc == 0 && mdb->mi_dn2id_bloom )
+		mdb_bloom_add( mdb->mi_dn2id_bloom, &pid, sizeof(ID), d->nrdn, nrlen );
 
 	/* Add our own node */
 	if (rc == 0) {
@@ -156,45 +159,121 @@ mdb_dn2id_add(
 	}
 	op->o_tmpfree( d, op->o_tmpmemctx );
 
+	/* Add our ID to the parent's children */
+	if ( rc == 0 && mdb->mi_id2kids ) {
+		MDB_val pkey, kid;
+		pkey.mv_size = sizeof( ID );
+		pkey.mv_data = &pid;
+		kid.mv_size = sizeof( ID );
+		kid.mv_data = &e->e_id;
+		/* tools only ever add the highest ID yet */
+		rc = mdb_put( mdb_cursor_txn( mcp ), mdb->mi_id2kids, &pkey, &kid,
+			( slapMode & SLAP_TOOL_MODE ) ? MDB_APPENDDUP : MDB_NODUPDATA );
+		if ( rc == MDB_KEYEXIST )
+			rc = 0;
+	}
+
 	/* Add our subtree count to all superiors */
-	if ( rc == 0 && upsub && pid ) {
-		ID subs;
-		nid = pid;
-		do {
-			/* Get parent's RDN */
-			rc = mdb_cursor_get( mcp, &key, &data, MDB_SET );
+	if ( rc == 0 && upsub && pid )
+		rc = mdb_dn2id_upsub( op, mcp, pid, nsubs );
+
+	Debug( LDAP_DEBUG_TRACE, "<= mdb_dn2id_add 0x%lx: %d\n", e->e_id, rc, 0 );
+
+	return rc;
+}
+
+/* Build the filter of the RDNs under each parent, from the child
+ * nodes in dn2id.
+ */
+int
+mdb_dn2id_bloom(
+	MDB_txn *txn,
+	struct mdb_info *mdb )
+{
+	MDB_cursor *mc;
+	MDB_val key, data;
+	MDB_stat st;
+	mdb_bloom *mb;
+	diskNode *d;
+	ID pid;
+	int rc, nrlen;
+
+	rc = mdb_stat( txn, mdb->mi_dn2id, &st );
+	if ( rc )
+		return rc;
+	rc = mdb_cursor_open( txn, mdb->mi_dn2id, &mc );
+	if ( rc )
+		return rc;
+
+	/* an entry's own node and its node under the parent */
+	mb = mdb_bloom_new( st.ms_entries / 2 );
+	while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT )) == 0 ) {
+		d = data.mv_data;
+		if ( !( d->nrdnlen[0] & 0x80 ))
+			continue;
+		nrlen = (( d->nrdnlen[0] & 0x7f ) << 8 ) | d->nrdnlen[1];
+		memcpy( &pid, key.mv_data, sizeof(ID));
+		mdb_bloom_add( mb, &pid, sizeof(ID), d->nrdn, nrlen );
+	}
+	mdb_cursor_close( mc );
+	if ( rc != MDB_NOTFOUND ) {
+		mdb_bloom_free( mb );
+		return rc;
+	}
+	mdb->mi_dn2id_bloom = mb;
+	return 0;
+}
+
+/* Add nsubs to the subtree counts of pid and all its superiors */
+int
+mdb_dn2id_upsub(
+	Operation	*op,
+	MDB_cursor	*mcp,
+	ID pid,
+	ID nsubs )
+{
+	MDB_val		key, data;
+	ID		nid, subs;
+	int		rc, rlen;
+	diskNode *d;
+	char *ptr;
+
+	key.mv_size = sizeof(ID);
+	key.mv_data = &nid;
+
+	nid = pid;
+	do {
+		/* Get parent's RDN */
+		rc = mdb_cursor_get( mcp, &key, &data, MDB_SET );
+		if ( !rc ) {
+			char *p2;
+			ptr = (char *)data.mv_data + data.mv_size - sizeof( ID );
+			memcpy( &nid, ptr, sizeof( ID ));
+			/* Get parent's node under grandparent */
+			d = data.mv_data;
+			rlen = ( d->nrdnlen[0] << 8 ) | d->nrdnlen[1];
+			p2 = op->o_tmpalloc( rlen + 2, op->o_tmpmemctx );
+			memcpy( p2, data.mv_data, rlen+2 );
+			*p2 ^= 0x80;
+			data.mv_data = p2;
+			rc = mdb_cursor_get( mcp, &key, &data, MDB_GET_BOTH );
+			op->o_tmpfree( p2, op->o_tmpmemctx );
 			if ( !rc ) {
-				char *p2;
+				/* Get parent's subtree count */
 				ptr = (char *)data.mv_data + data.mv_size - sizeof( ID );
-				memcpy( &nid, ptr, sizeof( ID ));
-				/* Get parent's node under grandparent */
-				d = data.mv_data;
-				rlen = ( d->nrdnlen[0] << 8 ) | d->nrdnlen[1];
-				p2 = op->o_tmpalloc( rlen + 2, op->o_tmpmemctx );
-				memcpy( p2, data.mv_data, rlen+2 );
-				*p2 ^= 0x80;
+				memcpy( &subs, ptr, sizeof( ID ));
+				subs += nsubs;
+				p2 = op->o_tmpalloc( data.mv_size, op->o_tmpmemctx );
+				memcpy( p2, data.mv_data, data.mv_size - sizeof( ID ));
+				memcpy( p2+data.mv_size - sizeof( ID ), &subs, sizeof( ID ));
 				data.mv_data = p2;
-				rc = mdb_cursor_get( mcp, &key, &data, MDB_GET_BOTH );
+				rc = mdb_cursor_put( mcp, &key, &data, MDB_CURRENT );
 				op->o_tmpfree( p2, op->o_tmpmemctx );
-				if ( !rc ) {
-					/* Get parent's subtree count */
-					ptr = (char *)data.mv_data + data.mv_size - sizeof( ID );
-					memcpy( &subs, ptr, sizeof( ID ));
-					subs += nsubs;
-					p2 = op->o_tmpalloc( data.mv_size, op->o_tmpmemctx );
-					memcpy( p2, data.mv_data, data.mv_size - sizeof( ID ));
-					memcpy( p2+data.mv_size - sizeof( ID ), &subs, sizeof( ID ));
-					data.mv_data = p2;
-					rc = mdb_cursor_put( mcp, &key, &data, MDB_CURRENT );
-					op->o_tmpfree( p2, op->o_tmpmemctx );
-				}
 			}
-			if ( rc )
-				break;
-		} while ( nid );
-	}
-
-	Debug( LDAP_DEBUG_TRACE, "<= mdb_dn2id_add 0x%lx: %d\n", e->e_id, rc, 0 );
+		}
+		if ( rc )
+			break;
+	} while ( nid );
 
 	return rc;
 }
@@ -207,6 +286,7 @@ mdb_dn2id_delete(
 	ID id,
 	ID nsubs )
 {
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	ID nid;
 	char *ptr;
 	int rc;
@@ -214,6 +294,23 @@ mdb_dn2id_delete(
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_dn2id_delete 0x%lx\n",
 		id, 0, 0 );
 
+	/* Delete our ID from the parent's children */
+	if ( mdb->mi_id2kids ) {
+		MDB_val key, kid;
+		rc = mdb_cursor_get( mc, &key, NULL, MDB_GET_CURRENT );
+		if ( rc == 0 ) {
+			memcpy( &nid, key.mv_data, sizeof( ID ));
+			key.mv_data = &nid;
+			kid.mv_size = sizeof( ID );
+			kid.mv_data = &id;
+			rc = mdb_del( mdb_cursor_txn( mc ), mdb->mi_id2kids, &key, &kid );
+			if ( rc == MDB_NOTFOUND )
+				rc = 0;
+		}
+		if ( rc )
+			goto done;
+	}
+
 	/* Delete our ID from the parent's list */
 	rc = mdb_cursor_del( mc, 0 );
 
@@ -276,6 +373,7 @@ mdb_dn2id_delete(
 		} while ( nid );
 	}
 
+done:
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_dn2id_delete 0x%lx: %d\n", id, rc, 0 );
 	return rc;
 }
@@ -353,6 +451,12 @@ mdb_dn2id(
 		key.mv_data = &pid;
 		pid = nid;
 
+		if ( mdb->mi_dn2id_bloom && !mdb_bloom_test( mdb->mi_dn2id_bloom,
+			&pid, sizeof(ID), tmp.bv_val, tmp.bv_len )) {
+			rc = MDB_NOTFOUND;
+			break;
+		}
+
 		data.mv_size = sizeof(diskNode) + tmp.bv_len;
 		d = op->o_tmpalloc( data.mv_size, op->o_tmpmemctx );
 		d->nrdnlen[1] = tmp.bv_len & 0xff;
@@ -534,6 +638,10 @@ mdb_dn2id_children(
 	key.mv_data = &id;
 	id = e->e_id;
 
+	/* any key in the children index has at least one child */
+	if ( mdb->mi_id2kids )
+		return mdb_get( txn, mdb->mi_id2kids, &key, &data );
+
 	rc = mdb_cursor_open( txn, dbi, &cursor );
 	if ( rc ) return rc;
 
@@ -549,6 +657,114 @@ mdb_dn2id_children(
 	return rc;
 }
 
+/* Fill the ID2KIDS database from the child nodes in DN2ID.
+ * Used on a database written before the children index existed.
+ */
+int
+mdb_id2kids_build(
+	MDB_txn *txn,
+	struct mdb_info *mdb )
+{
+	MDB_cursor *mc;
+	MDB_val key, data, kid;
+	ID id;
+	int rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_dn2id, &mc );
+	if ( rc ) return rc;
+
+	kid.mv_size = sizeof( ID );
+	kid.mv_data = &id;
+	while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT )) == 0 ) {
+		unsigned char *ptr = data.mv_data;
+		/* only child nodes have the high bit set */
+		if ( !( ptr[0] & 0x80 ))
+			continue;
+		memcpy( &id, ptr + data.mv_size - 2 * sizeof( ID ), sizeof( ID ));
+		rc = mdb_put( txn, mdb->mi_id2kids, &key, &kid, MDB_NODUPDATA );
+		if ( rc && rc != MDB_KEYEXIST )
+			break;
+	}
+	mdb_cursor_close( mc );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	return rc;
+}
+
+/* The children index is only right if every write since it was built
+ * kept it up to date, and older versions of slapd and the tools write
+ * DN2ID without it. So a clean close stores the ID of its last txn in
+ * ID2KIDS under the key NOID, and a writable open takes it out again.
+ * If it is missing or isn't the last txn, something else wrote to the
+ * database, or it wasn't closed cleanly: the index is rebuilt, or with
+ * rdonly set, MDB_NOTFOUND is returned and it must not be used.
+ */
+int
+mdb_id2kids_check(
+	MDB_txn *txn,
+	struct mdb_info *mdb,
+	int rdonly )
+{
+	MDB_val key, data;
+	MDB_stat st;
+	ID kid = NOID, stamp = NOID, last;
+	int rc;
+
+	key.mv_size = sizeof( ID );
+	key.mv_data = &kid;
+	rc = mdb_get( txn, mdb->mi_id2kids, &key, &data );
+	if ( rc == 0 && data.mv_size == sizeof( ID ))
+		memcpy( &stamp, data.mv_data, sizeof( ID ));
+	else if ( rc && rc != MDB_NOTFOUND )
+		return rc;
+
+	/* a write txn is the one after the last */
+	last = mdb_txn_id( txn ) - !rdonly;
+	if ( rdonly )
+		return stamp == last ? 0 : MDB_NOTFOUND;
+
+	if ( stamp == last )
+		return mdb_del( txn, mdb->mi_id2kids, &key, NULL );
+
+	rc = mdb_stat( txn, mdb->mi_dn2id, &st );
+	if ( rc )
+		return rc;
+	if ( st.ms_entries )
+		Debug( LDAP_DEBUG_ANY, "mdb_id2kids_check: database \"%s\": "
+			"rebuilding the children index\n",
+			mdb->mi_dbenv_home, 0, 0 );
+	rc = mdb_drop( txn, mdb->mi_id2kids, 0 );
+	if ( rc == 0 )
+		rc = mdb_id2kids_build( txn, mdb );
+	return rc;
+}
+
+/* Record at close that the children index is up to date */
+int
+mdb_id2kids_stamp(
+	struct mdb_info *mdb )
+{
+	MDB_txn *txn;
+	MDB_val key, data;
+	ID kid = NOID, stamp;
+	int rc;
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+	if ( rc )
+		return rc;
+	stamp = mdb_txn_id( txn );
+	key.mv_size = sizeof( ID );
+	key.mv_data = &kid;
+	data.mv_size = sizeof( ID );
+	data.mv_data = &stamp;
+	rc = mdb_put( txn, mdb->mi_id2kids, &key, &data, 0 );
+	if ( rc == 0 )
+		rc = mdb_txn_commit( txn );
+	else
+		mdb_txn_abort( txn );
+	return rc;
+}
+
 int
 mdb_id2name(
 	Operation *op,
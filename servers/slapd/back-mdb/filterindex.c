@@ -25,6 +25,15 @@
 #include <component.h>
 #endif
 
+#ifdef MDB_MONITOR_IDX
+#define MDB_IDX_STAT( op, desc, type, ids ) \
+	( ((struct mdb_info *)(op)->o_bd->be_private)->mi_monitor_stats ? \
+		mdb_monitor_idx_stat( (op)->o_bd, desc, type, \
+			MDB_IDL_N( ids ), MDB_IDL_IS_RANGE( ids )) : 0 )
+#else
+#define MDB_IDX_STAT( op, desc, type, ids )
+#endif /* MDB_MONITOR_IDX */
+
 static int presence_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
@@ -37,6 +46,17 @@ static int equality_candidates(
 	AttributeAssertion *ava,
 	ID *ids,
 	ID *tmp );
+static int equality_keys(
+	Operation *op,
+	AttributeAssertion *ava,
+	MDB_dbi *dbi,
+	struct berval **keys );
+static int equality_intersect(
+	Operation *op,
+	MDB_txn *rtxn,
+	AttributeAssertion *ava,
+	ID *ids,
+	ID *tmp );
 static int inequality_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
@@ -167,8 +187,7 @@ mdb_filter_candidates(
 	case LDAP_FILTER_GE:
 		/* if no GE index, use pres */
 		Debug( LDAP_DEBUG_FILTER, "\tGE\n", 0, 0, 0 );
-		if( f->f_ava->aa_desc->ad_type->sat_ordering &&
-			( f->f_ava->aa_desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) )
+		if( f->f_ava->aa_desc->ad_type->sat_ordering )
 			rc = inequality_candidates( op, rtxn, f->f_ava, ids, tmp, LDAP_FILTER_GE );
 		else
 			rc = presence_candidates( op, rtxn, f->f_ava->aa_desc, ids );
@@ -177,8 +196,7 @@ mdb_filter_candidates(
 	case LDAP_FILTER_LE:
 		/* if no LE index, use pres */
 		Debug( LDAP_DEBUG_FILTER, "\tLE\n", 0, 0, 0 );
-		if( f->f_ava->aa_desc->ad_type->sat_ordering &&
-			( f->f_ava->aa_desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) )
+		if( f->f_ava->aa_desc->ad_type->sat_ordering )
 			rc = inequality_candidates( op, rtxn, f->f_ava, ids, tmp, LDAP_FILTER_LE );
 		else
 			rc = presence_candidates( op, rtxn, f->f_ava->aa_desc, ids );
@@ -558,6 +576,228 @@ base:
 	return 0;
 }
 
+/* Estimated number of candidates a filter yields, from the sizes of
+ * its index keys. Filters that are indexed but whose keys can't be
+ * counted cheaply get FILTER_COST_UNKNOWN, unindexed ones NOID.
+ */
+#define FILTER_COST_UNKNOWN	(NOID-1)
+
+static ID
+filter_cost(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f )
+{
+	MDB_dbi	dbi;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	AttributeDescription *desc;
+	ID cost, n;
+	int i, ftype;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return 0;
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		return f->f_result == LDAP_COMPARE_TRUE ? NOID : 0;
+
+	case LDAP_FILTER_PRESENT:
+		if ( f->f_desc == slap_schema.si_ad_objectClass )
+			return NOID;
+		if ( mdb_index_param( op->o_bd, f->f_desc, LDAP_FILTER_PRESENT,
+			&dbi, &mask, &prefix ) || !prefix.bv_val )
+			return NOID;
+		if ( mdb_key_count( op->o_bd, rtxn, dbi, &prefix, &cost ))
+			return FILTER_COST_UNKNOWN;
+		return cost;
+
+	case LDAP_FILTER_EQUALITY:
+		if ( f->f_av_desc == slap_schema.si_ad_entryDN )
+			return 1;
+		if ( mdb_index_param( op->o_bd, f->f_av_desc, LDAP_FILTER_EQUALITY,
+			&dbi, &mask, &prefix ))
+			return NOID;
+		if ( !equality_keys( op, f->f_ava, &dbi, &keys ))
+			return NOID;
+		cost = NOID;
+		for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+			if ( mdb_key_count( op->o_bd, rtxn, dbi, &keys[i], &n )) {
+				n = FILTER_COST_UNKNOWN;
+			}
+			if ( n < cost )
+				cost = n;
+		}
+		ber_bvarray_free_x( keys, op->o_tmpmemctx );
+		return cost;
+
+	case LDAP_FILTER_AND:
+		cost = NOID;
+		for ( f = f->f_and; f; f = f->f_next ) {
+			if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
+				f->f_result == LDAP_SUCCESS )
+				continue;
+			n = filter_cost( op, rtxn, f );
+			if ( n < cost )
+				cost = n;
+			if ( !cost )
+				break;
+		}
+		return cost;
+
+	case LDAP_FILTER_OR:
+		cost = 0;
+		for ( f = f->f_or; f; f = f->f_next ) {
+			n = filter_cost( op, rtxn, f );
+			if ( n >= FILTER_COST_UNKNOWN )
+				return n;
+			cost += n;
+		}
+		return cost;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		desc = f->f_sub_desc;
+		ftype = LDAP_FILTER_SUBSTRINGS;
+		break;
+
+	case LDAP_FILTER_APPROX:
+		desc = f->f_av_desc;
+		ftype = LDAP_FILTER_APPROX;
+		break;
+
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		desc = f->f_av_desc;
+		if ( desc->ad_type->sat_ordering &&
+			( desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ))
+			ftype = LDAP_FILTER_EQUALITY;
+		else
+			ftype = f->f_choice;
+		break;
+
+	case LDAP_FILTER_EXT:
+		return FILTER_COST_UNKNOWN;
+
+	default:
+		return NOID;
+	}
+
+	if ( mdb_index_param( op->o_bd, desc, ftype, &dbi, &mask, &prefix ))
+		return NOID;
+	return FILTER_COST_UNKNOWN;
+}
+
+/* Find the widest composite index whose components all have an
+ * equality term in an AND, read its key and the overflow key into
+ * ids and drop those terms. Returns 0 if there was none.
+ */
+static int
+composite_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter **fv,
+	int *np,
+	ID *ids,
+	ID *tmp )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	CompInfo *ci, *best = NULL;
+	Filter *cf[MDB_COMP_MAX], *bf[MDB_COMP_MAX];
+	struct berval *ckeys[MDB_COMP_MAX] = { NULL };
+	struct berval key;
+	char *ptr;
+	int i, j, k, n = *np, rc = LDAP_OTHER;
+
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		ci = mdb->mi_comps[i];
+		if ( !IS_SLAP_INDEX( ci->ci_indexmask, SLAP_INDEX_EQUALITY ) ||
+			( ci->ci_indexmask & MDB_INDEX_DELETING ) ||
+			ci->ci_nads > n || ( best && best->ci_nads >= ci->ci_nads ))
+			continue;
+		for ( k = 0; k < ci->ci_nads; k++ ) {
+			for ( j = 0; j < n; j++ ) {
+				if ( fv[j]->f_choice == LDAP_FILTER_EQUALITY &&
+					fv[j]->f_av_desc == ci->ci_ads[k] )
+					break;
+			}
+			if ( j == n )
+				break;
+			cf[k] = fv[j];
+		}
+		if ( k < ci->ci_nads )
+			continue;
+		best = ci;
+		AC_MEMCPY( bf, cf, sizeof(cf) );
+	}
+	if ( !best )
+		return 0;
+
+	key.bv_len = 0;
+	for ( k = 0; k < best->ci_nads; k++ ) {
+		AttributeDescription *ad = best->ci_ads[k];
+		MatchingRule *mr = ad->ad_type->sat_equality;
+
+		rc = mr->smr_filter( LDAP_FILTER_EQUALITY, SLAP_INDEX_EQUALITY,
+			ad->ad_type->sat_syntax, mr, &ad->ad_type->sat_cname,
+			&bf[k]->f_av_value, &ckeys[k], op->o_tmpmemctx );
+		/* a value with several keys is left to the plain indexes */
+		if ( rc != LDAP_SUCCESS || ckeys[k] == NULL ||
+			!BER_BVISNULL( &ckeys[k][1] )) {
+			rc = LDAP_OTHER;
+			goto done;
+		}
+		key.bv_len += ckeys[k][0].bv_len;
+	}
+	key.bv_len = MDB_COMP_PAD( key.bv_len );
+	key.bv_val = ptr = op->o_tmpcalloc( 1, key.bv_len, op->o_tmpmemctx );
+	for ( k = 0; k < best->ci_nads; k++ ) {
+		AC_MEMCPY( ptr, ckeys[k][0].bv_val, ckeys[k][0].bv_len );
+		ptr += ckeys[k][0].bv_len;
+	}
+
+	rc = mdb_key_read( op->o_bd, rtxn, best->ci_dbi, &key, ids, NULL, 0 );
+	if ( rc == MDB_NOTFOUND ) {
+		MDB_IDL_ZERO( ids );
+		rc = 0;
+	}
+
+	/* entries with too many key combinations to list */
+	if ( rc == LDAP_SUCCESS && !MDB_IDL_IS_RANGE( ids )) {
+		memset( key.bv_val, 0, MDB_COMP_OVERFLOW_LEN );
+		key.bv_len = MDB_COMP_OVERFLOW_LEN;
+		rc = mdb_key_read( op->o_bd, rtxn, best->ci_dbi, &key, tmp,
+			NULL, 0 );
+		if ( rc == LDAP_SUCCESS )
+			mdb_idl_union( ids, tmp );
+		else if ( rc == MDB_NOTFOUND )
+			rc = 0;
+	}
+	op->o_tmpfree( key.bv_val, op->o_tmpmemctx );
+
+	if ( rc == LDAP_SUCCESS ) {
+		for ( i = 0, j = 0; i < n; i++ ) {
+			for ( k = 0; k < best->ci_nads; k++ ) {
+				if ( fv[i] == bf[k] )
+					break;
+			}
+			if ( k == best->ci_nads )
+				fv[j++] = fv[i];
+		}
+		*np = j;
+		Debug( LDAP_DEBUG_FILTER,
+			"mdb_composite_candidates: %s, %ld candidates\n",
+			best->ci_name.bv_val, (long) MDB_IDL_N( ids ), 0 );
+	}
+
+done:
+	for ( k = 0; k < best->ci_nads; k++ ) {
+		if ( ckeys[k] )
+			ber_bvarray_free_x( ckeys[k], op->o_tmpmemctx );
+	}
+	return rc == LDAP_SUCCESS;
+}
+
 static int
 list_candidates(
 	Operation *op,
@@ -570,14 +810,95 @@ list_candidates(
 {
 	int rc = 0;
 	Filter	*f;
+	Filter	*fbuf[8], **fv = fbuf;
+	ID	cbuf[8], *cv = cbuf;
+	int	i, j, n, have = 0;
 
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_list_candidates 0x%x\n", ftype, 0, 0 );
-	for ( f = flist; f != NULL; f = f->f_next ) {
-		/* ignore precomputed scopes */
+
+	/* collect the terms, ignoring precomputed scopes */
+	for ( n = 0, f = flist; f != NULL; f = f->f_next ) {
+		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
+		     f->f_result == LDAP_SUCCESS ) {
+			continue;
+		}
+		n++;
+	}
+	if ( n > (int)(sizeof(fbuf)/sizeof(fbuf[0])) ) {
+		fv = op->o_tmpalloc( n * ( sizeof(Filter *) + sizeof(ID) ),
+			op->o_tmpmemctx );
+		cv = (ID *)(fv + n);
+	}
+	for ( n = 0, f = flist; f != NULL; f = f->f_next ) {
 		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
 		     f->f_result == LDAP_SUCCESS ) {
 			continue;
 		}
+		fv[n++] = f;
+	}
+
+	/* A composite index can answer several equality terms at once */
+	if ( ftype == LDAP_FILTER_AND && n > 1 &&
+		composite_candidates( op, rtxn, fv, &n, ids, tmp )) {
+		have = 1;
+		if ( MDB_IDL_IS_ZERO( ids ))
+			goto leave;
+	}
+
+	/* Estimate each term from its key sizes. An AND is evaluated
+	 * cheapest first; an OR with an unindexed term matches
+	 * everything, no need to read the others.
+	 */
+	if ( n > 1 ) {
+		for ( i = 0; i < n; i++ ) {
+			ID c = filter_cost( op, rtxn, fv[i] );
+			if ( ftype == LDAP_FILTER_OR && c == NOID ) {
+				MDB_IDL_ALL( ids );
+				goto leave;
+			}
+			f = fv[i];
+			for ( j = i; j > 0 && cv[j-1] > c; j-- ) {
+				fv[j] = fv[j-1];
+				cv[j] = cv[j-1];
+			}
+			fv[j] = f;
+			cv[j] = c;
+		}
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		f = fv[i];
+
+		if ( ftype == LDAP_FILTER_AND && have ) {
+			/* Once the candidates are few, leave the remaining
+			 * terms to test_filter() */
+			if ( !MDB_IDL_IS_RANGE( ids ) &&
+				ids[0] <= MDB_IDL_AND_SHORTCUT ) {
+				Debug( LDAP_DEBUG_FILTER,
+					"mdb_list_candidates: %ld candidates, "
+					"skipping %d terms\n", (long) ids[0], n - i, 0 );
+				break;
+			}
+			/* an unindexed term can't narrow anything */
+			if ( n > 1 && cv[i] == NOID )
+				break;
+
+			/* narrow an exact list in place rather than reading
+			 * every ID of a possibly huge key */
+			if ( f->f_choice == LDAP_FILTER_EQUALITY &&
+				f->f_av_desc != slap_schema.si_ad_entryDN &&
+				!MDB_IDL_IS_RANGE( ids ) ) {
+				rc = equality_intersect( op, rtxn, f->f_ava, ids, tmp );
+				if ( rc != 0 ) {
+					rc = 0;
+					continue;
+				}
+				if( MDB_IDL_IS_ZERO( ids ) )
+					break;
+				continue;
+			}
+		}
+
 		MDB_IDL_ZERO( save );
 		rc = mdb_filter_candidates( op, rtxn, f, save, tmp,
 			save+MDB_IDL_UM_SIZE );
@@ -592,22 +913,32 @@ list_candidates(
 
 		
 		if ( ftype == LDAP_FILTER_AND ) {
-			if ( f == flist ) {
+			if ( !have ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_intersection( ids, save );
 			}
+			have = 1;
 			if( MDB_IDL_IS_ZERO( ids ) )
 				break;
 		} else {
-			if ( f == flist ) {
+			if ( !have ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_union( ids, save );
 			}
+			have = 1;
 		}
 	}
 
+	if ( ftype == LDAP_FILTER_AND && !have ) {
+		MDB_IDL_ALL( ids );
+	}
+
+leave:
+	if ( fv != fbuf )
+		op->o_tmpfree( fv, op->o_tmpmemctx );
+
 	if( rc == LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_FILTER,
 			"<= mdb_list_candidates: id=%ld first=%ld last=%ld\n",
@@ -683,6 +1014,7 @@ presence_candidates(
 			desc->ad_cname.bv_val, rc, 0 );
 		goto done;
 	}
+	MDB_IDX_STAT( op, desc, SLAP_INDEX_PRESENT, ids );
 
 	Debug(LDAP_DEBUG_TRACE,
 		"<= mdb_presence_candidates: id=%ld first=%ld last=%ld\n",
@@ -694,44 +1026,23 @@ done:
 	return rc;
 }
 
+/* Get the equality index keys for an assertion; returns 0 if the
+ * attribute is not usably indexed.
+ */
 static int
-equality_candidates(
+equality_keys(
 	Operation *op,
-	MDB_txn *rtxn,
 	AttributeAssertion *ava,
-	ID *ids,
-	ID *tmp )
+	MDB_dbi *dbi,
+	struct berval **keys )
 {
-	MDB_dbi	dbi;
-	int i;
 	int rc;
 	slap_mask_t mask;
 	struct berval prefix = {0, NULL};
-	struct berval *keys = NULL;
 	MatchingRule *mr;
 
-	Debug( LDAP_DEBUG_TRACE, "=> mdb_equality_candidates (%s)\n",
-			ava->aa_desc->ad_cname.bv_val, 0, 0 );
-
-	if ( ava->aa_desc == slap_schema.si_ad_entryDN ) {
-		ID id;
-		rc = mdb_dn2id( op, rtxn, NULL, &ava->aa_value, &id, NULL, NULL, NULL );
-		if ( rc == LDAP_SUCCESS ) {
-			/* exactly one ID can match */
-			ids[0] = 1;
-			ids[1] = id;
-		}
-		if ( rc == MDB_NOTFOUND ) {
-			MDB_IDL_ZERO( ids );
-			rc = 0;
-		}
-		return rc;
-	}
-
-	MDB_IDL_ALL( ids );
-
 	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
-		&dbi, &mask, &prefix );
+		dbi, &mask, &prefix );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -764,7 +1075,7 @@ equality_candidates(
 		mr,
 		&prefix,
 		&ava->aa_value,
-		&keys, op->o_tmpmemctx );
+		keys, op->o_tmpmemctx );
 
 	if( rc != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_TRACE,
@@ -774,44 +1085,81 @@ equality_candidates(
 		return 0;
 	}
 
-	if( keys == NULL ) {
+	if( *keys == NULL ) {
 		Debug( LDAP_DEBUG_TRACE,
 			"<= mdb_equality_candidates: (%s) no keys\n",
 			ava->aa_desc->ad_cname.bv_val, 0, 0 );
 		return 0;
 	}
 
-	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
-		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
+	return 1;
+}
 
-		if( rc == MDB_NOTFOUND ) {
+static int
+equality_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	AttributeAssertion *ava,
+	ID *ids,
+	ID *tmp )
+{
+	MDB_dbi	dbi;
+	AttrInfo *ai;
+	struct berval atname;
+	int i;
+	int rc;
+	struct berval *keys = NULL;
+
+	Debug( LDAP_DEBUG_TRACE, "=> mdb_equality_candidates (%s)\n",
+			ava->aa_desc->ad_cname.bv_val, 0, 0 );
+
+	if ( ava->aa_desc == slap_schema.si_ad_entryDN ) {
+		ID id;
+		rc = mdb_dn2id( op, rtxn, NULL, &ava->aa_value, &id, NULL, NULL, NULL );
+		if ( rc == LDAP_SUCCESS ) {
+			/* exactly one ID can match */
+			ids[0] = 1;
+			ids[1] = id;
+		}
+		if ( rc == MDB_NOTFOUND ) {
 			MDB_IDL_ZERO( ids );
 			rc = 0;
-			break;
-		} else if( rc != LDAP_SUCCESS ) {
-			Debug( LDAP_DEBUG_TRACE,
-				"<= mdb_equality_candidates: (%s) "
-				"key read failed (%d)\n",
-				ava->aa_desc->ad_cname.bv_val, rc, 0 );
-			break;
 		}
+		return rc;
+	}
 
-		if( MDB_IDL_IS_ZERO( tmp ) ) {
-			Debug( LDAP_DEBUG_TRACE,
-				"<= mdb_equality_candidates: (%s) NULL\n", 
-				ava->aa_desc->ad_cname.bv_val, 0, 0 );
-			MDB_IDL_ZERO( ids );
-			break;
-		}
+	MDB_IDL_ALL( ids );
 
-		if ( i == 0 ) {
-			MDB_IDL_CPY( ids, tmp );
-		} else {
-			mdb_idl_intersection( ids, tmp );
+	if ( !equality_keys( op, ava, &dbi, &keys )) {
+		return 0;
+	}
+
+	/* a key that's certainly not in the index matches nothing */
+	ai = mdb_index_mask( op->o_bd, ava->aa_desc, &atname );
+	if ( ai && ai->ai_bloom && !mdb_bloom_test_keys( ai->ai_bloom, keys )) {
+		MDB_IDL_ZERO( ids );
+		rc = 0;
+	} else {
+		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[0], ids, NULL, 0 );
+		if( rc == MDB_NOTFOUND ) {
+			MDB_IDL_ZERO( ids );
+			rc = 0;
 		}
+	}
 
+	for ( i = 1; rc == LDAP_SUCCESS && keys[i].bv_val != NULL; i++ ) {
 		if( MDB_IDL_IS_ZERO( ids ) )
 			break;
+		rc = mdb_key_intersect( op->o_bd, rtxn, dbi, &keys[i], ids, tmp );
+	}
+
+	if( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<= mdb_equality_candidates: (%s) "
+			"key read failed (%d)\n",
+			ava->aa_desc->ad_cname.bv_val, rc, 0 );
+	} else {
+		MDB_IDX_STAT( op, ava->aa_desc, SLAP_INDEX_EQUALITY, ids );
 	}
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
@@ -824,6 +1172,47 @@ equality_candidates(
 	return( rc );
 }
 
+/* Narrow an AND's candidate list by an equality assertion. This
+ * probes the index per candidate when the key is much larger than
+ * the list, so the result stays exact even for huge keys.
+ */
+static int
+equality_intersect(
+	Operation *op,
+	MDB_txn *rtxn,
+	AttributeAssertion *ava,
+	ID *ids,
+	ID *tmp )
+{
+	MDB_dbi	dbi;
+	int i;
+	int rc = 0;
+	struct berval *keys = NULL;
+
+	Debug( LDAP_DEBUG_TRACE, "=> mdb_equality_intersect (%s)\n",
+			ava->aa_desc->ad_cname.bv_val, 0, 0 );
+
+	if ( !equality_keys( op, ava, &dbi, &keys )) {
+		return 0;
+	}
+
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+		if( MDB_IDL_IS_ZERO( ids ) )
+			break;
+		rc = mdb_key_intersect( op->o_bd, rtxn, dbi, &keys[i], ids, tmp );
+		if ( rc != LDAP_SUCCESS )
+			break;
+	}
+
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+
+	Debug( LDAP_DEBUG_TRACE,
+		"<= mdb_equality_intersect: id=%ld, first=%ld, last=%ld\n",
+		(long) ids[0],
+		(long) MDB_IDL_FIRST(ids),
+		(long) MDB_IDL_LAST(ids) );
+	return( rc );
+}
 
 static int
 approx_candidates(
@@ -936,6 +1325,8 @@ approx_candidates(
 	}
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	if ( rc == LDAP_SUCCESS )
+		MDB_IDX_STAT( op, ava->aa_desc, SLAP_INDEX_APPROX, ids );
 
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_approx_candidates %ld, first=%ld, last=%ld\n",
 		(long) ids[0],
@@ -1051,6 +1442,8 @@ substring_candidates(
 	}
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	if ( rc == LDAP_SUCCESS )
+		MDB_IDX_STAT( op, sub->sa_desc, SLAP_INDEX_SUBSTR, ids );
 
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_substring_candidates: %ld, first=%ld, last=%ld\n",
 		(long) ids[0],
@@ -1075,12 +1468,31 @@ inequality_candidates(
 	struct berval *keys = NULL;
 	MatchingRule *mr;
 	MDB_cursor *cursor = NULL;
+	slap_mask_t itype = SLAP_INDEX_EQUALITY;
 
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_inequality_candidates (%s)\n",
 			ava->aa_desc->ad_cname.bv_val, 0, 0 );
 
 	MDB_IDL_ALL( ids );
 
+	if ( !( ava->aa_desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX )) {
+		/* Only an ordered index has keys to scan for this rule */
+		rc = mdb_index_param( op->o_bd, ava->aa_desc, gtorlt,
+			&dbi, &mask, &prefix );
+		if ( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_TRACE,
+				"<= mdb_inequality_candidates: (%s) no ordered index\n",
+				ava->aa_desc->ad_cname.bv_val, 0, 0 );
+			return presence_candidates( op, rtxn, ava->aa_desc, ids );
+		}
+		keys = op->o_tmpalloc( 2 * sizeof(struct berval), op->o_tmpmemctx );
+		keys[0].bv_val = op->o_tmpalloc( MDB_ORDERED_KEYLEN, op->o_tmpmemctx );
+		mdb_ordered_key( &ava->aa_value, &keys[0] );
+		BER_BVZERO( &keys[1] );
+		itype = SLAP_INDEX_ORDERED;
+		goto scan;
+	}
+
 	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
 		&dbi, &mask, &prefix );
 
@@ -1132,6 +1544,7 @@ inequality_candidates(
 		return 0;
 	}
 
+scan:
 	MDB_IDL_ZERO( ids );
 	while(1) {
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[0], tmp, &cursor, gtorlt );
@@ -1163,6 +1576,8 @@ inequality_candidates(
 		}
 	}
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	if ( rc == LDAP_SUCCESS )
+		MDB_IDX_STAT( op, ava->aa_desc, itype, ids );
 
 	Debug( LDAP_DEBUG_TRACE,
 		"<= mdb_inequality_candidates: id=%ld, first=%ld, last=%ld\n",
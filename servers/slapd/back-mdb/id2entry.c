@@ -36,9 +36,12 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data,
 	Ecount *ec);
 static Entry *mdb_entry_alloc( Operation *op, int nattrs, int nvals );
+static void mdb_ecache_invalidate( struct mdb_info *mdb, MDB_txn *txn, ID id );
 
 #define ID2VKSZ	(sizeof(ID)+2)
 
+#define MDB_MVAL_SAME	0xffff
+
 int
 mdb_id2v_compare(
 	const MDB_val *usrkey,
@@ -63,6 +66,7 @@ mdb_id2v_compare(
 /* usrkey[0] is the key in DB format, as described at mdb_mval_put.
  * usrkey[1] is the value we'll actually match against.
  * usrkey[2] is the attributeDescription for this value.
+ * usrkey[3].mv_size is nonzero if the DB uses MDB_MVAL_SAME.
  */
 int
 mdb_id2v_dupsort(
@@ -80,7 +84,7 @@ mdb_id2v_dupsort(
 	memcpy(&s, ptr, 2);
 	bv2.bv_val = curkey->mv_data;
 	bv2.bv_len = curkey->mv_size - 3;
-	if (s)
+	if (s && !(s == MDB_MVAL_SAME && usrkey[3].mv_size))
 		bv2.bv_len -= (s+1);
 
 	bv1.bv_val = usrkey[1].mv_data;
@@ -103,12 +107,15 @@ mdb_id2v_dupsort(
 /* Values are stored as
  * [normalized-value NUL ] original-value NUL 2-byte-len
  * The trailing 2-byte-len is zero if there is no normalized value.
- * Otherwise, it is the length of the original-value.
+ * Otherwise, it is the length of the original-value. In a DB stamped
+ * by mdb_mval_format, it is MDB_MVAL_SAME if the original-value is
+ * identical to the normalized-value and is not stored again, and
+ * longer values can't be stored.
  */
 int mdb_mval_put(Operation *op, MDB_cursor *mc, ID id, Attribute *a)
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
-	MDB_val key, data[3];
+	MDB_val key, data[4];
 	char *buf;
 	char ivk[ID2VKSZ];
 	unsigned i;
@@ -124,11 +131,18 @@ int mdb_mval_put(Operation *op, MDB_cursor *mc, ID id, Attribute *a)
 		data[2].mv_data = NULL;
 	else
 		data[2].mv_data = a->a_desc;
+	data[3].mv_size = mdb->mi_flags & MDB_MVAL_ONCE;
 
 	for (i=0; i<a->a_numvals; i++) {
+		int same = a->a_nvals == a->a_vals || ( data[3].mv_size &&
+			bvmatch( &a->a_nvals[i], &a->a_vals[i] ));
+		if (!same && data[3].mv_size &&
+			a->a_vals[i].bv_len >= MDB_MVAL_SAME)
+			return MDB_BAD_VALSIZE;
 		len = a->a_nvals[i].bv_len + 1 + 2;
-		if (a->a_nvals != a->a_vals) {
+		if (!same)
 			len += a->a_vals[i].bv_len + 1;
+		if (a->a_nvals != a->a_vals) {
 			data[1].mv_data = a->a_nvals[i].bv_val;
 			data[1].mv_size = a->a_nvals[i].bv_len;
 		} else {
@@ -141,12 +155,15 @@ int mdb_mval_put(Operation *op, MDB_cursor *mc, ID id, Attribute *a)
 		memcpy(buf, a->a_nvals[i].bv_val, a->a_nvals[i].bv_len);
 		buf += a->a_nvals[i].bv_len;
 		*buf++ = 0;
-		if (a->a_nvals != a->a_vals) {
+		if (!same) {
 			s = a->a_vals[i].bv_len;
 			memcpy(buf, a->a_vals[i].bv_val, a->a_vals[i].bv_len);
 			buf += a->a_vals[i].bv_len;
 			*buf++ = 0;
 			memcpy(buf, &s, 2);
+		} else if (a->a_nvals != a->a_vals) {
+			s = MDB_MVAL_SAME;
+			memcpy(buf, &s, 2);
 		} else {
 			*buf++ = 0;
 			*buf++ = 0;
@@ -162,7 +179,7 @@ int mdb_mval_put(Operation *op, MDB_cursor *mc, ID id, Attribute *a)
 int mdb_mval_del(Operation *op, MDB_cursor *mc, ID id, Attribute *a)
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
-	MDB_val key, data[3];
+	MDB_val key, data[4];
 	char *ptr;
 	char ivk[ID2VKSZ];
 	unsigned i;
@@ -178,6 +195,7 @@ int mdb_mval_del(Operation *op, MDB_cursor *mc, ID id, Attribute *a)
 		data[2].mv_data = NULL;
 	else
 		data[2].mv_data = a->a_desc;
+	data[3].mv_size = mdb->mi_flags & MDB_MVAL_ONCE;
 
 	if (a->a_numvals) {
 		for (i=0; i<a->a_numvals; i++) {
@@ -209,7 +227,7 @@ int mdb_mval_del(Operation *op, MDB_cursor *mc, ID id, Attribute *a)
 static int mdb_mval_get(Operation *op, MDB_cursor *mc, ID id, Attribute *a, int have_nvals)
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
-	MDB_val key, data[3];
+	MDB_val key, data[4];
 	char *ptr;
 	char ivk[ID2VKSZ];
 	unsigned i;
@@ -241,7 +259,12 @@ static int mdb_mval_get(Operation *op, MDB_cursor *mc, ID id, Attribute *a, int
 			return rc;
 		ptr = (char*)data[0].mv_data + data[0].mv_size - 2;
 		memcpy(&s, ptr, 2);
-		if (have_nvals) {
+		if (have_nvals && s == MDB_MVAL_SAME &&
+			( mdb->mi_flags & MDB_MVAL_ONCE )) {
+			a->a_nvals[i].bv_val = data[0].mv_data;
+			a->a_nvals[i].bv_len = data[0].mv_size - 3;
+			a->a_vals[i] = a->a_nvals[i];
+		} else if (have_nvals) {
 			a->a_nvals[i].bv_val = data[0].mv_data;
 			a->a_vals[i].bv_len = s;
 			a->a_vals[i].bv_val = ptr - a->a_vals[i].bv_len - 1;
@@ -259,6 +282,59 @@ static int mdb_mval_get(Operation *op, MDB_cursor *mc, ID id, Attribute *a, int
 	return 0;
 }
 
+static char mdb_mval_stamp[] = "mvalsame";
+
+/* Find out at open whether id2val uses MDB_MVAL_SAME. Older code
+ * reads that length as the length of an original-value, so the
+ * encoding is only used in a DB that starts out empty with mvalsame
+ * configured. It is recorded under ID 0, which no entry uses, and
+ * the stamp decides from then on, whatever the config says.
+ */
+int mdb_mval_format( MDB_txn *txn, struct mdb_info *mdb, int rdonly )
+{
+	MDB_cursor *mc;
+	MDB_val key, data[4];
+	char ivk[ID2VKSZ];
+	int rc;
+
+	mdb->mi_flags &= ~MDB_MVAL_ONCE;
+	memset(ivk, 0, sizeof(ivk));
+	key.mv_data = ivk;
+	key.mv_size = sizeof(ivk);
+
+	rc = mdb_cursor_open( txn, mdb->mi_dbis[MDB_ID2VAL], &mc );
+	if (rc)
+		return rc;
+	rc = mdb_cursor_get( mc, &key, data, MDB_SET );
+	if (rc == 0) {
+		if (data[0].mv_size == sizeof(mdb_mval_stamp) &&
+			!memcmp(data[0].mv_data, mdb_mval_stamp, sizeof(mdb_mval_stamp)))
+			mdb->mi_flags |= MDB_MVAL_ONCE;
+	} else if (rc == MDB_NOTFOUND && mdb->mi_mval_same && !rdonly) {
+		rc = mdb_cursor_get( mc, &key, data, MDB_FIRST );
+		if (rc == MDB_NOTFOUND) {
+			key.mv_data = ivk;
+			key.mv_size = sizeof(ivk);
+			data[0].mv_data = mdb_mval_stamp;
+			data[0].mv_size = sizeof(mdb_mval_stamp);
+			data[1] = data[0];
+			data[2].mv_data = NULL;
+			data[3].mv_size = 0;
+			rc = mdb_cursor_put( mc, &key, data, MDB_NOOVERWRITE );
+			if (rc == 0)
+				mdb->mi_flags |= MDB_MVAL_ONCE;
+		} else if (rc == 0) {
+			Debug( LDAP_DEBUG_ANY, "mdb_mval_format: "
+				"id2val already holds values, ignoring mvalsame "
+				"until the database is reloaded.\n", 0, 0, 0 );
+		}
+	}
+	if (rc == MDB_NOTFOUND)
+		rc = 0;
+	mdb_cursor_close( mc );
+	return rc;
+}
+
 #define ADD_FLAGS	(MDB_NOOVERWRITE|MDB_APPEND)
 
 static int mdb_id2entry_put(
@@ -275,6 +351,8 @@ static int mdb_id2entry_put(
 
 	/* We only store rdns, and they go in the dn2id database. */
 
+	mdb_ecache_invalidate( mdb, txn, e->e_id );
+
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
 
@@ -383,14 +461,225 @@ int mdb_id2edata(
 	return rc;
 }
 
+/* Ask the OS to start reading the pages of an entry a search will get
+ * to shortly. Without data, only the leaf page the entry is on, found
+ * from the branch pages, which are usually cached; last is the leaf
+ * asked for before, so that a run of entries on one leaf costs one
+ * request. With data, the leaf is read, and should be in by then, to
+ * ask for the overflow pages of a large entry.
+ */
+void mdb_id2entry_prefetch(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	ID id,
+	int data,
+	size_t *last )
+{
+	MDB_val key;
+	size_t pgno, npages = 1;
+
+	key.mv_data = &id;
+	key.mv_size = sizeof(ID);
+
+	if ( mdb_key_page( txn, mdb->mi_id2entry, &key, &pgno,
+		data ? &npages : NULL ))
+		return;
+	if ( data ) {
+		if ( !npages )
+			return;
+	} else {
+		if ( pgno == *last )
+			return;
+		*last = pgno;
+	}
+	mdb_env_prefetch( mdb->mi_dbenv, pgno, npages );
+}
+
+/* Decoded entry cache. Each slot holds one entry, the one read most
+ * among the IDs that hash to it. A write stamps the slot with its txn
+ * ID before it commits, so a read txn only shares or stores a decoded
+ * entry if its snapshot is at least as recent as the slot's last write.
+ * Write txns neither use nor fill the cache.
+ */
+int
+mdb_ecache_open( struct mdb_info *mdb )
+{
+	unsigned i;
+
+	if ( !mdb->mi_ecache_size || !( slapMode & SLAP_SERVER_MODE ))
+		return 0;
+
+	mdb->mi_ecache_slots = mdb->mi_ecache_size;
+	mdb->mi_ecache = ch_calloc( mdb->mi_ecache_slots, sizeof(mdb_ecache_slot) );
+	for ( i = 0; i < mdb->mi_ecache_slots; i++ )
+		ldap_pvt_thread_mutex_init( &mdb->mi_ecache[i].es_mutex );
+	return 0;
+}
+
+void
+mdb_ecache_close( struct mdb_info *mdb )
+{
+	unsigned i;
+
+	if ( !mdb->mi_ecache )
+		return;
+
+	for ( i = 0; i < mdb->mi_ecache_slots; i++ ) {
+		if ( mdb->mi_ecache[i].es_val )
+			ch_free( mdb->mi_ecache[i].es_val );
+		ldap_pvt_thread_mutex_destroy( &mdb->mi_ecache[i].es_mutex );
+	}
+	ch_free( mdb->mi_ecache );
+	mdb->mi_ecache = NULL;
+	mdb->mi_ecache_slots = 0;
+}
+
+static void
+mdb_ecache_invalidate( struct mdb_info *mdb, MDB_txn *txn, ID id )
+{
+	mdb_ecache_slot *es;
+	mdb_ecache_val *ev = NULL;
+
+	if ( !mdb->mi_ecache )
+		return;
+
+	es = &mdb->mi_ecache[id % mdb->mi_ecache_slots];
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	es->es_txnid = mdb_txn_id( txn );
+	if ( es->es_val && es->es_val->ev_id == id ) {
+		ev = es->es_val;
+		es->es_val = NULL;
+		es->es_hits = 0;
+		if ( --ev->ev_refs )
+			ev = NULL;
+	}
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	if ( ev )
+		ch_free( ev );
+}
+
+static void
+mdb_ecache_release( mdb_ecache_val *ev )
+{
+	mdb_ecache_slot *es = ev->ev_slot;
+	int refs;
+
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	refs = --ev->ev_refs;
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	if ( !refs )
+		ch_free( ev );
+}
+
+/* The snapshot of the read txn mc belongs to, 0 if it isn't one */
+static size_t
+mdb_ecache_reader( Operation *op, struct mdb_info *mdb, MDB_cursor *mc )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb ) {
+			mdb_op_info *moi = (mdb_op_info *)oex;
+			if (( moi->moi_flag & MOI_READER ) &&
+				moi->moi_txn == mdb_cursor_txn( mc ))
+				return mdb_txn_id( moi->moi_txn );
+			break;
+		}
+	}
+	return 0;
+}
+
+/* Copy a decoded entry's attributes and values into one block */
+static mdb_ecache_val *
+mdb_ecache_copy( mdb_ecache_slot *es, Entry *e )
+{
+	mdb_ecache_val *ev;
+	Attribute *a, *sa;
+	struct berval *bv, *sv;
+	char *ptr;
+	int nattrs = 0, nvals = 0, i;
+	ber_len_t len = 0;
+
+	for ( sa = e->e_attrs; sa; sa = sa->a_next ) {
+		nattrs++;
+		for ( i = 0; i < sa->a_numvals; i++ )
+			len += sa->a_vals[i].bv_len + 1;
+		nvals += sa->a_numvals + 1;
+		if ( sa->a_nvals != sa->a_vals ) {
+			for ( i = 0; i < sa->a_numvals; i++ )
+				len += sa->a_nvals[i].bv_len + 1;
+			nvals += sa->a_numvals + 1;
+		}
+	}
+
+	ev = ch_malloc( sizeof(mdb_ecache_val) + nattrs * sizeof(Attribute) +
+		nvals * sizeof(struct berval) + len );
+	ev->ev_slot = es;
+	ev->ev_id = e->e_id;
+	ev->ev_refs = 1;
+	ev->ev_nattrs = nattrs;
+	ev->ev_ocflags = e->e_ocflags;
+	ev->ev_attrs = (Attribute *)(ev+1);
+	bv = (struct berval *)(ev->ev_attrs + nattrs);
+	ptr = (char *)(bv + nvals);
+
+	for ( sa = e->e_attrs, a = ev->ev_attrs; sa; sa = sa->a_next, a++ ) {
+		*a = *sa;
+		a->a_next = NULL;
+		a->a_flags |= SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
+		for ( sv = sa->a_vals, a->a_vals = bv; ; sv = sa->a_nvals, a->a_nvals = bv ) {
+			for ( i = 0; i < sa->a_numvals; i++, bv++ ) {
+				bv->bv_len = sv[i].bv_len;
+				bv->bv_val = ptr;
+				AC_MEMCPY( ptr, sv[i].bv_val, sv[i].bv_len );
+				ptr += sv[i].bv_len;
+				*ptr++ = '\0';
+			}
+			BER_BVZERO( bv );
+			bv++;
+			if ( sv != sa->a_vals || sa->a_nvals == sa->a_vals )
+				break;
+		}
+		if ( sa->a_nvals == sa->a_vals )
+			a->a_nvals = a->a_vals;
+	}
+	return ev;
+}
+
+/* A reader's own copy of the Entry and Attributes of a cached entry */
+static Entry *
+mdb_ecache_entry( Operation *op, mdb_ecache_val *ev )
+{
+	Entry *e = op->o_tmpalloc( sizeof(Entry) +
+		ev->ev_nattrs * sizeof(Attribute), op->o_tmpmemctx );
+	int i;
+
+	BER_BVZERO(&e->e_bv);
+	e->e_private = ev;
+	e->e_ocflags = ev->ev_ocflags;
+	if ( ev->ev_nattrs ) {
+		e->e_attrs = (Attribute *)(e+1);
+		AC_MEMCPY( e->e_attrs, ev->ev_attrs, ev->ev_nattrs * sizeof(Attribute) );
+		for ( i = 1; i < ev->ev_nattrs; i++ )
+			e->e_attrs[i-1].a_next = &e->e_attrs[i];
+	} else {
+		e->e_attrs = NULL;
+	}
+	return e;
+}
+
 int mdb_id2entry(
 	Operation *op,
 	MDB_cursor *mc,
 	ID id,
 	Entry **e )
 {
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	MDB_val key, data;
-	int rc = 0;
+	mdb_ecache_slot *es = NULL;
+	mdb_ecache_val *ev = NULL, *old = NULL;
+	size_t txnid = 0;
+	int rc = 0, admit = 0;
 
 	*e = NULL;
 
@@ -436,13 +725,56 @@ int mdb_id2entry(
 		rc = MDB_NOTFOUND;
 	if ( rc ) return rc;
 
-	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, id, e );
-	if ( rc ) return rc;
+	if ( mdb->mi_ecache && ( txnid = mdb_ecache_reader( op, mdb, mc ))) {
+		es = &mdb->mi_ecache[id % mdb->mi_ecache_slots];
+		ldap_pvt_thread_mutex_lock( &es->es_mutex );
+		if ( txnid >= es->es_txnid ) {
+			ev = es->es_val;
+			if ( ev && ev->ev_id == id ) {
+				ev->ev_refs++;
+				if ( es->es_hits < MDB_ECACHE_HITS )
+					es->es_hits++;
+			} else {
+				if ( !ev || !es->es_hits )
+					admit = 1;
+				else
+					es->es_hits--;
+				ev = NULL;
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	}
+
+	if ( ev ) {
+		*e = mdb_ecache_entry( op, ev );
+	} else {
+		rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, id, e );
+		if ( rc ) return rc;
+	}
 
 	(*e)->e_id = id;
 	(*e)->e_name.bv_val = NULL;
 	(*e)->e_nname.bv_val = NULL;
 
+	if ( admit ) {
+		ev = mdb_ecache_copy( es, *e );
+		ldap_pvt_thread_mutex_lock( &es->es_mutex );
+		if ( txnid >= es->es_txnid &&
+			!( es->es_val && es->es_val->ev_id == id )) {
+			old = es->es_val;
+			if ( old && --old->ev_refs )
+				old = NULL;
+			es->es_val = ev;
+			es->es_hits = 1;
+			ev = NULL;
+		}
+		ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+		if ( old )
+			ch_free( old );
+		if ( ev )
+			ch_free( ev );
+	}
+
 	return rc;
 }
 
@@ -460,6 +792,8 @@ int mdb_id2entry_delete(
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
 
+	mdb_ecache_invalidate( mdb, tid, e->e_id );
+
 	/* delete from database */
 	rc = mdb_del( tid, dbi, &key, NULL );
 	if (rc)
@@ -516,6 +850,8 @@ int mdb_entry_return(
 	if ( !e )
 		return 0;
 	if ( e->e_private ) {
+		if ( e->e_private != e )
+			mdb_ecache_release( e->e_private );
 		if ( op->o_hdr && op->o_tmpmfuncs ) {
 			op->o_tmpfree( e->e_nname.bv_val, op->o_tmpmemctx );
 			op->o_tmpfree( e->e_name.bv_val, op->o_tmpmemctx );
@@ -651,6 +987,178 @@ return_results:
 	return(rc);
 }
 
+/* Group commit. Each write operation runs in a nested txn of one
+ * top-level write txn, the batch, one at a time. The operation that
+ * finds no batch open begins it on its own thread, and since the
+ * writer lock of the env has to be released by the thread that took
+ * it, that thread also commits the batch: once its own txn is done it
+ * waits until no other write is waiting to start or the batch holds
+ * groupcommit operations. A burst of concurrent writes thus costs one
+ * sync instead of one each. Operations only return once their batch
+ * is committed, and get its result.
+ */
+typedef struct mdb_gc_batch {
+	ldap_pvt_thread_t	gb_owner;	/* began the top-level txn */
+	int		gb_rc;
+	int		gb_refs;	/* operations waiting for the commit */
+	int		gb_commit;	/* the owner is to commit it now */
+	int		gb_done;
+} mdb_gc_batch;
+
+void
+mdb_gc_start( struct mdb_info *mdb )
+{
+	if ( mdb->mi_gc_running )
+		return;
+	if ( mdb->mi_dbenv_flags & MDB_WRITEMAP ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_gc_start: "
+			"groupcommit is not supported with writemap, ignored\n", 0, 0, 0 );
+		return;
+	}
+	ldap_pvt_thread_mutex_init( &mdb->mi_gc_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_gc_cond );
+	mdb->mi_gc_txn = NULL;
+	mdb->mi_gc_batch = NULL;
+	mdb->mi_gc_ops = 0;
+	mdb->mi_gc_waiting = 0;
+	mdb->mi_gc_busy = 0;
+	mdb->mi_gc_running = 1;
+}
+
+/* Called with no write operations in progress. The owner of a batch
+ * only returns once it is committed, so none is open.
+ */
+void
+mdb_gc_stop( struct mdb_info *mdb )
+{
+	if ( !mdb->mi_gc_running )
+		return;
+	assert( mdb->mi_gc_txn == NULL );
+	ldap_pvt_thread_cond_destroy( &mdb->mi_gc_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_gc_mutex );
+	mdb->mi_gc_running = 0;
+}
+
+/* An operation's txn is done; let the next one in, or have the batch
+ * committed if nobody is waiting. If this thread owns the batch, wait
+ * for that and commit it. Called with mi_gc_mutex locked.
+ */
+static void
+mdb_gc_release( struct mdb_info *mdb )
+{
+	mdb_gc_batch *gb = mdb->mi_gc_batch;
+	MDB_txn *txn;
+	int rc;
+
+	mdb->mi_gc_busy = 0;
+	if ( gb && ( !mdb->mi_gc_waiting ||
+		mdb->mi_gc_ops >= mdb->mi_gc_max ))
+		gb->gb_commit = 1;
+	ldap_pvt_thread_cond_broadcast( &mdb->mi_gc_cond );
+
+	if ( !gb || !ldap_pvt_thread_equal( gb->gb_owner, ldap_pvt_thread_self() ))
+		return;
+
+	while ( !gb->gb_commit )
+		ldap_pvt_thread_cond_wait( &mdb->mi_gc_cond, &mdb->mi_gc_mutex );
+
+	/* nobody starts another txn in the batch once it is to commit */
+	txn = mdb->mi_gc_txn;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+	rc = mdb_txn_commit( txn );
+	ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_gc_release: txn_commit failed: %s (%d)\n",
+			mdb_strerror(rc), rc, 0 );
+		mdb->mi_numads = 0;
+	}
+	gb->gb_rc = rc;
+	gb->gb_done = 1;
+	mdb->mi_gc_txn = NULL;
+	mdb->mi_gc_batch = NULL;
+	mdb->mi_gc_ops = 0;
+	if ( !gb->gb_refs )
+		ch_free( gb );
+	ldap_pvt_thread_cond_broadcast( &mdb->mi_gc_cond );
+}
+
+static int
+mdb_gc_begin( struct mdb_info *mdb, MDB_txn **txn )
+{
+	MDB_txn *ptxn;
+	int rc;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+	mdb->mi_gc_waiting++;
+	while ( mdb->mi_gc_busy ||
+		( mdb->mi_gc_batch && mdb->mi_gc_batch->gb_commit ))
+		ldap_pvt_thread_cond_wait( &mdb->mi_gc_cond, &mdb->mi_gc_mutex );
+	mdb->mi_gc_waiting--;
+	mdb->mi_gc_busy = 1;
+	if ( !mdb->mi_gc_txn ) {
+		/* may wait for a writer outside the batches; being busy
+		 * keeps the other operations out meanwhile */
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &ptxn );
+		ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "mdb_gc_begin: txn_begin failed: %s (%d)\n",
+				mdb_strerror(rc), rc, 0 );
+			mdb_gc_release( mdb );
+			ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+			return rc;
+		}
+		mdb->mi_gc_txn = ptxn;
+		mdb->mi_gc_batch = ch_calloc( 1, sizeof( mdb_gc_batch ));
+		mdb->mi_gc_batch->gb_owner = ldap_pvt_thread_self();
+	}
+	rc = mdb_txn_begin( mdb->mi_dbenv, mdb->mi_gc_txn, 0, txn );
+	if ( rc )
+		mdb_gc_release( mdb );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+	return rc;
+}
+
+int
+mdb_wtxn_commit( struct mdb_info *mdb, MDB_txn *txn )
+{
+	mdb_gc_batch *gb;
+	int rc;
+
+	if ( !mdb->mi_gc_running )
+		return mdb_txn_commit( txn );
+
+	rc = mdb_txn_commit( txn );
+	ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+	if ( rc ) {
+		mdb_gc_release( mdb );
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+		return rc;
+	}
+	gb = mdb->mi_gc_batch;
+	gb->gb_refs++;
+	mdb->mi_gc_ops++;
+	mdb_gc_release( mdb );
+	while ( !gb->gb_done )
+		ldap_pvt_thread_cond_wait( &mdb->mi_gc_cond, &mdb->mi_gc_mutex );
+	rc = gb->gb_rc;
+	if ( !--gb->gb_refs )
+		ch_free( gb );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+	return rc;
+}
+
+void
+mdb_wtxn_abort( struct mdb_info *mdb, MDB_txn *txn )
+{
+	mdb_txn_abort( txn );
+	if ( mdb->mi_gc_running ) {
+		ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+		mdb_gc_release( mdb );
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+	}
+}
+
 static void
 mdb_reader_free( void *key, void *data )
 {
@@ -732,6 +1240,14 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 		if ( !moi->moi_txn ) {
 			if (( slapMode & SLAP_TOOL_MODE ) && mdb_tool_txn ) {
 				moi->moi_txn = mdb_tool_txn;
+			} else if ( mdb->mi_gc_running ) {
+				/* lazyCommit makes no difference to a shared batch */
+				rc = mdb_gc_begin( mdb, &moi->moi_txn );
+				if (rc) {
+					Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
+						mdb_strerror(rc), rc, 0 );
+				}
+				return rc;
 			} else {
 				int flag = 0;
 				if ( get_lazyCommit( op ))
@@ -815,14 +1331,14 @@ int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 		}
 		return rc;
 	case SLAP_TXN_COMMIT:
-		rc = mdb_txn_commit( moi->moi_txn );
+		rc = mdb_wtxn_commit( mdb, moi->moi_txn );
 		if ( rc )
 			mdb->mi_numads = 0;
 		op->o_tmpfree( moi, op->o_tmpmemctx );
 		return rc;
 	case SLAP_TXN_ABORT:
 		mdb->mi_numads = 0;
-		mdb_txn_abort( moi->moi_txn );
+		mdb_wtxn_abort( mdb, moi->moi_txn );
 		op->o_tmpfree( moi, op->o_tmpmemctx );
 		return 0;
 	}
@@ -996,48 +1512,55 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
  * Note: everything is stored in a single contiguous block, so
  * you can not free individual attributes or names from this
  * structure. Attempting to do so will likely corrupt memory.
+ *
+ * If need is given, only the attributes it selects are decoded; the
+ * others are skipped over, which for separately stored multi-valued
+ * attributes saves the id2val lookups entirely. Their slots are kept,
+ * so mdb_entry_partial_complete() can fill them in place from the same
+ * record, which stays valid for as long as the txn, before the entry
+ * is handed out.
  */
 
-int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e)
+/* Every attribute has a fixed slot and its values a fixed range in the
+ * entry, whether decoded or not. With rest set, the attributes need
+ * left out are decoded and all of them linked.
+ */
+static int mdb_entry_decode_attrs(Operation *op, MDB_txn *txn, MDB_val *data,
+	ID id, mdb_attrmask *need, int rest, Entry *x)
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int i, j, nattrs, nvals;
-	int rc;
+	int rc = 0;
 	Attribute *a;
-	Entry *x;
 	const char *text;
 	unsigned int *lp = (unsigned int *)data->mv_data;
 	unsigned char *ptr;
 	BerVarray bptr;
 	MDB_cursor *mvc = NULL;
-
-	Debug( LDAP_DEBUG_TRACE,
-		"=> mdb_entry_decode:\n",
-		0, 0, 0 );
+	Attribute *last = NULL;
 
 	nattrs = *lp++;
 	nvals = *lp++;
-	x = mdb_entry_alloc(op, nattrs, nvals);
-	x->e_ocflags = *lp++;
-	if (!nvals) {
-		goto done;
-	}
-	a = x->e_attrs;
-	bptr = a->a_vals;
+	lp++;	/* e_ocflags */
+	if (!nvals)
+		return 0;
+	a = (Attribute *)(x+1);
+	bptr = (BerVarray)(a+nattrs);
 	i = *lp++;
 	ptr = (unsigned char *)(lp + i);
 
-	for (;nattrs>0; nattrs--) {
-		int have_nval = 0, multi = 0;
-		a->a_flags = SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
+	for (;nattrs>0; nattrs--, a++) {
+		int have_nval = 0, multi = 0, want;
+		unsigned flags = SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
+		unsigned numvals;
 		i = *lp++;
 		if (i & MDB_AT_SORTED) {
 			i ^= MDB_AT_SORTED;
-			a->a_flags |= SLAP_ATTR_SORTED_VALS;
+			flags |= SLAP_ATTR_SORTED_VALS;
 		}
 		if (i & MDB_AT_MULTI) {
 			i ^= MDB_AT_MULTI;
-			a->a_flags |= SLAP_ATTR_BIG_MULTI;
+			flags |= SLAP_ATTR_BIG_MULTI;
 			multi = 1;
 		}
 		if (i > mdb->mi_numads) {
@@ -1052,12 +1575,31 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 				goto leave;
 			}
 		}
-		a->a_desc = mdb->mi_ads[i];
-		a->a_numvals = *lp++;
-		if (a->a_numvals & MDB_AT_NVALS) {
-			a->a_numvals ^= MDB_AT_NVALS;
+		numvals = *lp++;
+		if (numvals & MDB_AT_NVALS) {
+			numvals ^= MDB_AT_NVALS;
 			have_nval = 1;
 		}
+		want = !need || i > need->am_numads || need->am_need[i];
+		if (rest ? want : !want) {
+			/* not wanted, or already there: step over its values */
+			if (!multi) {
+				j = numvals;
+				if (have_nval)
+					j += numvals;
+				for (; j>0; j--)
+					ptr += *lp++ + 1;
+			}
+			bptr += numvals + 1;
+			if (have_nval)
+				bptr += numvals + 1;
+			if (!rest)
+				continue;
+			goto link;
+		}
+		a->a_flags = flags;
+		a->a_desc = mdb->mi_ads[i];
+		a->a_numvals = numvals;
 		a->a_vals = bptr;
 		if (multi) {
 			if (!mvc) {
@@ -1110,14 +1652,17 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 				goto leave;
 			}
 		}
-		a->a_next = a+1;
-		a = a->a_next;
+link:
+		if (last)
+			last->a_next = a;
+		else
+			x->e_attrs = a;
+		last = a;
 	}
-	a[-1].a_next = NULL;
-done:
-	Debug(LDAP_DEBUG_TRACE, "<= mdb_entry_decode\n",
-		0, 0, 0 );
-	*e = x;
+	if (last)
+		last->a_next = NULL;
+	else
+		x->e_attrs = NULL;
 	rc = 0;
 
 leave:
@@ -1125,3 +1670,38 @@ leave:
 		mdb_cursor_close(mvc);
 	return rc;
 }
+
+int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e)
+{
+	return mdb_entry_partial_decode( op, txn, data, id, NULL, e );
+}
+
+int mdb_entry_partial_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id,
+	mdb_attrmask *need, Entry **e)
+{
+	unsigned int *lp = (unsigned int *)data->mv_data;
+	Entry *x;
+	int rc;
+
+	Debug( LDAP_DEBUG_TRACE,
+		"=> mdb_entry_decode:\n",
+		0, 0, 0 );
+
+	x = mdb_entry_alloc(op, lp[0], lp[1]);
+	x->e_ocflags = lp[2];
+	rc = mdb_entry_decode_attrs(op, txn, data, id, need, 0, x);
+	if (rc)
+		return rc;
+
+	Debug(LDAP_DEBUG_TRACE, "<= mdb_entry_decode\n",
+		0, 0, 0 );
+	*e = x;
+	return 0;
+}
+
+/* Decode what a partial decode of data with the same need left out */
+int mdb_entry_partial_complete(Operation *op, MDB_txn *txn, MDB_val *data,
+	mdb_attrmask *need, Entry *e)
+{
+	return mdb_entry_decode_attrs(op, txn, data, e->e_id, need, 1, e);
+}
@@ -271,7 +271,7 @@ mdb_idl_fetch_key(
 	MDB_val data, key2, *kptr;
 	MDB_cursor *cursor;
 	ID *i;
-	size_t len;
+	size_t len, count = 0;
 	int rc;
 	MDB_cursor_op opflag;
 
@@ -331,7 +331,19 @@ mdb_idl_fetch_key(
 		key->mv_data, key->mv_size ) > 0 ) {
 		rc = MDB_NOTFOUND;
 	}
-	if (rc == 0) {
+	if (rc == 0)
+		rc = mdb_cursor_count( cursor, &count );
+	if (rc == 0 && count > MDB_IDL_DB_MAX) {
+		/* An exact key too big for an IDL, read it as a range */
+		ID lo, hi;
+		memcpy( &lo, data.mv_data, sizeof(ID) );
+		rc = mdb_cursor_get( cursor, key, &data, MDB_LAST_DUP );
+		if (rc == 0) {
+			memcpy( &hi, data.mv_data, sizeof(ID) );
+			MDB_IDL_RANGE( ids, lo, hi );
+			data.mv_size = MDB_IDL_SIZEOF(ids);
+		}
+	} else if (rc == 0) {
 		i = ids+1;
 		rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
 		while (rc == 0) {
@@ -389,6 +401,129 @@ mdb_idl_fetch_key(
 	return rc;
 }
 
+/*
+ * Count the IDs stored under key without reading them.
+ */
+int
+mdb_idl_count_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count )
+{
+	MDB_val data;
+	MDB_cursor *cursor;
+	size_t n;
+	ID lo, *i;
+	int rc;
+
+	*count = 0;
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc != 0 )
+		return rc;
+	rc = mdb_cursor_get( cursor, key, &data, MDB_SET );
+	if ( rc == 0 )
+		rc = mdb_cursor_count( cursor, &n );
+	if ( rc == 0 ) {
+		memcpy( &lo, data.mv_data, sizeof(ID) );
+		if ( lo == 0 ) {
+			/* a range, its size is all we can tell */
+			rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
+			if ( rc == 0 && data.mv_size >= MDB_IDL_RANGE_SIZEOF ) {
+				i = data.mv_data;
+				*count = i[2] - i[1] + 1;
+			}
+		} else {
+			*count = n;
+		}
+	}
+	mdb_cursor_close( cursor );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	return rc;
+}
+
+/*
+ * Intersect ids with the IDs stored under key. When the key holds
+ * many more IDs than ids (or more than an IDL can, so that reading it
+ * would only give a range), each candidate is looked up in the key
+ * instead, which keeps the result exact.
+ */
+int
+mdb_idl_intersect_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*ids,
+	ID			*tmp )
+{
+	MDB_val data;
+	MDB_cursor *cursor;
+	size_t count;
+	ID lo, i, j;
+	int rc;
+
+	if ( MDB_IDL_IS_ZERO( ids ) )
+		return 0;
+	if ( MDB_IDL_IS_RANGE( ids ) )
+		goto fetch;
+
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc != 0 ) {
+		Debug( LDAP_DEBUG_ANY, "=> mdb_idl_intersect_key: "
+			"cursor failed: %s (%d)\n", mdb_strerror(rc), rc, 0 );
+		return rc;
+	}
+	rc = mdb_cursor_get( cursor, key, &data, MDB_SET );
+	if ( rc == 0 )
+		rc = mdb_cursor_count( cursor, &count );
+	if ( rc != 0 ) {
+		mdb_cursor_close( cursor );
+		if ( rc == MDB_NOTFOUND ) {
+			MDB_IDL_ZERO( ids );
+			rc = 0;
+		}
+		return rc;
+	}
+	memcpy( &lo, data.mv_data, sizeof(ID) );
+
+	/* ranges and small keys are cheaper to read whole */
+	if ( lo == 0 || ( count <= MDB_IDL_DB_MAX &&
+		count / MDB_IDL_PROBE_RATIO <= ids[0] )) {
+		mdb_cursor_close( cursor );
+		goto fetch;
+	}
+
+	for ( i = 1, j = 0; i <= ids[0]; i++ ) {
+		data.mv_data = &ids[i];
+		data.mv_size = sizeof(ID);
+		rc = mdb_cursor_get( cursor, key, &data, MDB_GET_BOTH );
+		if ( rc == 0 ) {
+			ids[++j] = ids[i];
+		} else if ( rc != MDB_NOTFOUND ) {
+			break;
+		}
+	}
+	mdb_cursor_close( cursor );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	if ( rc == 0 )
+		ids[0] = j;
+	return rc;
+
+fetch:
+	rc = mdb_idl_fetch_key( be, txn, dbi, key, tmp, NULL, 0 );
+	if ( rc == MDB_NOTFOUND ) {
+		MDB_IDL_ZERO( ids );
+		rc = 0;
+	} else if ( rc == 0 ) {
+		mdb_idl_intersection( ids, tmp );
+	}
+	return rc;
+}
+
 int
 mdb_idl_insert_keys(
 	BackendDB	*be,
@@ -447,7 +582,7 @@ mdb_idl_insert_keys(
 				err = "c_count";
 				goto fail;
 			}
-			if ( count >= MDB_IDL_DB_MAX ) {
+			if ( count >= MDB_IDL_DB_MAX && !mdb->mi_idl_exact ) {
 			/* No room, convert to a range */
 				lo = *i;
 				rc = mdb_cursor_get( cursor, &key, &data, MDB_LAST_DUP );
@@ -666,6 +801,33 @@ fail:
 }
 
 
+/*
+ * Find the first position at or after lo in ids whose ID is not
+ * less than id, stepping exponentially before the binary search.
+ */
+static ID
+idl_gallop( ID *ids, ID lo, ID id )
+{
+	ID hi, step = 1;
+
+	hi = lo;
+	while ( hi <= ids[0] && ids[hi] < id ) {
+		lo = hi + 1;
+		hi += step;
+		step <<= 1;
+	}
+	if ( hi > ids[0] )
+		hi = ids[0] + 1;
+	while ( lo < hi ) {
+		ID mid = lo + (( hi - lo ) >> 1 );
+		if ( ids[mid] < id )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
 /*
  * idl_intersection - return a = a intersection b
  */
@@ -726,6 +888,35 @@ mdb_idl_intersection(
 		goto done;
 	}
 
+	/* When one list is much shorter, look its IDs up in the
+	 * longer one instead of walking both. Matches are stored in
+	 * a, which never overtakes the position being read.
+	 */
+	if ( !MDB_IDL_IS_RANGE( b ) && ( a[0] > b[0] * MDB_IDL_PROBE_RATIO
+		|| b[0] > a[0] * MDB_IDL_PROBE_RATIO )) {
+		ID *s = a, *l = b;
+		if ( a[0] > b[0] ) {
+			s = b;
+			l = a;
+		}
+		cursora = 1;
+		cursorc = 0;
+		for ( cursorb = 1; cursorb <= s[0]; cursorb++ ) {
+			ida = s[cursorb];
+			if ( ida < idmin )
+				continue;
+			if ( ida > idmax )
+				break;
+			cursora = idl_gallop( l, cursora, ida );
+			if ( cursora > l[0] )
+				break;
+			if ( l[cursora] == ida )
+				a[++cursorc] = ida;
+		}
+		a[0] = cursorc;
+		goto done;
+	}
+
 	/* Fine, do the intersection one element at a time.
 	 * First advance to idmin in both IDLs.
 	 */
@@ -29,6 +29,14 @@
 
 #define MDB_IDL_UM_MAX		(MDB_IDL_UM_SIZE-1)
 
+/* An intersection looks IDs up individually in the other set
+ * once that is this many times larger */
+#define MDB_IDL_PROBE_RATIO	16
+
+/* An AND stops reading index keys once it is down to this
+ * many candidates */
+#define MDB_IDL_AND_SHORTCUT	32
+
 #define MDB_IDL_IS_RANGE(ids)	((ids)[0] == NOID)
 #define MDB_IDL_RANGE_SIZE		(3)
 #define MDB_IDL_RANGE_SIZEOF	(MDB_IDL_RANGE_SIZE * sizeof(ID))
@@ -100,6 +100,10 @@ int mdb_index_param(
 		case LDAP_FILTER_SUBSTRINGS:
 			type = SLAP_INDEX_SUBSTR;
 			break;
+		case LDAP_FILTER_GE:
+		case LDAP_FILTER_LE:
+			type = SLAP_INDEX_ORDERED;
+			break;
 		default:
 			return LDAP_INAPPROPRIATE_MATCHING;
 		}
@@ -145,6 +149,14 @@ int mdb_index_param(
 		}
 		break;
 
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		type = SLAP_INDEX_ORDERED;
+		if( IS_SLAP_INDEX( mask, SLAP_INDEX_ORDERED ) ) {
+			goto done;
+		}
+		break;
+
 	default:
 		return LDAP_OTHER;
 	}
@@ -161,6 +173,111 @@ done:
 	return LDAP_SUCCESS;
 }
 
+/* The ordered index key of a value: its first MDB_ORDERED_KEYLEN
+ * bytes, zero padded. Comparing these with memcmp orders them like
+ * octetStringOrderingMatch orders the values, except that values
+ * sharing a prefix that long get the same key.
+ */
+void mdb_ordered_key(
+	struct berval *val,
+	struct berval *key )
+{
+	ber_len_t len = val->bv_len;
+
+	if ( len > MDB_ORDERED_KEYLEN )
+		len = MDB_ORDERED_KEYLEN;
+	AC_MEMCPY( key->bv_val, val->bv_val, len );
+	memset( key->bv_val + len, 0, MDB_ORDERED_KEYLEN - len );
+	key->bv_len = MDB_ORDERED_KEYLEN;
+}
+
+static struct berval *
+ordered_keys(
+	Operation *op,
+	BerVarray vals )
+{
+	struct berval *keys;
+	char *ptr;
+	int i;
+
+	for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ ) ;
+	keys = op->o_tmpalloc( (i+1) * sizeof(struct berval) +
+		i * MDB_ORDERED_KEYLEN, op->o_tmpmemctx );
+	ptr = (char *)(keys + i+1);
+	for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ ) {
+		keys[i].bv_val = ptr;
+		mdb_ordered_key( &vals[i], &keys[i] );
+		ptr += MDB_ORDERED_KEYLEN;
+	}
+	BER_BVZERO( &keys[i] );
+	return keys;
+}
+
+static int
+keycmp( const void *v1, const void *v2 )
+{
+	return ber_bvcmp( (struct berval *)v1, (struct berval *)v2 );
+}
+
+/* Remove from keys those that are also in keep, so that deleting some
+ * values of an attribute leaves the keys its other values still need.
+ * Removed keys are freed if they were allocated one by one.
+ */
+static void
+index_keys_minus(
+	Operation *op,
+	struct berval *keys,
+	struct berval *keep,
+	int freeit )
+{
+	int i, j, n;
+
+	if ( !keep )
+		return;
+	for ( n = 0; !BER_BVISNULL( &keep[n] ); n++ ) ;
+	qsort( keep, n, sizeof(struct berval), keycmp );
+
+	for ( i = j = 0; !BER_BVISNULL( &keys[i] ); i++ ) {
+		if ( bsearch( &keys[i], keep, n, sizeof(struct berval), keycmp )) {
+			if ( freeit )
+				ber_memfree_x( keys[i].bv_val, op->o_tmpmemctx );
+		} else {
+			keys[j++] = keys[i];
+		}
+	}
+	BER_BVZERO( &keys[j] );
+}
+
+/* Drop the keys of a matching rule that keep's values also produce */
+static int
+index_keys_keep(
+	Operation *op,
+	MatchingRule *mr,
+	unsigned use,
+	slap_mask_t mask,
+	AttributeDescription *ad,
+	struct berval *atname,
+	BerVarray keep,
+	struct berval *keys )
+{
+	struct berval *kkeys = NULL;
+	int rc;
+
+	if ( !keep )
+		return LDAP_SUCCESS;
+
+	rc = mr->smr_indexer( use, mask, ad->ad_type->sat_syntax, mr,
+		atname, keep, &kkeys, op->o_tmpmemctx );
+	if ( rc == LDAP_SUCCESS && kkeys != NULL ) {
+		index_keys_minus( op, keys, kkeys, 1 );
+		ber_bvarray_free_x( kkeys, op->o_tmpmemctx );
+	}
+	return rc;
+}
+
+/* Index or unindex the values of one attribute. When deleting, keep
+ * lists the attribute's remaining values, whose keys must be left.
+ */
 static int indexer(
 	Operation *op,
 	MDB_txn *txn,
@@ -168,19 +285,28 @@ static int indexer(
 	AttributeDescription *ad,
 	struct berval *atname,
 	BerVarray vals,
+	BerVarray keep,
 	ID id,
 	int opid,
 	slap_mask_t mask )
 {
 	int rc;
-	struct berval *keys;
+	struct berval *keys, *kkeys;
 	MDB_cursor *mc = ai->ai_cursor;
 	mdb_idl_keyfunc *keyfunc;
+	AttrIxInfo *ax = NULL;
 	char *err;
 
 	assert( mask != 0 );
 
-	if ( !mc ) {
+	/* slapindex -q collects the keys in memory, see tools.c */
+	if ( opid == SLAP_INDEX_ADD_OP && ( slapMode & SLAP_TOOL_QUICK )) {
+		ax = (AttrIxInfo *)LDAP_SLIST_FIRST(&op->o_extra);
+		if ( ax && ax->ai_oe.oe_key != (void *)mdb_tool_bulk_add )
+			ax = NULL;
+	}
+
+	if ( !mc && !ax ) {
 		err = "c_open";
 		rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
 		if ( rc ) goto done;
@@ -189,6 +315,11 @@ static int indexer(
 	}
 
 	if ( opid == SLAP_INDEX_ADD_OP ) {
+		if ( ax ) {
+			ax->ai_ai = ai;
+			keyfunc = mdb_tool_bulk_add;
+			mc = (MDB_cursor *)ax;
+		} else
 #ifdef MDB_TOOL_IDL_CACHING
 		if (( slapMode & SLAP_TOOL_QUICK ) && slap_tool_thread_max > 2 ) {
 			AttrIxInfo *ax = (AttrIxInfo *)LDAP_SLIST_FIRST(&op->o_extra);
@@ -201,7 +332,7 @@ static int indexer(
 	} else
 		keyfunc = mdb_idl_delete_keys;
 
-	if( IS_SLAP_INDEX( mask, SLAP_INDEX_PRESENT ) ) {
+	if( IS_SLAP_INDEX( mask, SLAP_INDEX_PRESENT ) && !keep ) {
 		rc = keyfunc( op->o_bd, mc, presence_key, id );
 		if( rc ) {
 			err = "presence";
@@ -218,7 +349,13 @@ static int indexer(
 			atname, vals, &keys, op->o_tmpmemctx );
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
-			rc = keyfunc( op->o_bd, mc, keys, id );
+			rc = index_keys_keep( op, ad->ad_type->sat_equality, LDAP_FILTER_EQUALITY,
+				mask, ad, atname, keep, keys );
+			if ( rc == LDAP_SUCCESS && !BER_BVISNULL( keys ))
+				rc = keyfunc( op->o_bd, mc, keys, id );
+			if ( rc == LDAP_SUCCESS && ai->ai_bloom &&
+				opid == SLAP_INDEX_ADD_OP )
+				mdb_bloom_add_keys( ai->ai_bloom, keys );
 			ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if ( rc ) {
 				err = "equality";
@@ -237,7 +374,10 @@ static int indexer(
 			atname, vals, &keys, op->o_tmpmemctx );
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
-			rc = keyfunc( op->o_bd, mc, keys, id );
+			rc = index_keys_keep( op, ad->ad_type->sat_approx, LDAP_FILTER_APPROX,
+				mask, ad, atname, keep, keys );
+			if ( rc == LDAP_SUCCESS && !BER_BVISNULL( keys ))
+				rc = keyfunc( op->o_bd, mc, keys, id );
 			ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if ( rc ) {
 				err = "approx";
@@ -257,7 +397,10 @@ static int indexer(
 			atname, vals, &keys, op->o_tmpmemctx );
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
-			rc = keyfunc( op->o_bd, mc, keys, id );
+			rc = index_keys_keep( op, ad->ad_type->sat_substr, LDAP_FILTER_SUBSTRINGS,
+				mask, ad, atname, keep, keys );
+			if ( rc == LDAP_SUCCESS && !BER_BVISNULL( keys ))
+				rc = keyfunc( op->o_bd, mc, keys, id );
 			ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if( rc ) {
 				err = "substr";
@@ -268,6 +411,22 @@ static int indexer(
 		rc = LDAP_SUCCESS;
 	}
 
+	if( IS_SLAP_INDEX( mask, SLAP_INDEX_ORDERED ) ) {
+		keys = ordered_keys( op, vals );
+		if ( keep ) {
+			kkeys = ordered_keys( op, keep );
+			index_keys_minus( op, keys, kkeys, 0 );
+			op->o_tmpfree( kkeys, op->o_tmpmemctx );
+		}
+
+		rc = BER_BVISNULL( keys ) ? 0 : keyfunc( op->o_bd, mc, keys, id );
+		op->o_tmpfree( keys, op->o_tmpmemctx );
+		if( rc ) {
+			err = "ordered";
+			goto done;
+		}
+	}
+
 done:
 	if ( !(slapMode & SLAP_TOOL_QUICK))
 		mdb_cursor_close( mc );
@@ -289,6 +448,7 @@ static int index_at_values(
 	AttributeType *type,
 	struct berval *tags,
 	BerVarray vals,
+	BerVarray keep,
 	ID id,
 	int opid )
 {
@@ -304,7 +464,7 @@ static int index_at_values(
 		/* recurse */
 		rc = index_at_values( op, txn, NULL,
 			type->sat_sup, tags,
-			vals, id, opid );
+			vals, keep, id, opid );
 
 		if( rc ) return rc;
 	}
@@ -319,7 +479,7 @@ static int index_at_values(
 				ComponentReference *cr;
 				for( cr = ai->ai_cr ; cr ; cr = cr->cr_next ) {
 					rc = indexer( op, txn, ai, cr->cr_ad, &type->sat_cname,
-						cr->cr_nvals, id, ixop,
+						cr->cr_nvals, NULL, id, ixop,
 						cr->cr_indexmask );
 				}
 			}
@@ -337,7 +497,7 @@ static int index_at_values(
 				mask = ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask;
 			if( mask ) {
 				rc = indexer( op, txn, ai, ad, &type->sat_cname,
-					vals, id, ixop, mask );
+					vals, keep, id, ixop, mask );
 
 				if( rc ) return rc;
 			}
@@ -358,7 +518,7 @@ static int index_at_values(
 					mask = ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask;
 				if ( mask ) {
 					rc = indexer( op, txn, ai, desc, &desc->ad_cname,
-						vals, id, ixop, mask );
+						vals, keep, id, ixop, mask );
 
 					if( rc ) {
 						return rc;
@@ -387,11 +547,342 @@ int mdb_index_values(
 
 	rc = index_at_values( op, txn, desc,
 		desc->ad_type, &desc->ad_tags,
-		vals, id, opid );
+		vals, NULL, id, opid );
 
 	return rc;
 }
 
+/* Delete the index keys of some values of an attribute, except those
+ * that the values it still has also produce. Only the keys that
+ * actually change are touched, however many values remain.
+ */
+int mdb_index_delete_values(
+	Operation *op,
+	MDB_txn *txn,
+	AttributeDescription *desc,
+	BerVarray vals,
+	BerVarray keep,
+	ID id )
+{
+	if ( id == 0 )
+		return 0;
+
+	if ( keep && BER_BVISNULL( keep ))
+		keep = NULL;
+
+	return index_at_values( op, txn, desc,
+		desc->ad_type, &desc->ad_tags,
+		vals, keep, id, SLAP_INDEX_DELETE_OP );
+}
+
+/* The composite index keys of an entry: each combination of one eq
+ * key of every component, concatenated. No keys if a component has
+ * no values, only the overflow key if there are too many combinations.
+ */
+static int
+comp_keys(
+	Operation *op,
+	CompInfo *ci,
+	Attribute *attrs,
+	struct berval **keysp )
+{
+	struct berval *ckeys[MDB_COMP_MAX] = { NULL };
+	int nkeys[MDB_COMP_MAX], cur[MDB_COMP_MAX];
+	struct berval *keys;
+	Attribute *a, *first;
+	BerVarray vals;
+	MatchingRule *mr;
+	ber_len_t size;
+	unsigned long count = 1, n;
+	char *ptr;
+	int i, j, rc = LDAP_SUCCESS;
+
+	*keysp = NULL;
+
+	for ( i = 0; i < ci->ci_nads; i++ ) {
+		AttributeDescription *ad = ci->ci_ads[i];
+
+		/* A filter on ad matches the values of its subtypes too */
+		first = NULL;
+		n = 0;
+		for ( a = attrs; a; a = a->a_next ) {
+			if ( is_ad_subtype( a->a_desc, ad )) {
+				if ( !first )
+					first = a;
+				n += a->a_numvals;
+			}
+		}
+		if ( !n )
+			goto done;
+		/* past the cap, all that matters is that every
+		 * component has values */
+		if ( count > MDB_COMP_MAXKEYS )
+			continue;
+		if ( n == first->a_numvals ) {
+			vals = first->a_nvals;
+		} else {
+			vals = op->o_tmpalloc( (n+1) * sizeof(struct berval),
+				op->o_tmpmemctx );
+			n = 0;
+			for ( a = first; a; a = a->a_next ) {
+				if ( is_ad_subtype( a->a_desc, ad )) {
+					AC_MEMCPY( &vals[n], a->a_nvals,
+						a->a_numvals * sizeof(struct berval) );
+					n += a->a_numvals;
+				}
+			}
+			BER_BVZERO( &vals[n] );
+		}
+
+		mr = ad->ad_type->sat_equality;
+		rc = mr->smr_indexer( LDAP_FILTER_EQUALITY, SLAP_INDEX_EQUALITY,
+			ad->ad_type->sat_syntax, mr, &ad->ad_type->sat_cname,
+			vals, &ckeys[i], op->o_tmpmemctx );
+		if ( vals != first->a_nvals )
+			op->o_tmpfree( vals, op->o_tmpmemctx );
+		if ( rc != LDAP_SUCCESS || ckeys[i] == NULL )
+			goto done;
+
+		for ( j = 0; !BER_BVISNULL( &ckeys[i][j] ); j++ ) ;
+		nkeys[i] = j;
+		if ( j > MDB_COMP_MAXKEYS / count )
+			count = MDB_COMP_MAXKEYS + 1;
+		else
+			count *= j;
+	}
+
+	if ( count > MDB_COMP_MAXKEYS ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"comp_keys: %s: more than %d keys, using the overflow key\n",
+			ci->ci_name.bv_val, MDB_COMP_MAXKEYS, 0 );
+		keys = op->o_tmpcalloc( 1, 2 * sizeof(struct berval) +
+			MDB_COMP_OVERFLOW_LEN, op->o_tmpmemctx );
+		keys[0].bv_val = (char *)(keys + 2);
+		keys[0].bv_len = MDB_COMP_OVERFLOW_LEN;
+		*keysp = keys;
+		goto done;
+	}
+
+	size = 0;
+	for ( i = 0; i < ci->ci_nads; i++ ) {
+		for ( j = 0; j < nkeys[i]; j++ )
+			size += ckeys[i][j].bv_len * ( count / nkeys[i] );
+		cur[i] = 0;
+	}
+	size += count * 7;
+	keys = op->o_tmpalloc( (count+1) * sizeof(struct berval) + size,
+		op->o_tmpmemctx );
+	ptr = (char *)(keys + count+1);
+	for ( n = 0; n < count; n++ ) {
+		keys[n].bv_val = ptr;
+		for ( i = 0; i < ci->ci_nads; i++ ) {
+			AC_MEMCPY( ptr, ckeys[i][cur[i]].bv_val,
+				ckeys[i][cur[i]].bv_len );
+			ptr += ckeys[i][cur[i]].bv_len;
+		}
+		keys[n].bv_len = MDB_COMP_PAD( ptr - keys[n].bv_val );
+		memset( ptr, 0, keys[n].bv_val + keys[n].bv_len - ptr );
+		ptr = keys[n].bv_val + keys[n].bv_len;
+		/* next combination */
+		for ( i = ci->ci_nads-1; i >= 0; i-- ) {
+			if ( ++cur[i] < nkeys[i] )
+				break;
+			cur[i] = 0;
+		}
+	}
+	BER_BVZERO( &keys[n] );
+	*keysp = keys;
+
+done:
+	for ( i = 0; i < ci->ci_nads; i++ ) {
+		if ( ckeys[i] )
+			ber_bvarray_free_x( ckeys[i], op->o_tmpmemctx );
+	}
+	return rc;
+}
+
+/* Whether a composite index is to be maintained by opid, and with a
+ * modlist, whether it covers one of the modified attributes.
+ */
+static int
+comp_wanted(
+	CompInfo *ci,
+	int opid,
+	Modifications *ml )
+{
+	Modifications *m;
+	slap_mask_t mask;
+	int j;
+
+	if ( opid == MDB_INDEX_UPDATE_OP )
+		mask = ci->ci_newmask & ~ci->ci_indexmask;
+	else
+		mask = ci->ci_newmask ? ci->ci_newmask : ci->ci_indexmask;
+	if ( !IS_SLAP_INDEX( mask, SLAP_INDEX_EQUALITY ))
+		return 0;
+
+	if ( !ml )
+		return 1;
+	for ( m = ml; m; m = m->sml_next ) {
+		for ( j = 0; j < ci->ci_nads; j++ ) {
+			if ( is_ad_subtype( m->sml_desc, ci->ci_ads[j] ))
+				return 1;
+		}
+	}
+	return 0;
+}
+
+static int
+comp_write(
+	Operation *op,
+	MDB_txn *txn,
+	CompInfo *ci,
+	struct berval *dels,
+	struct berval *adds,
+	ID id )
+{
+	MDB_cursor *mc;
+	int rc;
+
+	rc = mdb_cursor_open( txn, ci->ci_dbi, &mc );
+	if ( rc == 0 ) {
+		if ( dels && !BER_BVISNULL( dels ))
+			rc = mdb_idl_delete_keys( op->o_bd, mc, dels, id );
+		if ( rc == 0 && adds && !BER_BVISNULL( adds ))
+			rc = mdb_idl_insert_keys( op->o_bd, mc, adds, id );
+		mdb_cursor_close( mc );
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_index_comps: %s failed: %s (%d)\n",
+			ci->ci_name.bv_val, mdb_strerror(rc), rc );
+		return LDAP_OTHER;
+	}
+	return LDAP_SUCCESS;
+}
+
+/* Add or delete an entry's composite index keys */
+int
+mdb_index_comps(
+	Operation *op,
+	MDB_txn *txn,
+	int opid,
+	Attribute *attrs,
+	ID id )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	CompInfo *ci;
+	struct berval *keys;
+	int i, rc = 0;
+
+	/* Never index ID 0 */
+	if ( id == 0 )
+		return 0;
+
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		ci = mdb->mi_comps[i];
+		if ( !comp_wanted( ci, opid, NULL ))
+			continue;
+
+		rc = comp_keys( op, ci, attrs, &keys );
+		if ( rc != LDAP_SUCCESS || keys == NULL )
+			continue;
+
+		if ( opid == SLAP_INDEX_DELETE_OP )
+			rc = comp_write( op, txn, ci, keys, NULL, id );
+		else
+			rc = comp_write( op, txn, ci, NULL, keys, id );
+		op->o_tmpfree( keys, op->o_tmpmemctx );
+		if ( rc )
+			return rc;
+	}
+	return LDAP_SUCCESS;
+}
+
+static int
+comp_key_cmp( const void *v1, const void *v2 )
+{
+	const struct berval *k1 = v1, *k2 = v2;
+
+	return ber_bvcmp( k1, k2 );
+}
+
+/* Rekey an entry's composite indexes after a modify. Only the
+ * composites over a modified attribute are looked at, and of those
+ * only the key combinations that came or went are written.
+ */
+int
+mdb_index_comps_modify(
+	Operation *op,
+	MDB_txn *txn,
+	Attribute *oldattrs,
+	Attribute *newattrs,
+	ID id,
+	Modifications *ml )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	CompInfo *ci;
+	struct berval *okeys, *nkeys, key;
+	int i, j, k, no, nn, cmp, rc = 0;
+
+	if ( id == 0 )
+		return 0;
+
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		ci = mdb->mi_comps[i];
+		if ( !comp_wanted( ci, SLAP_INDEX_ADD_OP, ml ))
+			continue;
+
+		if ( comp_keys( op, ci, oldattrs, &okeys ) != LDAP_SUCCESS )
+			okeys = NULL;
+		if ( comp_keys( op, ci, newattrs, &nkeys ) != LDAP_SUCCESS )
+			nkeys = NULL;
+
+		/* Drop the keys on both sides, leaving the old ones to
+		 * delete and the new ones to add.
+		 */
+		if ( okeys && nkeys ) {
+			for ( no = 0; !BER_BVISNULL( &okeys[no] ); no++ ) ;
+			for ( nn = 0; !BER_BVISNULL( &nkeys[nn] ); nn++ ) ;
+			qsort( okeys, no, sizeof(struct berval), comp_key_cmp );
+			qsort( nkeys, nn, sizeof(struct berval), comp_key_cmp );
+			for ( j = 0, k = 0, no = 0, nn = 0;
+				!BER_BVISNULL( &okeys[j] ) || !BER_BVISNULL( &nkeys[k] ); ) {
+				if ( BER_BVISNULL( &okeys[j] ))
+					cmp = 1;
+				else if ( BER_BVISNULL( &nkeys[k] ))
+					cmp = -1;
+				else
+					cmp = comp_key_cmp( &okeys[j], &nkeys[k] );
+				key = cmp > 0 ? nkeys[k] : okeys[j];
+				if ( cmp < 0 )
+					okeys[no++] = key;
+				else if ( cmp > 0 )
+					nkeys[nn++] = key;
+				/* a key can come up more than once on either side */
+				while ( !BER_BVISNULL( &okeys[j] ) &&
+					!comp_key_cmp( &okeys[j], &key ))
+					j++;
+				while ( !BER_BVISNULL( &nkeys[k] ) &&
+					!comp_key_cmp( &nkeys[k], &key ))
+					k++;
+			}
+			BER_BVZERO( &okeys[no] );
+			BER_BVZERO( &nkeys[nn] );
+		}
+
+		if ( okeys || nkeys )
+			rc = comp_write( op, txn, ci, okeys, nkeys, id );
+		if ( okeys )
+			op->o_tmpfree( okeys, op->o_tmpmemctx );
+		if ( nkeys )
+			op->o_tmpfree( nkeys, op->o_tmpmemctx );
+		if ( rc )
+			return rc;
+	}
+	return LDAP_SUCCESS;
+}
+
 /* Get the list of which indices apply to this attr */
 int
 mdb_index_recset(
@@ -462,7 +953,7 @@ int mdb_index_recrun(
 			ir->ir_attrs = al->next;
 			rc = indexer( op, txn, ir->ir_ai, ir->ir_ai->ai_desc,
 				&ir->ir_ai->ai_desc->ad_type->sat_cname,
-				al->attr->a_nvals, id, SLAP_INDEX_ADD_OP,
+				al->attr->a_nvals, NULL, id, SLAP_INDEX_ADD_OP,
 				ir->ir_ai->ai_indexmask );
 			free( al );
 			if ( rc ) break;
@@ -569,6 +1060,15 @@ mdb_index_entry(
 		}
 	}
 
+	rc = mdb_index_comps( op, txn, opid, e->e_attrs, e->e_id );
+	if( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<= index_entry_%s( %ld, \"%s\" ) composite failure\n",
+			opid == SLAP_INDEX_ADD_OP ? "add" : "del",
+			(long) e->e_id, e->e_dn );
+		return rc;
+	}
+
 	Debug( LDAP_DEBUG_TRACE, "<= index_entry_%s( %ld, \"%s\" ) success\n",
 		opid == SLAP_INDEX_DELETE_OP ? "del" : "add",
 		(long) e->e_id, e->e_dn ? e->e_dn : "" );
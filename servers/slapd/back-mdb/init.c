@@ -32,6 +32,7 @@ static const struct berval mdmi_databases[] = {
 	BER_BVC("dn2i"),
 	BER_BVC("id2e"),
 	BER_BVC("id2v"),
+	BER_BVC("id2k"),
 	BER_BVNULL
 };
 
@@ -61,9 +62,11 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_search_stack_depth = DEFAULT_SEARCH_STACK_DEPTH;
 	mdb->mi_search_stack = NULL;
+	ldap_pvt_thread_mutex_init( &mdb->mi_search_mutex );
 
 	mdb->mi_mapsize = DEFAULT_MAPSIZE;
 	mdb->mi_rtxn_size = DEFAULT_RTXN_SIZE;
+	mdb->mi_index_batch = DEFAULT_INDEX_BATCH;
 	mdb->mi_multi_hi = UINT_MAX;
 	mdb->mi_multi_lo = UINT_MAX;
 
@@ -82,10 +85,220 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 static int
 mdb_db_close( BackendDB *be, ConfigReply *cr );
 
+/* Startup warm-up. At close the pages of the map that are in memory
+ * are listed in mi_warmfile as "first-page count" runs, one per line,
+ * the format mdb_warm(1) uses too; at open they're handed back to the
+ * OS to read in, which it does in the background while we go on.
+ * Then the sub-databases in mi_warmup are read through in order, so
+ * that the listener only opens once they're in memory.
+ */
+#define MDB_WARM_CHUNK	65536
+
+static void
+mdb_warm_save( struct mdb_info *mdb )
+{
+	MDB_envinfo ei;
+	unsigned char *vec;
+	size_t pgno, npages, i, start = 0, run = 0, nsaved = 0;
+	char *tmp;
+	FILE *f;
+	int rc = 0;
+
+	tmp = ch_malloc( strlen( mdb->mi_warmfile ) + STRLENOF(".tmp") + 1 );
+	sprintf( tmp, "%s.tmp", mdb->mi_warmfile );
+	f = fopen( tmp, "w" );
+	if ( !f ) {
+		rc = errno;
+		goto done;
+	}
+
+	mdb_env_info( mdb->mi_dbenv, &ei );
+	vec = ch_malloc( MDB_WARM_CHUNK );
+	for ( pgno = 0; pgno <= ei.me_last_pgno; pgno += npages ) {
+		npages = ei.me_last_pgno + 1 - pgno;
+		if ( npages > MDB_WARM_CHUNK )
+			npages = MDB_WARM_CHUNK;
+		rc = mdb_env_incore( mdb->mi_dbenv, pgno, npages, vec );
+		if ( rc )
+			break;
+		for ( i = 0; i < npages; i++ ) {
+			if ( vec[i] ) {
+				if ( !run++ )
+					start = pgno + i;
+			} else if ( run ) {
+				fprintf( f, "%lu %lu\n", (unsigned long)start,
+					(unsigned long)run );
+				nsaved += run;
+				run = 0;
+			}
+		}
+	}
+	ch_free( vec );
+	if ( run ) {
+		fprintf( f, "%lu %lu\n", (unsigned long)start, (unsigned long)run );
+		nsaved += run;
+	}
+	if ( fclose( f ) && !rc )
+		rc = errno;
+	if ( !rc && rename( tmp, mdb->mi_warmfile ))
+		rc = errno;
+	if ( rc )
+		unlink( tmp );
+
+done:
+	ch_free( tmp );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_close) ": cannot save warm pages to %s: %s\n",
+			mdb->mi_warmfile, mdb_strerror( rc ), 0 );
+	} else {
+		Debug( LDAP_DEBUG_TRACE,
+			LDAP_XSTRING(mdb_db_close) ": saved %lu warm pages to %s\n",
+			(unsigned long)nsaved, mdb->mi_warmfile, 0 );
+	}
+}
+
+static void
+mdb_warm_load( struct mdb_info *mdb )
+{
+	FILE *f;
+	char buf[64];
+	unsigned long pgno, npages, nloaded = 0;
+
+	/* nothing saved yet */
+	f = fopen( mdb->mi_warmfile, "r" );
+	if ( !f )
+		return;
+	while ( fgets( buf, sizeof( buf ), f )) {
+		if ( sscanf( buf, "%lu %lu", &pgno, &npages ) != 2 )
+			continue;
+		if ( !mdb_env_prefetch( mdb->mi_dbenv, pgno, npages ))
+			nloaded += npages;
+	}
+	fclose( f );
+	Debug( LDAP_DEBUG_TRACE,
+		LDAP_XSTRING(mdb_db_open) ": requested %lu warm pages from %s\n",
+		nloaded, mdb->mi_warmfile, 0 );
+}
+
+static void
+mdb_warm_dbs( struct mdb_info *mdb )
+{
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_dbi dbi;
+	MDB_val key, data;
+	MDB_stat st;
+	char *ptr, *end;
+	int i, rc;
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+	if ( rc )
+		return;
+	mdb_env_stat( mdb->mi_dbenv, &st );
+	for ( i = 0; !BER_BVISNULL( &mdb->mi_warmup[i] ); i++ ) {
+		rc = mdb_dbi_open( txn, mdb->mi_warmup[i].bv_val, 0, &dbi );
+		if ( rc == 0 )
+			rc = mdb_cursor_open( txn, dbi, &mc );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": cannot warm up %s: %s\n",
+				mdb->mi_warmup[i].bv_val, mdb_strerror( rc ), 0 );
+			continue;
+		}
+		/* the cursor reads the branch and leaf pages; large
+		 * values are on overflow pages, touch each of those.
+		 */
+		while ( mdb_cursor_get( mc, &key, &data, MDB_NEXT ) == 0 ) {
+			if ( data.mv_size <= st.ms_psize )
+				continue;
+			end = (char *)data.mv_data + data.mv_size;
+			for ( ptr = data.mv_data; ptr < end; ptr += st.ms_psize )
+				(void)*(volatile char *)ptr;
+		}
+		mdb_cursor_close( mc );
+		Debug( LDAP_DEBUG_TRACE,
+			LDAP_XSTRING(mdb_db_open) ": warmed up %s\n",
+			mdb->mi_warmup[i].bv_val, 0, 0 );
+	}
+	/* handles opened here are closed again, the ones the
+	 * backend already had are left alone.
+	 */
+	mdb_txn_abort( txn );
+}
+
+/* Bloom filters of the keys in dn2id and in the equality indexes
+ * listed in mi_bloom, so that lookups of keys that aren't there
+ * don't have to search the DB. Built from the DBs here, kept up
+ * to date by the writers after that.
+ */
+static void
+mdb_bloom_open( struct mdb_info *mdb )
+{
+	MDB_txn *txn;
+	AttrInfo *ai;
+	char *name;
+	int i, j, rc;
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+	if ( rc )
+		return;
+	for ( i = 0; !BER_BVISNULL( &mdb->mi_bloom[i] ); i++ ) {
+		name = mdb->mi_bloom[i].bv_val;
+		if ( !strcmp( name, mdmi_databases[MDB_DN2ID].bv_val )) {
+			rc = mdb_dn2id_bloom( txn, mdb );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_db_open) ": no Bloom filter for %s: %s\n",
+					name, mdb_strerror( rc ), 0 );
+			} else {
+				Debug( LDAP_DEBUG_TRACE,
+					LDAP_XSTRING(mdb_db_open) ": Bloom filter for %s, %lu keys\n",
+					name, mdb->mi_dn2id_bloom->mb_count, 0 );
+			}
+			continue;
+		}
+		/* attributes that share an index DB, e.g. subtypes,
+		 * store keys of several AttrInfos; leave those out.
+		 */
+		ai = NULL;
+		for ( j = 0; j < mdb->mi_nattrs; j++ ) {
+			if ( strcmp( name,
+				mdb->mi_attrs[j]->ai_desc->ad_type->sat_cname.bv_val ))
+				continue;
+			if ( ai ) {
+				ai = NULL;
+				break;
+			}
+			ai = mdb->mi_attrs[j];
+		}
+		if ( !ai || !ai->ai_dbi ||
+			!IS_SLAP_INDEX( ai->ai_indexmask, SLAP_INDEX_EQUALITY ) ||
+			( ai->ai_indexmask & MDB_INDEX_DELETING )) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": no Bloom filter for %s: "
+				"not a single equality index\n",
+				name, 0, 0 );
+			continue;
+		}
+		rc = mdb_key_bloom( txn, ai->ai_dbi, &ai->ai_bloom );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": no Bloom filter for %s: %s\n",
+				name, mdb_strerror( rc ), 0 );
+			continue;
+		}
+		Debug( LDAP_DEBUG_TRACE,
+			LDAP_XSTRING(mdb_db_open) ": Bloom filter for %s, %lu keys\n",
+			name, ai->ai_bloom->mb_count, 0 );
+	}
+	mdb_txn_abort( txn );
+}
+
 static int
 mdb_db_open( BackendDB *be, ConfigReply *cr )
 {
-	int rc, i;
+	int rc, i, reindex = 0;
 	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
 	struct stat stat1;
 	uint32_t flags;
@@ -206,6 +419,8 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 				flags |= MDB_DUPSORT;
 			if ( i == MDB_ID2VAL )
 				flags ^= MDB_INTEGERKEY|MDB_DUPSORT;
+			if ( i == MDB_ID2KIDS )
+				flags |= MDB_DUPSORT|MDB_INTEGERDUP|MDB_DUPFIXED;
 			if ( !(slapMode & SLAP_TOOL_READONLY) )
 				flags |= MDB_CREATE;
 		}
@@ -215,6 +430,15 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			flags,
 			&mdb->mi_dbis[i] );
 
+		/* a read-only open of a database written before the
+		 * children index existed just goes without it.
+		 */
+		if ( i == MDB_ID2KIDS && ( rc == MDB_NOTFOUND || rc == EACCES )) {
+			mdb->mi_dbis[i] = 0;
+			rc = 0;
+			continue;
+		}
+
 		if ( rc != 0 ) {
 			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
 				"mdb_dbi_open(%s/%s) failed: %s (%d).", 
@@ -273,6 +497,44 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	rc = mdb_mval_format( txn, mdb, ( slapMode & SLAP_TOOL_READONLY ) ||
+		( mdb->mi_dbenv_flags & MDB_RDONLY ));
+	if ( rc ) {
+		snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+			"reading the id2val format failed: %s (%d).",
+			be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_open) ": %s\n",
+			cr->msg, 0, 0 );
+		mdb_txn_abort( txn );
+		goto fail;
+	}
+
+	/* rebuild the children index if something else wrote the
+	 * database since we last closed it, or it predates the index
+	 */
+	if ( mdb->mi_id2kids && ( mdb->mi_flags & MDB_NEED_UPGRADE )) {
+		mdb->mi_id2kids = 0;
+	} else if ( mdb->mi_id2kids && (( slapMode & SLAP_TOOL_READONLY ) ||
+		( mdb->mi_dbenv_flags & MDB_RDONLY ))) {
+		if ( mdb_id2kids_check( txn, mdb, 1 ))
+			mdb->mi_id2kids = 0;
+	} else if ( mdb->mi_id2kids ) {
+		rc = mdb_id2kids_check( txn, mdb, 0 );
+		if ( rc == 0 )
+			mdb->mi_flags |= MDB_KIDS_STAMP;
+		if ( rc ) {
+			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+				"building children index failed: %s (%d).",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": %s\n",
+				cr->msg, 0, 0 );
+			mdb_txn_abort( txn );
+			goto fail;
+		}
+	}
+
 	/* slapcat doesn't need indexes. avoid a failure if
 	 * a configured index wasn't created yet.
 	 */
@@ -284,6 +546,10 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		}
 	}
 
+	if (( slapMode & SLAP_SERVER_MODE ) &&
+		!( mdb->mi_dbenv_flags & MDB_RDONLY ))
+		reindex = mdb_online_index_resume( be, txn );
+
 	rc = mdb_txn_commit(txn);
 	if ( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -299,8 +565,25 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	if ( mdb->mi_gc_max && ( slapMode & SLAP_SERVER_MODE ))
+		mdb_gc_start( mdb );
+
+	if ( slapMode & SLAP_SERVER_MODE ) {
+		if ( mdb->mi_warmfile )
+			mdb_warm_load( mdb );
+		if ( mdb->mi_warmup )
+			mdb_warm_dbs( mdb );
+		if ( mdb->mi_bloom )
+			mdb_bloom_open( mdb );
+	}
+
+	mdb_ecache_open( mdb );
+
 	mdb->mi_flags |= MDB_IS_OPEN;
 
+	if ( reindex )
+		mdb_online_index_start( be );
+
 	return 0;
 
 fail:
@@ -317,8 +600,30 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 	/* monitor handling */
 	(void)mdb_monitor_db_close( be );
 
+	if (( mdb->mi_flags & MDB_IS_OPEN ) && mdb->mi_warmfile &&
+		( slapMode & SLAP_SERVER_MODE ))
+		mdb_warm_save( mdb );
+
 	mdb->mi_flags &= ~MDB_IS_OPEN;
 
+	mdb_gc_stop( mdb );
+
+	if ( mdb->mi_flags & MDB_KIDS_STAMP ) {
+		mdb->mi_flags ^= MDB_KIDS_STAMP;
+		rc = mdb_id2kids_stamp( mdb );
+		if ( rc != 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				"mdb_db_close: database \"%s\": "
+				"children index stamp failed: %s (%d).\n",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		}
+	}
+
+	mdb_ecache_close( mdb );
+
+	mdb_bloom_free( mdb->mi_dn2id_bloom );
+	mdb->mi_dn2id_bloom = NULL;
+
 	if( mdb->mi_dbenv ) {
 		mdb_reader_flush( mdb->mi_dbenv );
 	}
@@ -372,9 +677,15 @@ mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 	(void)mdb_monitor_db_destroy( be );
 
 	if( mdb->mi_dbenv_home ) ch_free( mdb->mi_dbenv_home );
+	if( mdb->mi_warmfile ) ch_free( mdb->mi_warmfile );
+	if( mdb->mi_warmup ) ber_bvarray_free( mdb->mi_warmup );
+	if( mdb->mi_bloom ) ber_bvarray_free( mdb->mi_bloom );
 
 	mdb_attr_index_destroy( mdb );
 
+	mdb_search_arena_free( NULL, mdb->mi_search_stack );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_search_mutex );
+
 	ch_free( mdb );
 	be->be_private = NULL;
 
@@ -490,6 +801,9 @@ mdb_back_initialize(
 	bi->bi_tool_dn2id_get = mdb_tool_dn2id_get;
 	bi->bi_tool_entry_modify = mdb_tool_entry_modify;
 	bi->bi_tool_entry_delete = mdb_tool_entry_delete;
+	bi->bi_tool_entry_range_open = mdb_tool_entry_range_open;
+	bi->bi_tool_entry_range = mdb_tool_entry_range;
+	bi->bi_tool_entry_range_close = mdb_tool_entry_range_close;
 
 	bi->bi_connection_init = 0;
 	bi->bi_connection_destroy = 0;
@@ -70,3 +70,275 @@ mdb_key_read(
 
 	return rc;
 }
+
+/* intersect ids with a key */
+int
+mdb_key_intersect(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *ids,
+	ID *tmp
+)
+{
+	int rc;
+	MDB_val key;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+#endif
+
+	Debug( LDAP_DEBUG_TRACE, "=> key_intersect\n", 0, 0, 0 );
+
+#ifndef MISALIGNED_OK
+	if (k->bv_len & ALIGNER) {
+		key.mv_size = sizeof(kbuf);
+		key.mv_data = kbuf;
+		kbuf[1] = 0;
+		memcpy(kbuf, k->bv_val, k->bv_len);
+	} else
+#endif
+	{
+		key.mv_size = k->bv_len;
+		key.mv_data = k->bv_val;
+	}
+
+	rc = mdb_idl_intersect_key( be, txn, dbi, &key, ids, tmp );
+
+	if( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE, "<= mdb_key_intersect: failed (%d)\n",
+			rc, 0, 0 );
+	} else {
+		Debug( LDAP_DEBUG_TRACE, "<= mdb_key_intersect %ld candidates\n",
+			(long) MDB_IDL_N(ids), 0, 0 );
+	}
+
+	return rc;
+}
+
+/* count the IDs under a key */
+int
+mdb_key_count(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *count
+)
+{
+	MDB_val key;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+#endif
+
+#ifndef MISALIGNED_OK
+	if (k->bv_len & ALIGNER) {
+		key.mv_size = sizeof(kbuf);
+		key.mv_data = kbuf;
+		kbuf[1] = 0;
+		memcpy(kbuf, k->bv_val, k->bv_len);
+	} else
+#endif
+	{
+		key.mv_size = k->bv_len;
+		key.mv_data = k->bv_val;
+	}
+
+	return mdb_idl_count_key( be, txn, dbi, &key, count );
+}
+
+/* Bloom filters. A key is hashed once with FNV-1a, then mixed for a
+ * second hash, and the probes are h1 + i * h2, h2 odd, over a power
+ * of two number of bits.
+ */
+#define MDB_BLOOM_LBITS	(sizeof(unsigned long) * 8)
+
+static void
+mdb_bloom_hash( const void *a, size_t alen, const void *b, size_t blen,
+	uint32_t *h1, uint32_t *h2 )
+{
+	const unsigned char *p;
+	uint32_t h = 2166136261U;
+
+	for ( p = a; alen--; p++ )
+		h = ( h ^ *p ) * 16777619U;
+	for ( p = b; blen--; p++ )
+		h = ( h ^ *p ) * 16777619U;
+	*h1 = h;
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	*h2 = h | 1;
+}
+
+mdb_bloom *
+mdb_bloom_new( unsigned long nkeys )
+{
+	mdb_bloom *mb;
+	unsigned long nbits = MDB_BLOOM_LBITS;
+
+	/* room to grow to twice the keys there are now */
+	if ( nkeys < 512 )
+		nkeys = 512;
+	while ( nbits < nkeys * 2 * MDB_BLOOM_BITS )
+		nbits <<= 1;
+
+	mb = ch_malloc( sizeof( mdb_bloom ));
+	mb->mb_bits = ch_calloc( nbits / MDB_BLOOM_LBITS, sizeof( unsigned long ));
+	mb->mb_mask = nbits - 1;
+	mb->mb_count = 0;
+	mb->mb_max = nbits / MDB_BLOOM_BITS;
+	return mb;
+}
+
+void
+mdb_bloom_free( mdb_bloom *mb )
+{
+	if ( mb ) {
+		ch_free( mb->mb_bits );
+		ch_free( mb );
+	}
+}
+
+/* Only keys that set a new bit are counted, so that adding a key
+ * that's already there doesn't use up the filter.
+ */
+void
+mdb_bloom_add( mdb_bloom *mb, const void *a, size_t alen,
+	const void *b, size_t blen )
+{
+	uint32_t h1, h2;
+	unsigned long bit, mask;
+	int i, added = 0;
+
+	mdb_bloom_hash( a, alen, b, blen, &h1, &h2 );
+	for ( i = 0; i < MDB_BLOOM_PROBES; i++ ) {
+		bit = ( h1 + (unsigned long)i * h2 ) & mb->mb_mask;
+		mask = 1UL << ( bit % MDB_BLOOM_LBITS );
+		if ( !( mb->mb_bits[bit / MDB_BLOOM_LBITS] & mask )) {
+			mb->mb_bits[bit / MDB_BLOOM_LBITS] |= mask;
+			added = 1;
+		}
+	}
+	if ( added && ++mb->mb_count == mb->mb_max + 1 ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_bloom_add: filter of %lu keys is full, "
+			"it is no longer used until the database is reopened\n",
+			mb->mb_max, 0, 0 );
+	}
+}
+
+/* Returns 0 if the key is certainly not there */
+int
+mdb_bloom_test( mdb_bloom *mb, const void *a, size_t alen,
+	const void *b, size_t blen )
+{
+	uint32_t h1, h2;
+	unsigned long bit;
+	int i;
+
+	/* too full to tell anything apart */
+	if ( mb->mb_count > mb->mb_max )
+		return 1;
+
+	mdb_bloom_hash( a, alen, b, blen, &h1, &h2 );
+	for ( i = 0; i < MDB_BLOOM_PROBES; i++ ) {
+		bit = ( h1 + (unsigned long)i * h2 ) & mb->mb_mask;
+		if ( !( mb->mb_bits[bit / MDB_BLOOM_LBITS] &
+			( 1UL << ( bit % MDB_BLOOM_LBITS ))))
+			return 0;
+	}
+	return 1;
+}
+
+/* Index keys are hashed as they are stored, see mdb_key_read() */
+void
+mdb_bloom_add_keys( mdb_bloom *mb, struct berval *keys )
+{
+	MDB_val key;
+	int i;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+#endif
+
+	for ( i = 0; keys[i].bv_val; i++ ) {
+#ifndef MISALIGNED_OK
+		if (keys[i].bv_len & ALIGNER) {
+			key.mv_size = sizeof(kbuf);
+			key.mv_data = kbuf;
+			kbuf[1] = 0;
+			memcpy(kbuf, keys[i].bv_val, keys[i].bv_len);
+		} else
+#endif
+		{
+			key.mv_size = keys[i].bv_len;
+			key.mv_data = keys[i].bv_val;
+		}
+		mdb_bloom_add( mb, key.mv_data, key.mv_size, NULL, 0 );
+	}
+}
+
+/* Returns 0 if any of the keys is certainly not there */
+int
+mdb_bloom_test_keys( mdb_bloom *mb, struct berval *keys )
+{
+	MDB_val key;
+	int i;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+#endif
+
+	for ( i = 0; keys[i].bv_val; i++ ) {
+#ifndef MISALIGNED_OK
+		if (keys[i].bv_len & ALIGNER) {
+			key.mv_size = sizeof(kbuf);
+			key.mv_data = kbuf;
+			kbuf[1] = 0;
+			memcpy(kbuf, keys[i].bv_val, keys[i].bv_len);
+		} else
+#endif
+		{
+			key.mv_size = keys[i].bv_len;
+			key.mv_data = keys[i].bv_val;
+		}
+		if ( !mdb_bloom_test( mb, key.mv_data, key.mv_size, NULL, 0 ))
+			return 0;
+	}
+	return 1;
+}
+
+/* Build the filter of an index from the keys in its DB */
+int
+mdb_key_bloom(
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	mdb_bloom **mbp )
+{
+	MDB_cursor *mc;
+	MDB_val key;
+	mdb_bloom *mb;
+	unsigned long nkeys = 0;
+	int rc;
+
+	rc = mdb_cursor_open( txn, dbi, &mc );
+	if ( rc )
+		return rc;
+	while (( rc = mdb_cursor_get( mc, &key, NULL, MDB_NEXT_NODUP )) == 0 )
+		nkeys++;
+	if ( rc != MDB_NOTFOUND ) {
+		mdb_cursor_close( mc );
+		return rc;
+	}
+	mb = mdb_bloom_new( nkeys );
+	for ( rc = mdb_cursor_get( mc, &key, NULL, MDB_FIRST ); rc == 0;
+		rc = mdb_cursor_get( mc, &key, NULL, MDB_NEXT_NODUP ))
+		mdb_bloom_add( mb, key.mv_data, key.mv_size, NULL, 0 );
+	mdb_cursor_close( mc );
+	if ( rc != MDB_NOTFOUND ) {
+		mdb_bloom_free( mb );
+		return rc;
+	}
+	*mbp = mb;
+	return 0;
+}
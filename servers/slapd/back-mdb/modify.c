@@ -74,6 +74,44 @@ mdb_modify_idxflags(
 	}
 }
 
+static int
+mdb_modify_bvcmp( const void *v1, const void *v2 )
+{
+	return ber_bvcmp( (struct berval *)v1, (struct berval *)v2 );
+}
+
+/* The normalized values of a that are not in b. They are found by
+ * sorting a copy of b's values instead of searching all of b for each
+ * value of a, which takes forever for a big group. The values are
+ * compared bytewise, so differently normalized values that match
+ * count as different; that only costs a few redundant index updates,
+ * since the keys of the remaining values are never deleted.
+ */
+static struct berval *
+mdb_modify_valdiff(
+	Operation *op,
+	Attribute *a,
+	Attribute *b )
+{
+	struct berval *vals, *sorted;
+	unsigned i, k;
+
+	vals = op->o_tmpalloc( (a->a_numvals + 1 + b->a_numvals) *
+		sizeof(struct berval), op->o_tmpmemctx );
+	sorted = vals + a->a_numvals + 1;
+	AC_MEMCPY( sorted, b->a_nvals, b->a_numvals * sizeof(struct berval) );
+	qsort( sorted, b->a_numvals, sizeof(struct berval), mdb_modify_bvcmp );
+
+	k = 0;
+	for ( i=0; i < a->a_numvals; i++ ) {
+		if ( !bsearch( &a->a_nvals[i], sorted, b->a_numvals,
+			sizeof(struct berval), mdb_modify_bvcmp ))
+			vals[k++] = a->a_nvals[i];
+	}
+	BER_BVZERO(vals+k);
+	return vals;
+}
+
 int mdb_modify_internal(
 	Operation *op,
 	MDB_txn *tid,
@@ -443,29 +481,19 @@ do_del:
 			a2 = attr_find( e->e_attrs, ap->a_desc );
 			if ( a2 ) {
 				/* need to detect which values were deleted */
-				int i, j;
 				/* let add know there were deletes */
 				if ( a2->a_flags & SLAP_ATTR_IXADD )
 					a2->a_flags |= SLAP_ATTR_IXDEL;
-				vals = op->o_tmpalloc( (ap->a_numvals + 1) *
-					sizeof(struct berval), op->o_tmpmemctx );
-				j = 0;
-				for ( i=0; i < ap->a_numvals; i++ ) {
-					rc = attr_valfind( a2, SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH,
-						&ap->a_nvals[i], NULL, op->o_tmpmemctx );
-					/* Save deleted values */
-					if ( rc == LDAP_NO_SUCH_ATTRIBUTE )
-						vals[j++] = ap->a_nvals[i];
-				}
-				BER_BVZERO(vals+j);
+				vals = mdb_modify_valdiff( op, ap, a2 );
 			} else {
 				/* attribute was completely deleted */
 				vals = ap->a_nvals;
 			}
 			rc = 0;
 			if ( !BER_BVISNULL( vals )) {
-				rc = mdb_index_values( op, tid, ap->a_desc,
-					vals, e->e_id, SLAP_INDEX_DELETE_OP );
+				/* the remaining values keep their keys */
+				rc = mdb_index_delete_values( op, tid, ap->a_desc,
+					vals, a2 ? a2->a_nvals : NULL, e->e_id );
 				if ( rc != LDAP_SUCCESS ) {
 					Debug( LDAP_DEBUG_ANY,
 						"%s: attribute \"%s\" index delete failure\n",
@@ -485,13 +513,19 @@ do_del:
 		if (ap->a_flags & SLAP_ATTR_IXADD) {
 			ap->a_flags &= ~SLAP_ATTR_IXADD;
 			if ( ap->a_flags & SLAP_ATTR_IXDEL ) {
-				/* if any values were deleted, we must readd index
-				 * for all remaining values.
+				/* if any values were deleted, index the values
+				 * that weren't there before; the others kept
+				 * their keys.
 				 */
+				struct berval *vals;
 				ap->a_flags &= ~SLAP_ATTR_IXDEL;
-				rc = mdb_index_values( op, tid, ap->a_desc,
-					ap->a_nvals,
-					e->e_id, SLAP_INDEX_ADD_OP );
+				vals = mdb_modify_valdiff( op, ap,
+					attr_find( save_attrs, ap->a_desc ));
+				rc = 0;
+				if ( !BER_BVISNULL( vals ))
+					rc = mdb_index_values( op, tid, ap->a_desc,
+						vals, e->e_id, SLAP_INDEX_ADD_OP );
+				op->o_tmpfree( vals, op->o_tmpmemctx );
 			} else {
 				int found = 0;
 				/* if this was only an add, we only need to index
@@ -542,6 +576,20 @@ do_del:
 		}
 	}
 
+	/* rekey the composite indexes over modified attributes */
+	if ( mdb->mi_ncomps ) {
+		rc = mdb_index_comps_modify( op, tid, save_attrs, e->e_attrs,
+			e->e_id, modlist );
+		if ( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY,
+				"%s: composite index update failure\n",
+				op->o_log_prefix, 0, 0 );
+			attrs_free( e->e_attrs );
+			e->e_attrs = save_attrs;
+			return rc;
+		}
+	}
+
 	return rc;
 }
 
@@ -741,12 +789,12 @@ mdb_modify( Operation *op, SlapReply *rs )
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
 			mdb->mi_numads = numads;
-			mdb_txn_abort( txn );
+			mdb_wtxn_abort( mdb, txn );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_wtxn_commit( mdb, txn );
 			if ( rs->sr_err )
 				mdb->mi_numads = numads;
 			txn = NULL;
@@ -792,7 +840,7 @@ done:
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
 			mdb->mi_numads = numads;
-			mdb_txn_abort( txn );
+			mdb_wtxn_abort( mdb, txn );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
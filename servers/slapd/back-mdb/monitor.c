@@ -32,6 +32,9 @@
 static ObjectClass		*oc_olmMDBDatabase;
 
 static AttributeDescription *ad_olmDbDirectory;
+static AttributeDescription *ad_olmDbSearchArenaPeak;
+static AttributeDescription *ad_olmDbIndexPercent;
+static AttributeDescription *ad_olmDbIndexETA;
 
 #ifdef MDB_MONITOR_IDX
 static int
@@ -40,6 +43,8 @@ mdb_monitor_idx_entry_add(
 	Entry		*e );
 
 static AttributeDescription	*ad_olmDbNotIndexed;
+static AttributeDescription	*ad_olmDbIndexStats;
+static AttributeDescription	*ad_olmDbFilterStats;
 #endif /* MDB_MONITOR_IDX */
 
 /*
@@ -78,6 +83,30 @@ static struct {
 		"USAGE dSAOperation )",
 		&ad_olmDbDirectory },
 
+	{ "( olmDatabaseAttributes:3 "
+		"NAME ( 'olmDbSearchArenaPeak' ) "
+		"DESC 'Largest per-thread search buffer space in bytes' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbSearchArenaPeak },
+
+	{ "( olmDatabaseAttributes:6 "
+		"NAME ( 'olmDbIndexPercent' ) "
+		"DESC 'Percent of the entries the online indexer has done' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexPercent },
+
+	{ "( olmDatabaseAttributes:7 "
+		"NAME ( 'olmDbIndexETA' ) "
+		"DESC 'Estimated seconds until the online indexer is done' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexETA },
+
 #ifdef MDB_MONITOR_IDX
 	{ "( olmDatabaseAttributes:2 "
 		"NAME ( 'olmDbNotIndexed' ) "
@@ -86,6 +115,24 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )",
 		&ad_olmDbNotIndexed },
+
+	{ "( olmDatabaseAttributes:4 "
+		"NAME ( 'olmDbIndexStats' ) "
+		"DESC 'Index lookups, average IDs per lookup and lookups "
+			"that returned a range, per attribute and index type' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexStats },
+
+	{ "( olmDatabaseAttributes:5 "
+		"NAME ( 'olmDbFilterStats' ) "
+		"DESC 'Searches, entries scanned and entries returned, "
+			"per filter shape' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbFilterStats },
 #endif /* MDB_MONITOR_IDX */
 
 	{ NULL }
@@ -102,8 +149,13 @@ static struct {
 		"SUP top AUXILIARY "
 		"MAY ( "
 			"olmDbDirectory "
+			"$ olmDbSearchArenaPeak "
+			"$ olmDbIndexPercent "
+			"$ olmDbIndexETA "
 #ifdef MDB_MONITOR_IDX
 			"$ olmDbNotIndexed "
+			"$ olmDbIndexStats "
+			"$ olmDbFilterStats "
 #endif /* MDB_MONITOR_IDX */
 			") )",
 		&oc_olmMDBDatabase },
@@ -118,9 +170,56 @@ mdb_monitor_update(
 	Entry		*e,
 	void		*priv )
 {
-#ifdef MDB_MONITOR_IDX
 	struct mdb_info		*mdb = (struct mdb_info *) priv;
+	Attribute		*a;
+	char			buf[ LDAP_PVT_INTTYPE_CHARS( unsigned long ) ];
+	struct berval		bv;
+	size_t			peak;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_search_mutex );
+	peak = mdb->mi_search_peak;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_search_mutex );
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", (unsigned long)peak );
+	a = attr_find( e->e_attrs, ad_olmDbSearchArenaPeak );
+	if ( a != NULL ) {
+		ber_bvreplace( &a->a_vals[ 0 ], &bv );
+	} else {
+		attr_merge_one( e, ad_olmDbSearchArenaPeak, &bv, NULL );
+	}
+
+	/* online indexing progress, by entry ID */
+	if ( mdb->mi_index_task && mdb->mi_index_last ) {
+		ID id = mdb->mi_index_id, last = mdb->mi_index_last;
+		ID first = mdb->mi_index_first;
+		time_t elapsed = slap_get_time() - mdb->mi_index_start;
+		unsigned long pct, eta = 0;
+
+		pct = id > last ? 100 : (unsigned long)( (double)( id - 1 ) * 100 / last );
+		if ( id > first && elapsed > 0 && id <= last )
+			eta = (double)( last - id + 1 ) * elapsed / ( id - first );
+
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", pct );
+		a = attr_find( e->e_attrs, ad_olmDbIndexPercent );
+		if ( a != NULL ) {
+			ber_bvreplace( &a->a_vals[ 0 ], &bv );
+		} else {
+			attr_merge_one( e, ad_olmDbIndexPercent, &bv, NULL );
+		}
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", eta );
+		a = attr_find( e->e_attrs, ad_olmDbIndexETA );
+		if ( a != NULL ) {
+			ber_bvreplace( &a->a_vals[ 0 ], &bv );
+		} else {
+			attr_merge_one( e, ad_olmDbIndexETA, &bv, NULL );
+		}
+	} else {
+		attr_delete( &e->e_attrs, ad_olmDbIndexPercent );
+		attr_delete( &e->e_attrs, ad_olmDbIndexETA );
+	}
 
+#ifdef MDB_MONITOR_IDX
 	mdb_monitor_idx_entry_add( mdb, e );
 #endif /* MDB_MONITOR_IDX */
 
@@ -270,7 +369,10 @@ mdb_monitor_db_init( BackendDB *be )
 
 #ifdef MDB_MONITOR_IDX
 	mdb->mi_idx = NULL;
+	mdb->mi_filterstat = NULL;
+	mdb->mi_nfilterstat = 0;
 	ldap_pvt_thread_mutex_init( &mdb->mi_idx_mutex );
+	ldap_pvt_thread_rdwr_init( &mdb->mi_filterstat_rwlock );
 #endif /* MDB_MONITOR_IDX */
 
 	return 0;
@@ -452,7 +554,9 @@ mdb_monitor_db_destroy( BackendDB *be )
 
 	/* TODO: free tree */
 	ldap_pvt_thread_mutex_destroy( &mdb->mi_idx_mutex );
+	ldap_pvt_thread_rdwr_destroy( &mdb->mi_filterstat_rwlock );
 	avl_free( mdb->mi_idx, ch_free );
+	avl_free( mdb->mi_filterstat, ch_free );
 #endif /* MDB_MONITOR_IDX */
 
 	return 0;
@@ -616,40 +720,323 @@ mdb_monitor_idx_apply( void *v_idx, void *v_valp )
 	return 0;
 }
 
+/* per index and index type lookup statistics; the counters live in
+ * the AttrInfo, so a lookup touches no shared lock
+ */
+
+static char *idxstatnames[] = {
+	"present", "equality", "approx", "substr", "ordered"
+};
+
+int
+mdb_monitor_idx_stat(
+	BackendDB		*be,
+	AttributeDescription	*desc,
+	slap_mask_t		type,
+	ID			nids,
+	int			range )
+{
+	AttrInfo		*ai;
+	mdb_idxstat		*is;
+	struct berval		atname;
+	int			key;
+
+	switch ( type ) {
+	case SLAP_INDEX_PRESENT:	key = 0; break;
+	case SLAP_INDEX_EQUALITY:	key = 1; break;
+	case SLAP_INDEX_APPROX:		key = 2; break;
+	case SLAP_INDEX_SUBSTR:		key = 3; break;
+	case SLAP_INDEX_ORDERED:	key = 4; break;
+	default:
+		return -1;
+	}
+
+	/* the index the lookup went to, tagged and subtypes included */
+	ai = mdb_index_mask( be, desc, &atname );
+	if ( ai == NULL )
+		return -1;
+
+	is = &ai->ai_stat[ key ];
+	__sync_fetch_and_add( &is->is_lookups, 1 );
+	__sync_fetch_and_add( &is->is_ids, nids );
+	if ( range )
+		__sync_fetch_and_add( &is->is_ranges, 1 );
+
+	return 0;
+}
+
+static void
+mdb_monitor_idxstat_values( AttrInfo *ai, BerVarray *valp )
+{
+	mdb_idxstat		*is;
+	struct berval		bv;
+	char			buf[ SLAP_TEXT_BUFLEN ];
+	unsigned long		lookups;
+	int			i;
+
+	for ( i = 0; i < MDB_IDXSTAT_TYPES; i++ ) {
+		is = &ai->ai_stat[ i ];
+		lookups = is->is_lookups;
+		if ( lookups == 0 ) {
+			continue;
+		}
+
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+			"%s#%s#lookups=%lu#avgids=%lu#ranges=%lu",
+			ai->ai_desc->ad_cname.bv_val, idxstatnames[ i ],
+			lookups, is->is_ids / lookups, is->is_ranges );
+		if ( bv.bv_len >= sizeof( buf ) )
+			bv.bv_len = sizeof( buf ) - 1;
+		bv.bv_val = buf;
+		value_add_one( valp, &bv );
+	}
+}
+
+/* per filter shape search statistics */
+
+/* filter shapes tracked; searches with new shapes
+ * are not counted once the table is full
+ */
+#define MDB_MONITOR_FILTERS	(128)
+
+typedef struct monitor_filter_t {
+	struct berval		mf_shape;
+	unsigned long		mf_searches;
+	unsigned long		mf_scanned;
+	unsigned long		mf_returned;
+} monitor_filter_t;
+
+static int
+monitor_filter_cmp( const void *p1, const void *p2 )
+{
+	const monitor_filter_t	*mf1 = (const monitor_filter_t *)p1;
+	const monitor_filter_t	*mf2 = (const monitor_filter_t *)p2;
+
+	return ber_bvcmp( &mf1->mf_shape, &mf2->mf_shape );
+}
+
+static void
+mdb_monitor_shape_put( char **pp, char *end, const char *s, ber_len_t len )
+{
+	if ( len > (ber_len_t)( end - *pp ))
+		len = end - *pp;
+	AC_MEMCPY( *pp, s, len );
+	*pp += len;
+}
+
+/* The filter with its assertion values left out, so searches
+ * that differ only in the values they ask for share a shape.
+ */
+static void
+mdb_monitor_filter_shape( Filter *f, char **pp, char *end )
+{
+	AttributeDescription	*ad = NULL;
+	const char		*op = NULL;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		mdb_monitor_shape_put( pp, end, "(?=undefined)",
+			STRLENOF( "(?=undefined)" ));
+		return;
+	}
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+	case LDAP_FILTER_NOT:
+		mdb_monitor_shape_put( pp, end,
+			f->f_choice == LDAP_FILTER_AND ? "(&" :
+			f->f_choice == LDAP_FILTER_OR ? "(|" : "(!", 2 );
+		for ( f = f->f_list; f; f = f->f_next )
+			mdb_monitor_filter_shape( f, pp, end );
+		mdb_monitor_shape_put( pp, end, ")", 1 );
+		return;
+
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		op = "=*";
+		break;
+	case LDAP_FILTER_EQUALITY:
+		ad = f->f_av_desc;
+		op = "=?";
+		break;
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		op = "~=?";
+		break;
+	case LDAP_FILTER_GE:
+		ad = f->f_av_desc;
+		op = ">=?";
+		break;
+	case LDAP_FILTER_LE:
+		ad = f->f_av_desc;
+		op = "<=?";
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		op = !BER_BVISNULL( &f->f_sub_initial ) ?
+			( !BER_BVISNULL( &f->f_sub_final ) ? "=?*?" : "=?*" ) :
+			( !BER_BVISNULL( &f->f_sub_final ) ? "=*?" : "=*?*" );
+		break;
+	case LDAP_FILTER_EXT:
+		ad = f->f_mr_desc;
+		op = ":=?";
+		break;
+	default:
+		mdb_monitor_shape_put( pp, end, "(?=computed)",
+			STRLENOF( "(?=computed)" ));
+		return;
+	}
+
+	mdb_monitor_shape_put( pp, end, "(", 1 );
+	if ( ad )
+		mdb_monitor_shape_put( pp, end, ad->ad_cname.bv_val,
+			ad->ad_cname.bv_len );
+	mdb_monitor_shape_put( pp, end, op, strlen( op ));
+	mdb_monitor_shape_put( pp, end, ")", 1 );
+}
+
+int
+mdb_monitor_filter_stat(
+	struct mdb_info		*mdb,
+	Filter			*f,
+	unsigned long		scanned,
+	unsigned long		returned )
+{
+	monitor_filter_t	mf_dummy, *mf;
+	char			buf[ SLAP_TEXT_BUFLEN ], *ptr = buf;
+	int			rc = 0;
+
+	mdb_monitor_filter_shape( f, &ptr, buf + sizeof( buf ));
+	mf_dummy.mf_shape.bv_val = buf;
+	mf_dummy.mf_shape.bv_len = ptr - buf;
+
+	/* Known shapes only need the read lock, their counters are
+	 * updated atomically; a new shape is added under the write lock.
+	 */
+	ldap_pvt_thread_rdwr_rlock( &mdb->mi_filterstat_rwlock );
+	mf = (monitor_filter_t *)avl_find( mdb->mi_filterstat,
+		(caddr_t)&mf_dummy, monitor_filter_cmp );
+	if ( mf != NULL ) {
+		__sync_fetch_and_add( &mf->mf_searches, 1 );
+		__sync_fetch_and_add( &mf->mf_scanned, scanned );
+		__sync_fetch_and_add( &mf->mf_returned, returned );
+	}
+	ldap_pvt_thread_rdwr_runlock( &mdb->mi_filterstat_rwlock );
+	if ( mf != NULL )
+		return 0;
+
+	ldap_pvt_thread_rdwr_wlock( &mdb->mi_filterstat_rwlock );
+
+	mf = (monitor_filter_t *)avl_find( mdb->mi_filterstat,
+		(caddr_t)&mf_dummy, monitor_filter_cmp );
+	if ( mf == NULL && mdb->mi_nfilterstat < MDB_MONITOR_FILTERS ) {
+		/* the shape is kept right behind its counters */
+		mf = ch_calloc( sizeof( monitor_filter_t ) +
+			mf_dummy.mf_shape.bv_len + 1, 1 );
+		mf->mf_shape.bv_val = (char *)( mf + 1 );
+		mf->mf_shape.bv_len = mf_dummy.mf_shape.bv_len;
+		AC_MEMCPY( mf->mf_shape.bv_val, buf, mf->mf_shape.bv_len );
+		if ( avl_insert( &mdb->mi_filterstat, (caddr_t)mf,
+			monitor_filter_cmp, avl_dup_error ) ) {
+			ch_free( mf );
+			mf = NULL;
+		} else {
+			mdb->mi_nfilterstat++;
+		}
+	}
+	if ( mf != NULL ) {
+		__sync_fetch_and_add( &mf->mf_searches, 1 );
+		__sync_fetch_and_add( &mf->mf_scanned, scanned );
+		__sync_fetch_and_add( &mf->mf_returned, returned );
+	} else {
+		rc = -1;
+	}
+
+	ldap_pvt_thread_rdwr_wunlock( &mdb->mi_filterstat_rwlock );
+
+	return rc;
+}
+
+static int
+mdb_monitor_filterstat_apply( void *v_mf, void *v_valp )
+{
+	monitor_filter_t	*mf = (monitor_filter_t *)v_mf;
+	BerVarray		*valp = (BerVarray *)v_valp;
+	struct berval		bv;
+	char			buf[ LDAP_PVT_INTTYPE_CHARS( unsigned long ) * 3
+					+ STRLENOF( "#searches=#scanned=#returned=" ) + 1 ];
+	ber_len_t		len;
+
+	len = snprintf( buf, sizeof( buf ),
+		"#searches=%lu#scanned=%lu#returned=%lu",
+		mf->mf_searches, mf->mf_scanned, mf->mf_returned );
+	bv.bv_len = mf->mf_shape.bv_len + len;
+	bv.bv_val = ch_malloc( bv.bv_len + 1 );
+	AC_MEMCPY( bv.bv_val, mf->mf_shape.bv_val, mf->mf_shape.bv_len );
+	AC_MEMCPY( bv.bv_val + mf->mf_shape.bv_len, buf, len + 1 );
+
+	ber_bvarray_add( valp, &bv );
+
+	return 0;
+}
+
+static void
+mdb_monitor_attr_set(
+	Entry			*e,
+	AttributeDescription	*ad,
+	BerVarray		vals )
+{
+	Attribute	*a;
+
+	if ( vals == NULL ) {
+		return;
+	}
+
+	a = attr_find( e->e_attrs, ad );
+	if ( a != NULL ) {
+		assert( a->a_nvals == a->a_vals );
+
+		ber_bvarray_free( a->a_vals );
+
+	} else {
+		Attribute	**ap;
+
+		for ( ap = &e->e_attrs; *ap != NULL; ap = &(*ap)->a_next )
+			;
+		*ap = attr_alloc( ad );
+		a = *ap;
+	}
+	a->a_vals = vals;
+	a->a_nvals = a->a_vals;
+	for ( a->a_numvals = 0; !BER_BVISNULL( &vals[ a->a_numvals ] );
+		a->a_numvals++ )
+		;
+}
+
 static int
 mdb_monitor_idx_entry_add(
 	struct mdb_info	*mdb,
 	Entry		*e )
 {
-	BerVarray	vals = NULL;
-	Attribute	*a;
-
-	a = attr_find( e->e_attrs, ad_olmDbNotIndexed );
+	BerVarray	vals = NULL, svals = NULL, fvals = NULL;
+	int		i;
 
 	ldap_pvt_thread_mutex_lock( &mdb->mi_idx_mutex );
-
 	avl_apply( mdb->mi_idx, mdb_monitor_idx_apply,
 		&vals, -1, AVL_INORDER );
-
 	ldap_pvt_thread_mutex_unlock( &mdb->mi_idx_mutex );
 
-	if ( vals != NULL ) {
-		if ( a != NULL ) {
-			assert( a->a_nvals == a->a_vals );
+	for ( i = 0; i < mdb->mi_nattrs; i++ )
+		mdb_monitor_idxstat_values( mdb->mi_attrs[ i ], &svals );
 
-			ber_bvarray_free( a->a_vals );
+	ldap_pvt_thread_rdwr_rlock( &mdb->mi_filterstat_rwlock );
+	avl_apply( mdb->mi_filterstat, mdb_monitor_filterstat_apply,
+		&fvals, -1, AVL_INORDER );
+	ldap_pvt_thread_rdwr_runlock( &mdb->mi_filterstat_rwlock );
 
-		} else {
-			Attribute	**ap;
-
-			for ( ap = &e->e_attrs; *ap != NULL; ap = &(*ap)->a_next )
-				;
-			*ap = attr_alloc( ad_olmDbNotIndexed );
-			a = *ap;
-		}
-		a->a_vals = vals;
-		a->a_nvals = a->a_vals;
-	}
+	mdb_monitor_attr_set( e, ad_olmDbNotIndexed, vals );
+	mdb_monitor_attr_set( e, ad_olmDbIndexStats, svals );
+	mdb_monitor_attr_set( e, ad_olmDbFilterStats, fvals );
 
 	return 0;
 }
@@ -46,6 +46,9 @@ void mdb_attr_index_free LDAP_P(( struct mdb_info *mdb,
 
 void mdb_attr_info_free( AttrInfo *ai );
 
+CompInfo *mdb_comp_find( struct mdb_info *mdb, struct berval *name );
+void mdb_comp_info_free( CompInfo *ci );
+
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn );
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 
@@ -54,6 +57,8 @@ int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
  */
 
 int mdb_back_init_cf( BackendInfo *bi );
+int mdb_online_index_resume( BackendDB *be, MDB_txn *txn );
+void mdb_online_index_start( BackendDB *be );
 
 /*
  * dn2entry.c
@@ -85,6 +90,12 @@ int mdb_dn2id_add(
 	int upsub,
 	Entry *e );
 
+int mdb_dn2id_upsub(
+	Operation *op,
+	MDB_cursor *mcp,
+	ID pid,
+	ID nsubs );
+
 int mdb_dn2id_delete(
 	Operation *op,
 	MDB_cursor *mc,
@@ -96,6 +107,22 @@ int mdb_dn2id_children(
 	MDB_txn *tid,
 	Entry *e );
 
+int mdb_dn2id_bloom(
+	MDB_txn *txn,
+	struct mdb_info *mdb );
+
+int mdb_id2kids_build(
+	MDB_txn *txn,
+	struct mdb_info *mdb );
+
+int mdb_id2kids_check(
+	MDB_txn *txn,
+	struct mdb_info *mdb,
+	int rdonly );
+
+int mdb_id2kids_stamp(
+	struct mdb_info *mdb );
+
 int mdb_dn2sups (
 	Operation *op,
 	MDB_txn *tid,
@@ -194,6 +221,16 @@ int mdb_id2entry(
 	ID id,
 	Entry **e);
 
+void mdb_id2entry_prefetch(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	ID id,
+	int data,
+	size_t *last );
+
+int mdb_ecache_open( struct mdb_info *mdb );
+void mdb_ecache_close( struct mdb_info *mdb );
+
 int mdb_id2edata(
 	Operation *op,
 	MDB_cursor *mc,
@@ -206,12 +243,21 @@ BI_entry_get_rw mdb_entry_get;
 BI_op_txn mdb_txn;
 
 int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e );
+int mdb_entry_partial_decode( Operation *op, MDB_txn *txn, MDB_val *data, ID id,
+	mdb_attrmask *need, Entry **e );
+int mdb_entry_partial_complete( Operation *op, MDB_txn *txn, MDB_val *data,
+	mdb_attrmask *need, Entry *e );
 
 void mdb_reader_flush( MDB_env *env );
 int mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **moi );
+void mdb_gc_start( struct mdb_info *mdb );
+void mdb_gc_stop( struct mdb_info *mdb );
+int mdb_wtxn_commit( struct mdb_info *mdb, MDB_txn *txn );
+void mdb_wtxn_abort( struct mdb_info *mdb, MDB_txn *txn );
 
 int mdb_mval_put(Operation *op, MDB_cursor *mc, ID id, Attribute *a);
 int mdb_mval_del(Operation *op, MDB_cursor *mc, ID id, Attribute *a);
+int mdb_mval_format(MDB_txn *txn, struct mdb_info *mdb, int rdonly);
 
 /*
  * idl.c
@@ -228,6 +274,21 @@ int mdb_idl_fetch_key(
 	MDB_cursor	**saved_cursor,
 	int                     get_flag );
 
+int mdb_idl_count_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count );
+
+int mdb_idl_intersect_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*ids,
+	ID			*tmp );
+
 int mdb_idl_insert( ID *ids, ID id );
 
 typedef int (mdb_idl_keyfunc)(
@@ -276,6 +337,11 @@ mdb_index_param LDAP_P((
 	slap_mask_t *mask,
 	struct berval *prefix ));
 
+extern void
+mdb_ordered_key LDAP_P((
+	struct berval *val,
+	struct berval *key ));
+
 extern int
 mdb_index_values LDAP_P((
 	Operation *op,
@@ -285,6 +351,15 @@ mdb_index_values LDAP_P((
 	ID id,
 	int opid ));
 
+extern int
+mdb_index_delete_values LDAP_P((
+	Operation *op,
+	MDB_txn *txn,
+	AttributeDescription *desc,
+	BerVarray vals,
+	BerVarray keep,
+	ID id ));
+
 extern int
 mdb_index_recset LDAP_P((
 	struct mdb_info *mdb,
@@ -302,6 +377,23 @@ mdb_index_recrun LDAP_P((
 	ID id,
 	int base ));
 
+extern int
+mdb_index_comps LDAP_P((
+	Operation *op,
+	MDB_txn *txn,
+	int opid,
+	Attribute *attrs,
+	ID id ));
+
+extern int
+mdb_index_comps_modify LDAP_P((
+	Operation *op,
+	MDB_txn *txn,
+	Attribute *oldattrs,
+	Attribute *newattrs,
+	ID id,
+	Modifications *ml ));
+
 int mdb_index_entry LDAP_P(( Operation *op, MDB_txn *t, int r, Entry *e ));
 
 #define mdb_index_entry_add(op,t,e) \
@@ -323,6 +415,37 @@ mdb_key_read(
     MDB_cursor **saved_cursor,
         int get_flags );
 
+extern int
+mdb_key_count(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *count );
+
+extern int
+mdb_key_intersect(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *ids,
+	ID *tmp );
+
+mdb_bloom *mdb_bloom_new( unsigned long nkeys );
+void mdb_bloom_free( mdb_bloom *mb );
+void mdb_bloom_add( mdb_bloom *mb, const void *a, size_t alen,
+	const void *b, size_t blen );
+int mdb_bloom_test( mdb_bloom *mb, const void *a, size_t alen,
+	const void *b, size_t blen );
+void mdb_bloom_add_keys( mdb_bloom *mb, struct berval *keys );
+int mdb_bloom_test_keys( mdb_bloom *mb, struct berval *keys );
+
+int mdb_key_bloom(
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	mdb_bloom **mbp );
+
 /*
  * nextid.c
  */
@@ -357,8 +480,29 @@ mdb_monitor_idx_add(
 	struct mdb_info		*mdb,
 	AttributeDescription	*desc,
 	slap_mask_t		type );
+
+int
+mdb_monitor_idx_stat(
+	BackendDB		*be,
+	AttributeDescription	*desc,
+	slap_mask_t		type,
+	ID			nids,
+	int			range );
+
+int
+mdb_monitor_filter_stat(
+	struct mdb_info		*mdb,
+	Filter			*f,
+	unsigned long		scanned,
+	unsigned long		returned );
 #endif /* MDB_MONITOR_IDX */
 
+/*
+ * search.c
+ */
+
+void mdb_search_arena_free( void *key, void *data );
+
 /*
  * former external.h
  */
@@ -393,8 +537,12 @@ extern BI_tool_entry_reindex		mdb_tool_entry_reindex;
 extern BI_tool_dn2id_get		mdb_tool_dn2id_get;
 extern BI_tool_entry_modify		mdb_tool_entry_modify;
 extern BI_tool_entry_delete		mdb_tool_entry_delete;
+extern BI_tool_entry_range_open		mdb_tool_entry_range_open;
+extern BI_tool_entry_range		mdb_tool_entry_range;
+extern BI_tool_entry_range_close	mdb_tool_entry_range_close;
 
 extern mdb_idl_keyfunc mdb_tool_idl_add;
+extern mdb_idl_keyfunc mdb_tool_bulk_add;
 
 LDAP_END_DECL
 
@@ -27,6 +27,21 @@ static int base_candidate(
 	Entry	*e,
 	ID		*ids );
 
+/* Per-thread search buffers. The candidate and scope lists live as
+ * long as the thread; the IDL stack for evaluating filters starts at
+ * the configured searchstack depth and grows for deeper filters.
+ * A search takes an arena off the thread's free list and puts it
+ * back when done, so an internal search nested in a callback of
+ * an outer one gets an arena of its own.
+ */
+typedef struct mdb_search_arena {
+	ID	*sa_cand;	/* MDB_IDL_UM_SIZE */
+	ID	*sa_scopes;	/* MDB_IDL_DB_SIZE */
+	ID	*sa_stack;
+	int	sa_depth;	/* UM_SIZE IDLs in sa_stack */
+	struct mdb_search_arena *sa_next;	/* free list */
+} mdb_search_arena;
+
 static int search_candidates(
 	Operation *op,
 	SlapReply *rs,
@@ -34,7 +49,7 @@ static int search_candidates(
 	IdScopes *isc,
 	MDB_cursor *mci,
 	ID	*ids,
-	ID *stack );
+	mdb_search_arena *sa );
 
 static int parse_paged_cookie( Operation *op, SlapReply *rs );
 
@@ -317,7 +332,9 @@ static void scope_chunk_ret( Operation *op, ID2 *scopes )
 			(void *)scopes, scope_chunk_free, NULL, NULL );
 }
 
-static void *search_stack( Operation *op );
+static mdb_search_arena *search_arena( Operation *op );
+static void search_arena_ret( Operation *op, mdb_search_arena *sa );
+static ID *search_stack( Operation *op, mdb_search_arena *sa, int depth );
 
 typedef struct ww_ctx {
 	MDB_txn *txn;
@@ -410,16 +427,928 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 	return rc;
 }
 
+/* Attributes test_filter() and the ACLs it consults may look at.
+ * Candidates are decoded with just these until they match, saving
+ * the work of materializing (and fetching the separately stored
+ * values of) attributes that are only needed for matching entries.
+ */
+static void
+mdb_attrmask_ad( struct mdb_info *mdb, mdb_attrmask *am, AttributeDescription *ad )
+{
+	int i;
+
+	for ( i=1; i<=am->am_numads; i++ ) {
+		if ( mdb->mi_ads[i] && is_ad_subtype( mdb->mi_ads[i], ad ))
+			am->am_need[i] = 1;
+	}
+}
+
+static int
+mdb_attrmask_filter( struct mdb_info *mdb, mdb_attrmask *am, Filter *f )
+{
+	int rc = 0;
+
+	for ( ; f && !rc; f = f->f_next ) {
+		if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+			continue;
+		switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+		case SLAPD_FILTER_COMPUTED:
+			break;
+		case LDAP_FILTER_EQUALITY:
+		case LDAP_FILTER_GE:
+		case LDAP_FILTER_LE:
+		case LDAP_FILTER_APPROX:
+			mdb_attrmask_ad( mdb, am, f->f_av_desc );
+			break;
+		case LDAP_FILTER_SUBSTRINGS:
+			mdb_attrmask_ad( mdb, am, f->f_sub_desc );
+			break;
+		case LDAP_FILTER_PRESENT:
+			mdb_attrmask_ad( mdb, am, f->f_desc );
+			break;
+		case LDAP_FILTER_EXT:
+			/* dnAttributes and type-less rules may match anything */
+			if ( !f->f_mr_desc || f->f_mr_dnattrs )
+				return -1;
+			mdb_attrmask_ad( mdb, am, f->f_mr_desc );
+			break;
+		case LDAP_FILTER_AND:
+		case LDAP_FILTER_OR:
+			rc = mdb_attrmask_filter( mdb, am, f->f_list );
+			break;
+		case LDAP_FILTER_NOT:
+			rc = mdb_attrmask_filter( mdb, am, f->f_not );
+			break;
+		default:
+			return -1;
+		}
+	}
+	return rc;
+}
+
+static int
+mdb_attrmask_acl( struct mdb_info *mdb, mdb_attrmask *am, AccessControl *acl )
+{
+	Access *b;
+
+	for ( ; acl; acl = acl->acl_next ) {
+		if ( acl->acl_filter &&
+			mdb_attrmask_filter( mdb, am, acl->acl_filter ))
+			return -1;
+		for ( b = acl->acl_access; b; b = b->a_next ) {
+			/* sets and dynamic ACLs may read any attribute */
+			if ( !BER_BVISEMPTY( &b->a_set_pat ))
+				return -1;
+#ifdef SLAP_DYNACL
+			if ( b->a_dynacl )
+				return -1;
+#endif
+			if ( b->a_dn_at )
+				mdb_attrmask_ad( mdb, am, b->a_dn_at );
+			if ( b->a_realdn_at )
+				mdb_attrmask_ad( mdb, am, b->a_realdn_at );
+		}
+	}
+	return 0;
+}
+
+static int
+mdb_attrmask_overlays( BackendDB *be )
+{
+	slap_overinfo *oi;
+	slap_overinst *on;
+
+	if ( !overlay_is_over( be ))
+		return 0;
+	oi = be->bd_info->bi_private;
+	for ( on = oi->oi_list; on; on = on->on_next ) {
+		if ( on->on_bi.bi_access_allowed )
+			return 1;
+	}
+	return 0;
+}
+
+/* Returns the mask to decode candidates with, or NULL if they must
+ * be decoded in full.
+ */
+static mdb_attrmask *
+mdb_attrmask_get( Operation *op, mdb_attrmask *am )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+
+	if ( !mdb->mi_numads )
+		return NULL;
+
+	/* overlays checking access may look at anything */
+	if ( mdb_attrmask_overlays( op->o_bd->bd_self ) ||
+		mdb_attrmask_overlays( frontendDB ))
+		return NULL;
+
+	am->am_numads = mdb->mi_numads;
+	am->am_need = op->o_tmpcalloc( am->am_numads + 1, 1, op->o_tmpmemctx );
+
+	/* needed for the referral, alias, glue and subentry checks */
+	mdb_attrmask_ad( mdb, am, slap_schema.si_ad_objectClass );
+
+	if ( mdb_attrmask_filter( mdb, am, op->oq_search.rs_filter ) ||
+		( !be_isroot( op ) &&
+		( mdb_attrmask_acl( mdb, am, op->o_bd->be_acl ) ||
+		mdb_attrmask_acl( mdb, am, frontendDB->be_acl )))) {
+		op->o_tmpfree( am->am_need, op->o_tmpmemctx );
+		am->am_need = NULL;
+		return NULL;
+	}
+	return am;
+}
+
+/* A candidate's least value of the sort attribute, and its index key */
+typedef struct sort_val {
+	ID sv_id;
+	struct berval sv_val;
+	struct berval sv_key;
+	slap_sort_key *sv_sk;
+} sort_val;
+
+static int
+sort_value( Operation *op, MDB_cursor *mci, ID id, mdb_attrmask *am,
+	slap_sort_key *sk, struct berval *val )
+{
+	MDB_val data;
+	Entry *e;
+	Attribute *a;
+	struct berval *bv;
+	unsigned i;
+	int rc, cmp;
+
+	BER_BVZERO( val );
+	rc = mdb_id2edata( op, mci, id, &data );
+	if ( rc == MDB_NOTFOUND )
+		return 0;
+	if ( rc == 0 )
+		rc = mdb_entry_partial_decode( op, mdb_cursor_txn( mci ), &data,
+			id, am, &e );
+	if ( rc )
+		return rc;
+	e->e_name.bv_val = NULL;
+	e->e_nname.bv_val = NULL;
+
+	a = attr_find( e->e_attrs, sk->sk_ad );
+	if ( a ) {
+		/* RFC 2891: multivalued attributes sort by their least value */
+		bv = &a->a_nvals[0];
+		for ( i = 1; i < a->a_numvals; i++ ) {
+			sk->sk_ordering->smr_match( &cmp, 0, sk->sk_ordering->smr_syntax,
+				sk->sk_ordering, bv, &a->a_nvals[i] );
+			if ( cmp > 0 )
+				bv = &a->a_nvals[i];
+		}
+		ber_dupbv_x( val, bv, op->o_tmpmemctx );
+	}
+	mdb_entry_return( op, e );
+	return 0;
+}
+
+/* The index key a value is stored under */
+static void
+sort_key( Operation *op, AttrInfo *ai, MatchingRule *eq, slap_sort_key *sk,
+	struct berval *val, struct berval *key )
+{
+	struct berval *keys = NULL;
+
+	if ( !eq ) {
+		key->bv_val = op->o_tmpalloc( MDB_ORDERED_KEYLEN, op->o_tmpmemctx );
+		mdb_ordered_key( val, key );
+		return;
+	}
+	BER_BVZERO( key );
+	eq->smr_filter( LDAP_FILTER_EQUALITY, ai->ai_indexmask,
+		sk->sk_ad->ad_type->sat_syntax, eq, &sk->sk_ad->ad_type->sat_cname,
+		val, &keys, op->o_tmpmemctx );
+	if ( keys ) {
+		if ( !BER_BVISNULL( &keys[0] ))
+			ber_dupbv_x( key, &keys[0], op->o_tmpmemctx );
+		ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	}
+}
+
+/* qsort order of a run: by value, ties in ID order */
+static int
+sort_val_cmp( const void *v1, const void *v2 )
+{
+	const sort_val *s1 = *(sort_val * const *)v1;
+	const sort_val *s2 = *(sort_val * const *)v2;
+	slap_sort_key *sk = s1->sv_sk;
+	int cmp;
+
+	sk->sk_ordering->smr_match( &cmp, 0, sk->sk_ordering->smr_syntax,
+		sk->sk_ordering, (struct berval *)&s1->sv_val,
+		(struct berval *)&s2->sv_val );
+	if ( cmp )
+		return cmp * sk->sk_direction;
+	return s1->sv_id < s2->sv_id ? -1 : s1->sv_id > s2->sv_id;
+}
+
+/* The walk reads every key of the index, so fewer candidates than
+ * 1/MDB_SORT_RATIO of the index's IDs are left for the overlay to
+ * sort in memory.
+ */
+#define MDB_SORT_RATIO	16
+
+/* Put the candidates in the order asked for by a single key server
+ * side sort, if the sort attribute has an order-preserving index:
+ * an ordered index, or an eq index of a SLAP_MR_ORDERED_INDEX rule.
+ * The index is walked in key order and each candidate is placed under
+ * the key of its least value; candidates with the same key are sorted
+ * by value, and those without the attribute go last (first, if the
+ * order is reversed), as slapo-sssvlv would do. The overlay then
+ * passes the entries through instead of collecting and sorting them.
+ * Each candidate is decoded once, the first time the walk reaches it.
+ *
+ * Returns 1 if the candidates were reordered.
+ */
+static int
+search_sorted( Operation *op, MDB_txn *txn, MDB_cursor *mci,
+	mdb_search_arena *sa, ID *ids )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	slap_sort_ctrl *sc;
+	slap_sort_key *sk;
+	AttrInfo *ai;
+	MatchingRule *eq = NULL;
+	mdb_attrmask am = { 0 }, *amp = NULL;
+	MDB_cursor *mc = NULL;
+	MDB_stat st;
+	MDB_val key, data;
+	MDB_cursor_op step;
+	sort_val *svs = NULL, *sv, **run = NULL;
+	char *state = NULL;
+#define SV_UNSEEN	0
+#define SV_PENDING	1	/* has a value, not yet reached by its key */
+#define SV_NONE		2	/* has no value */
+#define SV_DONE		3
+	ID *tmp, *out, i, n, nout = 0, ns, pos, lo, hi, nrun, k;
+	int cid, rc, sorted = 0;
+
+	if ( !op->o_ctrls ||
+		slap_find_control_id( LDAP_CONTROL_SORTREQUEST, &cid ) ||
+		op->o_ctrlflag[cid] <= SLAP_CONTROL_IGNORED )
+		return 0;
+	sc = op->o_controls[cid];
+	if ( !( sc->sc_flags & SLAP_SORT_PRESORT_OK ) || sc->sc_nkeys != 1 ||
+		MDB_IDL_IS_RANGE( ids ))
+		return 0;
+	/* The flag is per operation: with glue, another database's entries
+	 * would be passed through unsorted after ours.
+	 */
+	if ( SLAP_GLUE_INSTANCE( op->o_bd ) || SLAP_GLUE_SUBORDINATE( op->o_bd ))
+		return 0;
+	sk = &sc->sc_keys[0];
+
+	ai = mdb_attr_mask( mdb, sk->sk_ad );
+	if ( !ai || ( ai->ai_indexmask & MDB_INDEX_DELETING ))
+		return 0;
+	if ( IS_SLAP_INDEX( ai->ai_indexmask, SLAP_INDEX_ORDERED ) &&
+		sk->sk_ordering->smr_match == octetStringOrderingMatch ) {
+		eq = NULL;
+	} else if ( IS_SLAP_INDEX( ai->ai_indexmask, SLAP_INDEX_EQUALITY ) &&
+		sk->sk_ordering == sk->sk_ad->ad_type->sat_ordering &&
+		( sk->sk_ordering->smr_usage & SLAP_MR_ORDERED_INDEX )) {
+		eq = sk->sk_ad->ad_type->sat_equality;
+	} else {
+		return 0;
+	}
+
+	n = ids[0];
+	if ( n < 2 )
+		goto done;
+
+	if ( mdb_stat( txn, ai->ai_dbi, &st ) ||
+		n < st.ms_entries / MDB_SORT_RATIO )
+		return 0;
+
+	tmp = search_stack( op, sa, 2 );
+	out = tmp + MDB_IDL_UM_SIZE;
+	state = op->o_tmpcalloc( n + 1, 1, op->o_tmpmemctx );
+	svs = op->o_tmpcalloc( n + 1, sizeof( sort_val ), op->o_tmpmemctx );
+	run = op->o_tmpalloc( n * sizeof( sort_val * ), op->o_tmpmemctx );
+	if ( mdb->mi_numads ) {
+		am.am_numads = mdb->mi_numads;
+		am.am_need = op->o_tmpcalloc( am.am_numads + 1, 1, op->o_tmpmemctx );
+		mdb_attrmask_ad( mdb, &am, sk->sk_ad );
+		amp = &am;
+	}
+
+	rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
+	if ( rc )
+		goto leave;
+	step = sk->sk_direction > 0 ? MDB_NEXT_NODUP : MDB_PREV_NODUP;
+	rc = mdb_cursor_get( mc, &key, &data,
+		sk->sk_direction > 0 ? MDB_FIRST : MDB_LAST );
+	for ( ; rc == 0; rc = mdb_cursor_get( mc, &key, &data, step )) {
+		if ( op->o_abandon )
+			goto leave;
+		/* Candidates are only placed under the key of their own
+		 * value, so other keys mixed in with an eq index's (the
+		 * presence key, say) just cost a look at their entries.
+		 */
+		if ( !eq && key.mv_size != MDB_ORDERED_KEYLEN )
+			continue;
+		rc = mdb_idl_fetch_key( op->o_bd, txn, ai->ai_dbi, &key, tmp, NULL, 0 );
+		if ( rc )
+			goto leave;
+
+		/* Candidates under this key whose least value has it */
+		nrun = 0;
+		if ( MDB_IDL_IS_RANGE( tmp )) {
+			lo = MDB_IDL_RANGE_FIRST( tmp );
+			hi = MDB_IDL_RANGE_LAST( tmp );
+		} else {
+			lo = 1;
+			hi = tmp[0];
+		}
+		for ( i = lo; i <= hi; i++ ) {
+			ID id = MDB_IDL_IS_RANGE( tmp ) ? i : tmp[i];
+
+			pos = mdb_idl_search( ids, id );
+			if ( pos > n ) {
+				if ( MDB_IDL_IS_RANGE( tmp ))
+					break;
+				continue;
+			}
+			if ( ids[pos] != id ) {
+				/* skip ahead to the next candidate in the range */
+				if ( MDB_IDL_IS_RANGE( tmp ))
+					i = ids[pos] - 1;
+				continue;
+			}
+			sv = &svs[pos];
+			if ( state[pos] == SV_UNSEEN ) {
+				rc = sort_value( op, mci, id, amp, sk, &sv->sv_val );
+				if ( rc )
+					goto leave;
+				if ( BER_BVISNULL( &sv->sv_val )) {
+					state[pos] = SV_NONE;
+					continue;
+				}
+				sort_key( op, ai, eq, sk, &sv->sv_val, &sv->sv_key );
+				sv->sv_id = id;
+				sv->sv_sk = sk;
+				state[pos] = SV_PENDING;
+			}
+			/* it belongs under the key of its least value */
+			if ( state[pos] != SV_PENDING ||
+				sv->sv_key.bv_len != key.mv_size ||
+				memcmp( sv->sv_key.bv_val, key.mv_data, key.mv_size ))
+				continue;
+			state[pos] = SV_DONE;
+			run[nrun++] = sv;
+		}
+		if ( nrun > 1 )
+			qsort( run, nrun, sizeof( sort_val * ), sort_val_cmp );
+		for ( k = 0; k < nrun; k++ ) {
+			sv = run[k];
+			out[nout++] = sv->sv_id;
+			op->o_tmpfree( sv->sv_val.bv_val, op->o_tmpmemctx );
+			op->o_tmpfree( sv->sv_key.bv_val, op->o_tmpmemctx );
+			BER_BVZERO( &sv->sv_val );
+			BER_BVZERO( &sv->sv_key );
+		}
+	}
+	if ( rc != MDB_NOTFOUND )
+		goto leave;
+
+	/* The candidates without a value sort after all the others */
+	ns = nout;
+	for ( pos = 1; pos <= n; pos++ ) {
+		if ( state[pos] != SV_DONE )
+			out[nout++] = ids[pos];
+	}
+	if ( sk->sk_direction > 0 ) {
+		AC_MEMCPY( ids+1, out, n * sizeof(ID) );
+	} else {
+		AC_MEMCPY( ids+1, out+ns, ( n - ns ) * sizeof(ID) );
+		AC_MEMCPY( ids+1 + n - ns, out, ns * sizeof(ID) );
+	}
+
+done:
+	sc->sc_flags |= SLAP_SORT_PRESORTED;
+	sorted = 1;
+
+leave:
+	if ( svs ) {
+		for ( pos = 1; pos <= n; pos++ ) {
+			if ( svs[pos].sv_val.bv_val )
+				op->o_tmpfree( svs[pos].sv_val.bv_val, op->o_tmpmemctx );
+			if ( svs[pos].sv_key.bv_val )
+				op->o_tmpfree( svs[pos].sv_key.bv_val, op->o_tmpmemctx );
+		}
+		op->o_tmpfree( svs, op->o_tmpmemctx );
+	}
+	if ( run )
+		op->o_tmpfree( run, op->o_tmpmemctx );
+	if ( mc )
+		mdb_cursor_close( mc );
+	if ( am.am_need )
+		op->o_tmpfree( am.am_need, op->o_tmpmemctx );
+	if ( state )
+		op->o_tmpfree( state, op->o_tmpmemctx );
+	return sorted;
+}
+
+/* Parallel filter pass. With searchthreads set, a large candidate
+ * list is cut into partitions which helper tasks in the thread pool
+ * and the search thread itself test against the filter, each in its
+ * own read txn. The candidates that pass are put back in their
+ * original order, and the usual loop then checks scope and sends
+ * only those. The search thread takes partitions too, so the pass
+ * completes even when no pool thread is free to help.
+ *
+ * A helper's txn may see a newer snapshot than the search's. The
+ * usual loop tests the candidates a helper kept again anyway, but
+ * one it dropped might match in the search's snapshot, so the search
+ * thread tests those again in its own txn.
+ */
+#define MDB_PSCAN_MIN	4096	/* fewest candidates per partition */
+#define MDB_PSCAN_MAX	16
+
+struct mdb_pscan;
+
+typedef struct mdb_pscan_slot {
+	struct mdb_pscan	*pt_scan;
+	void	*pt_cookie;
+	int		pt_state;
+#define PSCAN_QUEUED	0
+#define PSCAN_RUNNING	1
+#define PSCAN_DONE		2
+} mdb_pscan_slot;
+
+typedef struct mdb_pscan {
+	Operation	*ps_op;
+	ID		*ps_ids;	/* the candidates */
+	ID		*ps_out;	/* one slice per partition */
+	ID		ps_nout[MDB_PSCAN_MAX];
+	mdb_attrmask	*ps_need;
+	time_t	ps_stoptime;
+	ID		ps_base;
+	size_t	ps_txnid;	/* the search's snapshot */
+	char	ps_stale[MDB_PSCAN_MAX];	/* tested in another snapshot */
+	int		ps_nparts;
+	int		ps_next;	/* next unclaimed partition */
+	int		ps_running;	/* helpers we must wait for */
+	int		ps_err;
+	ldap_pvt_thread_mutex_t	ps_mutex;
+	ldap_pvt_thread_cond_t	ps_cond;
+	mdb_pscan_slot	ps_slots[MDB_PSCAN_MAX];
+} mdb_pscan;
+
+/* Bounds of a partition, and of its slice of the output */
+static void
+pscan_bounds( mdb_pscan *ps, int part, ID *lo, ID *hi, ID *out, ID *max )
+{
+	ID *ids = ps->ps_ids, n;
+
+	if ( MDB_IDL_IS_RANGE( ids )) {
+		n = MDB_IDL_RANGE_LAST( ids ) - MDB_IDL_RANGE_FIRST( ids ) + 1;
+		*lo = MDB_IDL_RANGE_FIRST( ids ) + n * part / ps->ps_nparts;
+		*hi = MDB_IDL_RANGE_FIRST( ids ) + n * ( part + 1 ) / ps->ps_nparts - 1;
+		*out = (ID)MDB_IDL_UM_MAX * part / ps->ps_nparts;
+		*max = (ID)MDB_IDL_UM_MAX * ( part + 1 ) / ps->ps_nparts - *out;
+	} else {
+		n = ids[0];
+		*lo = 1 + n * part / ps->ps_nparts;
+		*hi = n * ( part + 1 ) / ps->ps_nparts;
+		*out = *lo - 1;
+		*max = *hi - *lo + 1;
+	}
+}
+
+/* Test one partition. If kept is set, the partition was tested
+ * before and the nkept IDs in kept passed; those are kept as is.
+ */
+static int
+pscan_part( Operation *op, MDB_txn *txn, mdb_pscan *ps, int part,
+	ID *kept, ID nkept )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	Operation *sop = ps->ps_op;
+	MDB_cursor *mci, *mcd = NULL;
+	MDB_val key, data;
+	ID *ids = ps->ps_ids, *out, i, id, lo, hi, max, nout = 0, k = 0;
+	Entry *e;
+	int rc, keep, range = MDB_IDL_IS_RANGE( ids );
+	int manageDSAit = get_manageDSAit( op );
+
+	pscan_bounds( ps, part, &lo, &hi, &i, &max );
+	out = ps->ps_out + i;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mci );
+	if ( rc )
+		return rc;
+
+	key.mv_size = sizeof(ID);
+	for ( i = lo; i <= hi; i++ ) {
+		if ( sop->o_abandon || slapd_shutdown || ps->ps_err ) {
+			rc = -1;
+			break;
+		}
+		if ( sop->ors_tlimit != SLAP_NO_LIMIT && !( i & 0x3f ) &&
+			slap_get_time() > ps->ps_stoptime ) {
+			rc = -1;
+			break;
+		}
+		if ( range ) {
+			/* walk id2entry instead of probing every ID */
+			key.mv_data = &i;
+			rc = mdb_cursor_get( mci, &key, &data,
+				i == lo ? MDB_SET_RANGE : MDB_NEXT );
+			if ( rc == MDB_NOTFOUND ) {
+				rc = 0;
+				break;
+			}
+			if ( rc )
+				break;
+			memcpy( &id, key.mv_data, sizeof(ID) );
+			if ( id > hi )
+				break;
+			i = id;
+		} else {
+			id = ids[i];
+			rc = mdb_id2edata( op, mci, id, &data );
+			if ( rc == MDB_NOTFOUND ) {
+				rc = 0;
+				continue;
+			}
+			if ( rc )
+				break;
+		}
+
+		while ( k < nkept && kept[k] < id )
+			k++;
+		if ( id == ps->ps_base || ( k < nkept && kept[k] == id )) {
+			keep = 1;
+		} else {
+			rc = mdb_entry_partial_decode( op, txn, &data, id, ps->ps_need, &e );
+			if ( rc )
+				break;
+			e->e_id = id;
+			e->e_name.bv_val = NULL;
+			e->e_nname.bv_val = NULL;
+			/* ACLs and entryDN filters need the DN */
+			rc = mdb_id2name( op, txn, &mcd, id, &e->e_name, &e->e_nname );
+			if ( rc ) {
+				mdb_entry_return( op, e );
+				break;
+			}
+			/* referrals are sent regardless of the filter */
+			keep = ( !manageDSAit && is_entry_referral( e )) ||
+				test_filter( op, e, op->ors_filter ) == LDAP_COMPARE_TRUE;
+			mdb_entry_return( op, e );
+		}
+		if ( keep ) {
+			if ( nout == max ) {
+				rc = -1;
+				break;
+			}
+			out[nout++] = id;
+		}
+	}
+	ps->ps_nout[part] = nout;
+
+	if ( mcd )
+		mdb_cursor_close( mcd );
+	mdb_cursor_close( mci );
+	return rc;
+}
+
+static void
+pscan_run( Operation *op, MDB_txn *txn, mdb_pscan *ps )
+{
+	int part;
+
+	for (;;) {
+		ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+		part = ps->ps_err ? ps->ps_nparts : ps->ps_next;
+		if ( part < ps->ps_nparts )
+			ps->ps_next++;
+		ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+		if ( part >= ps->ps_nparts )
+			break;
+		ps->ps_stale[part] = mdb_txn_id( txn ) != ps->ps_txnid;
+		if ( pscan_part( op, txn, ps, part, NULL, 0 )) {
+			ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+			ps->ps_err = 1;
+			ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+		}
+	}
+}
+
+static void *
+pscan_task( void *ctx, void *arg )
+{
+	mdb_pscan_slot *pt = arg;
+	mdb_pscan *ps = pt->pt_scan;
+	struct mdb_info *mdb = (struct mdb_info *) ps->ps_op->o_bd->be_private;
+	Operation op2 = *ps->ps_op;
+	Opheader oh = *op2.o_hdr;
+	mdb_op_info opinfo = {{{0}}}, *moi = &opinfo;
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	pt->pt_state = PSCAN_RUNNING;
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+	/* a copy of the search with this thread's memory and txn */
+	op2.o_hdr = &oh;
+	oh.oh_threadctx = ctx;
+	oh.oh_tid = ldap_pvt_thread_pool_tid( ctx );
+	oh.oh_tmpmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK,
+		ctx, 1 );
+	op2.o_groups = NULL;
+	LDAP_SLIST_INIT( &op2.o_extra );
+
+	if ( mdb_opinfo_get( &op2, mdb, 1, &moi )) {
+		ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+		ps->ps_err = 1;
+		ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+	} else {
+		pscan_run( &op2, moi->moi_txn, ps );
+		mdb_txn_reset( moi->moi_txn );
+		LDAP_SLIST_REMOVE( &op2.o_extra, &moi->moi_oe, OpExtra, oe_next );
+	}
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	pt->pt_state = PSCAN_DONE;
+	ps->ps_running--;
+	ldap_pvt_thread_cond_signal( &ps->ps_cond );
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+	return NULL;
+}
+
+/* Returns 1 if the candidates were replaced by those that matched */
+static int
+search_parallel( Operation *op, MDB_txn *txn, mdb_search_arena *sa,
+	ID *ids, ID base, mdb_attrmask *need, time_t stoptime )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_pscan ps;
+	ID n, lo, hi, out, max;
+	int i;
+
+	if ( !op->o_threadctx || !( slapMode & SLAP_SERVER_MODE ))
+		return 0;
+	if ( MDB_IDL_IS_RANGE( ids ))
+		n = MDB_IDL_RANGE_LAST( ids ) - MDB_IDL_RANGE_FIRST( ids ) + 1;
+	else
+		n = ids[0];
+	ps.ps_nparts = mdb->mi_search_threads;
+	if ( ps.ps_nparts > MDB_PSCAN_MAX )
+		ps.ps_nparts = MDB_PSCAN_MAX;
+	if ( n / MDB_PSCAN_MIN < (ID)ps.ps_nparts )
+		ps.ps_nparts = n / MDB_PSCAN_MIN;
+	if ( ps.ps_nparts < 2 )
+		return 0;
+
+	ps.ps_op = op;
+	ps.ps_ids = ids;
+	ps.ps_out = search_stack( op, sa, 1 );
+	ps.ps_need = need;
+	ps.ps_stoptime = stoptime;
+	ps.ps_base = base;
+	ps.ps_txnid = mdb_txn_id( txn );
+	ps.ps_next = 0;
+	ps.ps_running = 0;
+	ps.ps_err = 0;
+	ldap_pvt_thread_mutex_init( &ps.ps_mutex );
+	ldap_pvt_thread_cond_init( &ps.ps_cond );
+
+	ldap_pvt_thread_mutex_lock( &ps.ps_mutex );
+	for ( i = 1; i < ps.ps_nparts; i++ ) {
+		mdb_pscan_slot *pt = &ps.ps_slots[i];
+		pt->pt_scan = &ps;
+		pt->pt_state = PSCAN_QUEUED;
+		if ( ldap_pvt_thread_pool_submit2( &connection_pool, pscan_task, pt,
+			&pt->pt_cookie ))
+			pt->pt_state = PSCAN_DONE;
+		else
+			ps.ps_running++;
+	}
+	ldap_pvt_thread_mutex_unlock( &ps.ps_mutex );
+
+	pscan_run( op, txn, &ps );
+
+	/* Nothing is left for helpers that haven't started yet. The
+	 * ones that have may still be in the middle of a partition.
+	 */
+	ldap_pvt_thread_mutex_lock( &ps.ps_mutex );
+	for ( i = 1; i < ps.ps_nparts; i++ ) {
+		mdb_pscan_slot *pt = &ps.ps_slots[i];
+		if ( pt->pt_state == PSCAN_QUEUED &&
+			ldap_pvt_thread_pool_retract( pt->pt_cookie ) > 0 ) {
+			pt->pt_state = PSCAN_DONE;
+			ps.ps_running--;
+		}
+	}
+	while ( ps.ps_running )
+		ldap_pvt_thread_cond_wait( &ps.ps_cond, &ps.ps_mutex );
+	ldap_pvt_thread_mutex_unlock( &ps.ps_mutex );
+	ldap_pvt_thread_cond_destroy( &ps.ps_cond );
+	ldap_pvt_thread_mutex_destroy( &ps.ps_mutex );
+
+	if ( ps.ps_err )
+		return 0;
+
+	for ( i = 0; i < ps.ps_nparts; i++ ) {
+		ID *kept;
+		int rc;
+
+		if ( !ps.ps_stale[i] )
+			continue;
+		pscan_bounds( &ps, i, &lo, &hi, &out, &max );
+		kept = op->o_tmpalloc( ( ps.ps_nout[i] + 1 ) * sizeof(ID),
+			op->o_tmpmemctx );
+		AC_MEMCPY( kept, ps.ps_out+out, ps.ps_nout[i] * sizeof(ID) );
+		rc = pscan_part( op, txn, &ps, i, kept, ps.ps_nout[i] );
+		op->o_tmpfree( kept, op->o_tmpmemctx );
+		if ( rc )
+			return 0;
+	}
+
+	n = 0;
+	for ( i = 0; i < ps.ps_nparts; i++ ) {
+		pscan_bounds( &ps, i, &lo, &hi, &out, &max );
+		AC_MEMCPY( ids+1+n, ps.ps_out+out, ps.ps_nout[i] * sizeof(ID) );
+		n += ps.ps_nout[i];
+	}
+	ids[0] = n;
+
+	Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_search)
+		": %d partitions, %ld candidates left\n",
+		ps.ps_nparts, (long) n, 0 );
+	return 1;
+}
+
+/* Narrow a one-level search's candidates to the children of pid
+ * using the children index. A candidate list much shorter than the
+ * container is probed ID by ID; otherwise a container that fits in
+ * an IDL is read and intersected. A range over a container too big
+ * for an IDL is only clipped to the first and last child, and *mckp
+ * is left open for search_kid to step through the children.
+ */
+static int
+search_children( Operation *op, MDB_txn *txn, ID pid, ID *ids, ID *tmp,
+	MDB_cursor **mckp, ID *nkidsp )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	size_t nkids;
+	ID id, i, j;
+	int rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2kids, &mc );
+	if ( rc )
+		return rc;
+
+	key.mv_size = sizeof( ID );
+	key.mv_data = &pid;
+	rc = mdb_cursor_get( mc, &key, &data, MDB_SET );
+	if ( rc == MDB_NOTFOUND ) {
+		ids[0] = 0;
+		*nkidsp = 0;
+		rc = 0;
+		goto done;
+	}
+	if ( rc == 0 )
+		rc = mdb_cursor_count( mc, &nkids );
+	if ( rc )
+		goto done;
+	*nkidsp = nkids;
+
+	if ( !MDB_IDL_IS_RANGE( ids ) &&
+		( ids[0] < nkids / 16 || nkids > MDB_IDL_UM_MAX )) {
+		data.mv_size = sizeof( ID );
+		data.mv_data = &id;
+		for ( i = j = 1; i <= ids[0]; i++ ) {
+			id = ids[i];
+			rc = mdb_cursor_get( mc, &key, &data, MDB_GET_BOTH );
+			if ( rc == 0 )
+				ids[j++] = ids[i];
+			else if ( rc != MDB_NOTFOUND )
+				goto done;
+		}
+		ids[0] = j - 1;
+		rc = 0;
+	} else if ( nkids <= MDB_IDL_UM_MAX ) {
+		i = 0;
+		rc = mdb_cursor_get( mc, &key, &data, MDB_GET_MULTIPLE );
+		while ( rc == 0 ) {
+			memcpy( tmp + i + 1, data.mv_data, data.mv_size );
+			i += data.mv_size / sizeof( ID );
+			rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_MULTIPLE );
+		}
+		if ( rc != MDB_NOTFOUND )
+			goto done;
+		tmp[0] = i;
+		rc = mdb_idl_intersection( ids, tmp );
+	} else {
+		ID first, last;
+
+		rc = mdb_cursor_get( mc, &key, &data, MDB_FIRST_DUP );
+		if ( rc == 0 ) {
+			memcpy( &first, data.mv_data, sizeof( ID ));
+			rc = mdb_cursor_get( mc, &key, &data, MDB_LAST_DUP );
+		}
+		if ( rc )
+			goto done;
+		memcpy( &last, data.mv_data, sizeof( ID ));
+		if ( MDB_IDL_RANGE_FIRST( ids ) < first )
+			ids[1] = first;
+		if ( MDB_IDL_RANGE_LAST( ids ) > last )
+			ids[2] = last;
+		if ( ids[1] > ids[2] )
+			ids[0] = 0;
+		*mckp = mc;
+		return 0;
+	}
+
+done:
+	mdb_cursor_close( mc );
+	return rc;
+}
+
+/* The first child of pid in the range ids at or after *cursor */
+static ID
+search_kid( MDB_cursor *mc, ID pid, ID *ids, ID *cursor )
+{
+	MDB_val key, data;
+	ID id = *cursor;
+
+	if ( id < MDB_IDL_RANGE_FIRST( ids ))
+		id = MDB_IDL_RANGE_FIRST( ids );
+	key.mv_size = sizeof( ID );
+	key.mv_data = &pid;
+	data.mv_size = sizeof( ID );
+	data.mv_data = &id;
+	if ( mdb_cursor_get( mc, &key, &data, MDB_GET_BOTH_RANGE ))
+		return NOID;
+	memcpy( &id, data.mv_data, sizeof( ID ));
+	if ( id > MDB_IDL_RANGE_LAST( ids ))
+		return NOID;
+	*cursor = id;
+	return id;
+}
+
+/* Read-ahead state for a walk over the candidate list: the next
+ * positions to hint leaf pages and entry data for, and the leaf page
+ * hinted last.
+ */
+typedef struct search_pf {
+	ID		pf_leaf;
+	ID		pf_data;
+	size_t	pf_last;
+} search_pf;
+
+/* Before reading the entry at cursor, ask for the leaf pages of the
+ * next mi_prefetch candidates and the overflow pages of the next half
+ * of those; the leaves have had a head start by the time their data
+ * is looked up. cursor is an index into a list, or the ID itself in
+ * a range.
+ */
+static void
+search_prefetch( struct mdb_info *mdb, MDB_txn *txn, ID *ids, ID cursor,
+	search_pf *pf )
+{
+	int range = MDB_IDL_IS_RANGE( ids );
+	ID last = range ? MDB_IDL_RANGE_LAST( ids ) : ids[0];
+	ID end;
+
+	end = cursor + mdb->mi_prefetch;
+	if ( end > last || end < cursor )
+		end = last;
+	if ( pf->pf_leaf <= cursor )
+		pf->pf_leaf = cursor + 1;
+	for ( ; pf->pf_leaf <= end; pf->pf_leaf++ )
+		mdb_id2entry_prefetch( mdb, txn,
+			range ? pf->pf_leaf : ids[pf->pf_leaf], 0, &pf->pf_last );
+
+	end = cursor + mdb->mi_prefetch / 2;
+	if ( end > last || end < cursor )
+		end = last;
+	if ( pf->pf_data <= cursor )
+		pf->pf_data = cursor + 1;
+	for ( ; pf->pf_data <= end; pf->pf_data++ )
+		mdb_id2entry_prefetch( mdb, txn,
+			range ? pf->pf_data : ids[pf->pf_data], 1, &pf->pf_last );
+}
+
 int
 mdb_search( Operation *op, SlapReply *rs )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	ID		id, cursor, nsubs, ncand, cscope;
 	ID		lastid = NOID;
-	ID		candidates[MDB_IDL_UM_SIZE];
-	ID		iscopes[MDB_IDL_DB_SIZE];
+	ID		*candidates, *iscopes;
 	ID2		*scopes;
-	void	*stack;
+	mdb_search_arena	*sa;
 	Entry		*e = NULL, *base = NULL;
 	Entry		*matched = NULL;
 	AttributeName	*attrs;
@@ -427,10 +1356,14 @@ mdb_search( Operation *op, SlapReply *rs )
 	time_t		stoptime;
 	int		manageDSAit;
 	int		tentries = 0;
+	unsigned long	nscanned = 0;
 	IdScopes	isc;
-	MDB_cursor	*mci, *mcd;
+	search_pf	pf = { 0 };
+	MDB_cursor	*mci, *mcd, *mck = NULL;
 	ww_ctx wwctx;
 	slap_callback cb = { 0 };
+	mdb_attrmask	need = { 0 }, *needp;
+	int		partial = 0;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -465,12 +1398,14 @@ mdb_search( Operation *op, SlapReply *rs )
 	}
 
 	scopes = scope_chunk_get( op );
-	stack = search_stack( op );
+	sa = search_arena( op );
+	candidates = sa->sa_cand;
+	iscopes = sa->sa_scopes;
 	isc.mt = ltid;
 	isc.mc = mcd;
 	isc.scopes = scopes;
 	isc.oscope = op->ors_scope;
-	isc.sctmp = stack;
+	isc.sctmp = (ID2 *)sa->sa_stack;
 
 	if ( op->ors_deref & LDAP_DEREF_FINDING ) {
 		MDB_IDL_ZERO(candidates);
@@ -664,7 +1599,9 @@ dn2entry_retry:
 		scopes[1].mid = base->e_id;
 		scopes[1].mval.mv_data = NULL;
 		rs->sr_err = search_candidates( op, rs, base,
-			&isc, mci, candidates, stack );
+			&isc, mci, candidates, sa );
+		/* the stack may have grown */
+		isc.sctmp = (ID2 *)sa->sa_stack;
 		ncand = MDB_IDL_N( candidates );
 		if ( !base->e_id || ncand == NOID ) {
 			/* grab entry count from id2entry stat
@@ -676,6 +1613,20 @@ dn2entry_retry:
 			if ( ncand == NOID )
 				ncand = ms.ms_entries;
 		}
+		/* with the children index the candidates can be cut down
+		 * to the base's children, so no scope walk is needed
+		 */
+		if ( op->ors_scope == LDAP_SCOPE_ONELEVEL && mdb->mi_id2kids &&
+			!( op->ors_deref & LDAP_DEREF_SEARCHING ) &&
+			rs->sr_err == LDAP_SUCCESS ) {
+			ID nkids;
+			if ( search_children( op, ltid, base->e_id, candidates,
+				search_stack( op, sa, 1 ), &mck, &nkids ) == 0 ) {
+				isc.sctmp = (ID2 *)sa->sa_stack;
+				ncand = mck ? nkids : MDB_IDL_N( candidates );
+				nsubs = ncand;
+			}
+		}
 	}
 
 	/* start cursor at beginning of candidates.
@@ -719,6 +1670,8 @@ dn2entry_retry:
 		op->o_callback = &cb;
 	}
 
+	needp = mdb_attrmask_get( op, &need );
+
 	if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED ) {
 		PagedResultsState *ps = op->o_pagedresults_state;
 		/* deferred cookie parsing */
@@ -735,7 +1688,10 @@ dn2entry_retry:
 			send_ldap_result( op, rs );
 			goto done;
 		}
-		id = mdb_idl_first( candidates, &cursor );
+		if ( mck )
+			id = search_kid( mck, base->e_id, candidates, &cursor );
+		else
+			id = mdb_idl_first( candidates, &cursor );
 		if ( id == NOID ) {
 			Debug( LDAP_DEBUG_TRACE, 
 				LDAP_XSTRING(mdb_search)
@@ -746,11 +1702,22 @@ dn2entry_retry:
 			rs->sr_err = LDAP_OTHER;
 			goto done;
 		}
-		if ( id == (ID)ps->ps_cookie )
-			id = mdb_idl_next( candidates, &cursor );
+		if ( id == (ID)ps->ps_cookie ) {
+			if ( mck ) {
+				cursor++;
+				id = search_kid( mck, base->e_id, candidates, &cursor );
+			} else {
+				id = mdb_idl_next( candidates, &cursor );
+			}
+		}
 		nsubs = ncand;	/* always bypass scope'd search */
 		goto loop_begin;
 	}
+	if ( search_sorted( op, ltid, mci, sa, candidates )) {
+		/* the walk may have moved the IDL stack */
+		isc.sctmp = (ID2 *)sa->sa_stack;
+		nsubs = ncand;	/* return them in the order given */
+	}
 	if ( nsubs < ncand ) {
 		int rc;
 		/* Do scope-based search */
@@ -778,7 +1745,18 @@ dn2entry_retry:
 		else
 			id = isc.id;
 		cscope = 0;
+	} else if ( mck ) {
+		id = search_kid( mck, base->e_id, candidates, &cursor );
 	} else {
+		if ( mdb->mi_search_threads > 1 ) {
+			ID npre = MDB_IDL_N( candidates );
+			if ( search_parallel( op, ltid, sa, candidates, base->e_id,
+				needp, stoptime )) {
+				isc.sctmp = (ID2 *)sa->sa_stack;
+				/* the helpers tested the ones they dropped */
+				nscanned = npre - candidates[0];
+			}
+		}
 		id = mdb_idl_first( candidates, &cursor );
 	}
 
@@ -882,10 +1860,14 @@ loop_begin:
 		}
 
 scopeok:
+		partial = 0;
 		if ( id == base->e_id ) {
 			e = base;
 		} else {
 
+			if ( mdb->mi_prefetch && nsubs >= ncand && !mck )
+				search_prefetch( mdb, ltid, candidates, cursor, &pf );
+
 			/* get the entry */
 			rs->sr_err = mdb_id2edata( op, mci, id, &edata );
 			if ( rs->sr_err == MDB_NOTFOUND ) {
@@ -922,7 +1904,7 @@ notfound:
 				goto done;
 			}
 
-			rs->sr_err = mdb_entry_decode( op, ltid, &edata, id, &e );
+			rs->sr_err = mdb_entry_partial_decode( op, ltid, &edata, id, needp, &e );
 			if ( rs->sr_err ) {
 				rs->sr_err = LDAP_OTHER;
 				rs->sr_text = "internal error in mdb_entry_decode";
@@ -932,6 +1914,7 @@ notfound:
 			e->e_id = id;
 			e->e_name.bv_val = NULL;
 			e->e_nname.bv_val = NULL;
+			partial = needp != NULL;
 		}
 
 		if ( is_entry_subentry( e ) ) {
@@ -1036,7 +2019,17 @@ notfound:
 		if ( !manageDSAit && op->oq_search.rs_scope != LDAP_SCOPE_BASE
 			&& is_entry_referral( e ) )
 		{
-			BerVarray erefs = get_entry_referrals( op, e );
+			BerVarray erefs;
+
+			if ( partial && mdb_entry_partial_complete( op, ltid, &edata, needp, e )) {
+				mdb_entry_return( op, e );
+				e = NULL;
+				rs->sr_err = LDAP_OTHER;
+				rs->sr_text = "internal error in mdb_entry_decode";
+				send_ldap_result( op, rs );
+				goto done;
+			}
+			erefs = get_entry_referrals( op, e );
 			rs->sr_ref = referral_rewrite( erefs, &e->e_name, NULL,
 				op->oq_search.rs_scope == LDAP_SCOPE_ONELEVEL
 					? LDAP_SCOPE_BASE : LDAP_SCOPE_SUBTREE );
@@ -1059,9 +2052,20 @@ notfound:
 		}
 
 		/* if it matches the filter and scope, send it */
+		nscanned++;
 		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
+			/* everything past here gets the whole entry */
+			if ( partial && mdb_entry_partial_complete( op, ltid, &edata, needp, e )) {
+				mdb_entry_return( op, e );
+				e = NULL;
+				rs->sr_err = LDAP_OTHER;
+				rs->sr_text = "internal error in mdb_entry_decode";
+				send_ldap_result( op, rs );
+				goto done;
+			}
+
 			/* check size limit */
 			if ( get_pagedresults(op) > SLAP_CONTROL_IGNORED ) {
 				if ( rs->sr_nentries >= ((PagedResultsState *)op->o_pagedresults_state)->ps_size ) {
@@ -1136,6 +2140,8 @@ loop_continue:
 				send_ldap_result( op, rs );
 				goto done;
 			}
+			if ( mck )
+				mdb_cursor_renew( ltid, mck );
 		}
 
 		if( e != NULL ) {
@@ -1173,6 +2179,9 @@ loop_continue:
 				}
 			} else
 				id = isc.id;
+		} else if ( mck ) {
+			cursor++;
+			id = search_kid( mck, base->e_id, candidates, &cursor );
 		} else {
 			id = mdb_idl_next( candidates, &cursor );
 		}
@@ -1203,6 +2212,13 @@ done:
 			}
 		}
 	}
+#ifdef MDB_MONITOR_IDX
+	if ( mdb->mi_monitor_stats && op->ors_scope != LDAP_SCOPE_BASE )
+		mdb_monitor_filter_stat( mdb, op->ors_filter, nscanned,
+			rs->sr_nentries );
+#endif /* MDB_MONITOR_IDX */
+	if ( mck )
+		mdb_cursor_close( mck );
 	mdb_cursor_close( mcd );
 	mdb_cursor_close( mci );
 	if ( moi == &opinfo ) {
@@ -1217,7 +2233,10 @@ done:
 	}
 	if (base)
 		mdb_entry_return( op, base );
+	if ( need.am_need )
+		op->o_tmpfree( need.am_need, op->o_tmpmemctx );
 	scope_chunk_ret( op, scopes );
+	search_arena_ret( op, sa );
 
 	return rs->sr_err;
 }
@@ -1271,34 +2290,89 @@ static int oc_filter(
 	return rc;
 }
 
-static void search_stack_free( void *key, void *data )
+void mdb_search_arena_free( void *key, void *data )
 {
-	ber_memfree_x(data, NULL);
+	mdb_search_arena *sa, *next;
+
+	for ( sa = data; sa; sa = next ) {
+		next = sa->sa_next;
+		ber_memfree_x( sa->sa_stack, NULL );
+		ber_memfree_x( sa, NULL );
+	}
 }
 
-static void *search_stack( Operation *op )
+static void search_arena_peak( struct mdb_info *mdb, mdb_search_arena *sa )
+{
+	size_t size = ( MDB_IDL_UM_SIZE + MDB_IDL_DB_SIZE +
+		sa->sa_depth * MDB_IDL_UM_SIZE ) * sizeof( ID );
+
+	if ( size > mdb->mi_search_peak ) {
+		ldap_pvt_thread_mutex_lock( &mdb->mi_search_mutex );
+		if ( size > mdb->mi_search_peak )
+			mdb->mi_search_peak = size;
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_search_mutex );
+	}
+}
+
+/* Make sure the arena's IDL stack holds at least depth IDLs */
+static ID *search_stack( Operation *op, mdb_search_arena *sa, int depth )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
-	void *ret = NULL;
+
+	if ( depth > sa->sa_depth ) {
+		sa->sa_stack = ch_realloc( sa->sa_stack,
+			depth * MDB_IDL_UM_SIZE * sizeof( ID ));
+		sa->sa_depth = depth;
+	}
+	search_arena_peak( mdb, sa );
+	return sa->sa_stack;
+}
+
+static mdb_search_arena *search_arena( Operation *op )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_search_arena *sa = NULL;
 
 	if ( op->o_threadctx ) {
-		ldap_pvt_thread_pool_getkey( op->o_threadctx, (void *)search_stack,
-			&ret, NULL );
+		ldap_pvt_thread_pool_getkey( op->o_threadctx, (void *)search_arena,
+			(void **)&sa, NULL );
+		if ( sa )
+			ldap_pvt_thread_pool_setkey( op->o_threadctx, (void *)search_arena,
+				sa->sa_next, mdb_search_arena_free, NULL, NULL );
 	} else {
-		ret = mdb->mi_search_stack;
+		sa = mdb->mi_search_stack;
+		if ( sa )
+			mdb->mi_search_stack = sa->sa_next;
 	}
 
-	if ( !ret ) {
-		ret = ch_malloc( mdb->mi_search_stack_depth * MDB_IDL_UM_SIZE
-			* sizeof( ID ) );
-		if ( op->o_threadctx ) {
-			ldap_pvt_thread_pool_setkey( op->o_threadctx, (void *)search_stack,
-				ret, search_stack_free, NULL, NULL );
-		} else {
-			mdb->mi_search_stack = ret;
-		}
+	if ( !sa ) {
+		sa = ch_malloc( sizeof( mdb_search_arena ) +
+			( MDB_IDL_UM_SIZE + MDB_IDL_DB_SIZE ) * sizeof( ID ));
+		sa->sa_cand = (ID *)(sa + 1);
+		sa->sa_scopes = sa->sa_cand + MDB_IDL_UM_SIZE;
+		sa->sa_stack = NULL;
+		sa->sa_depth = 0;
+	}
+	sa->sa_next = NULL;
+	search_stack( op, sa, mdb->mi_search_stack_depth );
+	return sa;
+}
+
+static void search_arena_ret( Operation *op, mdb_search_arena *sa )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	void *next = NULL;
+
+	if ( op->o_threadctx ) {
+		ldap_pvt_thread_pool_getkey( op->o_threadctx, (void *)search_arena,
+			&next, NULL );
+		sa->sa_next = next;
+		ldap_pvt_thread_pool_setkey( op->o_threadctx, (void *)search_arena,
+			sa, mdb_search_arena_free, NULL, NULL );
+	} else {
+		sa->sa_next = mdb->mi_search_stack;
+		mdb->mi_search_stack = sa;
 	}
-	return ret;
 }
 
 static int search_candidates(
@@ -1308,10 +2382,10 @@ static int search_candidates(
 	IdScopes *isc,
 	MDB_cursor *mci,
 	ID	*ids,
-	ID *stack )
+	mdb_search_arena *sa )
 {
-	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int rc, depth = 1;
+	ID		*stack;
 	Filter		*f, rf, xf, nf, sf;
 	AttributeAssertion aa_ref = ATTRIBUTEASSERTION_INIT;
 	AttributeAssertion aa_subentry = ATTRIBUTEASSERTION_INIT;
@@ -1364,10 +2438,8 @@ static int search_candidates(
 		depth++;
 	}
 
-	/* Allocate IDL stack, plus 1 more for former tmp */
-	if ( depth+1 > mdb->mi_search_stack_depth ) {
-		stack = ch_malloc( (depth + 1) * MDB_IDL_UM_SIZE * sizeof( ID ) );
-	}
+	/* Need an IDL stack for the filter, plus 1 more for former tmp */
+	stack = search_stack( op, sa, depth+1 );
 
 	if( op->ors_deref & LDAP_DEREF_SEARCHING ) {
 		rc = search_aliases( op, rs, e->e_id, isc, mci, stack );
@@ -1380,10 +2452,6 @@ static int search_candidates(
 			stack, stack+MDB_IDL_UM_SIZE );
 	}
 
-	if ( depth+1 > mdb->mi_search_stack_depth ) {
-		ch_free( stack );
-	}
-
 	if( rc ) {
 		Debug(LDAP_DEBUG_TRACE,
 			"mdb_search_candidates: failed (rc=%d)\n",
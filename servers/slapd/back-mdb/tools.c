@@ -24,9 +24,6 @@
 #include "back-mdb.h"
 #include "idl.h"
 
-#ifdef MDB_TOOL_IDL_CACHING
-static int mdb_tool_idl_flush( BackendDB *be, MDB_txn *txn );
-
 #define	IDBLOCK	1024
 
 typedef struct mdb_tool_idl_cache_entry {
@@ -41,9 +38,18 @@ typedef struct mdb_tool_idl_cache {
 	int count;
 	short offset;
 	short flags;
+	ID *ids;	/* bulk reindex: the IDs after the first */
+	int size;
 } mdb_tool_idl_cache;
 #define WAS_FOUND	0x01
 #define WAS_RANGE	0x02
+#define IS_RANGE	0x04	/* written as a range */
+
+static int
+mdb_tool_idl_cmp( const void *v1, const void *v2 );
+
+#ifdef MDB_TOOL_IDL_CACHING
+static int mdb_tool_idl_flush( BackendDB *be, MDB_txn *txn );
 
 #define MDB_TOOL_IDL_FLUSH(be, txn)	mdb_tool_idl_flush(be, txn)
 #else
@@ -58,16 +64,40 @@ static MDB_cursor *mcp = NULL, *mcd = NULL;
 static MDB_val key, data;
 static ID previd = NOID;
 
+/* Parents that were created as placeholders because an entry came
+ * before them, hashed by ID until the real entry arrives.
+ */
 typedef struct dn_id {
 	ID id;
 	struct berval dn;
+	struct dn_id *next;
 } dn_id;
 
-#define	HOLE_SIZE	4096
-static dn_id hbuf[HOLE_SIZE], *holes = hbuf;
-static unsigned nhmax = HOLE_SIZE;
+#define	HOLE_SIZE	4096	/* initial buckets, a power of 2 */
+static dn_id **holes;
+static unsigned nhmax;
 static unsigned nholes;
 
+/* Recently added entries, as parents for the entries that follow:
+ * DNC_WAYS per DN depth, most recently used first. An entry whose
+ * parent is here is added without looking its DN up, and the count
+ * it adds to the parent's superiors is written once per txn rather
+ * than once per entry.
+ */
+typedef struct dn_cache {
+	struct berval dc_ndn;
+	ber_len_t dc_size;
+	ID dc_id;
+	ID dc_nsubs;	/* children not yet counted in the superiors */
+} dn_cache;
+
+#define	DNC_DEPTH	16
+#define	DNC_WAYS	4
+static dn_cache dnc[DNC_DEPTH][DNC_WAYS];
+
+static int mdb_tool_dnc_flush( BackendDB *bd );
+static void mdb_tool_dnc_clear( int release );
+
 static struct berval	*tool_base;
 static int		tool_scope;
 static Filter		*tool_filter;
@@ -98,6 +128,11 @@ static int	mdb_writes, mdb_writes_per_commit;
 static int
 mdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep );
 
+static BackendDB *mdb_tool_bulk_be;	/* set while bulk reindexing */
+static void mdb_tool_bulk_open( BackendDB *be );
+static int mdb_tool_bulk_index( Operation *op, MDB_txn *txn, Entry **ep );
+static int mdb_tool_bulk_close( BackendDB *be );
+
 int mdb_tool_entry_open(
 	BackendDB *be, int mode )
 {
@@ -147,6 +182,11 @@ int mdb_tool_entry_open(
 int mdb_tool_entry_close(
 	BackendDB *be )
 {
+	int brc = 0;
+
+	if ( mdb_tool_bulk_be )
+		brc = mdb_tool_bulk_close( be );
+
 #ifdef MDB_TOOL_IDL_CACHING
 	if ( mdb_tool_info ) {
 		int i;
@@ -206,9 +246,25 @@ int mdb_tool_entry_close(
 				mdb->mi_attrs[i]->ai_cursor = NULL;
 		}
 	}
+	if( txi ) {
+		int rc;
+		if (( rc = mdb_txn_commit( txi ))) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
+				"txn_commit failed: %s (%d)\n",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			brc = -1;
+		}
+		txi = NULL;
+	}
 	if( mdb_tool_txn ) {
 		int rc;
-		if (( rc = mdb_txn_commit( mdb_tool_txn ))) {
+		rc = mdb_tool_dnc_flush( be );
+		if ( rc )
+			mdb_txn_abort( mdb_tool_txn );
+		else
+			rc = mdb_txn_commit( mdb_tool_txn );
+		if ( rc ) {
 			Debug( LDAP_DEBUG_ANY,
 				LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
 				"txn_commit failed: %s (%d)\n",
@@ -218,18 +274,32 @@ int mdb_tool_entry_close(
 		mdb_tool_txn = NULL;
 	}
 
-	if( nholes ) {
+	mdb_tool_dnc_clear( 1 );
+
+	if( holes ) {
+		dn_id *h;
 		unsigned i;
-		fprintf( stderr, "Error, entries missing!\n");
-		for (i=0; i<nholes; i++) {
-			fprintf(stderr, "  entry %ld: %s\n",
-				holes[i].id, holes[i].dn.bv_val);
+		if ( nholes )
+			fprintf( stderr, "Error, entries missing!\n");
+		for (i=0; i<nhmax; i++) {
+			while (( h = holes[i] )) {
+				fprintf(stderr, "  entry %ld: %s\n",
+					h->id, h->dn.bv_val);
+				holes[i] = h->next;
+				ch_free( h->dn.bv_val );
+				ch_free( h );
+			}
+		}
+		ch_free( holes );
+		holes = NULL;
+		nhmax = 0;
+		if ( nholes ) {
+			nholes = 0;
+			return -1;
 		}
-		nholes = 0;
-		return -1;
 	}
 
-	return 0;
+	return brc ? -1 : 0;
 }
 
 ID
@@ -446,6 +516,352 @@ mdb_tool_entry_get( BackendDB *be, ID id )
 	return e;
 }
 
+typedef struct mdb_tool_range {
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_cursor *idc;
+} mdb_tool_range;
+
+/* A private read txn per caller, so multiple threads
+ * can each read their own part of id2entry.
+ */
+int
+mdb_tool_entry_range_open( BackendDB *be, void **ctx, ID *maxid,
+	unsigned long *snap )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_tool_range *mr;
+	MDB_val key, data;
+	int rc;
+
+	mr = ch_calloc( 1, sizeof( mdb_tool_range ));
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &mr->txn );
+	if ( rc == 0 ) {
+		rc = mdb_cursor_open( mr->txn, mdb->mi_id2entry, &mr->mc );
+		if ( rc )
+			mdb_txn_abort( mr->txn );
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_tool_entry_range_open: txn_begin failed: %s (%d)\n",
+			mdb_strerror(rc), rc, 0 );
+		ch_free( mr );
+		return -1;
+	}
+	if ( snap )
+		*snap = mdb_txn_id( mr->txn );
+	if ( maxid ) {
+		rc = mdb_cursor_get( mr->mc, &key, &data, MDB_LAST );
+		if ( rc == 0 )
+			memcpy( maxid, key.mv_data, sizeof( ID ));
+		else
+			*maxid = 0;
+	}
+	*ctx = mr;
+	return 0;
+}
+
+int
+mdb_tool_entry_range(
+	BackendDB *be,
+	void *ctx,
+	ID first,
+	ID last,
+	BI_tool_entry_range_cb *cb,
+	void *arg )
+{
+	mdb_tool_range *mr = ctx;
+	Operation op = {0};
+	Opheader ohdr = {0};
+	MDB_val key, data;
+	MDB_cursor_op mop = MDB_SET_RANGE;
+	ID id;
+	int rc;
+
+	op.o_hdr = &ohdr;
+	op.o_bd = be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+
+	key.mv_size = sizeof(ID);
+	key.mv_data = &first;
+
+	for (;;) {
+		Entry *e = NULL;
+		struct berval dn, ndn;
+
+		rc = mdb_cursor_get( mr->mc, &key, &data, mop );
+		mop = MDB_NEXT;
+		if ( rc ) {
+			if ( rc == MDB_NOTFOUND )
+				rc = 0;
+			break;
+		}
+		memcpy( &id, key.mv_data, sizeof(ID) );
+		if ( id > last )
+			break;
+		if ( !data.mv_size )
+			continue;
+
+		rc = mdb_id2name( &op, mr->txn, &mr->idc, id, &dn, &ndn );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				"mdb_tool_entry_range: no DN for entry %08lx (%d)\n",
+				(long) id, rc, 0 );
+			rc = LDAP_OTHER;
+			break;
+		}
+		rc = mdb_entry_decode( &op, mr->txn, &data, id, &e );
+		if ( rc ) {
+			ch_free( dn.bv_val );
+			ch_free( ndn.bv_val );
+			break;
+		}
+		e->e_id = id;
+		e->e_name = dn;
+		e->e_nname = ndn;
+		rc = cb( be, e, arg );
+		mdb_entry_release( &op, e, 0 );
+		if ( rc )
+			break;
+	}
+	return rc;
+}
+
+int
+mdb_tool_entry_range_close( BackendDB *be, void *ctx )
+{
+	mdb_tool_range *mr = ctx;
+
+	if ( mr->idc )
+		mdb_cursor_close( mr->idc );
+	mdb_cursor_close( mr->mc );
+	mdb_txn_abort( mr->txn );
+	ch_free( mr );
+	return 0;
+}
+
+static void
+mdb_tool_hole_add( ID id, struct berval *dn )
+{
+	dn_id *h, **bucket;
+
+	if ( nholes >= nhmax ) {
+		dn_id **old = holes;
+		unsigned i, n = nhmax;
+
+		nhmax = n ? n * 2 : HOLE_SIZE;
+		holes = ch_calloc( nhmax, sizeof(dn_id *) );
+		for ( i=0; i<n; i++ ) {
+			while (( h = old[i] )) {
+				old[i] = h->next;
+				bucket = &holes[h->id & (nhmax-1)];
+				h->next = *bucket;
+				*bucket = h;
+			}
+		}
+		ch_free( old );
+	}
+	h = ch_malloc( sizeof(dn_id) );
+	h->id = id;
+	ber_dupbv( &h->dn, dn );
+	bucket = &holes[id & (nhmax-1)];
+	h->next = *bucket;
+	*bucket = h;
+	nholes++;
+}
+
+static void
+mdb_tool_hole_fill( ID id )
+{
+	dn_id *h, **prev;
+
+	if ( !nholes )
+		return;
+	for ( prev = &holes[id & (nhmax-1)]; ( h = *prev ); prev = &h->next ) {
+		if ( h->id == id ) {
+			*prev = h->next;
+			ch_free( h->dn.bv_val );
+			ch_free( h );
+			nholes--;
+			break;
+		}
+	}
+}
+
+static int
+mdb_tool_dn_depth( struct berval *ndn )
+{
+	struct berval bv = *ndn;
+	int depth = 0;
+
+	while ( bv.bv_len ) {
+		depth++;
+		dnParent( &bv, &bv );
+	}
+	return depth;
+}
+
+static dn_cache *
+mdb_tool_dnc_find( int depth, struct berval *ndn )
+{
+	dn_cache *row, tmp;
+	int i;
+
+	if ( depth < 1 || depth > DNC_DEPTH )
+		return NULL;
+	row = dnc[depth-1];
+	for ( i=0; i<DNC_WAYS && row[i].dc_id; i++ ) {
+		if ( row[i].dc_ndn.bv_len == ndn->bv_len &&
+			!memcmp( row[i].dc_ndn.bv_val, ndn->bv_val, ndn->bv_len )) {
+			if ( i ) {
+				tmp = row[i];
+				AC_MEMCPY( &row[1], &row[0], i * sizeof(dn_cache) );
+				row[0] = tmp;
+			}
+			return &row[0];
+		}
+	}
+	return NULL;
+}
+
+static int
+mdb_tool_dnc_add( Operation *op, int depth, struct berval *ndn, ID id )
+{
+	dn_cache *row, tmp;
+	int rc;
+
+	if ( depth < 1 || depth > DNC_DEPTH )
+		return 0;
+	row = dnc[depth-1];
+
+	/* the least recently used one makes room */
+	tmp = row[DNC_WAYS-1];
+	if ( tmp.dc_nsubs ) {
+		rc = mdb_dn2id_upsub( op, mcp, tmp.dc_id, tmp.dc_nsubs );
+		if ( rc )
+			return rc;
+	}
+	AC_MEMCPY( &row[1], &row[0], (DNC_WAYS-1) * sizeof(dn_cache) );
+	if ( tmp.dc_size <= ndn->bv_len ) {
+		tmp.dc_size = ndn->bv_len + 1;
+		tmp.dc_ndn.bv_val = ch_realloc( tmp.dc_ndn.bv_val, tmp.dc_size );
+	}
+	AC_MEMCPY( tmp.dc_ndn.bv_val, ndn->bv_val, ndn->bv_len );
+	tmp.dc_ndn.bv_val[ndn->bv_len] = '\0';
+	tmp.dc_ndn.bv_len = ndn->bv_len;
+	tmp.dc_id = id;
+	tmp.dc_nsubs = 0;
+	row[0] = tmp;
+	return 0;
+}
+
+/* Add the pending subtree counts, before the txn commits */
+static int
+mdb_tool_dnc_flush( BackendDB *bd )
+{
+	Operation op = {0};
+	Opheader ohdr = {0};
+	int i, j, rc;
+
+	op.o_hdr = &ohdr;
+	op.o_bd = bd;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+
+	for ( i=0; i<DNC_DEPTH; i++ ) {
+		for ( j=0; j<DNC_WAYS && dnc[i][j].dc_id; j++ ) {
+			if ( !dnc[i][j].dc_nsubs )
+				continue;
+			rc = mdb_dn2id_upsub( &op, mcp, dnc[i][j].dc_id,
+				dnc[i][j].dc_nsubs );
+			if ( rc )
+				return rc;
+			dnc[i][j].dc_nsubs = 0;
+		}
+	}
+	return 0;
+}
+
+/* Forget the cached entries, after the txn that added them aborted */
+static void
+mdb_tool_dnc_clear( int release )
+{
+	int i, j;
+
+	for ( i=0; i<DNC_DEPTH; i++ ) {
+		for ( j=0; j<DNC_WAYS; j++ ) {
+			dnc[i][j].dc_id = 0;
+			dnc[i][j].dc_nsubs = 0;
+			if ( release ) {
+				ch_free( dnc[i][j].dc_ndn.bv_val );
+				BER_BVZERO( &dnc[i][j].dc_ndn );
+				dnc[i][j].dc_size = 0;
+			}
+		}
+	}
+}
+
+/* Assign e the next ID and add it under pid. Under a cached parent
+ * the superiors' counts are left to the cache and an existing DN is
+ * returned as MDB_KEYEXIST for the caller to look up.
+ */
+static int
+mdb_tool_dn2id_add(
+	Operation *op,
+	Entry *e,
+	ID pid,
+	dn_cache *dc,
+	int depth,
+	struct berval *text,
+	int hole )
+{
+	int rc;
+
+	rc = mdb_next_id( op->o_bd, idcursor, &e->e_id );
+	if ( rc ) {
+		snprintf( text->bv_val, text->bv_len,
+			"next_id failed: %s (%d)",
+			mdb_strerror(rc), rc );
+		Debug( LDAP_DEBUG_ANY,
+			"=> mdb_tool_next_id: %s\n", text->bv_val, 0, 0 );
+		return rc;
+	}
+	rc = mdb_dn2id_add( op, mcp, mcd, pid, 1, dc == NULL, e );
+	if ( rc == MDB_KEYEXIST && dc )
+		return rc;
+	if ( rc ) {
+		snprintf( text->bv_val, text->bv_len,
+			"dn2id_add failed: %s (%d)",
+			mdb_strerror(rc), rc );
+		Debug( LDAP_DEBUG_ANY,
+			"=> mdb_tool_next_id: %s\n", text->bv_val, 0, 0 );
+		return rc;
+	}
+	if ( dc )
+		dc->dc_nsubs++;
+	if ( hole ) {
+		MDB_val key, data;
+		mdb_tool_hole_add( e->e_id, &e->e_nname );
+		key.mv_size = sizeof(ID);
+		key.mv_data = &e->e_id;
+		data.mv_size = 0;
+		data.mv_data = NULL;
+		rc = mdb_cursor_put( idcursor, &key, &data, MDB_NOOVERWRITE );
+		if ( rc == MDB_KEYEXIST )
+			rc = 0;
+		if ( rc ) {
+			snprintf( text->bv_val, text->bv_len,
+				"dummy id2entry add failed: %s (%d)",
+				mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				"=> mdb_tool_next_id: %s\n", text->bv_val, 0, 0 );
+			return rc;
+		}
+	}
+	return mdb_tool_dnc_add( op, depth, &e->e_nname, e->e_id );
+}
+
 static int mdb_tool_next_id(
 	Operation *op,
 	MDB_txn *tid,
@@ -456,14 +872,26 @@ static int mdb_tool_next_id(
 	struct berval dn = e->e_name;
 	struct berval ndn = e->e_nname;
 	struct berval pdn, npdn, nmatched;
+	dn_cache *dc = NULL;
 	ID id, pid = 0;
-	int rc;
+	int rc, depth;
 
 	if (ndn.bv_len == 0) {
 		e->e_id = 0;
 		return 0;
 	}
 
+	depth = mdb_tool_dn_depth( &ndn );
+	if ( depth > 1 ) {
+		dnParent( &ndn, &npdn );
+		dc = mdb_tool_dnc_find( depth - 1, &npdn );
+	}
+	if ( dc ) {
+		rc = mdb_tool_dn2id_add( op, e, dc->dc_id, dc, depth, text, hole );
+		if ( rc != MDB_KEYEXIST )
+			return rc;
+	}
+
 	rc = mdb_dn2id( op, tid, mcp, &ndn, &id, NULL, NULL, &nmatched );
 	if ( rc == MDB_NOTFOUND ) {
 		if ( !be_issuffix( op->o_bd, &ndn ) ) {
@@ -490,66 +918,10 @@ static int mdb_tool_next_id(
 				pid = id;
 			}
 		}
-		rc = mdb_next_id( op->o_bd, idcursor, &e->e_id );
-		if ( rc ) {
-			snprintf( text->bv_val, text->bv_len,
-				"next_id failed: %s (%d)",
-				mdb_strerror(rc), rc );
-		Debug( LDAP_DEBUG_ANY,
-			"=> mdb_tool_next_id: %s\n", text->bv_val, 0, 0 );
-			return rc;
-		}
-		rc = mdb_dn2id_add( op, mcp, mcd, pid, 1, 1, e );
-		if ( rc ) {
-			snprintf( text->bv_val, text->bv_len,
-				"dn2id_add failed: %s (%d)",
-				mdb_strerror(rc), rc );
-			Debug( LDAP_DEBUG_ANY,
-				"=> mdb_tool_next_id: %s\n", text->bv_val, 0, 0 );
-		} else if ( hole ) {
-			MDB_val key, data;
-			if ( nholes == nhmax - 1 ) {
-				if ( holes == hbuf ) {
-					holes = ch_malloc( nhmax * sizeof(dn_id) * 2 );
-					AC_MEMCPY( holes, hbuf, sizeof(hbuf) );
-				} else {
-					holes = ch_realloc( holes, nhmax * sizeof(dn_id) * 2 );
-				}
-				nhmax *= 2;
-			}
-			ber_dupbv( &holes[nholes].dn, &ndn );
-			holes[nholes++].id = e->e_id;
-			key.mv_size = sizeof(ID);
-			key.mv_data = &e->e_id;
-			data.mv_size = 0;
-			data.mv_data = NULL;
-			rc = mdb_cursor_put( idcursor, &key, &data, MDB_NOOVERWRITE );
-			if ( rc == MDB_KEYEXIST )
-				rc = 0;
-			if ( rc ) {
-				snprintf( text->bv_val, text->bv_len,
-					"dummy id2entry add failed: %s (%d)",
-					mdb_strerror(rc), rc );
-				Debug( LDAP_DEBUG_ANY,
-					"=> mdb_tool_next_id: %s\n", text->bv_val, 0, 0 );
-			}
-		}
+		rc = mdb_tool_dn2id_add( op, e, pid, NULL, depth, text, hole );
 	} else if ( !hole ) {
-		unsigned i, j;
-
 		e->e_id = id;
-
-		for ( i=0; i<nholes; i++) {
-			if ( holes[i].id == e->e_id ) {
-				free(holes[i].dn.bv_val);
-				for (j=i;j<nholes;j++) holes[j] = holes[j+1];
-				holes[j].id = 0;
-				nholes--;
-				break;
-			} else if ( holes[i].id > e->e_id ) {
-				break;
-			}
-		}
+		mdb_tool_hole_fill( id );
 	}
 	return rc;
 }
@@ -562,14 +934,20 @@ mdb_tool_index_add(
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 
-	if ( !mdb->mi_nattrs )
+	if ( !mdb->mi_nattrs && !mdb->mi_ncomps )
 		return 0;
 
-	if ( mdb_tool_threads > 1 ) {
+	if ( mdb->mi_nattrs && mdb_tool_threads > 1 ) {
 		IndexRec *ir;
 		int i, rc;
 		Attribute *a;
 
+		/* The workers are idle, do the composites before waking them */
+		rc = mdb_index_comps( op, txn, SLAP_INDEX_ADD_OP,
+			e->e_attrs, e->e_id );
+		if ( rc )
+			return rc;
+
 		ir = mdb_tool_index_rec;
 		for (i=0; i<mdb->mi_nattrs; i++)
 			ir[i].ir_attrs = NULL;
@@ -745,7 +1123,11 @@ done:
 		if ( mdb_writes >= mdb_writes_per_commit ) {
 			unsigned i;
 			MDB_TOOL_IDL_FLUSH( be, mdb_tool_txn );
-			rc = mdb_txn_commit( mdb_tool_txn );
+			rc = mdb_tool_dnc_flush( be );
+			if ( rc == 0 )
+				rc = mdb_txn_commit( mdb_tool_txn );
+			else
+				mdb_txn_abort( mdb_tool_txn );
 			for ( i=0; i<mdb->mi_nattrs; i++ )
 				mdb->mi_attrs[i]->ai_cursor = NULL;
 			mdb_writes = 0;
@@ -753,6 +1135,7 @@ done:
 			idcursor = NULL;
 			if( rc != 0 ) {
 				mdb->mi_numads = 0;
+				mdb_tool_dnc_clear( 0 );
 				snprintf( text->bv_val, text->bv_len,
 						"txn_commit failed: %s (%d)",
 						mdb_strerror(rc), rc );
@@ -768,6 +1151,7 @@ done:
 		mdb_txn_abort( mdb_tool_txn );
 		mdb_tool_txn = NULL;
 		idcursor = NULL;
+		mdb_tool_dnc_clear( 0 );
 		for ( i=0; i<mdb->mi_nattrs; i++ )
 			mdb->mi_attrs[i]->ai_cursor = NULL;
 		mdb_writes = 0;
@@ -813,51 +1197,74 @@ int mdb_tool_entry_reindex(
 	/* No indexes configured, nothing to do. Could return an
 	 * error here to shortcut things.
 	 */
-	if (!mi->mi_attrs) {
+	if (!mi->mi_attrs && !mi->mi_comps) {
 		return 0;
 	}
 
 	/* Check for explicit list of attrs to index */
 	if ( adv ) {
-		int i, j, n;
-
-		if ( mi->mi_attrs[0]->ai_desc != adv[0] ) {
-			/* count */
-			for ( n = 0; adv[n]; n++ ) ;
-
-			/* insertion sort */
-			for ( i = 0; i < n; i++ ) {
-				AttributeDescription *ad = adv[i];
-				for ( j = i-1; j>=0; j--) {
-					if ( SLAP_PTRCMP( adv[j], ad ) <= 0 ) break;
-					adv[j+1] = adv[j];
-				}
-				adv[j+1] = ad;
+		int i, j, k, n;
+
+		/* Keep the composites over any of the listed attrs */
+		for ( i = 0, n = 0; i < mi->mi_ncomps; i++ ) {
+			CompInfo *ci = mi->mi_comps[i];
+			for ( j = 0; adv[j]; j++ ) {
+				for ( k = 0; k < ci->ci_nads; k++ )
+					if ( ci->ci_ads[k] == adv[j] ) break;
+				if ( k < ci->ci_nads ) break;
+			}
+			if ( adv[j] ) {
+				mi->mi_comps[i] = mi->mi_comps[n];
+				mi->mi_comps[n++] = ci;
 			}
 		}
+		mi->mi_ncomps = n;
+
+		/* insertion sort, so the plain indexes kept below stay
+		 * in the order mdb_attr_mask() expects */
+		for ( i = 1; adv[i]; i++ ) {
+			AttributeDescription *ad = adv[i];
+			for ( j = i-1; j>=0; j--) {
+				if ( SLAP_PTRCMP( adv[j], ad ) <= 0 ) break;
+				adv[j+1] = adv[j];
+			}
+			adv[j+1] = ad;
+		}
 
-		for ( i = 0; adv[i]; i++ ) {
-			if ( mi->mi_attrs[i]->ai_desc != adv[i] ) {
-				for ( j = i+1; j < mi->mi_nattrs; j++ ) {
-					if ( mi->mi_attrs[j]->ai_desc == adv[i] ) {
-						AttrInfo *ai = mi->mi_attrs[i];
-						mi->mi_attrs[i] = mi->mi_attrs[j];
-						mi->mi_attrs[j] = ai;
-						break;
-					}
-				}
-				if ( j == mi->mi_nattrs ) {
-					Debug( LDAP_DEBUG_ANY,
-						LDAP_XSTRING(mdb_tool_entry_reindex)
-						": no index configured for %s\n",
-						adv[i]->ad_cname.bv_val, 0, 0 );
-					return -1;
+		/* Move the plain indexes of the listed attrs to the front.
+		 * An attr may instead only be part of a composite index.
+		 */
+		for ( i = 0, n = 0; adv[i]; i++ ) {
+			for ( j = n; j < mi->mi_nattrs; j++ ) {
+				if ( mi->mi_attrs[j]->ai_desc == adv[i] ) {
+					AttrInfo *ai = mi->mi_attrs[n];
+					mi->mi_attrs[n++] = mi->mi_attrs[j];
+					mi->mi_attrs[j] = ai;
+					break;
 				}
 			}
+			if ( j < mi->mi_nattrs )
+				continue;
+			for ( j = 0; j < mi->mi_ncomps; j++ ) {
+				CompInfo *ci = mi->mi_comps[j];
+				for ( k = 0; k < ci->ci_nads; k++ )
+					if ( ci->ci_ads[k] == adv[i] ) break;
+				if ( k < ci->ci_nads ) break;
+			}
+			if ( j == mi->mi_ncomps ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_entry_reindex)
+					": no index configured for %s\n",
+					adv[i]->ad_cname.bv_val, 0, 0 );
+				return -1;
+			}
 		}
-		mi->mi_nattrs = i;
+		mi->mi_nattrs = n;
 	}
 
+	if ( !mdb_tool_bulk_be && ( slapMode & SLAP_TOOL_QUICK ) && mi->mi_nattrs )
+		mdb_tool_bulk_open( be );
+
 	e = mdb_tool_entry_get( be, id );
 
 	if( e == NULL ) {
@@ -892,6 +1299,17 @@ int mdb_tool_entry_reindex(
 				return -1;
 			}
 		}
+		for ( i=0; i < mi->mi_ncomps; i++ ) {
+			rc = mdb_drop( txi, mi->mi_comps[i]->ci_dbi, 0 );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_entry_reindex)
+					": (Truncate) mdb_drop(%s) failed: %s (%d)\n",
+					mi->mi_comps[i]->ci_name.bv_val,
+					mdb_strerror(rc), rc );
+				return -1;
+			}
+		}
 		slapMode ^= SLAP_TRUNCATE_MODE;
 	}
 
@@ -909,7 +1327,10 @@ int mdb_tool_entry_reindex(
 	op.o_tmpmemctx = NULL;
 	op.o_tmpmfuncs = &ch_mfuncs;
 
-	rc = mdb_tool_index_add( &op, txi, e );
+	if ( mdb_tool_bulk_be )
+		rc = mdb_tool_bulk_index( &op, txi, &e );
+	else
+		rc = mdb_tool_index_add( &op, txi, e );
 
 done:
 	if( rc == 0 ) {
@@ -927,7 +1348,8 @@ done:
 					"=> " LDAP_XSTRING(mdb_tool_entry_reindex)
 					": txn_commit failed: %s (%d)\n",
 					mdb_strerror(rc), rc, 0 );
-				e->e_id = NOID;
+				if ( e )
+					e->e_id = NOID;
 			}
 			mdb_cursor_close( cursor );
 			txi = NULL;
@@ -953,10 +1375,12 @@ done:
 			"=> " LDAP_XSTRING(mdb_tool_entry_reindex)
 			": txn_aborted! err=%d\n",
 			rc, 0, 0 );
-		e->e_id = NOID;
+		if ( e )
+			e->e_id = NOID;
 		txi = NULL;
 	}
-	mdb_entry_release( &op, e, 0 );
+	if ( e )
+		mdb_entry_release( &op, e, 0 );
 
 	return rc;
 }
@@ -967,6 +1391,7 @@ ID mdb_tool_entry_modify(
 	struct berval *text )
 {
 	int rc;
+	unsigned i;
 	struct mdb_info *mdb;
 	Operation op = {0};
 	Opheader ohdr = {0};
@@ -1020,10 +1445,16 @@ ID mdb_tool_entry_modify(
 	}
 
 done:
+	/* the txn may hold adds whose keys and superiors' counts are pending */
+	if( rc == 0 ) {
+		MDB_TOOL_IDL_FLUSH( be, mdb_tool_txn );
+		rc = mdb_tool_dnc_flush( be );
+	}
 	if( rc == 0 ) {
 		rc = mdb_txn_commit( mdb_tool_txn );
 		if( rc != 0 ) {
 			mdb->mi_numads = 0;
+			mdb_tool_dnc_clear( 0 );
 			snprintf( text->bv_val, text->bv_len,
 					"txn_commit failed: %s (%d)",
 					mdb_strerror(rc), rc );
@@ -1035,6 +1466,7 @@ done:
 
 	} else {
 		mdb_txn_abort( mdb_tool_txn );
+		mdb_tool_dnc_clear( 0 );
 		snprintf( text->bv_val, text->bv_len,
 			"txn_aborted! %s (%d)",
 			mdb_strerror(rc), rc );
@@ -1044,6 +1476,9 @@ done:
 		e->e_id = NOID;
 	}
 	mdb_tool_txn = NULL;
+	idcursor = NULL;
+	for ( i=0; i<mdb->mi_nattrs; i++ )
+		mdb->mi_attrs[i]->ai_cursor = NULL;
 
 	return e->e_id;
 }
@@ -1057,7 +1492,8 @@ int mdb_tool_entry_delete(
 	struct mdb_info *mdb;
 	Operation op = {0};
 	Opheader ohdr = {0};
-	Entry *e;
+	Entry *e = NULL;
+	unsigned i;
 
 	assert( be != NULL );
 	assert( slapMode & SLAP_TOOL_MODE );
@@ -1109,6 +1545,22 @@ int mdb_tool_entry_delete(
 	op.o_tmpmemctx = NULL;
 	op.o_tmpmfuncs = &ch_mfuncs;
 
+	/* write the pending keys and subtree counts of the adds in this
+	 * txn, and forget the cached parents: the entry may be one of them.
+	 */
+	MDB_TOOL_IDL_FLUSH( be, mdb_tool_txn );
+	rc = mdb_tool_dnc_flush( be );
+	mdb_tool_dnc_clear( 0 );
+	if( rc != 0 ) {
+		snprintf( text->bv_val, text->bv_len,
+			"subtree count update failed: %s (%d)",
+			mdb_strerror(rc), rc );
+		Debug( LDAP_DEBUG_ANY,
+			"=> " LDAP_XSTRING(mdb_tool_entry_delete) ": %s\n",
+			 text->bv_val, 0, 0 );
+		goto done;
+	}
+
 	rc = mdb_dn2entry( &op, mdb_tool_txn, cursor, ndn, &e, NULL, 0 );
 	if( rc != 0 ) {
 		snprintf( text->bv_val, text->bv_len,
@@ -1203,6 +1655,9 @@ done:
 	}
 	mdb_tool_txn = NULL;
 	cursor = NULL;
+	idcursor = NULL;
+	for ( i=0; i<mdb->mi_nattrs; i++ )
+		mdb->mi_attrs[i]->ai_cursor = NULL;
 
 	return rc;
 }
@@ -1248,17 +1703,22 @@ mdb_tool_index_task( void *ctx, void *ptr )
 	return NULL;
 }
 
-#ifdef MDB_TOOL_IDL_CACHING
+/* Same order as the keys in the index DBs */
 static int
 mdb_tool_idl_cmp( const void *v1, const void *v2 )
 {
 	const mdb_tool_idl_cache *c1 = v1, *c2 = v2;
+	ber_len_t len = c1->kstr.bv_len;
 	int rc;
 
-	if (( rc = c1->kstr.bv_len - c2->kstr.bv_len )) return rc;
-	return memcmp( c1->kstr.bv_val, c2->kstr.bv_val, c1->kstr.bv_len );
+	if ( len > c2->kstr.bv_len )
+		len = c2->kstr.bv_len;
+	if (( rc = memcmp( c1->kstr.bv_val, c2->kstr.bv_val, len ))) return rc;
+	return (int)c1->kstr.bv_len - (int)c2->kstr.bv_len;
 }
 
+#ifdef MDB_TOOL_IDL_CACHING
+
 static int
 mdb_tool_idl_flush_one( MDB_cursor *mc, AttrIxInfo *ai, mdb_tool_idl_cache *ic )
 {
@@ -1268,14 +1728,14 @@ mdb_tool_idl_flush_one( MDB_cursor *mc, AttrIxInfo *ai, mdb_tool_idl_cache *ic )
 	ID id, nid;
 
 	/* Freshly allocated, ignore it */
-	if ( !ic->head && ic->count <= MDB_IDL_DB_SIZE ) {
+	if ( !ic->head && !( ic->flags & IS_RANGE )) {
 		return 0;
 	}
 
 	key.mv_data = ic->kstr.bv_val;
 	key.mv_size = ic->kstr.bv_len;
 
-	if ( ic->count > MDB_IDL_DB_SIZE ) {
+	if ( ic->flags & IS_RANGE ) {
 		while ( ic->flags & WAS_FOUND ) {
 			rc = mdb_cursor_get( mc, &key, data, MDB_SET );
 			if ( rc ) {
@@ -1394,6 +1854,7 @@ int mdb_tool_idl_add(
 	struct berval *keys,
 	ID id )
 {
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
 	MDB_dbi dbi;
 	mdb_tool_idl_cache *ic, itmp;
 	mdb_tool_idl_cache_entry *ice;
@@ -1439,7 +1900,7 @@ int mdb_tool_idl_add(
 			nid = *(ID *)data.mv_data;
 			if ( nid == 0 ) {
 				ic->count = MDB_IDL_DB_SIZE+1;
-				ic->flags |= WAS_RANGE;
+				ic->flags |= WAS_RANGE|IS_RANGE;
 			} else {
 				size_t count;
 
@@ -1451,11 +1912,11 @@ int mdb_tool_idl_add(
 		}
 	}
 	/* are we a range already? */
-	if ( ic->count > MDB_IDL_DB_SIZE ) {
+	if ( ic->flags & IS_RANGE ) {
 		ic->last = id;
 		continue;
 	/* Are we at the limit, and converting to a range? */
-	} else if ( ic->count == MDB_IDL_DB_SIZE ) {
+	} else if ( ic->count >= MDB_IDL_DB_SIZE && !mdb->mi_idl_exact ) {
 		if ( ic->head ) {
 			ic->tail->next = ax->ai_flist;
 			ax->ai_flist = ic->head;
@@ -1463,6 +1924,7 @@ int mdb_tool_idl_add(
 		ic->head = ic->tail = NULL;
 		ic->last = id;
 		ic->count++;
+		ic->flags |= IS_RANGE;
 		continue;
 	}
 	/* No free block, create that too */
@@ -1497,6 +1959,489 @@ int mdb_tool_idl_add(
 }
 #endif /* MDB_TOOL_IDL_CACHING */
 
+/* Bulk reindex, for slapindex -q. The keys of every index are
+ * collected in memory, one mdb_tool_idl_cache per key, and each
+ * index DB is then written once in key order: an empty DB is
+ * loaded with MDB_APPEND, a populated one has the keys merged in.
+ * With tool-threads > 2 the main thread reads the entries and
+ * hands them in batches to the workers, each of which indexes
+ * its share of the attributes; see mdb_index_recrun(). Batched
+ * entries point into id2entry, which reindexing never writes,
+ * so they survive the read txn resets in mdb_tool_entry_reindex.
+ */
+#define	BULK_BATCH	256
+
+/* Write the keys out early once they take about this much memory */
+#ifndef MDB_TOOL_BULK_MEM
+#define	MDB_TOOL_BULK_MEM	(1024L*1024*1024)
+#endif
+
+typedef struct mdb_tool_bulk_worker {
+	AttrIxInfo bw_ax;		/* must be first */
+	ldap_pvt_thread_t bw_thr;
+	size_t bw_mem;
+	int bw_base;
+	int bw_rc;
+} mdb_tool_bulk_worker;
+
+typedef struct mdb_tool_bulk_batch {
+	Entry *bb_e[BULK_BATCH];
+	IndexRec *bb_ir;
+	int bb_n;
+} mdb_tool_bulk_batch;
+
+static int mdb_tool_bulk_nw;		/* worker threads, 0 if none */
+static mdb_tool_bulk_worker *mdb_tool_bulk_w;
+static mdb_tool_bulk_batch mdb_tool_bulk_b[2];
+static mdb_tool_bulk_batch *mdb_tool_bulk_work;	/* being indexed */
+static int mdb_tool_bulk_cur;		/* being filled */
+static int mdb_tool_bulk_pending, mdb_tool_bulk_gen, mdb_tool_bulk_stop;
+static ldap_pvt_thread_mutex_t mdb_tool_bulk_mutex;
+static ldap_pvt_thread_cond_t mdb_tool_bulk_cond_main;
+static ldap_pvt_thread_cond_t mdb_tool_bulk_cond_work;
+
+int mdb_tool_bulk_add(
+	BackendDB *be,
+	MDB_cursor *mc,
+	struct berval *keys,
+	ID id )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_tool_bulk_worker *bw = (mdb_tool_bulk_worker *)mc;
+	AttrInfo *ai = bw->bw_ax.ai_ai;
+	mdb_tool_idl_cache *ic, itmp;
+	int k;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+#endif
+
+	for ( k=0; keys[k].bv_val; k++ ) {
+		itmp.kstr = keys[k];
+#ifndef MISALIGNED_OK
+		/* padded like mdb_idl_insert_keys() does */
+		if ( keys[k].bv_len & ALIGNER ) {
+			kbuf[0] = kbuf[1] = 0;
+			memcpy( kbuf, keys[k].bv_val, keys[k].bv_len );
+			itmp.kstr.bv_val = (char *)kbuf;
+			itmp.kstr.bv_len = sizeof(kbuf);
+		}
+#endif
+		ic = tavl_find( ai->ai_root, &itmp, mdb_tool_idl_cmp );
+		if ( !ic ) {
+			ic = ch_malloc( sizeof( mdb_tool_idl_cache ) + itmp.kstr.bv_len );
+			ic->kstr.bv_len = itmp.kstr.bv_len;
+			ic->kstr.bv_val = (char *)(ic+1);
+			memcpy( ic->kstr.bv_val, itmp.kstr.bv_val, ic->kstr.bv_len );
+			ic->head = ic->tail = NULL;
+			ic->first = ic->last = id;
+			ic->count = 1;
+			ic->offset = 0;
+			ic->flags = 0;
+			ic->ids = NULL;
+			ic->size = 0;
+			tavl_insert( &ai->ai_root, ic, mdb_tool_idl_cmp, avl_dup_error );
+			bw->bw_mem += sizeof( mdb_tool_idl_cache ) + ic->kstr.bv_len +
+				sizeof( TAvlnode );
+			continue;
+		}
+		/* IDs arrive in order, so only the last one can repeat */
+		if ( ic->last == id )
+			continue;
+		ic->last = id;
+		if ( ic->flags & IS_RANGE )
+			continue;
+		/* Convert to a range where mdb_idl_insert_keys() would */
+		if ( ic->count >= MDB_IDL_DB_MAX && !mdb->mi_idl_exact ) {
+			bw->bw_mem -= ic->size * sizeof(ID);
+			ch_free( ic->ids );
+			ic->ids = NULL;
+			ic->size = 0;
+			ic->flags |= IS_RANGE;
+			continue;
+		}
+		if ( ic->count - 1 == ic->size ) {
+			int size = ic->size ? ic->size * 2 : 4;
+			ic->ids = ch_realloc( ic->ids, size * sizeof(ID) );
+			bw->bw_mem += ( size - ic->size ) * sizeof(ID);
+			ic->size = size;
+		}
+		ic->ids[ic->count - 1] = id;
+		ic->count++;
+	}
+	return 0;
+}
+
+static void
+mdb_tool_bulk_free( void *ptr )
+{
+	mdb_tool_idl_cache *ic = ptr;
+
+	ch_free( ic->ids );
+	ch_free( ic );
+}
+
+static int
+mdb_tool_bulk_put(
+	BackendDB *be,
+	MDB_cursor *mc,
+	mdb_tool_idl_cache *ic,
+	int append )
+{
+	MDB_val key, data[2];
+	ID nid = 0, lo, hi;
+	int i, rc;
+
+	key.mv_data = ic->kstr.bv_val;
+	key.mv_size = ic->kstr.bv_len;
+	data[0].mv_size = sizeof(ID);
+
+	if ( ic->flags & IS_RANGE ) {
+		if ( !append ) {
+			/* Widen to cover what is already there */
+			rc = mdb_cursor_get( mc, &key, data, MDB_SET );
+			if ( rc == 0 ) {
+				memcpy( &lo, data[0].mv_data, sizeof(ID) );
+				if ( lo == 0 ) {
+					rc = mdb_cursor_get( mc, &key, data, MDB_NEXT_DUP );
+					if ( rc == 0 )
+						memcpy( &lo, data[0].mv_data, sizeof(ID) );
+					if ( rc == 0 )
+						rc = mdb_cursor_get( mc, &key, data, MDB_NEXT_DUP );
+				} else {
+					rc = mdb_cursor_get( mc, &key, data, MDB_LAST_DUP );
+				}
+				if ( rc )
+					return rc;
+				memcpy( &hi, data[0].mv_data, sizeof(ID) );
+				if ( lo < ic->first )
+					ic->first = lo;
+				if ( hi > ic->last )
+					ic->last = hi;
+				rc = mdb_cursor_del( mc, MDB_NODUPDATA );
+				if ( rc )
+					return rc;
+				/* the old key pointed into the deleted node */
+				key.mv_data = ic->kstr.bv_val;
+			} else if ( rc != MDB_NOTFOUND ) {
+				return rc;
+			}
+		}
+		data[0].mv_data = &nid;
+		rc = mdb_cursor_put( mc, &key, data, append ? MDB_APPEND : 0 );
+		if ( rc == 0 ) {
+			data[0].mv_data = &ic->first;
+			rc = mdb_cursor_put( mc, &key, data, MDB_APPENDDUP );
+		}
+		if ( rc == 0 ) {
+			data[0].mv_data = &ic->last;
+			rc = mdb_cursor_put( mc, &key, data, MDB_APPENDDUP );
+		}
+		return rc;
+	}
+
+	if ( append ) {
+		data[0].mv_data = &ic->first;
+		rc = mdb_cursor_put( mc, &key, data, MDB_APPEND );
+		if ( rc == 0 && ic->count > 1 ) {
+			data[0].mv_data = ic->ids;
+			data[1].mv_size = ic->count - 1;
+			rc = mdb_cursor_put( mc, &key, data, MDB_APPENDDUP|MDB_MULTIPLE );
+		}
+		return rc;
+	} else {
+		struct berval keys[2];
+
+		keys[0] = ic->kstr;
+		BER_BVZERO( &keys[1] );
+		rc = mdb_idl_insert_keys( be, mc, keys, ic->first );
+		for ( i=0; rc == 0 && i < ic->count - 1; i++ )
+			rc = mdb_idl_insert_keys( be, mc, keys, ic->ids[i] );
+		return rc;
+	}
+}
+
+/* Write out the collected keys, one txn per index.
+ * Leaves txi open for mdb_tool_entry_reindex.
+ */
+static int
+mdb_tool_bulk_flush( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_cursor *mc;
+	MDB_stat st;
+	TAvlnode *root;
+	int i, rc = 0;
+
+	for ( i=0; i < mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[i];
+
+		if ( !ai->ai_root || rc )
+			goto next;
+		if ( !txi ) {
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txi );
+			if ( rc )
+				goto next;
+		}
+		rc = mdb_stat( txi, ai->ai_dbi, &st );
+		if ( rc == 0 )
+			rc = mdb_cursor_open( txi, ai->ai_dbi, &mc );
+		if ( rc == 0 ) {
+			for ( root = tavl_end( ai->ai_root, TAVL_DIR_LEFT ); root;
+				root = tavl_next( root, TAVL_DIR_RIGHT )) {
+				rc = mdb_tool_bulk_put( be, mc, root->avl_data,
+					st.ms_entries == 0 );
+				if ( rc )
+					break;
+			}
+			mdb_cursor_close( mc );
+		}
+		if ( rc == 0 ) {
+			rc = mdb_txn_commit( txi );
+		} else {
+			mdb_txn_abort( txi );
+		}
+		txi = NULL;
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_bulk_flush) ": %s: %s (%d)\n",
+				ai->ai_desc->ad_cname.bv_val, mdb_strerror(rc), rc );
+		}
+next:
+		if ( ai->ai_root ) {
+			tavl_free( ai->ai_root, mdb_tool_bulk_free );
+			ai->ai_root = NULL;
+		}
+	}
+	for ( i=0; i < ( mdb_tool_bulk_nw ? mdb_tool_bulk_nw : 1 ); i++ )
+		mdb_tool_bulk_w[i].bw_mem = 0;
+
+	if ( rc == 0 && !txi )
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txi );
+	return rc;
+}
+
+static void *
+mdb_tool_bulk_task( void *ptr )
+{
+	mdb_tool_bulk_worker *bw = ptr;
+	struct mdb_info *mdb = (struct mdb_info *) mdb_tool_bulk_be->be_private;
+	Operation op = {0};
+	Opheader ohdr = {0};
+	int gen = 0;
+
+	op.o_hdr = &ohdr;
+	op.o_bd = mdb_tool_bulk_be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+	LDAP_SLIST_INSERT_HEAD( &op.o_extra, &bw->bw_ax.ai_oe, oe_next );
+
+	ldap_pvt_thread_mutex_lock( &mdb_tool_bulk_mutex );
+	for (;;) {
+		mdb_tool_bulk_batch *bb;
+		int i;
+
+		while ( gen == mdb_tool_bulk_gen && !mdb_tool_bulk_stop )
+			ldap_pvt_thread_cond_wait( &mdb_tool_bulk_cond_work,
+				&mdb_tool_bulk_mutex );
+		if ( gen == mdb_tool_bulk_gen )
+			break;
+		gen = mdb_tool_bulk_gen;
+		bb = mdb_tool_bulk_work;
+		ldap_pvt_thread_mutex_unlock( &mdb_tool_bulk_mutex );
+
+		for ( i=0; i < bb->bb_n && !bw->bw_rc; i++ )
+			bw->bw_rc = mdb_index_recrun( &op, NULL, mdb,
+				bb->bb_ir + i * mdb->mi_nattrs, bb->bb_e[i]->e_id,
+				bw->bw_base );
+
+		ldap_pvt_thread_mutex_lock( &mdb_tool_bulk_mutex );
+		if ( !--mdb_tool_bulk_pending )
+			ldap_pvt_thread_cond_signal( &mdb_tool_bulk_cond_main );
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb_tool_bulk_mutex );
+
+	return NULL;
+}
+
+static void
+mdb_tool_bulk_open( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	int i;
+
+	mdb_tool_bulk_be = be;
+	mdb_tool_bulk_nw = slap_tool_thread_max - 1;
+	if ( mdb_tool_bulk_nw < 2 )
+		mdb_tool_bulk_nw = 0;
+	else if ( mdb_tool_bulk_nw > mdb->mi_nattrs )
+		mdb_tool_bulk_nw = mdb->mi_nattrs;
+
+	mdb_tool_bulk_w = ch_calloc( mdb_tool_bulk_nw ? mdb_tool_bulk_nw : 1,
+		sizeof( mdb_tool_bulk_worker ));
+	mdb_tool_bulk_w[0].bw_ax.ai_oe.oe_key = (void *)mdb_tool_bulk_add;
+	if ( !mdb_tool_bulk_nw )
+		return;
+
+	ldap_pvt_thread_mutex_init( &mdb_tool_bulk_mutex );
+	ldap_pvt_thread_cond_init( &mdb_tool_bulk_cond_main );
+	ldap_pvt_thread_cond_init( &mdb_tool_bulk_cond_work );
+	for ( i=0; i<2; i++ )
+		mdb_tool_bulk_b[i].bb_ir = ch_malloc( BULK_BATCH * mdb->mi_nattrs *
+			sizeof( IndexRec ));
+	for ( i=0; i<mdb_tool_bulk_nw; i++ ) {
+		mdb_tool_bulk_w[i].bw_ax.ai_oe.oe_key = (void *)mdb_tool_bulk_add;
+		mdb_tool_bulk_w[i].bw_base = i;
+		ldap_pvt_thread_create( &mdb_tool_bulk_w[i].bw_thr, 0,
+			mdb_tool_bulk_task, &mdb_tool_bulk_w[i] );
+	}
+}
+
+/* Hand the batch being filled to the workers, once they
+ * are done with the other one
+ */
+static int
+mdb_tool_bulk_submit( Operation *op )
+{
+	mdb_tool_bulk_batch *bb;
+	size_t mem = 0;
+	int i, rc = 0;
+
+	ldap_pvt_thread_mutex_lock( &mdb_tool_bulk_mutex );
+	while ( mdb_tool_bulk_pending )
+		ldap_pvt_thread_cond_wait( &mdb_tool_bulk_cond_main,
+			&mdb_tool_bulk_mutex );
+	ldap_pvt_thread_mutex_unlock( &mdb_tool_bulk_mutex );
+
+	bb = &mdb_tool_bulk_b[!mdb_tool_bulk_cur];
+	for ( i=0; i<bb->bb_n; i++ )
+		mdb_entry_release( op, bb->bb_e[i], 0 );
+	bb->bb_n = 0;
+
+	for ( i=0; i<mdb_tool_bulk_nw; i++ ) {
+		if ( mdb_tool_bulk_w[i].bw_rc )
+			rc = mdb_tool_bulk_w[i].bw_rc;
+		mem += mdb_tool_bulk_w[i].bw_mem;
+	}
+	if ( rc == 0 && mem > MDB_TOOL_BULK_MEM )
+		rc = mdb_tool_bulk_flush( op->o_bd );
+
+	bb = &mdb_tool_bulk_b[mdb_tool_bulk_cur];
+	if ( bb->bb_n ) {
+		ldap_pvt_thread_mutex_lock( &mdb_tool_bulk_mutex );
+		mdb_tool_bulk_work = bb;
+		mdb_tool_bulk_pending = mdb_tool_bulk_nw;
+		mdb_tool_bulk_gen++;
+		ldap_pvt_thread_cond_broadcast( &mdb_tool_bulk_cond_work );
+		ldap_pvt_thread_mutex_unlock( &mdb_tool_bulk_mutex );
+		mdb_tool_bulk_cur ^= 1;
+	}
+	return rc;
+}
+
+/* Index one entry. If the entry was queued for the workers,
+ * *ep is cleared and the entry is released later.
+ */
+static int
+mdb_tool_bulk_index( Operation *op, MDB_txn *txn, Entry **ep )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_tool_bulk_batch *bb;
+	IndexRec *ir;
+	Attribute *a;
+	Entry *e = *ep;
+	int i, rc;
+
+	if ( !mdb_tool_bulk_nw ) {
+		mdb_tool_bulk_worker *bw = mdb_tool_bulk_w;
+
+		LDAP_SLIST_INSERT_HEAD( &op->o_extra, &bw->bw_ax.ai_oe, oe_next );
+		rc = mdb_index_entry_add( op, txn, e );
+		LDAP_SLIST_REMOVE_HEAD( &op->o_extra, oe_next );
+		if ( rc == 0 && bw->bw_mem > MDB_TOOL_BULK_MEM )
+			rc = mdb_tool_bulk_flush( op->o_bd );
+		return rc;
+	}
+
+	rc = mdb_index_comps( op, txn, SLAP_INDEX_ADD_OP,
+		e->e_attrs, e->e_id );
+	if ( rc )
+		return rc;
+
+	bb = &mdb_tool_bulk_b[mdb_tool_bulk_cur];
+	ir = bb->bb_ir + bb->bb_n * mdb->mi_nattrs;
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		ir[i].ir_ai = NULL;
+		ir[i].ir_attrs = NULL;
+	}
+	for ( a = e->e_attrs; a != NULL; a = a->a_next ) {
+		rc = mdb_index_recset( mdb, a, a->a_desc->ad_type,
+			&a->a_desc->ad_tags, ir );
+		if ( rc )
+			return rc;
+	}
+	bb->bb_e[bb->bb_n++] = e;
+	*ep = NULL;
+
+	if ( bb->bb_n == BULK_BATCH )
+		rc = mdb_tool_bulk_submit( op );
+	return rc;
+}
+
+static int
+mdb_tool_bulk_close( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	Operation op = {0};
+	Opheader ohdr = {0};
+	int i, rc = 0;
+
+	op.o_hdr = &ohdr;
+	op.o_bd = be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+
+	if ( mdb_tool_bulk_nw ) {
+		/* the last batch, then wait for it */
+		mdb_tool_bulk_submit( &op );
+		mdb_tool_bulk_submit( &op );
+
+		ldap_pvt_thread_mutex_lock( &mdb_tool_bulk_mutex );
+		mdb_tool_bulk_stop = 1;
+		ldap_pvt_thread_cond_broadcast( &mdb_tool_bulk_cond_work );
+		ldap_pvt_thread_mutex_unlock( &mdb_tool_bulk_mutex );
+		for ( i=0; i<mdb_tool_bulk_nw; i++ ) {
+			ldap_pvt_thread_join( mdb_tool_bulk_w[i].bw_thr, NULL );
+			if ( mdb_tool_bulk_w[i].bw_rc )
+				rc = mdb_tool_bulk_w[i].bw_rc;
+		}
+		for ( i=0; i<2; i++ ) {
+			ch_free( mdb_tool_bulk_b[i].bb_ir );
+			mdb_tool_bulk_b[i].bb_ir = NULL;
+		}
+		ldap_pvt_thread_cond_destroy( &mdb_tool_bulk_cond_work );
+		ldap_pvt_thread_cond_destroy( &mdb_tool_bulk_cond_main );
+		ldap_pvt_thread_mutex_destroy( &mdb_tool_bulk_mutex );
+	}
+
+	if ( rc == 0 ) {
+		rc = mdb_tool_bulk_flush( be );
+	} else {
+		for ( i=0; i < mdb->mi_nattrs; i++ ) {
+			if ( mdb->mi_attrs[i]->ai_root ) {
+				tavl_free( mdb->mi_attrs[i]->ai_root, mdb_tool_bulk_free );
+				mdb->mi_attrs[i]->ai_root = NULL;
+			}
+		}
+	}
+
+	ch_free( mdb_tool_bulk_w );
+	mdb_tool_bulk_w = NULL;
+	mdb_tool_bulk_be = NULL;
+	mdb_tool_bulk_nw = 0;
+	mdb_tool_bulk_stop = 0;
+	return rc;
+}
+
 /* Upgrade from pre 2.4.34 dn2id format */
 
 #include <ac/unistd.h>
@@ -1306,6 +1306,10 @@ glue_db_init(
 		oi->oi_bi.bi_tool_entry_modify = glue_tool_entry_modify;
 	if ( bi->bi_tool_sync )
 		oi->oi_bi.bi_tool_sync = glue_tool_sync;
+	/* ranged reads would only see the root DB */
+	oi->oi_bi.bi_tool_entry_range_open = 0;
+	oi->oi_bi.bi_tool_entry_range = 0;
+	oi->oi_bi.bi_tool_entry_range_close = 0;
 
 	SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_GLUE_INSTANCE;
 
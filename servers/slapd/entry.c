@@ -37,7 +37,6 @@
 #include "ldif.h"
 
 static char		*ebuf;	/* buf returned by entry2str		 */
-static char		*ecur;	/* pointer to end of currently used ebuf */
 static int		emaxsize;/* max size of ebuf			 */
 
 /*
@@ -73,7 +72,6 @@ int entry_destroy(void)
 	slap_list *e;
 	if ( ebuf ) free( ebuf );
 	ebuf = NULL;
-	ecur = NULL;
 	emaxsize = 0;
 
 	for ( e=entry_chunks; e; e=entry_chunks ) {
@@ -374,13 +372,13 @@ fail:
 #define GRABSIZE	BUFSIZ
 
 #define MAKE_SPACE( n )	{ \
-		while ( ecur + (n) > ebuf + emaxsize ) { \
+		while ( ecur + (n) > *ebufp + *emaxp ) { \
 			ptrdiff_t	offset; \
-			offset = (int) (ecur - ebuf); \
-			ebuf = ch_realloc( ebuf, \
-				emaxsize + GRABSIZE ); \
-			emaxsize += GRABSIZE; \
-			ecur = ebuf + offset; \
+			offset = (int) (ecur - *ebufp); \
+			*ebufp = ch_realloc( *ebufp, \
+				*emaxp + GRABSIZE ); \
+			*emaxp += GRABSIZE; \
+			ecur = *ebufp + offset; \
 		} \
 	}
 
@@ -398,11 +396,26 @@ entry2str_wrap(
 	Entry		*e,
 	int			*len,
 	ber_len_t	wrap )
+{
+	return entry2str_wrap_r( e, len, wrap, &ebuf, &emaxsize );
+}
+
+/* Reentrant version: the result is written to the caller's
+ * buffer *ebufp of size *emaxp, which is grown as needed.
+ */
+char *
+entry2str_wrap_r(
+	Entry		*e,
+	int			*len,
+	ber_len_t	wrap,
+	char		**ebufp,
+	int			*emaxp )
 {
 	Attribute	*a;
 	struct berval	*bv;
 	int		i;
 	ber_len_t tmplen;
+	char	*ecur;
 
 	assert( e != NULL );
 
@@ -412,7 +425,7 @@ entry2str_wrap(
 	 *	[<attr>: <value>\n]*
 	 */
 
-	ecur = ebuf;
+	ecur = *ebufp;
 
 	/* put the dn */
 	if ( e->e_dn != NULL ) {
@@ -436,9 +449,9 @@ entry2str_wrap(
 	}
 	MAKE_SPACE( 1 );
 	*ecur = '\0';
-	*len = ecur - ebuf;
+	*len = ecur - *ebufp;
 
-	return( ebuf );
+	return( *ebufp );
 }
 
 void
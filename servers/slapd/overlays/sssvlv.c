@@ -74,17 +74,8 @@ typedef struct vlv_ctrl {
 	unsigned long vc_context;
 } vlv_ctrl;
 
-typedef struct sort_key
-{
-	AttributeDescription	*sk_ad;
-	MatchingRule			*sk_ordering;
-	int						sk_direction;	/* 1=normal, -1=reverse */
-} sort_key;
-
-typedef struct sort_ctrl {
-	int sc_nkeys;
-	sort_key sc_keys[1];
-} sort_ctrl;
+typedef slap_sort_key sort_key;
+typedef slap_sort_ctrl sort_ctrl;
 
 
 typedef struct sort_node
@@ -722,7 +713,12 @@ static int sssvlv_op_response(
 	sort_ctrl *sc = op->o_controls[sss_cid];
 	sort_op *so = op->o_callback->sc_private;
 
-	if ( rs->sr_type == REP_SEARCH ) {
+	if ( rs->sr_type == REP_SEARCH && ( sc->sc_flags & SLAP_SORT_PRESORTED )) {
+		/* The backend is returning them in order already */
+		so->so_nentries++;
+		return SLAP_CB_CONTINUE;
+
+	} else if ( rs->sr_type == REP_SEARCH ) {
 		int i;
 		size_t len;
 		sort_node *sn, *sn2;
@@ -963,6 +959,9 @@ static int sssvlv_op_search(
 					so->so_vlv_rc = 0;
 				} else {
 					so->so_vlv = SLAP_CONTROL_NONE;
+					/* Nothing to page through, so entries
+					 * already in order needn't be kept */
+					sc->sc_flags |= SLAP_SORT_PRESORT_OK;
 				}
 			}
 			so->so_session = sess_id;
@@ -1153,6 +1152,7 @@ static int sss_parseCtrl(
 	sc = op->o_tmpalloc( sizeof(sort_ctrl) +
 		(i-1) * sizeof(sort_key), op->o_tmpmemctx );
 	sc->sc_nkeys = i;
+	sc->sc_flags = 0;
 	op->o_controls[sss_cid] = sc;
 
 	/* peel off initial sequence */
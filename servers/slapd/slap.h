@@ -254,6 +254,7 @@ typedef struct slap_ssf_set {
 #define SLAP_INDEX_APPROX         0x0008UL
 #define SLAP_INDEX_SUBSTR         0x0010UL
 #define SLAP_INDEX_EXTENDED		  0x0020UL
+#define SLAP_INDEX_ORDERED        0x0040UL
 
 #define SLAP_INDEX_DEFAULT        SLAP_INDEX_EQUALITY
 
@@ -1961,6 +1962,9 @@ struct BackendDB {
 #define		be_dn2id_get bd_info->bi_tool_dn2id_get
 #define		be_entry_modify	bd_info->bi_tool_entry_modify
 #define		be_entry_delete	bd_info->bi_tool_entry_delete
+#define		be_entry_range_open	bd_info->bi_tool_entry_range_open
+#define		be_entry_range	bd_info->bi_tool_entry_range
+#define		be_entry_range_close	bd_info->bi_tool_entry_range_close
 #endif
 
 	/* supported controls */
@@ -2348,6 +2352,20 @@ typedef ID (BI_tool_entry_modify) LDAP_P(( BackendDB *be, Entry *e,
 typedef int (BI_tool_entry_delete) LDAP_P(( BackendDB *be, struct berval *ndn,
 	struct berval *text ));
 
+/* Ranged reads for multithreaded tools. Each thread opens its own
+ * context, which must not share state with the other tool hooks.
+ * Contexts opening the same snapshot of the database return the same
+ * snap, so that the threads can make sure they all read one.
+ * Entries are passed to the callback in ID order and released
+ * when it returns; a nonzero return stops the scan.
+ */
+typedef int (BI_tool_entry_range_cb) LDAP_P(( BackendDB *be, Entry *e, void *arg ));
+typedef int (BI_tool_entry_range_open) LDAP_P(( BackendDB *be, void **ctx, ID *maxid,
+	unsigned long *snap ));
+typedef int (BI_tool_entry_range) LDAP_P(( BackendDB *be, void *ctx, ID first, ID last,
+	BI_tool_entry_range_cb *cb, void *arg ));
+typedef int (BI_tool_entry_range_close) LDAP_P(( BackendDB *be, void *ctx ));
+
 struct BackendInfo {
 	char	*bi_type; /* type of backend */
 
@@ -2450,6 +2468,9 @@ struct BackendInfo {
 	BI_tool_dn2id_get	*bi_tool_dn2id_get;
 	BI_tool_entry_modify	*bi_tool_entry_modify;
 	BI_tool_entry_delete	*bi_tool_entry_delete;
+	BI_tool_entry_range_open	*bi_tool_entry_range_open;
+	BI_tool_entry_range	*bi_tool_entry_range;
+	BI_tool_entry_range_close	*bi_tool_entry_range_close;
 
 #define SLAP_INDEX_ADD_OP		0x0001
 #define SLAP_INDEX_DELETE_OP	0x0002
@@ -2585,6 +2606,26 @@ typedef struct PagedResultsState {
 	struct berval ps_cookieval;
 } PagedResultsState;
 
+/*
+ * Server Side Sorting request (RFC 2891), as parsed by slapo-sssvlv.
+ * When the overlay can pass presorted entries straight through it sets
+ * SLAP_SORT_PRESORT_OK; a backend that then returns the entries in the
+ * requested order sets SLAP_SORT_PRESORTED before sending the first one.
+ */
+typedef struct slap_sort_key {
+	AttributeDescription	*sk_ad;
+	MatchingRule			*sk_ordering;
+	int						sk_direction;	/* 1=normal, -1=reverse */
+} slap_sort_key;
+
+typedef struct slap_sort_ctrl {
+	int sc_nkeys;
+	int sc_flags;
+#define SLAP_SORT_PRESORT_OK	0x01
+#define SLAP_SORT_PRESORTED	0x02
+	slap_sort_key sc_keys[1];
+} slap_sort_ctrl;
+
 struct slap_csn_entry {
 	Operation *ce_op;
 	struct berval ce_csn;
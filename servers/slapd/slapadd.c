@@ -64,15 +64,32 @@ typedef struct Erec {
 	unsigned long nextline;
 } Erec;
 
+/* With tool-threads > 1, records are read by one thread, parsed and
+ * checked by a pool of others, and handed to be_entry_put in their
+ * original order. Trec is a slot of the bounded ring between them.
+ * The diagnostics of a record are kept in its slot and printed by
+ * the writer, so that they also come out in input order.
+ */
 typedef struct Trec {
 	Entry *e;
 	unsigned long lineno;
 	unsigned long nextline;
 	int rc;
 	int ready;
+	char *buf;
+	int lmax;
+	struct berval msg;
 } Trec;
 
-static Trec trec;
+/* records in flight between the reader and the writer */
+#define ADD_QUEUE	256
+
+static Trec *trecs;
+static unsigned long trec_read;		/* next record to read */
+static unsigned long trec_parse;	/* next record to parse */
+static unsigned long trec_write;	/* next record to put */
+static int nparsers;
+static ldap_pvt_thread_t *parsers;
 static unsigned long sid = SLAP_SYNC_SID_MAX + 1;
 static int checkvals;
 static int enable_meter;
@@ -83,244 +100,344 @@ static char *buf;
 static int lmax;
 
 static ldap_pvt_thread_mutex_t add_mutex;
-static ldap_pvt_thread_cond_t add_cond;
+static ldap_pvt_thread_cond_t add_cond;		/* reader waits for a free slot */
+static ldap_pvt_thread_cond_t parse_cond;	/* parsers wait for a record */
+static ldap_pvt_thread_cond_t ready_cond;	/* writer waits for its record */
 static int add_stop;
+static int add_eof;
+static int add_failed;	/* a record failed, and no -c */
 
 /* returns:
  *	1: got a record
  *	0: EOF
  * -1: read failure
+ */
+static int
+getrec_read(Erec *erec, char **bufp, int *lmaxp)
+{
+	int ldifrc;
+
+	do {
+		erec->lineno = erec->nextline+1;
+		/* nextline is the line number of the end of the current entry */
+		ldifrc = ldif_read_record( ldiffp, &erec->nextline, bufp, lmaxp );
+		if (ldifrc < 1)
+			return ldifrc < 0 ? -1 : 0;
+	} while ( erec->lineno < jumpline );
+
+	if ( enable_meter )
+		lutil_meter_update( &meter,
+				 ftello( ldiffp->fp ),
+				 0);
+	return 1;
+}
+
+/* returns:
+ *	1: got an entry
  * -2: parse failure
  */
 static int
-getrec0(Erec *erec)
+getrec_parse(Erec *erec, char *rec, Operation *op, struct berval *msg)
 {
 	const char *text;
-	int ldifrc;
 	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
 	size_t textlen = sizeof textbuf;
-	struct berval csn;
-	Operation *op = &opbuf.ob_op;
-	op->o_hdr = &opbuf.ob_hdr;
+	BackendDB *bd;
+	Entry *e;
+	int prev_DN_strict;
+
+	if ( !dbnum ) {
+		prev_DN_strict = slap_DN_strict;
+		slap_DN_strict = 0;
+	}
+	e = str2entry2( rec, checkvals );
+	if ( !dbnum ) {
+		slap_DN_strict = prev_DN_strict;
+	}
 
-again:
-	erec->lineno = erec->nextline+1;
-	/* nextline is the line number of the end of the current entry */
-	ldifrc = ldif_read_record( ldiffp, &erec->nextline, &buf, &lmax );
-	if (ldifrc < 1)
-		return ldifrc < 0 ? -1 : 0;
+	if( e == NULL ) {
+		slap_tool_msg( msg, "%s: could not parse entry (line=%lu)\n",
+			progname, erec->lineno );
+		return -2;
+	}
+
+	/* make sure the DN is not empty */
+	if( BER_BVISEMPTY( &e->e_nname ) &&
+		!BER_BVISEMPTY( be->be_nsuffix ))
 	{
-		BackendDB *bd;
-		Entry *e;
-		int prev_DN_strict;
+		slap_tool_msg( msg, "%s: line %lu: "
+			"cannot add entry with empty dn=\"%s\"",
+			progname, erec->lineno, e->e_dn );
+		bd = select_backend( &e->e_nname, nosubordinates );
+		if ( bd ) {
+			BackendDB *bdtmp;
+			int dbidx = 0;
+			LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
+				if ( bdtmp == bd ) break;
+				dbidx++;
+			}
 
-		if ( erec->lineno < jumpline )
-			goto again;
+			assert( bdtmp != NULL );
+			
+			slap_tool_msg( msg, "; did you mean to use database #%d (%s)?",
+				dbidx,
+				bd->be_suffix[0].bv_val );
 
-		if ( !dbnum ) {
-			prev_DN_strict = slap_DN_strict;
-			slap_DN_strict = 0;
-		}
-		e = str2entry2( buf, checkvals );
-		if ( !dbnum ) {
-			slap_DN_strict = prev_DN_strict;
 		}
+		slap_tool_msg( msg, "\n" );
+		entry_free( e );
+		return -2;
+	}
+
+	/* check backend */
+	bd = select_backend( &e->e_nname, nosubordinates );
+	if ( bd != be ) {
+		slap_tool_msg( msg, "%s: line %lu: "
+			"database #%d (%s) not configured to hold \"%s\"",
+			progname, erec->lineno,
+			dbnum,
+			be->be_suffix[0].bv_val,
+			e->e_dn );
+		if ( bd ) {
+			BackendDB *bdtmp;
+			int dbidx = 0;
+			LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
+				if ( bdtmp == bd ) break;
+				dbidx++;
+			}
 
-		if ( enable_meter )
-			lutil_meter_update( &meter,
-					 ftello( ldiffp->fp ),
-					 0);
+			assert( bdtmp != NULL );
+			
+			slap_tool_msg( msg, "; did you mean to use database #%d (%s)?",
+				dbidx,
+				bd->be_suffix[0].bv_val );
 
-		if( e == NULL ) {
-			fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
-				progname, erec->lineno );
-			return -2;
+		} else {
+			slap_tool_msg( msg, "; no database configured for that naming context" );
 		}
+		slap_tool_msg( msg, "\n" );
+		entry_free( e );
+		return -2;
+	}
 
-		/* make sure the DN is not empty */
-		if( BER_BVISEMPTY( &e->e_nname ) &&
-			!BER_BVISEMPTY( be->be_nsuffix ))
-		{
-			fprintf( stderr, "%s: line %lu: "
-				"cannot add entry with empty dn=\"%s\"",
-				progname, erec->lineno, e->e_dn );
-			bd = select_backend( &e->e_nname, nosubordinates );
-			if ( bd ) {
-				BackendDB *bdtmp;
-				int dbidx = 0;
-				LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
-					if ( bdtmp == bd ) break;
-					dbidx++;
-				}
+	if ( slap_tool_entry_check( progname, op, e, erec->lineno, &text, textbuf, textlen, msg ) !=
+		LDAP_SUCCESS ) {
+		entry_free( e );
+		return -2;
+	}
 
-				assert( bdtmp != NULL );
-				
-				fprintf( stderr, "; did you mean to use database #%d (%s)?",
-					dbidx,
-					bd->be_suffix[0].bv_val );
+	erec->e = e;
+	return 1;
+}
 
-			}
-			fprintf( stderr, "\n" );
-			entry_free( e );
-			return -2;
-		}
+/* Add the operational attributes. This runs in input order, so
+ * that generated CSNs and the context CSN follow the LDIF.
+ */
+static void
+getrec_finish(Erec *erec)
+{
+	Entry *e = erec->e;
+	struct berval csn;
 
-		/* check backend */
-		bd = select_backend( &e->e_nname, nosubordinates );
-		if ( bd != be ) {
-			fprintf( stderr, "%s: line %lu: "
-				"database #%d (%s) not configured to hold \"%s\"",
-				progname, erec->lineno,
-				dbnum,
-				be->be_suffix[0].bv_val,
-				e->e_dn );
-			if ( bd ) {
-				BackendDB *bdtmp;
-				int dbidx = 0;
-				LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
-					if ( bdtmp == bd ) break;
-					dbidx++;
-				}
+	if ( SLAP_LASTMOD(be) ) {
+		time_t now = slap_get_time();
+		char uuidbuf[ LDAP_LUTIL_UUIDSTR_BUFSIZE ];
+		struct berval vals[ 2 ];
 
-				assert( bdtmp != NULL );
-				
-				fprintf( stderr, "; did you mean to use database #%d (%s)?",
-					dbidx,
-					bd->be_suffix[0].bv_val );
+		struct berval name, timestamp;
 
-			} else {
-				fprintf( stderr, "; no database configured for that naming context" );
-			}
-			fprintf( stderr, "\n" );
-			entry_free( e );
-			return -2;
-		}
+		struct berval nvals[ 2 ];
+		struct berval nname;
+		char timebuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
 
-		if ( slap_tool_entry_check( progname, op, e, erec->lineno, &text, textbuf, textlen ) !=
-			LDAP_SUCCESS ) {
-			entry_free( e );
-			return -2;
-		}
+		enum {
+			GOT_NONE = 0x0,
+			GOT_CSN = 0x1,
+			GOT_UUID = 0x2,
+			GOT_ALL = (GOT_CSN|GOT_UUID)
+		} got = GOT_ALL;
 
-		if ( SLAP_LASTMOD(be) ) {
-			time_t now = slap_get_time();
-			char uuidbuf[ LDAP_LUTIL_UUIDSTR_BUFSIZE ];
-			struct berval vals[ 2 ];
+		vals[1].bv_len = 0;
+		vals[1].bv_val = NULL;
 
-			struct berval name, timestamp;
+		nvals[1].bv_len = 0;
+		nvals[1].bv_val = NULL;
 
-			struct berval nvals[ 2 ];
-			struct berval nname;
-			char timebuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+		csn.bv_len = ldap_pvt_csnstr( csnbuf, sizeof( csnbuf ), csnsid, 0 );
+		csn.bv_val = csnbuf;
 
-			enum {
-				GOT_NONE = 0x0,
-				GOT_CSN = 0x1,
-				GOT_UUID = 0x2,
-				GOT_ALL = (GOT_CSN|GOT_UUID)
-			} got = GOT_ALL;
+		timestamp.bv_val = timebuf;
+		timestamp.bv_len = sizeof(timebuf);
 
-			vals[1].bv_len = 0;
-			vals[1].bv_val = NULL;
+		slap_timestamp( &now, &timestamp );
 
-			nvals[1].bv_len = 0;
-			nvals[1].bv_val = NULL;
+		if ( BER_BVISEMPTY( &be->be_rootndn ) ) {
+			BER_BVSTR( &name, SLAPD_ANONYMOUS );
+			nname = name;
+		} else {
+			name = be->be_rootdn;
+			nname = be->be_rootndn;
+		}
 
-			csn.bv_len = ldap_pvt_csnstr( csnbuf, sizeof( csnbuf ), csnsid, 0 );
-			csn.bv_val = csnbuf;
+		if( attr_find( e->e_attrs, slap_schema.si_ad_entryUUID )
+			== NULL )
+		{
+			got &= ~GOT_UUID;
+			vals[0].bv_len = lutil_uuidstr( uuidbuf, sizeof( uuidbuf ) );
+			vals[0].bv_val = uuidbuf;
+			attr_merge_normalize_one( e, slap_schema.si_ad_entryUUID, vals, NULL );
+		}
 
-			timestamp.bv_val = timebuf;
-			timestamp.bv_len = sizeof(timebuf);
+		if( attr_find( e->e_attrs, slap_schema.si_ad_creatorsName )
+			== NULL )
+		{
+			vals[0] = name;
+			nvals[0] = nname;
+			attr_merge( e, slap_schema.si_ad_creatorsName, vals, nvals );
+		}
 
-			slap_timestamp( &now, &timestamp );
+		if( attr_find( e->e_attrs, slap_schema.si_ad_createTimestamp )
+			== NULL )
+		{
+			vals[0] = timestamp;
+			attr_merge( e, slap_schema.si_ad_createTimestamp, vals, NULL );
+		}
 
-			if ( BER_BVISEMPTY( &be->be_rootndn ) ) {
-				BER_BVSTR( &name, SLAPD_ANONYMOUS );
-				nname = name;
-			} else {
-				name = be->be_rootdn;
-				nname = be->be_rootndn;
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_entryCSN )
+			== NULL )
+		{
+			got &= ~GOT_CSN;
+			vals[0] = csn;
+			attr_merge( e, slap_schema.si_ad_entryCSN, vals, NULL );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_entryUUID )
-				== NULL )
-			{
-				got &= ~GOT_UUID;
-				vals[0].bv_len = lutil_uuidstr( uuidbuf, sizeof( uuidbuf ) );
-				vals[0].bv_val = uuidbuf;
-				attr_merge_normalize_one( e, slap_schema.si_ad_entryUUID, vals, NULL );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_modifiersName )
+			== NULL )
+		{
+			vals[0] = name;
+			nvals[0] = nname;
+			attr_merge( e, slap_schema.si_ad_modifiersName, vals, nvals );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_creatorsName )
-				== NULL )
-			{
-				vals[0] = name;
-				nvals[0] = nname;
-				attr_merge( e, slap_schema.si_ad_creatorsName, vals, nvals );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_modifyTimestamp )
+			== NULL )
+		{
+			vals[0] = timestamp;
+			attr_merge( e, slap_schema.si_ad_modifyTimestamp, vals, NULL );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_createTimestamp )
-				== NULL )
-			{
-				vals[0] = timestamp;
-				attr_merge( e, slap_schema.si_ad_createTimestamp, vals, NULL );
-			}
+		if ( SLAP_SINGLE_SHADOW(be) && got != GOT_ALL ) {
+			char buf[SLAP_TEXT_BUFLEN];
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_entryCSN )
-				== NULL )
-			{
-				got &= ~GOT_CSN;
-				vals[0] = csn;
-				attr_merge( e, slap_schema.si_ad_entryCSN, vals, NULL );
-			}
+			snprintf( buf, sizeof(buf),
+				"%s%s%s",
+				( !(got & GOT_UUID) ? slap_schema.si_ad_entryUUID->ad_cname.bv_val : "" ),
+				( !(got & GOT_CSN) ? "," : "" ),
+				( !(got & GOT_CSN) ? slap_schema.si_ad_entryCSN->ad_cname.bv_val : "" ) );
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_modifiersName )
-				== NULL )
-			{
-				vals[0] = name;
-				nvals[0] = nname;
-				attr_merge( e, slap_schema.si_ad_modifiersName, vals, nvals );
-			}
+			Debug( LDAP_DEBUG_ANY, "%s: warning, missing attrs %s from entry dn=\"%s\"\n",
+				progname, buf, e->e_name.bv_val );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_modifyTimestamp )
-				== NULL )
-			{
-				vals[0] = timestamp;
-				attr_merge( e, slap_schema.si_ad_modifyTimestamp, vals, NULL );
-			}
+		sid = slap_tool_update_ctxcsn_check( progname, e );
+	}
+}
 
-			if ( SLAP_SINGLE_SHADOW(be) && got != GOT_ALL ) {
-				char buf[SLAP_TEXT_BUFLEN];
+/* returns:
+ *	1: got a record
+ *	0: EOF
+ * -1: read failure
+ * -2: parse failure
+ */
+static int
+getrec0(Erec *erec)
+{
+	Operation *op = &opbuf.ob_op;
+	int rc;
 
-				snprintf( buf, sizeof(buf),
-					"%s%s%s",
-					( !(got & GOT_UUID) ? slap_schema.si_ad_entryUUID->ad_cname.bv_val : "" ),
-					( !(got & GOT_CSN) ? "," : "" ),
-					( !(got & GOT_CSN) ? slap_schema.si_ad_entryCSN->ad_cname.bv_val : "" ) );
+	op->o_hdr = &opbuf.ob_hdr;
 
-				Debug( LDAP_DEBUG_ANY, "%s: warning, missing attrs %s from entry dn=\"%s\"\n",
-					progname, buf, e->e_name.bv_val );
-			}
+	rc = getrec_read( erec, &buf, &lmax );
+	if ( rc == 1 )
+		rc = getrec_parse( erec, buf, op, NULL );
+	if ( rc == 1 )
+		getrec_finish( erec );
+	return rc;
+}
+
+static void *
+getrec_thr(void *ctx)
+{
+	Trec *t;
+	unsigned long nextline = 0;
+	int rc;
+
+	ldap_pvt_thread_mutex_lock( &add_mutex );
+	for (;;) {
+		while ( !add_stop && trec_read - trec_write >= ADD_QUEUE )
+			ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
+		if ( add_stop )
+			break;
+		t = &trecs[ trec_read % ADD_QUEUE ];
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
 
-			sid = slap_tool_update_ctxcsn_check( progname, e );
+		t->nextline = nextline;
+		rc = getrec_read( (Erec *)t, &t->buf, &t->lmax );
+		nextline = t->nextline;
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		if ( rc < 1 ) {
+			/* eof or read failure, left for the writer
+			 * in the slot after the last record
+			 */
+			t->e = NULL;
+			t->rc = rc;
+			t->ready = 1;
+			add_eof = 1;
+			ldap_pvt_thread_cond_broadcast( &parse_cond );
+			ldap_pvt_thread_cond_signal( &ready_cond );
+			break;
 		}
-		erec->e = e;
+		trec_read++;
+		ldap_pvt_thread_cond_signal( &parse_cond );
 	}
-	return 1;
+	ldap_pvt_thread_mutex_unlock( &add_mutex );
+	return NULL;
 }
 
 static void *
-getrec_thr(void *ctx)
+parse_thr(void *ctx)
 {
+	OperationBuffer opb;
+	Operation *op = &opb.ob_op;
+	unsigned long n;
+	Trec *t;
+
+	memset( &opb, 0, sizeof( opb ));
+	op->o_hdr = &opb.ob_hdr;
+
 	ldap_pvt_thread_mutex_lock( &add_mutex );
-	while (!add_stop) {
-		trec.rc = getrec0((Erec *)&trec);
-		trec.ready = 1;
-		while (trec.ready)
-			ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
-		/* eof or read failure */
-		if ( trec.rc == 0 || trec.rc == -1 )
+	for (;;) {
+		while ( !add_stop && !add_eof && trec_parse == trec_read )
+			ldap_pvt_thread_cond_wait( &parse_cond, &add_mutex );
+		if ( add_stop || add_failed || trec_parse == trec_read )
 			break;
+		n = trec_parse++;
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+
+		t = &trecs[ n % ADD_QUEUE ];
+		t->e = NULL;
+		t->rc = getrec_parse( (Erec *)t, t->buf, op, &t->msg );
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		/* the writer stops at the first failure, so
+		 * later records need not be parsed
+		 */
+		if ( t->rc == -2 && !continuemode )
+			add_failed = 1;
+		t->ready = 1;
+		if ( n == trec_write )
+			ldap_pvt_thread_cond_signal( &ready_cond );
 	}
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
 	return NULL;
@@ -331,20 +448,38 @@ static int ldif_threaded;
 static int
 getrec(Erec *erec)
 {
+	Trec *t;
 	int rc;
+
 	if ( !ldif_threaded )
 		return getrec0(erec);
 
-	while (!trec.ready)
-		ldap_pvt_thread_yield();
-	erec->e = trec.e;
-	erec->lineno = trec.lineno;
-	erec->nextline = trec.nextline;
-	trec.ready = 0;
-	rc = trec.rc;
+	t = &trecs[ trec_write % ADD_QUEUE ];
 	ldap_pvt_thread_mutex_lock( &add_mutex );
+	while ( !t->ready )
+		ldap_pvt_thread_cond_wait( &ready_cond, &add_mutex );
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
+
+	if ( t->msg.bv_len ) {
+		fputs( t->msg.bv_val, stderr );
+		t->msg.bv_len = 0;
+	}
+	erec->lineno = t->lineno;
+	erec->nextline = t->nextline;
+	rc = t->rc;
+	if ( rc < 1 && rc != -2 )
+		return rc;
+	if ( rc == 1 ) {
+		erec->e = t->e;
+		getrec_finish( erec );
+	}
+
+	ldap_pvt_thread_mutex_lock( &add_mutex );
+	t->e = NULL;
+	t->ready = 0;
+	trec_write++;
 	ldap_pvt_thread_cond_signal( &add_cond );
+	ldap_pvt_thread_mutex_unlock( &add_mutex );
 	return rc;
 }
 
@@ -357,6 +492,7 @@ slapadd( int argc, char **argv )
 	struct berval bvtext;
 	ldap_pvt_thread_t thr;
 	ID id;
+	int i;
 	Entry *prev = NULL;
 
 	int ldifrc;
@@ -427,10 +563,20 @@ slapadd( int argc, char **argv )
 		enable_meter = 0;
 	}
 
-	if ( slap_tool_thread_max > 1 ) {
+	/* the config database is small, and toggles slap_DN_strict
+	 * around each parse
+	 */
+	if ( slap_tool_thread_max > 1 && dbnum ) {
+		nparsers = slap_tool_thread_max - 1;
+		trecs = ch_calloc( ADD_QUEUE, sizeof( Trec ));
+		parsers = ch_calloc( nparsers, sizeof( ldap_pvt_thread_t ));
 		ldap_pvt_thread_mutex_init( &add_mutex );
 		ldap_pvt_thread_cond_init( &add_cond );
+		ldap_pvt_thread_cond_init( &parse_cond );
+		ldap_pvt_thread_cond_init( &ready_cond );
 		ldap_pvt_thread_create( &thr, 0, getrec_thr, NULL );
+		for ( i = 0; i < nparsers; i++ )
+			ldap_pvt_thread_create( &parsers[i], 0, parse_thr, NULL );
 		ldif_threaded = 1;
 	}
 
@@ -480,12 +626,32 @@ slapadd( int argc, char **argv )
 	}
 
 	if ( ldif_threaded ) {
+		unsigned long n;
+
 		ldap_pvt_thread_mutex_lock( &add_mutex );
 		add_stop = 1;
-		trec.ready = 0;
 		ldap_pvt_thread_cond_signal( &add_cond );
+		ldap_pvt_thread_cond_broadcast( &parse_cond );
 		ldap_pvt_thread_mutex_unlock( &add_mutex );
 		ldap_pvt_thread_join( thr, NULL );
+		for ( i = 0; i < nparsers; i++ )
+			ldap_pvt_thread_join( parsers[i], NULL );
+
+		/* entries parsed after a failed put */
+		for ( n = trec_write; n < trec_parse; n++ ) {
+			if ( trecs[ n % ADD_QUEUE ].e )
+				entry_free( trecs[ n % ADD_QUEUE ].e );
+		}
+		for ( i = 0; i < ADD_QUEUE; i++ ) {
+			ch_free( trecs[i].buf );
+			ch_free( trecs[i].msg.bv_val );
+		}
+		ch_free( trecs );
+		ch_free( parsers );
+		ldap_pvt_thread_cond_destroy( &ready_cond );
+		ldap_pvt_thread_cond_destroy( &parse_cond );
+		ldap_pvt_thread_cond_destroy( &add_cond );
+		ldap_pvt_thread_mutex_destroy( &add_mutex );
 	}
 	if ( erec.e ) entry_free( erec.e );
 
@@ -28,18 +28,296 @@
 #include <ac/ctype.h>
 #include <ac/socket.h>
 #include <ac/string.h>
+#include <ac/unistd.h>
+
+#include <lutil_meter.h>
+#include <sys/stat.h>
 
 #include "slapcommon.h"
 #include "ldif.h"
 
 static volatile sig_atomic_t gotsig;
 
+/* With tool-threads > 1 and a backend that supports ranged reads,
+ * the ID space is cut into ranges of CAT_RANGE IDs. Worker threads
+ * each read and render one range at a time with their own read txn,
+ * and the main thread writes the ranges out in ID order.
+ *
+ * The workers open their txns before reading anything, and start
+ * only once all of them see the same snapshot; if a write got in
+ * between, they all open again. Should that keep failing, the single
+ * threaded path is used instead.
+ */
+#define CAT_RANGE	1024
+
+/* ranges in flight between the workers and the writer */
+#define CAT_QUEUE	64
+
+/* attempts at a common snapshot */
+#define CAT_TRIES	16
+
+/* slapcat_ranges() could not get one */
+#define CAT_SERIAL	(-1)
+
+typedef struct Crange {
+	char *buf;
+	ber_len_t len;
+	ber_len_t size;
+	int rc;
+	int ready;
+} Crange;
+
+typedef struct Cworker {
+	ldap_pvt_thread_t thr;
+	char *ebuf;
+	int emax;
+	Crange *cr;
+	void *rctx;
+	int rc;			/* of be_entry_range_open */
+	ID maxid;
+	unsigned long snap;
+} Cworker;
+
+static Crange *cranges;
+static unsigned long cat_read;		/* next range to read */
+static unsigned long cat_write;		/* next range to write */
+static unsigned long cat_nranges;
+static int cat_stop;
+static int cat_go;		/* all workers read the same snapshot */
+static int cat_opened;		/* workers done opening this round */
+static int cat_round;
+static ldap_pvt_thread_mutex_t cat_mutex;
+static ldap_pvt_thread_cond_t cat_cond;		/* workers wait for a free slot */
+static ldap_pvt_thread_cond_t ready_cond;	/* writer waits for its range */
+
 static RETSIGTYPE
 slapcat_sig( int sig )
 {
 	gotsig=1;
 }
 
+static int
+slapcat_entry( BackendDB *bd, Entry *e, void *arg )
+{
+	Cworker *cw = arg;
+	Crange *cr = cw->cr;
+	int len;
+
+	if ( gotsig || cat_stop )
+		return -1;
+
+	if ( sub_ndn.bv_len && !dnIsSuffixScope( &e->e_nname, &sub_ndn, scope ))
+		return 0;
+	if ( filter != NULL && test_filter( NULL, e, filter ) != LDAP_COMPARE_TRUE )
+		return 0;
+
+	entry2str_wrap_r( e, &len, ldif_wrap, &cw->ebuf, &cw->emax );
+	if ( cr->len + len + 2 > cr->size ) {
+		cr->size = ( cr->len + len + 2 ) * 2;
+		cr->buf = ch_realloc( cr->buf, cr->size );
+	}
+	AC_MEMCPY( cr->buf + cr->len, cw->ebuf, len );
+	cr->len += len;
+	cr->buf[cr->len++] = '\n';
+	return 0;
+}
+
+static void *
+slapcat_thr( void *ctx )
+{
+	Cworker *cw = ctx;
+	int round;
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	for (;;) {
+		round = cat_round;
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+		cw->rc = be->be_entry_range_open( be, &cw->rctx,
+			&cw->maxid, &cw->snap );
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cat_opened++;
+		ldap_pvt_thread_cond_broadcast( &ready_cond );
+		while ( !cat_go && !cat_stop && cat_round == round )
+			ldap_pvt_thread_cond_wait( &cat_cond, &cat_mutex );
+		if ( cat_go || cat_stop )
+			break;
+		/* another snapshot was seen, try again */
+		if ( cw->rc == 0 ) {
+			ldap_pvt_thread_mutex_unlock( &cat_mutex );
+			be->be_entry_range_close( be, cw->rctx );
+			ldap_pvt_thread_mutex_lock( &cat_mutex );
+		}
+	}
+
+	for (;;) {
+		unsigned long n;
+		ID first;
+
+		while ( !cat_stop && cat_read < cat_nranges &&
+			cat_read - cat_write >= CAT_QUEUE )
+			ldap_pvt_thread_cond_wait( &cat_cond, &cat_mutex );
+		if ( cat_stop || cat_read >= cat_nranges )
+			break;
+		n = cat_read++;
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		cw->cr = &cranges[n % CAT_QUEUE];
+		cw->cr->len = 0;
+		first = (ID) n * CAT_RANGE;
+		cw->cr->rc = be->be_entry_range( be, cw->rctx, first,
+			first + CAT_RANGE - 1, slapcat_entry, cw );
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cw->cr->ready = 1;
+		ldap_pvt_thread_cond_broadcast( &ready_cond );
+	}
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+	if ( cw->rc == 0 )
+		be->be_entry_range_close( be, cw->rctx );
+	return NULL;
+}
+
+static int
+slapcat_ranges( const char *progname )
+{
+	int rc = EXIT_SUCCESS;
+	int nworkers = slap_tool_thread_max, i;
+	int enable_meter = 0;
+	lutil_meter_t meter;
+	Cworker *workers;
+	ID maxid;
+	struct stat stat_buf;
+	int tries;
+
+	cranges = ch_calloc( CAT_QUEUE, sizeof( Crange ));
+	workers = ch_calloc( nworkers, sizeof( Cworker ));
+	ldap_pvt_thread_mutex_init( &cat_mutex );
+	ldap_pvt_thread_cond_init( &cat_cond );
+	ldap_pvt_thread_cond_init( &ready_cond );
+
+	for ( i = 0; i < nworkers; i++ )
+		ldap_pvt_thread_create( &workers[i].thr, 0, slapcat_thr, &workers[i] );
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	for ( tries = 1; ; tries++ ) {
+		while ( cat_opened < nworkers )
+			ldap_pvt_thread_cond_wait( &ready_cond, &cat_mutex );
+		for ( i = 0; i < nworkers; i++ ) {
+			if ( workers[i].rc ) {
+				fprintf( stderr, "%s: could not open database.\n",
+					progname );
+				rc = EXIT_FAILURE;
+				break;
+			}
+			if ( workers[i].snap != workers[0].snap )
+				break;
+		}
+		if ( i == nworkers ) {
+			cat_go = 1;
+			break;
+		}
+		if ( rc != EXIT_SUCCESS || tries == CAT_TRIES ) {
+			cat_stop = 1;
+			break;
+		}
+		cat_opened = 0;
+		cat_round++;
+		ldap_pvt_thread_cond_broadcast( &cat_cond );
+	}
+	if ( cat_stop ) {
+		ldap_pvt_thread_cond_broadcast( &cat_cond );
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+		if ( rc == EXIT_SUCCESS )
+			rc = CAT_SERIAL;
+		goto leave;
+	}
+	maxid = workers[0].maxid;
+	cat_nranges = maxid / CAT_RANGE + 1;
+	ldap_pvt_thread_cond_broadcast( &cat_cond );
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+	/* the meter counts IDs, not bytes */
+	if ( isatty( 2 )
+#ifdef LDAP_DEBUG
+		/* tools default to "none" */
+		&& slap_debug == LDAP_DEBUG_NONE
+#endif
+		&& !fstat( fileno( ldiffp->fp ), &stat_buf )
+		&& !S_ISCHR( stat_buf.st_mode ) && maxid ) {
+		enable_meter = !lutil_meter_open(
+			&meter,
+			&lutil_meter_text_display,
+			&lutil_meter_linear_estimator,
+			maxid );
+	}
+
+	while ( cat_write < cat_nranges ) {
+		Crange *cr = &cranges[cat_write % CAT_QUEUE];
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		while ( !cr->ready )
+			ldap_pvt_thread_cond_wait( &ready_cond, &cat_mutex );
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		if ( gotsig )
+			break;
+
+		if ( cr->rc ) {
+			ID first = (ID) cat_write * CAT_RANGE;
+			fprintf( stderr, "%s: error reading entries %08lx-%08lx.\n",
+				progname, (long) first, (long) ( first + CAT_RANGE - 1 ));
+			rc = EXIT_FAILURE;
+			if ( !continuemode )
+				break;
+		}
+
+		if ( cr->len && fwrite( cr->buf, cr->len, 1, ldiffp->fp ) != 1 ) {
+			fprintf(stderr, "%s: error writing output.\n",
+				progname);
+			rc = EXIT_FAILURE;
+			break;
+		}
+
+		if ( enable_meter )
+			lutil_meter_update( &meter,
+				cat_write + 1 < cat_nranges ?
+				(cat_write + 1) * CAT_RANGE : maxid, 0 );
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cr->ready = 0;
+		cat_write++;
+		ldap_pvt_thread_cond_broadcast( &cat_cond );
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+	}
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	cat_stop = 1;
+	ldap_pvt_thread_cond_broadcast( &cat_cond );
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+leave:
+	for ( i = 0; i < nworkers; i++ ) {
+		ldap_pvt_thread_join( workers[i].thr, NULL );
+		ch_free( workers[i].ebuf );
+	}
+	if ( enable_meter ) {
+		if ( rc == EXIT_SUCCESS && !gotsig )
+			lutil_meter_update( &meter, maxid, 1 );
+		lutil_meter_close( &meter );
+	}
+
+	for ( i = 0; i < CAT_QUEUE; i++ )
+		ch_free( cranges[i].buf );
+	ch_free( cranges );
+	ch_free( workers );
+	ldap_pvt_thread_cond_destroy( &ready_cond );
+	ldap_pvt_thread_cond_destroy( &cat_cond );
+	ldap_pvt_thread_mutex_destroy( &cat_mutex );
+
+	return rc;
+}
+
 int
 slapcat( int argc, char **argv )
 {
@@ -80,6 +358,20 @@ slapcat( int argc, char **argv )
 		exit( EXIT_FAILURE );
 	}
 
+	/* entries are read in ID order from a single snapshot, so the
+	 * output is the same as that of the single threaded loop below
+	 */
+	if ( slap_tool_thread_max > 1 && !verbose &&
+		be->be_entry_range_open &&
+		be->be_entry_range &&
+		be->be_entry_range_close )
+	{
+		rc = slapcat_ranges( progname );
+		if ( rc != CAT_SERIAL )
+			goto done;
+		rc = EXIT_SUCCESS;
+	}
+
 	op.o_bd = be;
 	if ( !requestBSF && be->be_entry_first ) {
 		id = be->be_entry_first( be );
@@ -167,6 +459,7 @@ slapcat( int argc, char **argv )
 		}
 	}
 
+done:
 	be->be_entry_close( be );
 
 	if ( slap_tool_destroy())
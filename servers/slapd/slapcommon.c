@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 
+#include <ac/stdarg.h>
 #include <ac/stdlib.h>
 #include <ac/ctype.h>
 #include <ac/string.h>
@@ -1171,6 +1172,34 @@ slap_tool_update_ctxcsn_init(void)
 	return 0;
 }
 
+/* Print a diagnostic, or append it to msg when that is given, so
+ * that a tool checking entries in several threads can print them in
+ * input order.
+ */
+void
+slap_tool_msg( struct berval *msg, const char *fmt, ... )
+{
+	va_list vl;
+	int len;
+
+	va_start( vl, fmt );
+	if ( msg == NULL ) {
+		vfprintf( stderr, fmt, vl );
+		va_end( vl );
+		return;
+	}
+	len = vsnprintf( NULL, 0, fmt, vl );
+	va_end( vl );
+	if ( len <= 0 )
+		return;
+
+	msg->bv_val = ch_realloc( msg->bv_val, msg->bv_len + len + 1 );
+	va_start( vl, fmt );
+	vsnprintf( msg->bv_val + msg->bv_len, len + 1, fmt, vl );
+	va_end( vl );
+	msg->bv_len += len;
+}
+
 int
 slap_tool_entry_check(
 	const char *progname,
@@ -1179,7 +1208,8 @@ slap_tool_entry_check(
 	int lineno,
 	const char **text,
 	char *textbuf,
-	size_t textlen )
+	size_t textlen,
+	struct berval *msg )
 {
 	/* NOTE: we may want to conditionally enable manage */
 	int manage = 0;
@@ -1188,7 +1218,7 @@ slap_tool_entry_check(
 		slap_schema.si_ad_objectClass );
 
 	if( oc == NULL ) {
-		fprintf( stderr, "%s: dn=\"%s\" (line=%d): %s\n",
+		slap_tool_msg( msg, "%s: dn=\"%s\" (line=%d): %s\n",
 			progname, e->e_dn, lineno,
 			"no objectClass attribute");
 		return LDAP_NO_SUCH_ATTRIBUTE;
@@ -1202,7 +1232,7 @@ slap_tool_entry_check(
 			text, textbuf, textlen );
 
 		if( rc != LDAP_SUCCESS ) {
-			fprintf( stderr, "%s: dn=\"%s\" (line=%d): (%d) %s\n",
+			slap_tool_msg( msg, "%s: dn=\"%s\" (line=%d): (%d) %s\n",
 				progname, e->e_dn, lineno, rc, *text );
 			return rc;
 		}
@@ -1214,7 +1244,7 @@ slap_tool_entry_check(
 
 		int rc = slap_entry2mods( e, &ml, text, textbuf, textlen );
 		if ( rc != LDAP_SUCCESS ) {
-			fprintf( stderr, "%s: dn=\"%s\" (line=%d): (%d) %s\n",
+			slap_tool_msg( msg, "%s: dn=\"%s\" (line=%d): (%d) %s\n",
 				progname, e->e_dn, lineno, rc, *text );
 			return rc;
 		}
@@ -1223,7 +1253,7 @@ slap_tool_entry_check(
 		rc = slap_mods_check( op, ml, text, textbuf, textlen, NULL );
 		slap_mods_free( ml, 1 );
 		if ( rc != LDAP_SUCCESS ) {
-			fprintf( stderr, "%s: dn=\"%s\" (line=%d): (%d) %s\n",
+			slap_tool_msg( msg, "%s: dn=\"%s\" (line=%d): (%d) %s\n",
 				progname, e->e_dn, lineno, rc, *text );
 			return rc;
 		}
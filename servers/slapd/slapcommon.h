@@ -134,6 +134,11 @@ int slap_tool_entry_check LDAP_P((
 	int lineno,
 	const char **text,
 	char *textbuf,
-	size_t textlen ));
+	size_t textlen,
+	struct berval *msg ));
+
+void slap_tool_msg LDAP_P((
+	struct berval *msg,
+	const char *fmt, ... )) LDAP_GCCATTR((format(printf, 2, 3)));
 
 #endif /* SLAPCOMMON_H_ */
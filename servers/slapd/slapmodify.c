@@ -443,7 +443,7 @@ slapmodify( int argc, char **argv )
 				}
 			}
 
-			rc = slap_tool_entry_check( progname, op, e, lineno, &text, textbuf, textlen );
+			rc = slap_tool_entry_check( progname, op, e, lineno, &text, textbuf, textlen, NULL );
 			if ( rc != LDAP_SUCCESS ) {
 				rc = EXIT_FAILURE;
 				goto cleanup;
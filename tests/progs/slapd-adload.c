@@ -0,0 +1,561 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * AD/Samba workload profile: provisions OUs carrying an
+ * nTSecurityDescriptor, bulk-adds users and groups below them, then
+ * issues SD-flags reads, ANR-style lookups and group membership
+ * updates, and reports per-operation latency percentiles.  Meant to be
+ * run against a database stacked with the samba4 overlays.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/unistd.h"
+#include "ac/wait.h"
+#include "ac/time.h"
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "slapd-common.h"
+
+#define OUS		4
+#define USERS		25
+#define GROUPS		5
+
+/* LDAP_SERVER_SD_FLAGS_OID; owner, group and DACL */
+#define SDFLAGS_OID	"1.2.840.113556.1.4.801"
+#define SDFLAGS		0x7
+
+enum {
+	ADL_OU_ADD = 0,
+	ADL_USER_ADD,
+	ADL_GROUP_ADD,
+	ADL_SD_SEARCH,
+	ADL_ANR_SEARCH,
+	ADL_MEMBER_MOD,
+	ADL_DELETE,
+	ADL_LAST
+};
+
+static struct adl_stat {
+	const char	*name;
+	long		*lat;	/* usec */
+	int		nlat;
+	int		maxlat;
+	int		errors;
+} adl_stats[ ADL_LAST ] = {
+	{ "ou-add" },
+	{ "user-add" },
+	{ "group-add" },
+	{ "sd-search" },
+	{ "anr-search" },
+	{ "member-mod" },
+	{ "delete" },
+};
+
+/*
+ * Self-relative security descriptor put on every OU: owner and group
+ * BUILTIN\Administrators, DACL granting Administrators full control and
+ * Authenticated Users read, both container-inherited.
+ */
+static unsigned char adl_sd[] = {
+	/* revision, sbz1, control SE_SELF_RELATIVE|SE_DACL_PRESENT */
+	0x01, 0x00, 0x04, 0x80,
+	/* owner, group, sacl, dacl offsets */
+	0x14, 0x00, 0x00, 0x00,
+	0x24, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00,
+	0x34, 0x00, 0x00, 0x00,
+	/* owner S-1-5-32-544 */
+	0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05,
+	0x20, 0x00, 0x00, 0x00, 0x20, 0x02, 0x00, 0x00,
+	/* group S-1-5-32-544 */
+	0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05,
+	0x20, 0x00, 0x00, 0x00, 0x20, 0x02, 0x00, 0x00,
+	/* ACL revision 2, size 52, 2 ACEs */
+	0x02, 0x00, 0x34, 0x00, 0x02, 0x00, 0x00, 0x00,
+	/* allow, CONTAINER_INHERIT, size 24, mask 0x000f01ff, S-1-5-32-544 */
+	0x00, 0x02, 0x18, 0x00, 0xff, 0x01, 0x0f, 0x00,
+	0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05,
+	0x20, 0x00, 0x00, 0x00, 0x20, 0x02, 0x00, 0x00,
+	/* allow, CONTAINER_INHERIT, size 20, mask 0x00020094, S-1-5-11 */
+	0x00, 0x02, 0x14, 0x00, 0x94, 0x00, 0x02, 0x00,
+	0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05,
+	0x0b, 0x00, 0x00, 0x00
+};
+
+static void
+do_adload( struct tester_conn_args *config, char *base, int pass,
+	int nous, int nusers, int ngroups, int anr, int keep );
+
+static void
+usage( char *name, int opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"-b <base> "
+		"[-A] "
+		"[-g <groups per OU>] "
+		"[-k] "
+		"[-n <OUs>] "
+		"[-u <users per OU>]\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i;
+	char		*base = NULL;
+	int		nous = OUS;
+	int		nusers = USERS;
+	int		ngroups = GROUPS;
+	int		anr = 0;
+	int		keep = 0;
+	struct tester_conn_args	*config;
+
+	config = tester_init( "slapd-adload", TESTER_ADLOAD );
+
+	while ( ( i = getopt( argc, argv, TESTER_COMMON_OPTS "Ab:g:kn:u:" ) ) != EOF )
+	{
+		switch ( i ) {
+		case 'A':		/* let the server expand ANR */
+			anr++;
+			break;
+
+		case 'b':		/* where the OUs are provisioned */
+			base = strdup( optarg );
+			break;
+
+		case 'g':
+			if ( lutil_atoi( &ngroups, optarg ) != 0 || ngroups < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'k':		/* leave the entries in place */
+			keep++;
+			break;
+
+		case 'n':
+			if ( lutil_atoi( &nous, optarg ) != 0 || nous < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'u':
+			if ( lutil_atoi( &nusers, optarg ) != 0 || nusers < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if ( base == NULL )
+		usage( argv[0], 0 );
+
+	tester_config_finish( config );
+
+	for ( i = 0; i < config->outerloops; i++ ) {
+		do_adload( config, base, i, nous, nusers, ngroups, anr, keep );
+	}
+
+	exit( EXIT_SUCCESS );
+}
+
+static long
+adl_now( void )
+{
+#ifdef _WIN32
+	return (long)GetTickCount() * 1000;
+#else
+	struct timeval	tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+#endif
+}
+
+/* records the latency of one operation; returns non-zero if the
+ * result is fatal for the run */
+static int
+adl_record( LDAP *ld, int phase, long beg, int rc, const char *fname )
+{
+	struct adl_stat	*st = &adl_stats[ phase ];
+
+	if ( st->nlat == st->maxlat ) {
+		st->maxlat = st->maxlat ? 2 * st->maxlat : 256;
+		st->lat = realloc( st->lat, st->maxlat * sizeof( long ) );
+		if ( st->lat == NULL ) {
+			tester_error( "realloc failed" );
+			exit( EXIT_FAILURE );
+		}
+	}
+	st->lat[ st->nlat++ ] = adl_now() - beg;
+
+	if ( rc != LDAP_SUCCESS ) {
+		st->errors++;
+		if ( !tester_ignore_err( rc ) ) {
+			tester_ldap_error( ld, fname, NULL );
+		}
+		if ( rc == LDAP_SERVER_DOWN ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int
+adl_cmp( const void *v1, const void *v2 )
+{
+	long	l1 = *(const long *)v1, l2 = *(const long *)v2;
+
+	return l1 < l2 ? -1 : l1 > l2;
+}
+
+static void
+adl_report( void )
+{
+	int	i, j;
+
+	fprintf( stderr, "  PID=%ld - %-10s %7s %6s %8s %8s %8s %8s %8s (usec)\n",
+		(long) pid, "phase", "ops", "errors",
+		"avg", "p50", "p90", "p99", "max" );
+
+	for ( i = 0; i < ADL_LAST; i++ ) {
+		struct adl_stat	*st = &adl_stats[ i ];
+		double		sum = 0;
+
+		if ( st->nlat == 0 ) {
+			continue;
+		}
+
+		qsort( st->lat, st->nlat, sizeof( long ), adl_cmp );
+		for ( j = 0; j < st->nlat; j++ ) {
+			sum += st->lat[ j ];
+		}
+
+#define	PCT(p)	st->lat[ ( st->nlat - 1 ) * (p) / 100 ]
+		fprintf( stderr, "  PID=%ld - %-10s %7d %6d %8.0f %8ld %8ld %8ld %8ld\n",
+			(long) pid, st->name, st->nlat, st->errors,
+			sum / st->nlat, PCT( 50 ), PCT( 90 ), PCT( 99 ),
+			st->lat[ st->nlat - 1 ] );
+#undef PCT
+	}
+}
+
+static int
+adl_add( LDAP *ld, int phase, char *dn, char **oc, char *cn,
+	char *sam, struct berval *sd )
+{
+	LDAPMod		mods[ 6 ], *pmods[ 7 ];
+	char		*cnv[ 2 ] = { cn, NULL };
+	char		*samv[ 2 ] = { sam, NULL };
+	struct berval	*sdv[ 2 ] = { sd, NULL };
+	int		i = 0, rc;
+	long		beg;
+
+	mods[ i ].mod_op = LDAP_MOD_ADD;
+	mods[ i ].mod_type = "objectClass";
+	mods[ i ].mod_values = oc;
+	i++;
+
+	if ( sam != NULL ) {
+		mods[ i ].mod_op = LDAP_MOD_ADD;
+		mods[ i ].mod_type = "cn";
+		mods[ i ].mod_values = cnv;
+		i++;
+
+		mods[ i ].mod_op = LDAP_MOD_ADD;
+		mods[ i ].mod_type = "sAMAccountName";
+		mods[ i ].mod_values = samv;
+		i++;
+
+		if ( phase == ADL_USER_ADD ) {
+			/* the attributes an ANR lookup matches on */
+			mods[ i ].mod_op = LDAP_MOD_ADD;
+			mods[ i ].mod_type = "displayName";
+			mods[ i ].mod_values = samv;
+			i++;
+
+			mods[ i ].mod_op = LDAP_MOD_ADD;
+			mods[ i ].mod_type = "sn";
+			mods[ i ].mod_values = cnv;
+			i++;
+		}
+
+	} else {
+		mods[ i ].mod_op = LDAP_MOD_ADD;
+		mods[ i ].mod_type = "ou";
+		mods[ i ].mod_values = cnv;
+		i++;
+	}
+
+	if ( sd != NULL ) {
+		mods[ i ].mod_op = LDAP_MOD_ADD | LDAP_MOD_BVALUES;
+		mods[ i ].mod_type = "nTSecurityDescriptor";
+		mods[ i ].mod_bvalues = sdv;
+		i++;
+	}
+
+	for ( pmods[ i ] = NULL; i-- > 0; ) {
+		pmods[ i ] = &mods[ i ];
+	}
+
+	beg = adl_now();
+	rc = ldap_add_ext_s( ld, dn, pmods, NULL, NULL );
+	return adl_record( ld, phase, beg, rc, "ldap_add_ext_s" );
+}
+
+static int
+adl_search( LDAP *ld, int phase, char *base, int scope, char *filter,
+	char **attrs, LDAPControl **ctrls )
+{
+	LDAPMessage	*res = NULL;
+	int		rc;
+	long		beg;
+
+	beg = adl_now();
+	rc = ldap_search_ext_s( ld, base, scope, filter, attrs, 0,
+		ctrls, NULL, NULL, LDAP_NO_LIMIT, &res );
+	if ( res != NULL ) {
+		ldap_msgfree( res );
+	}
+	return adl_record( ld, phase, beg, rc, "ldap_search_ext_s" );
+}
+
+static int
+adl_member( LDAP *ld, char *group, char *user, int op )
+{
+	LDAPMod		mod, *pmods[ 2 ];
+	char		*values[ 2 ] = { user, NULL };
+	int		rc;
+	long		beg;
+
+	mod.mod_op = op;
+	mod.mod_type = "member";
+	mod.mod_values = values;
+	pmods[ 0 ] = &mod;
+	pmods[ 1 ] = NULL;
+
+	beg = adl_now();
+	rc = ldap_modify_ext_s( ld, group, pmods, NULL, NULL );
+	return adl_record( ld, ADL_MEMBER_MOD, beg, rc, "ldap_modify_ext_s" );
+}
+
+static int
+adl_delete( LDAP *ld, char *dn )
+{
+	int		rc;
+	long		beg;
+
+	beg = adl_now();
+	rc = ldap_delete_ext_s( ld, dn, NULL, NULL );
+	return adl_record( ld, ADL_DELETE, beg, rc, "ldap_delete_ext_s" );
+}
+
+#define	RANDOM(n)	((int)(((double)(n))*rand()/(RAND_MAX + 1.0)))
+
+static void
+do_adload( struct tester_conn_args *config, char *base, int pass,
+	int nous, int nusers, int ngroups, int anr, int keep )
+{
+	LDAP		*ld = NULL;
+	char		**ous, **users, **groups;
+	char		cn[ BUFSIZ ], sam[ BUFSIZ ], dn[ BUFSIZ ];
+	char		filter[ BUFSIZ ];
+	char		*oc_ou[] = { "top", "organizationalUnit", NULL };
+	char		*oc_user[] = { "top", "person", "organizationalPerson",
+				"user", NULL };
+	char		*oc_group[] = { "top", "group", NULL };
+	char		*sd_attrs[] = { "nTSecurityDescriptor", NULL };
+	char		*anr_attrs[] = { "cn", "sAMAccountName", NULL };
+	struct berval	sd, ctrlval = { 0, NULL };
+	LDAPControl	sdctrl, *ctrls[ 2 ];
+	BerElement	*ber;
+	int		i, j, o, nu = 0, ng = 0;
+	long		beg, end;
+
+	sd.bv_val = (char *)adl_sd;
+	sd.bv_len = sizeof( adl_sd );
+
+	ber = ber_alloc_t( LBER_USE_DER );
+	if ( ber == NULL || ber_printf( ber, "{i}", (ber_int_t) SDFLAGS ) == -1 ||
+		ber_flatten2( ber, &ctrlval, 0 ) == -1 )
+	{
+		tester_error( "unable to encode the SD flags control" );
+		exit( EXIT_FAILURE );
+	}
+	sdctrl.ldctl_oid = SDFLAGS_OID;
+	sdctrl.ldctl_value = ctrlval;
+	sdctrl.ldctl_iscritical = 0;
+	ctrls[ 0 ] = &sdctrl;
+	ctrls[ 1 ] = NULL;
+
+	ous = calloc( nous, sizeof( char * ) );
+	users = calloc( nous * nusers, sizeof( char * ) );
+	groups = calloc( nous * ngroups, sizeof( char * ) );
+	if ( ous == NULL || users == NULL || groups == NULL ) {
+		tester_error( "calloc failed" );
+		exit( EXIT_FAILURE );
+	}
+
+	tester_init_ld( &ld, config, 0 );
+
+	fprintf( stderr, "PID=%ld - ADload(%d): base=\"%s\" ous=%d users=%d groups=%d.\n",
+		(long) pid, config->loops, base, nous, nusers, ngroups );
+
+	beg = adl_now();
+
+	/* provisioning: the OUs carry the descriptor, users and groups
+	 * below them get theirs computed by the overlays */
+	for ( o = 0; o < nous; o++ ) {
+		snprintf( cn, sizeof( cn ), "adload%ld-%d-%d", (long) pid, pass, o );
+		snprintf( dn, sizeof( dn ), "ou=%s,%s", cn, base );
+		if ( adl_add( ld, ADL_OU_ADD, dn, oc_ou, cn, NULL, &sd ) ) {
+			goto done;
+		}
+		ous[ o ] = strdup( dn );
+
+		for ( i = 0; i < nusers; i++ ) {
+			snprintf( cn, sizeof( cn ), "u%ld-%d-%d-%d", (long) pid, pass, o, i );
+			snprintf( sam, sizeof( sam ), "al%lx%xu%x", (long) pid, pass, o * nusers + i );
+			snprintf( dn, sizeof( dn ), "cn=%s,%s", cn, ous[ o ] );
+			if ( adl_add( ld, ADL_USER_ADD, dn, oc_user, cn, sam, NULL ) ) {
+				goto done;
+			}
+			users[ nu++ ] = strdup( dn );
+		}
+
+		for ( i = 0; i < ngroups; i++ ) {
+			snprintf( cn, sizeof( cn ), "g%ld-%d-%d-%d", (long) pid, pass, o, i );
+			snprintf( sam, sizeof( sam ), "al%lx%xg%x", (long) pid, pass, o * ngroups + i );
+			snprintf( dn, sizeof( dn ), "cn=%s,%s", cn, ous[ o ] );
+			if ( adl_add( ld, ADL_GROUP_ADD, dn, oc_group, cn, sam, NULL ) ) {
+				goto done;
+			}
+			groups[ ng++ ] = strdup( dn );
+		}
+	}
+
+	/* reads of the descriptor, as samba does with the SD flags control */
+	for ( i = 0; i < config->loops; i++ ) {
+		if ( adl_search( ld, ADL_SD_SEARCH, users[ RANDOM( nu ) ],
+			LDAP_SCOPE_BASE, "(objectClass=*)", sd_attrs, ctrls ) )
+		{
+			goto done;
+		}
+	}
+
+	/* ANR lookups on a sAMAccountName prefix; unless -A, send them
+	 * expanded, as samba's ldb does before they reach slapd */
+	for ( i = 0; i < config->loops; i++ ) {
+		j = RANDOM( nu );
+		snprintf( sam, sizeof( sam ), "al%lx%xu%x", (long) pid, pass, j );
+		if ( anr ) {
+			snprintf( filter, sizeof( filter ), "(anr=%s)", sam );
+		} else {
+			snprintf( filter, sizeof( filter ),
+				"(|(displayName=%s*)(givenName=%s*)(sn=%s*)"
+				"(sAMAccountName=%s*)(name=%s*))",
+				sam, sam, sam, sam, sam );
+		}
+		if ( adl_search( ld, ADL_ANR_SEARCH, base, LDAP_SCOPE_SUBTREE,
+			filter, anr_attrs, NULL ) )
+		{
+			goto done;
+		}
+	}
+
+	/* membership churn */
+	for ( i = 0; i < config->loops; i++ ) {
+		char	*group = groups[ RANDOM( ng ) ];
+		char	*user = users[ RANDOM( nu ) ];
+
+		if ( adl_member( ld, group, user, LDAP_MOD_ADD ) ||
+			adl_member( ld, group, user, LDAP_MOD_DELETE ) )
+		{
+			goto done;
+		}
+	}
+
+	if ( !keep ) {
+		for ( i = nu; i-- > 0; ) {
+			if ( adl_delete( ld, users[ i ] ) ) {
+				goto done;
+			}
+		}
+		for ( i = ng; i-- > 0; ) {
+			if ( adl_delete( ld, groups[ i ] ) ) {
+				goto done;
+			}
+		}
+		for ( o = nous; o-- > 0; ) {
+			if ( ous[ o ] != NULL && adl_delete( ld, ous[ o ] ) ) {
+				goto done;
+			}
+		}
+	}
+
+done:;
+	end = adl_now() - beg;
+	fprintf( stderr, "  PID=%ld - ADload done in %ld.%06ld seconds.\n",
+		(long) pid, end / 1000000, end % 1000000 );
+	adl_report();
+
+	for ( i = 0; i < ADL_LAST; i++ ) {
+		free( adl_stats[ i ].lat );
+		adl_stats[ i ].lat = NULL;
+		adl_stats[ i ].nlat = adl_stats[ i ].maxlat = 0;
+		adl_stats[ i ].errors = 0;
+	}
+	for ( o = 0; o < nous; o++ ) {
+		free( ous[ o ] );
+	}
+	for ( i = 0; i < nu; i++ ) {
+		free( users[ i ] );
+	}
+	for ( i = 0; i < ng; i++ ) {
+		free( groups[ i ] );
+	}
+	free( ous );
+	free( users );
+	free( groups );
+	ber_free( ber, 1 );
+
+	ldap_unbind_ext( ld, NULL, NULL );
+}
@@ -23,6 +23,7 @@
 typedef enum {
 	TESTER_TESTER,
 	TESTER_ADDEL,
+	TESTER_ADLOAD,
 	TESTER_BIND,
 	TESTER_MODIFY,
 	TESTER_MODRDN,
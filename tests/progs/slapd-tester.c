@@ -52,6 +52,7 @@
 #define MODRDNCMD		"slapd-modrdn" EXE
 #define MODIFYCMD		"slapd-modify" EXE
 #define BINDCMD			"slapd-bind" EXE
+#define ADLOADCMD		"slapd-adload" EXE
 #define MAXARGS      		100
 #define MAXREQS			5000
 #define LOOPS			100
@@ -64,6 +65,7 @@
 #define TMODRDNFILE		"do_modrdn.0"
 #define TMODIFYFILE		"do_modify.0"
 #define TBINDFILE		"do_bind.0"
+#define TADLOADFILE		"do_adload.0"
 
 static char *get_file_name( char *dirname, char *filename );
 static int  get_search_filters( char *filename, char *filters[], char *attrs[], char *bases[], LDAPURLDesc *luds[] );
@@ -194,6 +196,14 @@ main( int argc, char **argv )
 	char		bcmd[MAXPATHLEN];
 	static char	bloops[LDAP_PVT_INTTYPE_CHARS(unsigned long)];
 	char		**bargs_extra = NULL;
+	/* adload */
+	char		*dfile = NULL;
+	char		*dreqs[MAXREQS];
+	int		dnum = 0;
+	char		*dargs[MAXARGS];
+	int		danum;
+	char		dcmd[MAXPATHLEN];
+	static char	dloops[LDAP_PVT_INTTYPE_CHARS(unsigned long)];
 
 	char		*friendlyOpt = NULL;
 	int		pw_ask = 0;
@@ -216,6 +226,7 @@ main( int argc, char **argv )
 	nloops[0] = '\0';
 	mloops[0] = '\0';
 	bloops[0] = '\0';
+	dloops[0] = '\0';
 
 	while ( ( i = getopt( argc, argv, "AB:CD:d:FH:h:Ii:j:L:l:NP:p:r:St:Ww:y:" ) ) != EOF )
 	{
@@ -291,6 +302,7 @@ main( int argc, char **argv )
 						char		*buf;
 					} types[] = {
 						{ BER_BVC( "add=" ),	aloops },
+						{ BER_BVC( "adload=" ),	dloops },
 						{ BER_BVC( "bind=" ),	bloops },
 						{ BER_BVC( "modify=" ),	mloops },
 						{ BER_BVC( "modrdn=" ),	nloops },
@@ -409,6 +421,9 @@ main( int argc, char **argv )
 		} else if ( !strcasecmp( file->d_name, TBINDFILE )) {
 			bfile = get_file_name( dirname, file->d_name );
 			continue;
+		} else if ( !strcasecmp( file->d_name, TADLOADFILE )) {
+			dfile = get_file_name( dirname, file->d_name );
+			continue;
 		}
 	}
 
@@ -427,7 +442,7 @@ main( int argc, char **argv )
 		passwd = pw.bv_val;
 	}
 
-	if ( !sfile && !rfile && !nfile && !mfile && !bfile && !anum ) {
+	if ( !sfile && !rfile && !nfile && !mfile && !bfile && !dfile && !anum ) {
 		fprintf( stderr, "no data files found.\n" );
 		exit( EXIT_FAILURE );
 	}
@@ -487,6 +502,17 @@ main( int argc, char **argv )
 		}
 	}
 
+	/* look for AD workload bases */
+	if ( dfile ) {
+		dnum = get_read_entries( dfile, dreqs, NULL );
+		if ( dnum < 0 ) {
+			fprintf( stderr,
+				"unable to parse file \"%s\" line %d\n",
+				dfile, -2*(dnum + 1) );
+			exit( EXIT_FAILURE );
+		}
+	}
+
 	/* setup friendly option */
 	switch ( friendly ) {
 	case 0:
@@ -518,6 +544,7 @@ main( int argc, char **argv )
 	if ( nloops[0] == '\0' ) snprintf( nloops, sizeof( nloops ), "%d", loops );
 	if ( mloops[0] == '\0' ) snprintf( mloops, sizeof( mloops ), "%d", loops );
 	if ( bloops[0] == '\0' ) snprintf( bloops, sizeof( bloops ), "%d", 20 * loops );
+	if ( dloops[0] == '\0' ) snprintf( dloops, sizeof( dloops ), "%d", loops );
 
 	/*
 	 * generate the search clients
@@ -813,6 +840,46 @@ main( int argc, char **argv )
 	bargs[banum++] = NULL;
 	bargs[banum] = NULL;
 
+	/*
+	 * generate the AD workload clients
+	 */
+
+	danum = 0;
+	snprintf( dcmd, sizeof dcmd, "%s" LDAP_DIRSEP ADLOADCMD,
+		progdir );
+	dargs[danum++] = dcmd;
+	if ( uri ) {
+		dargs[danum++] = "-H";
+		dargs[danum++] = uri;
+	} else {
+		dargs[danum++] = "-h";
+		dargs[danum++] = host;
+		dargs[danum++] = "-p";
+		dargs[danum++] = port;
+	}
+	dargs[danum++] = "-D";
+	dargs[danum++] = manager;
+	dargs[danum++] = "-w";
+	dargs[danum++] = passwd;
+	dargs[danum++] = "-l";
+	dargs[danum++] = dloops;
+	dargs[danum++] = "-L";
+	dargs[danum++] = outerloops;
+	dargs[danum++] = "-r";
+	dargs[danum++] = retries;
+	dargs[danum++] = "-t";
+	dargs[danum++] = delay;
+	if ( chaserefs ) {
+		dargs[danum++] = "-C";
+	}
+	if ( ignore ) {
+		dargs[danum++] = "-i";
+		dargs[danum++] = ignore;
+	}
+	dargs[danum++] = "-b";
+	dargs[danum++] = NULL;		/* will hold the provisioning base */
+	dargs[danum] = NULL;
+
 #define	DOREQ(n,j) ((n) && ((maxkids > (n)) ? ((j) < maxkids ) : ((j) < (n))))
 
 	for ( j = 0; j < MAXREQS; j++ ) {
@@ -903,6 +970,12 @@ main( int argc, char **argv )
 			fork_child( acmd, aargs );
 		}
 
+		/* AD workload */
+		if ( j < dnum ) {
+			dargs[danum - 1] = dreqs[j];
+			fork_child( dcmd, dargs );
+		}
+
 		/* bind */
 		if ( DOREQ( bnum, j ) ) {
 			int	jj = j % bnum;